@@ -14,7 +14,10 @@
  * limitations under the License.
  */
 
+#define ATRACE_TAG ATRACE_TAG_DALVIK
+
 #include <android-base/logging.h>
+#include <cutils/trace.h>
 #include <stdbool.h>
 
 #include <map>
@@ -55,19 +58,26 @@ palette_status_t PaletteWriteCrashThreadStacks(/*in*/ const char* stacks, size_t
   return PALETTE_STATUS_OK;
 }
 
+// Tracing goes through libcutils, which on the host records to the file named
+// by ATRACE_HOST_OUTPUT and otherwise costs a single test of the enabled tags.
+
 palette_status_t PaletteTraceEnabled(/*out*/bool* enabled) {
-  *enabled = false;
+  *enabled = ATRACE_ENABLED() != 0;
   return PALETTE_STATUS_OK;
 }
 
-palette_status_t PaletteTraceBegin([[maybe_unused]] const char* name) { return PALETTE_STATUS_OK; }
+palette_status_t PaletteTraceBegin(const char* name) {
+  ATRACE_BEGIN(name);
+  return PALETTE_STATUS_OK;
+}
 
 palette_status_t PaletteTraceEnd() {
+  ATRACE_END();
   return PALETTE_STATUS_OK;
 }
 
-palette_status_t PaletteTraceIntegerValue([[maybe_unused]] const char* name,
-                                          [[maybe_unused]] int32_t value) {
+palette_status_t PaletteTraceIntegerValue(const char* name, int32_t value) {
+  ATRACE_INT(name, value);
   return PALETTE_STATUS_OK;
 }
 
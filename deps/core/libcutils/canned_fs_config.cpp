@@ -18,7 +18,7 @@
 #include <private/canned_fs_config.h>
 #include <private/fs_config.h>
 
-#include <android-base/strings.h>
+#include <android-base/file.h>
 
 #include <errno.h>
 #include <inttypes.h>
@@ -28,59 +28,82 @@
 #include <string.h>
 
 #include <algorithm>
-#include <fstream>
+#include <deque>
 #include <iostream>
 #include <string>
-#include <vector>
-
-using android::base::ConsumePrefix;
-using android::base::StartsWith;
-using android::base::Tokenize;
+#include <string_view>
+#include <unordered_map>
 
 struct Entry {
-    std::string path;
     unsigned uid;
     unsigned gid;
     unsigned mode;
     uint64_t capabilities;
 };
 
-static std::vector<Entry> canned_data;
+// The contents of every loaded file. The paths in canned_data point into these, so the
+// strings must never move; std::deque doesn't move its elements on emplace_back().
+static std::deque<std::string> canned_files;
+static std::unordered_map<std::string_view, Entry> canned_data;
+// Every entry loaded from every file, counting those that were later overridden.
+static size_t canned_entries_loaded;
+
+// Returns the next space-separated token of |line| starting at |*pos|, skipping runs of spaces
+// like android::base::Tokenize(line, " ") would, or an empty view at the end of the line.
+static std::string_view next_token(std::string_view line, size_t* pos) {
+    size_t start = line.find_first_not_of(' ', *pos);
+    if (start == std::string_view::npos) {
+        *pos = line.size();
+        return {};
+    }
+    size_t end = std::min(line.find(' ', start), line.size());
+    *pos = end;
+    return line.substr(start, end - start);
+}
 
 int load_canned_fs_config(const char* fn) {
-    std::ifstream input(fn);
-    for (std::string line; std::getline(input, line);) {
+    // Like the std::ifstream this replaced, an unreadable file loads no entries.
+    std::string& contents = canned_files.emplace_back();
+    android::base::ReadFileToString(fn, &contents);
+
+    // The numeric fields are parsed in place with atoi()/strtol(). They stop at the space or
+    // newline that ends the token, or at the terminating NUL of |contents|.
+    std::string_view data(contents);
+    while (!data.empty()) {
+        size_t eol = std::min(data.find('\n'), data.size());
+        std::string_view line = data.substr(0, eol);
+        data.remove_prefix(std::min(eol + 1, data.size()));
+
         // Historical: the root dir can be represented as a space character.
         // e.g. " 1000 1000 0755" is parsed as
         // path = " ", uid = 1000, gid = 1000, mode = 0755.
         // But at the same time, we also have accepted
         // "/ 1000 1000 0755".
-        if (StartsWith(line, " ")) {
-            line.insert(line.begin(), '/');
-        }
-
-        std::vector<std::string> tokens = Tokenize(line, " ");
-        if (tokens.size() < 4) {
+        size_t pos = 0;
+        std::string_view path = line.starts_with(' ') ? "/" : next_token(line, &pos);
+        std::string_view uid = next_token(line, &pos);
+        std::string_view gid = next_token(line, &pos);
+        std::string_view mode = next_token(line, &pos);
+        if (mode.empty()) {
             std::cerr << "Ill-formed line: " << line << " in " << fn << std::endl;
             return -1;
         }
 
         // Historical: remove the leading '/' if exists.
-        std::string path(tokens[0].front() == '/' ? std::string(tokens[0], 1) : tokens[0]);
+        if (path.front() == '/') path.remove_prefix(1);
 
         Entry e{
-                .path = std::move(path),
-                .uid = static_cast<unsigned int>(atoi(tokens[1].c_str())),
-                .gid = static_cast<unsigned int>(atoi(tokens[2].c_str())),
+                .uid = static_cast<unsigned int>(atoi(uid.data())),
+                .gid = static_cast<unsigned int>(atoi(gid.data())),
                 // mode is in octal
-                .mode = static_cast<unsigned int>(strtol(tokens[3].c_str(), nullptr, 8)),
+                .mode = static_cast<unsigned int>(strtol(mode.data(), nullptr, 8)),
                 .capabilities = 0,
         };
 
-        for (size_t i = 4; i < tokens.size(); i++) {
-            std::string_view sv = tokens[i];
-            if (ConsumePrefix(&sv, "capabilities=")) {
-                e.capabilities = strtoll(std::string(sv).c_str(), nullptr, 0);
+        for (std::string_view sv = next_token(line, &pos); !sv.empty();
+             sv = next_token(line, &pos)) {
+            if (sv.starts_with("capabilities=")) {
+                e.capabilities = strtoll(sv.data() + strlen("capabilities="), nullptr, 0);
                 break;
             }
             // Historical: there can be tokens like "selabel=..." here. They have been ignored.
@@ -89,20 +112,14 @@ int load_canned_fs_config(const char* fn) {
             std::cerr << "info: ignored token \"" << sv << "\" in " << fn << std::endl;
         }
 
-        canned_data.emplace_back(std::move(e));
+        // There can be multiple entries for the same path. Then the one that comes the last
+        // wins. This is to allow overriding platform provided fs_config with a user provided
+        // fs_config by appending the latter to the former.
+        canned_data.insert_or_assign(path, e);
+        ++canned_entries_loaded;
     }
 
-    // Note: we used to sort the entries by path names. This was to improve the lookup performance
-    // by doing binary search. However, this is no longer the case. The lookup performance is not
-    // critical because this tool runs on the host, not on the device. Now, there can be multiple
-    // entries for the same path. Then the one that comes the last wins. This is to allow overriding
-    // platform provided fs_config with a user provided fs_config by appending the latter to the
-    // former.
-    //
-    // To implement the strategy, reverse the entries order, and search from the top.
-    std::reverse(canned_data.begin(), canned_data.end());
-
-    std::cout << "loaded " << canned_data.size() << " fs_config entries" << std::endl;
+    std::cout << "loaded " << canned_entries_loaded << " fs_config entries" << std::endl;
     return 0;
 }
 
@@ -111,23 +128,14 @@ void canned_fs_config(const char* path, [[maybe_unused]] int dir,
                       unsigned* mode, uint64_t* capabilities) {
     if (path != nullptr && path[0] == '/') path++;  // canned paths lack the leading '/'
 
-    const Entry* found = nullptr;
-    // canned_data is already reversed. First match wins.
-    for (const auto& entry : canned_data) {
-        if (path == entry.path) {
-            found = &entry;
-            break;
-        }
-        continue;
-    }
-
-    if (found == nullptr) {
+    auto found = canned_data.find(path);
+    if (found == canned_data.end()) {
         std::cerr << "failed to find " << path << " in canned fs_config" << std::endl;
         exit(1);
     }
 
-    *uid = found->uid;
-    *gid = found->gid;
-    *mode = found->mode;
-    *capabilities = found->capabilities;
+    *uid = found->second.uid;
+    *gid = found->second.gid;
+    *mode = found->second.mode;
+    *capabilities = found->second.capabilities;
 }
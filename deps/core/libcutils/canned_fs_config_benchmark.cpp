@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+#include <private/canned_fs_config.h>
+
+using android::base::StringPrintf;
+
+static constexpr size_t kEntries = 500000;
+
+// A canned fs_config the size of a large system image, whose last 1% re-specifies earlier paths
+// the way an appended user fs_config overrides the platform one.
+static const std::vector<std::string>& Paths() {
+    static std::vector<std::string> paths = [] {
+        std::vector<std::string> result;
+        for (size_t i = 0; i < kEntries; ++i) {
+            result.push_back(StringPrintf("system/app/App%zu/lib/arm64/lib%zu.so", i / 64, i));
+        }
+        return result;
+    }();
+    return paths;
+}
+
+static const char* CannedFsConfig() {
+    static TemporaryFile tf;
+    static bool written = [] {
+        std::string data = " 0 0 0755\n";
+        for (auto& path : Paths()) {
+            data += StringPrintf("%s 0 0 0644\n", path.c_str());
+        }
+        for (size_t i = 0; i < kEntries / 100; ++i) {
+            data += StringPrintf("%s 1000 1000 0600 capabilities=0x1000\n", Paths()[i * 97].c_str());
+        }
+        return android::base::WriteStringToFile(data, tf.path);
+    }();
+    CHECK(written);
+    return tf.path;
+}
+
+static void BM_load_canned_fs_config(benchmark::State& state) {
+    const char* fn = CannedFsConfig();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(load_canned_fs_config(fn));
+    }
+    state.SetItemsProcessed(state.iterations() * (kEntries + kEntries / 100 + 1));
+}
+BENCHMARK(BM_load_canned_fs_config)->Iterations(3)->Unit(benchmark::kMillisecond);
+
+static void BM_canned_fs_config(benchmark::State& state) {
+    CHECK_EQ(0, load_canned_fs_config(CannedFsConfig()));
+    size_t i = 0;
+    for (auto _ : state) {
+        unsigned uid, gid, mode;
+        uint64_t capabilities;
+        canned_fs_config(Paths()[i].c_str(), 0, nullptr, &uid, &gid, &mode, &capabilities);
+        benchmark::DoNotOptimize(mode);
+        i = (i + 7919) % kEntries;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_canned_fs_config);
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <private/canned_fs_config.h>
+
+#include <stdio.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+static void LoadCannedFsConfig(const std::string& data, std::string* output) {
+    TemporaryFile tf;
+    ASSERT_TRUE(android::base::WriteStringToFile(data, tf.path));
+    testing::internal::CaptureStdout();
+    ASSERT_EQ(0, load_canned_fs_config(tf.path));
+    *output = testing::internal::GetCapturedStdout();
+}
+
+TEST(canned_fs_config, last_entry_wins) {
+    std::string first_output, second_output;
+    // The same path given twice in one file, and again in a later file, as when a user fs_config
+    // is appended to the platform one.
+    LoadCannedFsConfig("system/bin/canned_a 0 0 0755\n"
+                       "/system/bin/canned_b 0 2000 0750\n"
+                       "system/bin/canned_a 1000 1000 0700 capabilities=0x1000\n",
+                       &first_output);
+    LoadCannedFsConfig("system/bin/canned_b 1000 2000 0755 capabilities=0x20\n", &second_output);
+
+    unsigned uid, gid, mode;
+    uint64_t capabilities;
+    canned_fs_config("system/bin/canned_a", 0, nullptr, &uid, &gid, &mode, &capabilities);
+    EXPECT_EQ(1000U, uid);
+    EXPECT_EQ(1000U, gid);
+    EXPECT_EQ(0700U, mode);
+    EXPECT_EQ(0x1000U, capabilities);
+
+    canned_fs_config("/system/bin/canned_b", 0, nullptr, &uid, &gid, &mode, &capabilities);
+    EXPECT_EQ(1000U, uid);
+    EXPECT_EQ(2000U, gid);
+    EXPECT_EQ(0755U, mode);
+    EXPECT_EQ(0x20U, capabilities);
+
+    // The count covers every file loaded so far, overridden entries included.
+    size_t first_count, second_count;
+    ASSERT_EQ(1, sscanf(first_output.c_str(), "loaded %zu fs_config entries", &first_count));
+    ASSERT_EQ(1, sscanf(second_output.c_str(), "loaded %zu fs_config entries", &second_count));
+    EXPECT_EQ(first_count + 1, second_count);
+}
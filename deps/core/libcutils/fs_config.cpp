@@ -29,10 +29,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include <android-base/strings.h>
 #include <cutils/fs.h>
@@ -271,7 +276,7 @@ static int fs_config_open(int dir, int which, const char* target_out_path) {
 
 // if path is "odm/<stuff>", "oem/<stuff>", "product/<stuff>",
 // "system_ext/<stuff>" or "vendor/<stuff>"
-static bool is_partition(const std::string& path) {
+static bool is_partition(std::string_view path) {
     static const char* partitions[] = {"odm/", "oem/", "product/", "system_ext/", "vendor/"};
     for (size_t i = 0; i < (sizeof(partitions) / sizeof(partitions[0])); ++i) {
         if (StartsWith(path, partitions[i])) return true;
@@ -391,6 +396,257 @@ bool get_fs_config(const char* path, bool dir, const char* target_out_path,
     return false;
 }
 
+// Compiled form of every rule get_fs_config() consults for one target_out_path.
+//
+// Each pattern is massaged once the way fs_config_cmp() would, then split into its literal
+// head (everything before the first glob metacharacter) and its glob tail.  The literal heads
+// are kept in a prefix trie, so a lookup walks the characters of the path once to find the
+// only rules that can possibly match, and only those pay for glob matching.  Every rule keeps
+// its position in the "first match" order and the lowest matching position wins.
+namespace {
+
+constexpr uint32_t kNoMatch = UINT32_MAX;
+
+struct CompiledRule {
+    std::string pattern;
+    size_t literal_len;
+    bool use_fnmatch;  // has a bracket expression, which glob_match() does not handle
+    struct fs_config conf;
+};
+
+struct TrieNode {
+    std::vector<std::pair<char, uint32_t>> children;
+    // Rules whose literal head ends at this node, in ascending (first match) order.
+    std::vector<uint32_t> rules;
+};
+
+class RuleSet {
+  public:
+    RuleSet() : nodes_(1) {}
+
+    void Add(bool dir, const char* prefix, size_t len, const struct fs_config& conf);
+    // |input| must already be massaged as in fs_config_cmp().
+    bool Lookup(const std::string& input, struct fs_config* conf) const;
+
+  private:
+    uint32_t Walk(const char* input, size_t len, uint32_t best) const;
+
+    std::vector<CompiledRule> rules_;
+    std::vector<TrieNode> nodes_;
+};
+
+}  // namespace
+
+// Equivalent to fnmatch(pattern, input, FNM_NOESCAPE) == 0 for patterns made only of
+// literals, '*' and '?'.  Without FNM_PATHNAME a '*' also matches '/'.
+static bool glob_match(const char* p, const char* pend, const char* s, const char* send) {
+    const char* star = nullptr;
+    const char* resume = nullptr;
+    while (s < send) {
+        if (p < pend && *p == '*') {
+            star = ++p;
+            resume = s;
+        } else if (p < pend && (*p == '?' || *p == *s)) {
+            ++p;
+            ++s;
+        } else if (star) {
+            p = star;
+            s = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (p < pend && *p == '*') ++p;
+    return p == pend;
+}
+
+// Returns the "<partition>/<stuff>" tail of a "system/<partition>/<stuff>" or
+// "vendor/odm/<stuff>" input, which fs_config_cmp() also tries to match, or nullptr.
+static const char* logical_partition_alias(const std::string& input) {
+    static constexpr const char* kLogicalPartitions[] = {"system/product/", "system/system_ext/",
+                                                         "system/vendor/", "vendor/odm/"};
+    for (auto& logical_partition : kLogicalPartitions) {
+        if (StartsWith(input, logical_partition)) {
+            const char* input_in_partition = input.c_str() + input.find('/') + 1;
+            if (is_partition(input_in_partition)) return input_in_partition;
+        }
+    }
+    return nullptr;
+}
+
+void RuleSet::Add(bool dir, const char* prefix, size_t len, const struct fs_config& conf) {
+    std::string pattern(prefix, len);
+    if (dir && !EndsWith(pattern, "/*")) {
+        pattern.append(EndsWith(pattern, "/") ? "*" : "/*");
+    }
+    size_t literal_len = std::min(pattern.find_first_of("*?["), pattern.size());
+    bool use_fnmatch = pattern.find('[', literal_len) != std::string::npos;
+
+    uint32_t node = 0;
+    for (size_t i = 0; i < literal_len; ++i) {
+        uint32_t next = kNoMatch;
+        for (auto& [c, child] : nodes_[node].children) {
+            if (c == pattern[i]) {
+                next = child;
+                break;
+            }
+        }
+        if (next == kNoMatch) {
+            next = nodes_.size();
+            nodes_[node].children.emplace_back(pattern[i], next);
+            nodes_.emplace_back();
+        }
+        node = next;
+    }
+    nodes_[node].rules.push_back(rules_.size());
+    rules_.push_back({std::move(pattern), literal_len, use_fnmatch, conf});
+}
+
+uint32_t RuleSet::Walk(const char* input, size_t len, uint32_t best) const {
+    uint32_t node = 0;
+    for (size_t depth = 0;; ++depth) {
+        for (uint32_t ordinal : nodes_[node].rules) {
+            if (ordinal >= best) break;
+            const CompiledRule& rule = rules_[ordinal];
+            bool match = rule.use_fnmatch
+                                 ? fnmatch(rule.pattern.c_str(), input, FNM_NOESCAPE) == 0
+                                 : glob_match(rule.pattern.data() + rule.literal_len,
+                                              rule.pattern.data() + rule.pattern.size(),
+                                              input + rule.literal_len, input + len);
+            if (match) {
+                best = ordinal;
+                break;
+            }
+        }
+        if (depth == len) break;
+
+        uint32_t next = kNoMatch;
+        for (auto& [c, child] : nodes_[node].children) {
+            if (c == input[depth]) {
+                next = child;
+                break;
+            }
+        }
+        if (next == kNoMatch) break;
+        node = next;
+    }
+    return best;
+}
+
+bool RuleSet::Lookup(const std::string& input, struct fs_config* conf) const {
+    uint32_t best = Walk(input.c_str(), input.size(), kNoMatch);
+    if (const char* alias = logical_partition_alias(input); alias) {
+        best = Walk(alias, input.size() - (alias - input.c_str()), best);
+    }
+    if (best == kNoMatch) return false;
+    *conf = rules_[best].conf;
+    return true;
+}
+
+struct fs_config_rules {
+    RuleSet rules[2];  // indexed by dir
+};
+
+// Appends every well-formed entry of one fs_config_(dirs|files) override file, stopping at the
+// first corrupted one just like get_fs_config() does.
+static void fs_config_rules_load_file(RuleSet* rules, int dir, int which, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size <= 0) return;
+    size_t size = st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        ALOGE("%s mmap failed: %s", conf[which][dir], strerror(errno));
+        return;
+    }
+
+    const char* data = static_cast<const char*>(map);
+    size_t offset = 0;
+    while (size - offset >= sizeof(fs_path_config_from_file)) {
+        struct fs_path_config_from_file header;
+        memcpy(&header, data + offset, sizeof(header));
+        ssize_t remainder = header.len - sizeof(header);
+        if (remainder <= 0) {
+            ALOGE("%s len is corrupted", conf[which][dir]);
+            break;
+        }
+        offset += sizeof(header);
+        if (size - offset < static_cast<size_t>(remainder)) {
+            ALOGE("%s prefix is truncated", conf[which][dir]);
+            break;
+        }
+        const char* prefix = data + offset;
+        size_t len = strnlen(prefix, remainder);
+        if (len >= static_cast<size_t>(remainder)) {  // missing a terminating null
+            ALOGE("%s is corrupted", conf[which][dir]);
+            break;
+        }
+        rules->Add(dir, prefix, len,
+                   {.uid = header.uid,
+                    .gid = header.gid,
+                    .mode = header.mode,
+                    .capabilities = header.capabilities});
+        offset += remainder;
+    }
+    munmap(map, size);
+}
+
+struct fs_config_rules* fs_config_rules_load(const char* target_out_path) {
+    auto result = new fs_config_rules;
+    for (int dir = 0; dir < 2; ++dir) {
+        RuleSet* rules = &result->rules[dir];
+        for (size_t which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
+            int fd = fs_config_open(dir, which, target_out_path);
+            if (fd < 0) continue;
+            fs_config_rules_load_file(rules, dir, which, fd);
+            close(fd);
+        }
+        for (const fs_path_config* pc = dir ? android_dirs : android_files; pc->prefix; pc++) {
+            rules->Add(dir, pc->prefix, strlen(pc->prefix),
+                       {.uid = pc->uid,
+                        .gid = pc->gid,
+                        .mode = pc->mode,
+                        .capabilities = pc->capabilities});
+        }
+    }
+    return result;
+}
+
+void fs_config_rules_free(struct fs_config_rules* rules) {
+    delete rules;
+}
+
+// |scratch| is reused across calls so that batches don't allocate per path.
+static bool fs_config_rules_lookup_one(const struct fs_config_rules* rules, const char* path,
+                                       bool dir, std::string* scratch, struct fs_config* conf) {
+    if (path[0] == '/') {
+        path++;
+    }
+    scratch->assign(path);
+    if (dir && !EndsWith(*scratch, "/")) {
+        scratch->push_back('/');
+    }
+    return rules->rules[dir].Lookup(*scratch, conf);
+}
+
+bool fs_config_rules_lookup(const struct fs_config_rules* rules, const char* path, bool dir,
+                            struct fs_config* conf) {
+    std::string scratch;
+    return fs_config_rules_lookup_one(rules, path, dir, &scratch, conf);
+}
+
+size_t fs_config_rules_lookup_batch(const struct fs_config_rules* rules,
+                                    struct fs_config_query* queries, size_t count) {
+    std::string scratch;
+    size_t found = 0;
+    for (size_t i = 0; i < count; ++i) {
+        struct fs_config_query* query = &queries[i];
+        query->found =
+                fs_config_rules_lookup_one(rules, query->path, query->dir, &scratch, &query->conf);
+        if (query->found) ++found;
+    }
+    return found;
+}
+
 void fs_config(const char* path, int dir, const char* target_out_path, unsigned* uid, unsigned* gid,
                unsigned* mode, uint64_t* capabilities) {
     struct fs_config conf;
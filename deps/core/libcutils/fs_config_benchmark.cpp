@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+#include <private/fs_config.h>
+
+#include "fs_config.h"
+
+using android::base::StringPrintf;
+
+// A product out directory with |state.range(0)| rules in each override file, and a set of paths
+// that looks like a system image: mostly files that only match the built-in defaults.
+class FsConfigFixture : public benchmark::Fixture {
+  public:
+    void SetUp(const benchmark::State& state) override {
+        std::string system = std::string(tmp_.path) + "/system";
+        // The fixture is reused across arguments, so the directories may already exist.
+        mkdir(system.c_str(), 0755);
+        mkdir((system + "/etc").c_str(), 0755);
+        std::string data;
+        for (int i = 0; i < state.range(0); ++i) {
+            Append(&data, StringPrintf("vendor/app/Vendor%d/*", i));
+        }
+        CHECK(android::base::WriteStringToFile(data, system + "/etc/fs_config_files"));
+        CHECK(android::base::WriteStringToFile(data, system + "/etc/fs_config_dirs"));
+
+        paths_.clear();
+        for (int i = 0; i < 1000; ++i) {
+            paths_.push_back(StringPrintf("system/app/App%d/App%d.apk", i % 97, i));
+            paths_.push_back(StringPrintf("system/lib64/lib%d.so", i));
+            paths_.push_back(StringPrintf("vendor/app/Vendor%d/oat/arm64/Vendor.odex", i));
+            paths_.push_back(StringPrintf("system/apex/com.android.m%d/bin/tool", i % 13));
+        }
+    }
+
+  protected:
+    static void Append(std::string* data, const std::string& prefix) {
+        size_t len = sizeof(fs_path_config_from_file) + prefix.size() + 1;
+        len = (len + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+        fs_path_config_from_file header = {.len = static_cast<uint16_t>(len), .mode = 0644};
+        data->append(reinterpret_cast<const char*>(&header), sizeof(header));
+        data->append(prefix);
+        data->append(len - sizeof(header) - prefix.size(), '\0');
+    }
+
+    TemporaryDir tmp_;
+    std::vector<std::string> paths_;
+};
+
+BENCHMARK_DEFINE_F(FsConfigFixture, get_fs_config)(benchmark::State& state) {
+    for (auto _ : state) {
+        for (auto& path : paths_) {
+            struct fs_config conf;
+            benchmark::DoNotOptimize(get_fs_config(path.c_str(), false, tmp_.path, &conf));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * paths_.size());
+}
+BENCHMARK_REGISTER_F(FsConfigFixture, get_fs_config)->Arg(0)->Arg(16)->Arg(256);
+
+BENCHMARK_DEFINE_F(FsConfigFixture, fs_config_rules_lookup)(benchmark::State& state) {
+    fs_config_rules* rules = fs_config_rules_load(tmp_.path);
+    for (auto _ : state) {
+        for (auto& path : paths_) {
+            struct fs_config conf;
+            benchmark::DoNotOptimize(fs_config_rules_lookup(rules, path.c_str(), false, &conf));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * paths_.size());
+    fs_config_rules_free(rules);
+}
+BENCHMARK_REGISTER_F(FsConfigFixture, fs_config_rules_lookup)->Arg(0)->Arg(16)->Arg(256);
+
+BENCHMARK_DEFINE_F(FsConfigFixture, fs_config_rules_lookup_batch)(benchmark::State& state) {
+    fs_config_rules* rules = fs_config_rules_load(tmp_.path);
+    std::vector<fs_config_query> queries;
+    for (auto& path : paths_) {
+        queries.push_back({.path = path.c_str(), .dir = false});
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+                fs_config_rules_lookup_batch(rules, queries.data(), queries.size()));
+    }
+    state.SetItemsProcessed(state.iterations() * paths_.size());
+    fs_config_rules_free(rules);
+}
+BENCHMARK_REGISTER_F(FsConfigFixture, fs_config_rules_lookup_batch)->Arg(0)->Arg(16)->Arg(256);
+
+BENCHMARK_MAIN();
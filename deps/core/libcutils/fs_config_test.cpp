@@ -15,8 +15,10 @@
  */
 
 #include <inttypes.h>
+#include <sys/stat.h>
 
 #include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -25,6 +27,7 @@
 #include <android-base/strings.h>
 
 #include <private/android_filesystem_config.h>
+#include <private/fs_config.h>
 
 #include "fs_config.h"
 
@@ -258,3 +261,108 @@ TEST(fs_config, odm_files_alias) {
 TEST(fs_config, system_alias) {
     EXPECT_FALSE(check_fs_config_cmp(fs_config_cmp_tests));
 }
+
+static void append_override(std::string* data, uint16_t mode, uint16_t uid, uint16_t gid,
+                            uint64_t capabilities, const std::string& prefix) {
+    size_t len = sizeof(fs_path_config_from_file) + prefix.size() + 1;
+    len = (len + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    fs_path_config_from_file header = {
+            .len = static_cast<uint16_t>(len),
+            .mode = mode,
+            .uid = uid,
+            .gid = gid,
+            .capabilities = capabilities,
+    };
+    data->append(reinterpret_cast<const char*>(&header), sizeof(header));
+    data->append(prefix);
+    data->append(len - sizeof(header) - prefix.size(), '\0');
+}
+
+TEST(fs_config, rules_match_get_fs_config) {
+    TemporaryDir tmp;
+    std::string etc = std::string(tmp.path) + "/system/etc";
+    ASSERT_EQ(0, mkdir((std::string(tmp.path) + "/system").c_str(), 0755));
+    ASSERT_EQ(0, mkdir(etc.c_str(), 0755));
+
+    std::string files;
+    append_override(&files, 0700, AID_SYSTEM, AID_SYSTEM, 0, "system/bin/override");
+    append_override(&files, 0640, AID_SHELL, AID_SHELL, 1, "vendor/lib/*.so");
+    append_override(&files, 0600, AID_ROOT, AID_SHELL, 0, "system/etc/[ab]*.conf");
+    append_override(&files, 0444, AID_ROOT, AID_ROOT, 0, "*/?ilter");
+    ASSERT_TRUE(android::base::WriteStringToFile(files, etc + "/fs_config_files"));
+    std::string dirs;
+    append_override(&dirs, 0750, AID_SYSTEM, AID_SHELL, 0, "system/bin/override.d");
+    append_override(&dirs, 0700, AID_ROOT, AID_ROOT, 0, "odm/secret/");
+    ASSERT_TRUE(android::base::WriteStringToFile(dirs, etc + "/fs_config_dirs"));
+
+    static const char* paths[] = {
+            "",
+            "/system/bin/override",
+            "system/bin/override",
+            "system/bin/override.d",
+            "system/bin/sh",
+            "system/bin",
+            "system/vendor/lib/libfoo.so",
+            "vendor/lib/libfoo.so",
+            "vendor/lib/libfoo.so.1",
+            "system/etc/a.conf",
+            "system/etc/c.conf",
+            "system/etc/ppp/ip-up",
+            "data/filter",
+            "filter",
+            "vendor/odm/secret",
+            "vendor/odm/secret/key",
+            "odm/secret/key",
+            "system/product/bin/foo",
+            "product/apex/com.android.foo/bin/bar",
+            "system/apex/com.android.foo/bin/bar",
+            "system/apex/com.android.tethering/bin/for-system/clatd",
+            "init.rc",
+            "init",
+            "fstab.foo",
+            "data/misc/dhcp/leases",
+            "data/media/Music",
+            "sdcard",
+            "not/configured/anywhere",
+    };
+
+    fs_config_rules* rules = fs_config_rules_load(tmp.path);
+    ASSERT_NE(nullptr, rules);
+    std::vector<fs_config_query> queries;
+    for (const char* path : paths) {
+        for (bool dir : {false, true}) {
+            struct fs_config expected = {};
+            bool expected_found = get_fs_config(path, dir, tmp.path, &expected);
+            struct fs_config actual = {};
+            bool found = fs_config_rules_lookup(rules, path, dir, &actual);
+            ASSERT_EQ(expected_found, found) << path << " dir=" << dir;
+            if (found) {
+                EXPECT_EQ(expected.uid, actual.uid) << path << " dir=" << dir;
+                EXPECT_EQ(expected.gid, actual.gid) << path << " dir=" << dir;
+                EXPECT_EQ(expected.mode, actual.mode) << path << " dir=" << dir;
+                EXPECT_EQ(expected.capabilities, actual.capabilities) << path << " dir=" << dir;
+            }
+            queries.push_back({.path = path, .dir = dir});
+        }
+    }
+
+    size_t found = fs_config_rules_lookup_batch(rules, queries.data(), queries.size());
+    size_t expected_found = 0;
+    for (auto& query : queries) {
+        struct fs_config expected = {};
+        bool expected_query_found = get_fs_config(query.path, query.dir, tmp.path, &expected);
+        ASSERT_EQ(expected_query_found, query.found) << query.path << " dir=" << query.dir;
+        if (query.found) {
+            ++expected_found;
+            EXPECT_EQ(expected.uid, query.conf.uid) << query.path;
+            EXPECT_EQ(expected.mode, query.conf.mode) << query.path;
+        }
+    }
+    EXPECT_EQ(expected_found, found);
+
+    struct fs_config conf = {};
+    ASSERT_TRUE(fs_config_rules_lookup(rules, "system/vendor/lib/libfoo.so", false, &conf));
+    EXPECT_EQ(0640U, conf.mode);
+    EXPECT_EQ(1U, conf.capabilities);
+    fs_config_rules_free(rules);
+}
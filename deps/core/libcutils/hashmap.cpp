@@ -19,113 +19,208 @@
 #include <assert.h>
 #include <errno.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 
-typedef struct Entry Entry;
-struct Entry {
-    void* key;
-    int hash;
-    void* value;
-    Entry* next;
+#include <atomic>
+#include <new>
+
+// Open addressing with linear probing. Entries live inline in the slot array together with
+// their hash, so a lookup touches one or two cache lines instead of chasing a malloc()ed Entry
+// per link, and only calls the equals function once the hashes agree. Removal shifts the rest of
+// the probe run back instead of leaving tombstones, so lookups never get slower over time.
+//
+// Maps created with hashmapCreateConcurrent() additionally let hashmapGet() run without the
+// lock, concurrently with a writer that holds it. Writers bump a sequence count around every
+// mutation and readers retry if it changed underneath them. Tables replaced by a resize are kept
+// until hashmapFree() so a racing reader never touches freed memory; since tables double, that
+// costs at most as much memory again as the current table. All slot fields are accessed through
+// relaxed atomics, which are plain loads and stores for maps that aren't concurrent.
+
+struct Slot {
+    std::atomic<void*> key;
+    std::atomic<void*> value;
+    std::atomic<int> hash;
+    std::atomic<bool> used;
+};
+
+struct Table {
+    size_t mask;
+    unsigned shift;  // 64 - log2(mask + 1)
+    Slot* slots;
+    Table* retired;  // previous, smaller tables of a concurrent map
 };
 
 struct Hashmap {
-    Entry** buckets;
-    size_t bucketCount;
+    std::atomic<Table*> table;
+    size_t size;
     int (*hash)(void* key);
     bool (*equals)(void* keyA, void* keyB);
     pthread_mutex_t lock;
-    size_t size;
+    bool concurrent;
+    std::atomic<uint32_t> sequence;
 };
 
-Hashmap* hashmapCreate(size_t initialCapacity,
-        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB)) {
+static constexpr auto relaxed = std::memory_order_relaxed;
+
+static Table* createTable(size_t slotCount) {
+    Table* table = new (std::nothrow) Table;
+    if (table == nullptr) {
+        return nullptr;
+    }
+    table->slots = new (std::nothrow) Slot[slotCount]();
+    if (table->slots == nullptr) {
+        delete table;
+        return nullptr;
+    }
+    table->mask = slotCount - 1;
+    table->shift = 64 - __builtin_ctzll(slotCount);
+    table->retired = nullptr;
+    return table;
+}
+
+static void freeTable(Table* table) {
+    while (table != nullptr) {
+        Table* retired = table->retired;
+        delete[] table->slots;
+        delete table;
+        table = retired;
+    }
+}
+
+static Hashmap* createHashmap(size_t initialCapacity, int (*hash)(void* key),
+                              bool (*equals)(void* keyA, void* keyB), bool concurrent) {
     assert(hash != NULL);
     assert(equals != NULL);
 
-    Hashmap* map = static_cast<Hashmap*>(malloc(sizeof(Hashmap)));
+    Hashmap* map = new (std::nothrow) Hashmap;
     if (map == NULL) {
         return NULL;
     }
 
     // 0.75 load factor.
-    size_t minimumBucketCount = initialCapacity * 4 / 3;
-    map->bucketCount = 1;
-    while (map->bucketCount <= minimumBucketCount) {
-        // Bucket count must be power of 2.
-        map->bucketCount <<= 1;
+    size_t minimumSlotCount = initialCapacity * 4 / 3;
+    size_t slotCount = 2;
+    while (slotCount <= minimumSlotCount) {
+        // Slot count must be power of 2.
+        slotCount <<= 1;
     }
 
-    map->buckets = static_cast<Entry**>(calloc(map->bucketCount, sizeof(Entry*)));
-    if (map->buckets == NULL) {
-        free(map);
+    Table* table = createTable(slotCount);
+    if (table == NULL) {
+        delete map;
         return NULL;
     }
-
+    map->table.store(table, relaxed);
     map->size = 0;
-
     map->hash = hash;
     map->equals = equals;
+    map->concurrent = concurrent;
+    map->sequence.store(0, relaxed);
 
     pthread_mutex_init(&map->lock, nullptr);
 
     return map;
 }
 
+Hashmap* hashmapCreate(size_t initialCapacity,
+        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB)) {
+    return createHashmap(initialCapacity, hash, equals, false);
+}
+
+Hashmap* hashmapCreateConcurrent(size_t initialCapacity,
+        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB)) {
+    return createHashmap(initialCapacity, hash, equals, true);
+}
+
 /**
- * Hashes the given key.
+ * Maps a hash to its home slot. Fibonacci hashing spreads weak hashes over the table as well as
+ * the old secondary hash did, with one multiply.
  */
-#ifdef __clang__
-__attribute__((no_sanitize("integer")))
-#endif
-static inline int hashKey(Hashmap* map, void* key) {
-    int h = map->hash(key);
+static inline size_t homeIndex(const Table* table, int hash) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(hash)) * 0x9e3779b97f4a7c15ULL) >>
+           table->shift;
+}
 
-    // We apply this secondary hashing discovered by Doug Lea to defend
-    // against bad hashes.
-    h += ~(h << 9);
-    h ^= (((unsigned int) h) >> 14);
-    h += (h << 4);
-    h ^= (((unsigned int) h) >> 10);
+// Brackets a mutation of a concurrent map, making the sequence count odd while it is under way.
+static inline void beginWrite(Hashmap* map) {
+    if (map->concurrent) {
+        map->sequence.store(map->sequence.load(relaxed) + 1, relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+}
 
-    return h;
+static inline void endWrite(Hashmap* map) {
+    if (map->concurrent) {
+        map->sequence.store(map->sequence.load(relaxed) + 1, std::memory_order_release);
+    }
 }
 
-static inline size_t calculateIndex(size_t bucketCount, int hash) {
-    return ((size_t) hash) & (bucketCount - 1);
+static inline void storeSlot(Slot* slot, void* key, int hash, void* value) {
+    slot->key.store(key, relaxed);
+    slot->hash.store(hash, relaxed);
+    slot->value.store(value, relaxed);
+    slot->used.store(true, relaxed);
 }
 
-static void expandIfNecessary(Hashmap* map) {
-    // If the load factor exceeds 0.75...
-    if (map->size > (map->bucketCount * 3 / 4)) {
-        // Start off with a 0.33 load factor.
-        size_t newBucketCount = map->bucketCount << 1;
-        Entry** newBuckets = static_cast<Entry**>(calloc(newBucketCount, sizeof(Entry*)));
-        if (newBuckets == NULL) {
-            // Abort expansion.
-            return;
+static inline bool equalKeys(void* keyA, int hashA, void* keyB, int hashB,
+        bool (*equals)(void*, void*)) {
+    if (keyA == keyB) {
+        return true;
+    }
+    if (hashA != hashB) {
+        return false;
+    }
+    return equals(keyA, keyB);
+}
+
+/**
+ * Returns the slot holding key, or the empty slot that ends its probe run. The table always has
+ * at least one empty slot, so the probe terminates.
+ */
+static Slot* findSlot(Hashmap* map, const Table* table, void* key, int hash) {
+    for (size_t i = homeIndex(table, hash);; i = (i + 1) & table->mask) {
+        Slot* slot = &table->slots[i];
+        if (!slot->used.load(relaxed) ||
+            equalKeys(slot->key.load(relaxed), slot->hash.load(relaxed), key, hash,
+                      map->equals)) {
+            return slot;
         }
+    }
+}
 
-        // Move over existing entries.
-        size_t i;
-        for (i = 0; i < map->bucketCount; i++) {
-            Entry* entry = map->buckets[i];
-            while (entry != NULL) {
-                Entry* next = entry->next;
-                size_t index = calculateIndex(newBucketCount, entry->hash);
-                entry->next = newBuckets[index];
-                newBuckets[index] = entry;
-                entry = next;
-            }
+static bool expand(Hashmap* map) {
+    Table* oldTable = map->table.load(relaxed);
+    size_t oldSlotCount = oldTable->mask + 1;
+    Table* newTable = createTable(oldSlotCount << 1);
+    if (newTable == NULL) {
+        return false;
+    }
+
+    // Move over existing entries. They are all distinct, so each one just goes to the first
+    // free slot of its probe run.
+    for (size_t i = 0; i < oldSlotCount; i++) {
+        Slot* slot = &oldTable->slots[i];
+        if (!slot->used.load(relaxed)) continue;
+        int hash = slot->hash.load(relaxed);
+        size_t index = homeIndex(newTable, hash);
+        while (newTable->slots[index].used.load(relaxed)) {
+            index = (index + 1) & newTable->mask;
         }
+        storeSlot(&newTable->slots[index], slot->key.load(relaxed), hash,
+                  slot->value.load(relaxed));
+    }
 
-        // Copy over internals.
-        free(map->buckets);
-        map->buckets = newBuckets;
-        map->bucketCount = newBucketCount;
+    if (map->concurrent) {
+        newTable->retired = oldTable;
+        map->table.store(newTable, std::memory_order_release);
+    } else {
+        map->table.store(newTable, relaxed);
+        freeTable(oldTable);
     }
+    return true;
 }
 
 void hashmapLock(Hashmap* map) {
@@ -137,18 +232,9 @@ void hashmapUnlock(Hashmap* map) {
 }
 
 void hashmapFree(Hashmap* map) {
-    size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            Entry* next = entry->next;
-            free(entry);
-            entry = next;
-        }
-    }
-    free(map->buckets);
+    freeTable(map->table.load(relaxed));
     pthread_mutex_destroy(&map->lock);
-    free(map);
+    delete map;
 }
 
 #ifdef __clang__
@@ -166,109 +252,143 @@ int hashmapHash(void* key, size_t keySize) {
     return h;
 }
 
-static Entry* createEntry(void* key, int hash, void* value) {
-    Entry* entry = static_cast<Entry*>(malloc(sizeof(Entry)));
-    if (entry == NULL) {
-        return NULL;
+void* hashmapPut(Hashmap* map, void* key, void* value) {
+    int hash = map->hash(key);
+    Table* table = map->table.load(relaxed);
+    Slot* slot = findSlot(map, table, key, hash);
+
+    // Replace existing entry.
+    if (slot->used.load(relaxed)) {
+        void* oldValue = slot->value.load(relaxed);
+        beginWrite(map);
+        slot->value.store(value, relaxed);
+        endWrite(map);
+        return oldValue;
     }
-    entry->key = key;
-    entry->hash = hash;
-    entry->value = value;
-    entry->next = NULL;
-    return entry;
-}
 
-static inline bool equalKeys(void* keyA, int hashA, void* keyB, int hashB,
-        bool (*equals)(void*, void*)) {
-    if (keyA == keyB) {
-        return true;
-    }
-    if (hashA != hashB) {
-        return false;
+    // Add a new entry, first growing the table if the load factor would exceed 0.75.
+    beginWrite(map);
+    if (map->size + 1 > (table->mask + 1) * 3 / 4) {
+        if (expand(map)) {
+            table = map->table.load(relaxed);
+            slot = findSlot(map, table, key, hash);
+        } else if (map->size + 2 > table->mask + 1) {
+            // Without a free slot to spare, probing could no longer terminate.
+            endWrite(map);
+            errno = ENOMEM;
+            return NULL;
+        }
     }
-    return equals(keyA, keyB);
+    storeSlot(slot, key, hash, value);
+    map->size++;
+    endWrite(map);
+    return NULL;
 }
 
-void* hashmapPut(Hashmap* map, void* key, void* value) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
+void* hashmapGet(Hashmap* map, void* key) {
+    int hash = map->hash(key);
+
+    if (!map->concurrent) {
+        Slot* slot = findSlot(map, map->table.load(relaxed), key, hash);
+        return slot->used.load(relaxed) ? slot->value.load(relaxed) : NULL;
+    }
 
-    Entry** p = &(map->buckets[index]);
     while (true) {
-        Entry* current = *p;
-
-        // Add a new entry.
-        if (current == NULL) {
-            *p = createEntry(key, hash, value);
-            if (*p == NULL) {
-                errno = ENOMEM;
-                return NULL;
+        uint32_t sequence = map->sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            // A writer is in the middle of a mutation.
+            continue;
+        }
+        const Table* table = map->table.load(std::memory_order_acquire);
+        void* value = NULL;
+        // A racing writer can leave the table momentarily without an empty slot at the end of
+        // our run, so bound the probe by the table size.
+        size_t i = homeIndex(table, hash);
+        for (size_t probes = 0; probes <= table->mask; probes++, i = (i + 1) & table->mask) {
+            const Slot* slot = &table->slots[i];
+            if (!slot->used.load(relaxed)) break;
+            void* slotKey = slot->key.load(relaxed);
+            // A slot that a racing writer is filling or emptying may show a NULL key, which
+            // equals() need not accept. The sequence check below discards whatever this probe
+            // finds in that case.
+            if (slotKey == NULL && key != NULL) continue;
+            if (equalKeys(slotKey, slot->hash.load(relaxed), key, hash, map->equals)) {
+                value = slot->value.load(relaxed);
+                break;
             }
-            map->size++;
-            expandIfNecessary(map);
-            return NULL;
         }
-
-        // Replace existing entry.
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            void* oldValue = current->value;
-            current->value = value;
-            return oldValue;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (map->sequence.load(relaxed) == sequence) {
+            return value;
         }
-
-        // Move to next entry.
-        p = &current->next;
     }
 }
 
-void* hashmapGet(Hashmap* map, void* key) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    Entry* entry = map->buckets[index];
-    while (entry != NULL) {
-        if (equalKeys(entry->key, entry->hash, key, hash, map->equals)) {
-            return entry->value;
+/**
+ * Empties the slot at index and shifts later entries of the same probe run back into the hole,
+ * so that no run is ever broken by an empty slot.
+ */
+static void removeAt(Table* table, size_t index) {
+    size_t hole = index;
+    for (size_t i = (index + 1) & table->mask;; i = (i + 1) & table->mask) {
+        Slot* slot = &table->slots[i];
+        if (!slot->used.load(relaxed)) break;
+        int hash = slot->hash.load(relaxed);
+        size_t home = homeIndex(table, hash);
+        // Move the entry only if the hole lies between its home slot and where it is now.
+        if (((i - home) & table->mask) >= ((i - hole) & table->mask)) {
+            storeSlot(&table->slots[hole], slot->key.load(relaxed), hash,
+                      slot->value.load(relaxed));
+            hole = i;
         }
-        entry = entry->next;
     }
-
-    return NULL;
+    Slot* slot = &table->slots[hole];
+    slot->used.store(false, relaxed);
+    slot->key.store(NULL, relaxed);
+    slot->value.store(NULL, relaxed);
 }
 
 void* hashmapRemove(Hashmap* map, void* key) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    // Pointer to the current entry.
-    Entry** p = &(map->buckets[index]);
-    Entry* current;
-    while ((current = *p) != NULL) {
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            void* value = current->value;
-            *p = current->next;
-            free(current);
-            map->size--;
-            return value;
-        }
-
-        p = &current->next;
+    int hash = map->hash(key);
+    Table* table = map->table.load(relaxed);
+    Slot* slot = findSlot(map, table, key, hash);
+    if (!slot->used.load(relaxed)) {
+        return NULL;
     }
 
-    return NULL;
+    void* value = slot->value.load(relaxed);
+    beginWrite(map);
+    removeAt(table, slot - table->slots);
+    map->size--;
+    endWrite(map);
+    return value;
 }
 
 void hashmapForEach(Hashmap* map, bool (*callback)(void* key, void* value, void* context),
                     void* context) {
-    size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            Entry *next = entry->next;
-            if (!callback(entry->key, entry->value, context)) {
+    Table* table = map->table.load(relaxed);
+    if (map->size == 0) {
+        return;
+    }
+
+    // Callbacks may remove entries, including the current one, and removal only ever moves
+    // entries backwards within their probe run. Starting right after an empty slot means no run
+    // wraps around past the start, so an entry that moves into the slot just visited has not
+    // been visited yet: look at that slot again instead of advancing.
+    size_t start = 0;
+    while (table->slots[start].used.load(relaxed)) {
+        start++;
+    }
+    for (size_t n = 1; n <= table->mask + 1; n++) {
+        Slot* slot = &table->slots[(start + n) & table->mask];
+        while (slot->used.load(relaxed)) {
+            void* key = slot->key.load(relaxed);
+            if (!callback(key, slot->value.load(relaxed), context)) {
                 return;
             }
-            entry = next;
+            if (slot->used.load(relaxed) && slot->key.load(relaxed) == key) {
+                break;
+            }
         }
     }
 }
@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <cutils/hashmap.h>
+
+// The chained hash map that hashmap.cpp used to be, kept as the baseline to compare against.
+namespace chained {
+
+struct Entry {
+    void* key;
+    int hash;
+    void* value;
+    Entry* next;
+};
+
+struct Map {
+    Entry** buckets;
+    size_t bucketCount;
+    int (*hash)(void* key);
+    bool (*equals)(void* keyA, void* keyB);
+    size_t size;
+};
+
+static Map* Create(size_t initialCapacity, int (*hash)(void*), bool (*equals)(void*, void*)) {
+    Map* map = new Map;
+    size_t minimumBucketCount = initialCapacity * 4 / 3;
+    map->bucketCount = 1;
+    while (map->bucketCount <= minimumBucketCount) map->bucketCount <<= 1;
+    map->buckets = static_cast<Entry**>(calloc(map->bucketCount, sizeof(Entry*)));
+    map->hash = hash;
+    map->equals = equals;
+    map->size = 0;
+    return map;
+}
+
+static int HashKey(Map* map, void* key) {
+    unsigned h = map->hash(key);
+    h += ~(h << 9);
+    h ^= h >> 14;
+    h += h << 4;
+    h ^= h >> 10;
+    return h;
+}
+
+static void ExpandIfNecessary(Map* map) {
+    if (map->size <= map->bucketCount * 3 / 4) return;
+    size_t newBucketCount = map->bucketCount << 1;
+    Entry** newBuckets = static_cast<Entry**>(calloc(newBucketCount, sizeof(Entry*)));
+    for (size_t i = 0; i < map->bucketCount; i++) {
+        for (Entry* entry = map->buckets[i]; entry != nullptr;) {
+            Entry* next = entry->next;
+            size_t index = static_cast<size_t>(entry->hash) & (newBucketCount - 1);
+            entry->next = newBuckets[index];
+            newBuckets[index] = entry;
+            entry = next;
+        }
+    }
+    free(map->buckets);
+    map->buckets = newBuckets;
+    map->bucketCount = newBucketCount;
+}
+
+static bool EqualKeys(Map* map, Entry* entry, void* key, int hash) {
+    return entry->key == key || (entry->hash == hash && map->equals(entry->key, key));
+}
+
+static void* Put(Map* map, void* key, void* value) {
+    int hash = HashKey(map, key);
+    Entry** p = &map->buckets[static_cast<size_t>(hash) & (map->bucketCount - 1)];
+    for (; *p != nullptr; p = &(*p)->next) {
+        if (EqualKeys(map, *p, key, hash)) {
+            void* oldValue = (*p)->value;
+            (*p)->value = value;
+            return oldValue;
+        }
+    }
+    *p = new Entry{key, hash, value, nullptr};
+    map->size++;
+    ExpandIfNecessary(map);
+    return nullptr;
+}
+
+static void* Get(Map* map, void* key) {
+    int hash = HashKey(map, key);
+    for (Entry* entry = map->buckets[static_cast<size_t>(hash) & (map->bucketCount - 1)];
+         entry != nullptr; entry = entry->next) {
+        if (EqualKeys(map, entry, key, hash)) return entry->value;
+    }
+    return nullptr;
+}
+
+static void* Remove(Map* map, void* key) {
+    int hash = HashKey(map, key);
+    for (Entry** p = &map->buckets[static_cast<size_t>(hash) & (map->bucketCount - 1)];
+         *p != nullptr; p = &(*p)->next) {
+        if (EqualKeys(map, *p, key, hash)) {
+            Entry* current = *p;
+            void* value = current->value;
+            *p = current->next;
+            delete current;
+            map->size--;
+            return value;
+        }
+    }
+    return nullptr;
+}
+
+static void Free(Map* map) {
+    for (size_t i = 0; i < map->bucketCount; i++) {
+        for (Entry* entry = map->buckets[i]; entry != nullptr;) {
+            Entry* next = entry->next;
+            delete entry;
+            entry = next;
+        }
+    }
+    free(map->buckets);
+    delete map;
+}
+
+}  // namespace chained
+
+// The same string hash str_parms uses.
+static int str_hash(void* str) {
+    uint32_t hash = 5381;
+    for (char* p = static_cast<char*>(str); *p; p++) hash = ((hash << 5) + hash) + *p;
+    return static_cast<int>(hash);
+}
+
+static bool str_equals(void* a, void* b) {
+    return strcmp(static_cast<char*>(a), static_cast<char*>(b)) == 0;
+}
+
+// Distinct keys whose pointers differ from the map's, so every hit goes through equals.
+static std::vector<std::string> Keys(size_t n, const char* prefix) {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < n; ++i) keys.push_back(prefix + std::to_string(i));
+    return keys;
+}
+
+struct Hashmaps {
+    static Hashmap* Create(size_t n) { return hashmapCreate(n, str_hash, str_equals); }
+    static void* Put(Hashmap* map, void* key, void* value) { return hashmapPut(map, key, value); }
+    static void* Get(Hashmap* map, void* key) { return hashmapGet(map, key); }
+    static void* Remove(Hashmap* map, void* key) { return hashmapRemove(map, key); }
+    static void Free(Hashmap* map) { hashmapFree(map); }
+};
+
+struct ChainedMaps {
+    static chained::Map* Create(size_t n) { return chained::Create(n, str_hash, str_equals); }
+    static void* Put(chained::Map* map, void* key, void* value) {
+        return chained::Put(map, key, value);
+    }
+    static void* Get(chained::Map* map, void* key) { return chained::Get(map, key); }
+    static void* Remove(chained::Map* map, void* key) { return chained::Remove(map, key); }
+    static void Free(chained::Map* map) { chained::Free(map); }
+};
+
+template <typename Maps>
+static void BM_get(benchmark::State& state) {
+    size_t n = state.range(0);
+    auto keys = Keys(n, "key");
+    auto lookups = Keys(n, "key");
+    auto map = Maps::Create(5);
+    for (auto& key : keys) Maps::Put(map, key.data(), key.data());
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Maps::Get(map, lookups[i].data()));
+        if (++i == n) i = 0;
+    }
+    Maps::Free(map);
+}
+BENCHMARK_TEMPLATE(BM_get, ChainedMaps)->Range(8, 1 << 16);
+BENCHMARK_TEMPLATE(BM_get, Hashmaps)->Range(8, 1 << 16);
+
+template <typename Maps>
+static void BM_get_miss(benchmark::State& state) {
+    size_t n = state.range(0);
+    auto keys = Keys(n, "key");
+    auto lookups = Keys(n, "missing");
+    auto map = Maps::Create(5);
+    for (auto& key : keys) Maps::Put(map, key.data(), key.data());
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Maps::Get(map, lookups[i].data()));
+        if (++i == n) i = 0;
+    }
+    Maps::Free(map);
+}
+BENCHMARK_TEMPLATE(BM_get_miss, ChainedMaps)->Range(8, 1 << 16);
+BENCHMARK_TEMPLATE(BM_get_miss, Hashmaps)->Range(8, 1 << 16);
+
+// Builds and tears down a small map, like str_parms does for every parameter string.
+template <typename Maps>
+static void BM_put_remove(benchmark::State& state) {
+    size_t n = state.range(0);
+    auto keys = Keys(n, "key");
+    for (auto _ : state) {
+        auto map = Maps::Create(5);
+        for (auto& key : keys) Maps::Put(map, key.data(), key.data());
+        for (auto& key : keys) Maps::Remove(map, key.data());
+        Maps::Free(map);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_TEMPLATE(BM_put_remove, ChainedMaps)->Range(8, 1 << 12);
+BENCHMARK_TEMPLATE(BM_put_remove, Hashmaps)->Range(8, 1 << 12);
+
+// Many threads looking up a shared map: with the lock, versus lock-free on a concurrent map.
+static Hashmap* shared_map;
+static std::vector<std::string> shared_keys = Keys(1024, "key");
+
+static void BM_shared_get_locked(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        shared_map = hashmapCreate(5, str_hash, str_equals);
+        for (auto& key : shared_keys) hashmapPut(shared_map, key.data(), key.data());
+    }
+    size_t i = state.thread_index();
+    for (auto _ : state) {
+        hashmapLock(shared_map);
+        benchmark::DoNotOptimize(hashmapGet(shared_map, shared_keys[i].data()));
+        hashmapUnlock(shared_map);
+        i = (i + 1) & 1023;
+    }
+    if (state.thread_index() == 0) hashmapFree(shared_map);
+}
+BENCHMARK(BM_shared_get_locked)->ThreadRange(1, 8);
+
+static void BM_shared_get_concurrent(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        shared_map = hashmapCreateConcurrent(5, str_hash, str_equals);
+        for (auto& key : shared_keys) hashmapPut(shared_map, key.data(), key.data());
+    }
+    size_t i = state.thread_index();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(hashmapGet(shared_map, shared_keys[i].data()));
+        i = (i + 1) & 1023;
+    }
+    if (state.thread_index() == 0) hashmapFree(shared_map);
+}
+BENCHMARK(BM_shared_get_concurrent)->ThreadRange(1, 8);
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/hashmap.h>
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Keys are small integers smuggled through the key pointer. The hash deliberately collides a
+// lot so that probe runs get long and removals have to shift entries around.
+static int int_hash(void* key) {
+    return static_cast<int>(reinterpret_cast<uintptr_t>(key) % 61);
+}
+
+static bool int_equals(void* key_a, void* key_b) {
+    return key_a == key_b;
+}
+
+static void* as_ptr(uintptr_t i) {
+    return reinterpret_cast<void*>(i);
+}
+
+TEST(hashmap, matches_unordered_map) {
+    Hashmap* map = hashmapCreate(0, int_hash, int_equals);
+    ASSERT_NE(nullptr, map);
+    std::unordered_map<uintptr_t, uintptr_t> expected;
+    std::mt19937 rng(42);
+
+    for (int i = 0; i < 200000; ++i) {
+        uintptr_t key = 1 + rng() % 2000;
+        uintptr_t value = 1 + rng() % 1000;
+        auto it = expected.find(key);
+        void* old_value = it == expected.end() ? nullptr : as_ptr(it->second);
+        switch (rng() % 3) {
+            case 0:
+                ASSERT_EQ(old_value, hashmapPut(map, as_ptr(key), as_ptr(value)));
+                expected[key] = value;
+                break;
+            case 1:
+                ASSERT_EQ(old_value, hashmapRemove(map, as_ptr(key)));
+                expected.erase(key);
+                break;
+            case 2:
+                ASSERT_EQ(old_value, hashmapGet(map, as_ptr(key)));
+                break;
+        }
+    }
+    for (uintptr_t key = 1; key <= 2000; ++key) {
+        auto it = expected.find(key);
+        ASSERT_EQ(it == expected.end() ? nullptr : as_ptr(it->second),
+                  hashmapGet(map, as_ptr(key)));
+    }
+    hashmapFree(map);
+}
+
+struct for_each_context {
+    Hashmap* map;
+    std::multiset<uintptr_t> seen;
+};
+
+static bool remove_every_other(void* key, void*, void* context) {
+    auto ctx = static_cast<for_each_context*>(context);
+    uintptr_t i = reinterpret_cast<uintptr_t>(key);
+    ctx->seen.insert(i);
+    if (i % 2) hashmapRemove(ctx->map, key);
+    return true;
+}
+
+TEST(hashmap, for_each_removing_entries) {
+    Hashmap* map = hashmapCreate(5, int_hash, int_equals);
+    ASSERT_NE(nullptr, map);
+    for (uintptr_t i = 1; i <= 1000; ++i) {
+        hashmapPut(map, as_ptr(i), as_ptr(i));
+    }
+
+    // Every entry is visited exactly once even though entries shift while we iterate.
+    for_each_context context = {.map = map};
+    hashmapForEach(map, remove_every_other, &context);
+    ASSERT_EQ(1000U, context.seen.size());
+    for (uintptr_t i = 1; i <= 1000; ++i) {
+        ASSERT_EQ(1U, context.seen.count(i)) << i;
+        ASSERT_EQ(i % 2 ? nullptr : as_ptr(i), hashmapGet(map, as_ptr(i))) << i;
+    }
+
+    context.seen.clear();
+    hashmapForEach(map, remove_every_other, &context);
+    ASSERT_EQ(500U, context.seen.size());
+    hashmapFree(map);
+}
+
+TEST(hashmap, concurrent_readers) {
+    Hashmap* map = hashmapCreateConcurrent(0, int_hash, int_equals);
+    ASSERT_NE(nullptr, map);
+    // Even keys are always present with value == key; odd keys come and go.
+    for (uintptr_t i = 2; i <= 512; i += 2) {
+        hashmapPut(map, as_ptr(i), as_ptr(i));
+    }
+
+    std::atomic<bool> done = false;
+    std::atomic<bool> failed = false;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&] {
+            while (!done) {
+                for (uintptr_t i = 1; i <= 1024; ++i) {
+                    void* value = hashmapGet(map, as_ptr(i));
+                    if ((i % 2 == 0 && i <= 512 && value != as_ptr(i)) ||
+                        (value != nullptr && value != as_ptr(i))) {
+                        failed = true;
+                    }
+                }
+            }
+        });
+    }
+
+    std::mt19937 rng(7);
+    for (int i = 0; i < 200000; ++i) {
+        uintptr_t key = 2 * (rng() % 512) + 1;
+        hashmapLock(map);
+        if (rng() % 2) {
+            hashmapPut(map, as_ptr(key), as_ptr(key));
+        } else {
+            hashmapRemove(map, as_ptr(key));
+        }
+        hashmapUnlock(map);
+    }
+    // Force some resizes while readers are running.
+    for (uintptr_t i = 514; i <= 1024; i += 2) {
+        hashmapLock(map);
+        hashmapPut(map, as_ptr(i), as_ptr(i));
+        hashmapUnlock(map);
+    }
+    done = true;
+    for (auto& reader : readers) reader.join();
+    EXPECT_FALSE(failed);
+    hashmapFree(map);
+}
+
+static std::atomic<bool> string_equals_saw_null = false;
+
+// Unlike int_equals(), this dereferences both keys the way real string keyed maps do.
+static bool string_equals(void* key_a, void* key_b) {
+    if (key_a == nullptr || key_b == nullptr) {
+        string_equals_saw_null = true;
+        return false;
+    }
+    return strcmp(static_cast<char*>(key_a), static_cast<char*>(key_b)) == 0;
+}
+
+static int colliding_string_hash(void* key) {
+    return hashmapHash(key, strlen(static_cast<char*>(key))) % 61;
+}
+
+TEST(hashmap, concurrent_readers_with_string_keys) {
+    Hashmap* map = hashmapCreateConcurrent(0, colliding_string_hash, string_equals);
+    ASSERT_NE(nullptr, map);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 512; ++i) {
+        keys.push_back("key" + std::to_string(i));
+    }
+    // Lookups use copies of the keys, so that only string_equals() can match them.
+    std::vector<std::string> lookup_keys = keys;
+    // Even keys are always present; odd keys come and go.
+    for (size_t i = 0; i < keys.size(); i += 2) {
+        hashmapPut(map, keys[i].data(), keys[i].data());
+    }
+
+    string_equals_saw_null = false;
+    std::atomic<bool> done = false;
+    std::atomic<bool> failed = false;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&] {
+            while (!done) {
+                for (size_t i = 0; i < lookup_keys.size(); ++i) {
+                    void* value = hashmapGet(map, lookup_keys[i].data());
+                    if ((i % 2 == 0 && value != keys[i].data()) ||
+                        (value != nullptr && value != keys[i].data())) {
+                        failed = true;
+                    }
+                }
+            }
+        });
+    }
+
+    std::mt19937 rng(7);
+    for (int i = 0; i < 200000; ++i) {
+        std::string& key = keys[2 * (rng() % 256) + 1];
+        hashmapLock(map);
+        if (rng() % 2) {
+            hashmapPut(map, key.data(), key.data());
+        } else {
+            hashmapRemove(map, key.data());
+        }
+        hashmapUnlock(map);
+    }
+    done = true;
+    for (auto& reader : readers) reader.join();
+    EXPECT_FALSE(failed);
+    EXPECT_FALSE(string_equals_saw_null);
+    hashmapFree(map);
+}
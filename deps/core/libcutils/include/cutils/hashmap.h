@@ -44,6 +44,19 @@ typedef struct Hashmap Hashmap;
 Hashmap* hashmapCreate(size_t initialCapacity,
         int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB));
 
+/**
+ * Creates a new hash map whose hashmapGet() may be called without holding the map's lock,
+ * concurrently with one writer that holds it. Lookups never block; they retry if they overlap a
+ * put or remove. Every other function still requires the lock when the map is shared.
+ *
+ * Keys and values removed or replaced while readers may be looking them up must not be freed
+ * until those readers are done, because a lookup may still be comparing against them.
+ *
+ * Returns NULL if memory allocation fails.
+ */
+Hashmap* hashmapCreateConcurrent(size_t initialCapacity,
+        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB));
+
 /**
  * Frees the hash map. Does not free the keys or values themselves.
  */
@@ -78,7 +91,8 @@ void* hashmapRemove(Hashmap* map, void* key);
 
 /**
  * Invokes the given callback on each entry in the map. Stops iterating if
- * the callback returns false.
+ * the callback returns false. The callback may remove entries, but must not
+ * add any.
  */
 void hashmapForEach(Hashmap* map, bool (*callback)(void* key, void* value, void* context),
                     void* context);
@@ -23,6 +23,7 @@
 
 #include <fcntl.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/cdefs.h>
 #include <unistd.h>
@@ -56,4 +57,34 @@ struct fs_config {
 bool get_fs_config(const char* path, bool dir, const char* target_out_path,
                    struct fs_config* conf);
 
+/*
+ * An immutable, compiled snapshot of every rule get_fs_config() consults for one
+ * target_out_path: the <partition>/etc/fs_config_(dirs|files) override files, read once, followed
+ * by the built-in defaults. Lookups keep the "first match" order and give the same answer as
+ * get_fs_config() as long as the override files don't change after loading, without touching the
+ * file system. Build tools that configure many paths should load the rules once and use these
+ * instead of get_fs_config(). A loaded snapshot may be shared between threads.
+ */
+struct fs_config_rules;
+
+struct fs_config_rules* fs_config_rules_load(const char* target_out_path);
+void fs_config_rules_free(struct fs_config_rules* rules);
+
+bool fs_config_rules_lookup(const struct fs_config_rules* rules, const char* path, bool dir,
+                            struct fs_config* conf);
+
+struct fs_config_query {
+  const char* path;      /* in */
+  bool dir;              /* in */
+  bool found;            /* out */
+  struct fs_config conf; /* out, only valid if found */
+};
+
+/*
+ * Resolves every query in one pass, reusing the same scratch state for all of them.
+ * Returns the number of queries that found a configuration.
+ */
+size_t fs_config_rules_lookup_batch(const struct fs_config_rules* rules,
+                                    struct fs_config_query* queries, size_t count);
+
 __END_DECLS
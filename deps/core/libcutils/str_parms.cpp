@@ -26,229 +26,256 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include <cutils/hashmap.h>
 #include <cutils/memory.h>
 #include <log/log.h>
 
-/* When an object is allocated but not freed in a function,
- * because its ownership is released to other object like a hashmap,
- * call RELEASE_OWNERSHIP to tell the clang analyzer and avoid
- * false warnings about potential memory leak.
- * For now, a "temporary" assignment to global variables
- * is enough to confuse the clang static analyzer.
+/*
+ * Parameter strings are short and parsed often, so a str_parms avoids per-pair allocations:
+ *
+ * - str_parms_create_str() copies the input once, into the same allocation as the str_parms
+ *   itself, and cuts it into NUL-terminated keys and values in place.
+ * - Pairs are kept in insertion order in a flat table of spans into that copy, inline in the
+ *   str_parms for the common case of a handful of pairs. Each pair carries its key's hash and
+ *   length, so lookups rarely need a strcmp().
+ * - Keys and values added later are copied into a bump arena; nothing is freed until
+ *   str_parms_destroy(). A value replaced by one that fits in its space is rewritten in place,
+ *   so setting the same keys over and over does not grow the arena.
  */
-#ifdef __clang_analyzer__
-static void *released_pointer;
-#define RELEASE_OWNERSHIP(x) { released_pointer = x; released_pointer = 0; }
-#else
-#define RELEASE_OWNERSHIP(x)
-#endif
 
-struct str_parms {
-    Hashmap *map;
+#define INLINE_PAIRS 16
+#define MIN_CHUNK_SIZE 256
+
+struct pair {
+    const char *key;
+    const char *value;
+    uint32_t key_len;
+    uint32_t value_len;
+    uint32_t value_size;  // room at value for rewriting it in place, not counting the NUL
+    uint32_t hash;
 };
 
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
 
-static bool str_eq(void *key_a, void *key_b)
-{
-    return !strcmp((const char *)key_a, (const char *)key_b);
-}
+struct str_parms {
+    struct pair *pairs;
+    size_t count;
+    size_t capacity;
+    struct arena_chunk *arena;
+    struct pair inline_pairs[INLINE_PAIRS];
+    char input[];  // str_parms_create_str()'s copy of its input
+};
 
 /* use djb hash unless we find it inadequate */
 #ifdef __clang__
 __attribute__((no_sanitize("integer")))
 #endif
-static int str_hash_fn(void *str)
+static uint32_t str_hash_fn(const char *str, uint32_t *len)
 {
     uint32_t hash = 5381;
+    const char *p = str;
 
-    for (char* p = static_cast<char*>(str); p && *p; p++)
+    for (; *p; p++)
         hash = ((hash << 5) + hash) + *p;
-    return (int)hash;
+    *len = p - str;
+    return hash;
 }
 
-struct str_parms *str_parms_create(void)
+static struct str_parms *str_parms_alloc(size_t input_size)
 {
-    str_parms* s = static_cast<str_parms*>(calloc(1, sizeof(str_parms)));
+    str_parms* s = static_cast<str_parms*>(malloc(sizeof(str_parms) + input_size));
     if (!s) return NULL;
 
-    s->map = hashmapCreate(5, str_hash_fn, str_eq);
-    if (!s->map) {
-        free(s);
-        return NULL;
-    }
-
+    s->pairs = s->inline_pairs;
+    s->count = 0;
+    s->capacity = INLINE_PAIRS;
+    s->arena = NULL;
     return s;
 }
 
-struct remove_ctxt {
-    struct str_parms *str_parms;
-    const char *key;
-};
+struct str_parms *str_parms_create(void)
+{
+    return str_parms_alloc(0);
+}
 
-static bool remove_pair(void *key, void *value, void *context)
+void str_parms_destroy(struct str_parms *str_parms)
 {
-    remove_ctxt* ctxt = static_cast<remove_ctxt*>(context);
-    bool should_continue;
-
-    /*
-     * - if key is not supplied, then we are removing all entries,
-     *   so remove key and continue (i.e. return true)
-     * - if key is supplied and matches, then remove it and don't
-     *   continue (return false). Otherwise, return true and keep searching
-     *   for key.
-     *
-     */
-    if (!ctxt->key) {
-        should_continue = true;
-        goto do_remove;
-    } else if (!strcmp(ctxt->key, static_cast<const char*>(key))) {
-        should_continue = false;
-        goto do_remove;
+    struct arena_chunk *chunk = str_parms->arena;
+    while (chunk) {
+        struct arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
     }
+    if (str_parms->pairs != str_parms->inline_pairs)
+        free(str_parms->pairs);
+    free(str_parms);
+}
 
-    return true;
+static struct pair *find_pair(struct str_parms *str_parms, const char *key)
+{
+    uint32_t key_len;
+    uint32_t hash = str_hash_fn(key, &key_len);
 
-do_remove:
-    hashmapRemove(ctxt->str_parms->map, key);
-    free(key);
-    free(value);
-    return should_continue;
+    for (size_t i = 0; i < str_parms->count; i++) {
+        struct pair *pair = &str_parms->pairs[i];
+        if (pair->hash == hash && pair->key_len == key_len && !memcmp(pair->key, key, key_len))
+            return pair;
+    }
+    return NULL;
 }
 
-void str_parms_del(struct str_parms *str_parms, const char *key)
+/* Sets key's value, replacing the old one if key is already present. Returns -ENOMEM or 0. */
+static int put_pair(struct str_parms *str_parms, const char *key, const char *value,
+                    size_t value_len)
 {
-    struct remove_ctxt ctxt = {
-        .str_parms = str_parms,
-        .key = key,
-    };
-    hashmapForEach(str_parms->map, remove_pair, &ctxt);
+    struct pair *pair = find_pair(str_parms, key);
+    if (pair) {
+        pair->value = value;
+        pair->value_len = value_len;
+        pair->value_size = value_len;
+        return 0;
+    }
+
+    if (str_parms->count == str_parms->capacity) {
+        size_t capacity = str_parms->capacity * 2;
+        struct pair *pairs;
+        if (str_parms->pairs == str_parms->inline_pairs) {
+            pairs = static_cast<struct pair*>(malloc(capacity * sizeof(*pairs)));
+            if (pairs)
+                memcpy(pairs, str_parms->pairs, str_parms->count * sizeof(*pairs));
+        } else {
+            pairs = static_cast<struct pair*>(realloc(str_parms->pairs, capacity * sizeof(*pairs)));
+        }
+        if (!pairs)
+            return -ENOMEM;
+        str_parms->pairs = pairs;
+        str_parms->capacity = capacity;
+    }
+
+    pair = &str_parms->pairs[str_parms->count++];
+    pair->key = key;
+    pair->hash = str_hash_fn(key, &pair->key_len);
+    pair->value = value;
+    pair->value_len = value_len;
+    pair->value_size = value_len;
+    return 0;
 }
 
-void str_parms_destroy(struct str_parms *str_parms)
+/* Copies str into the arena. */
+static char *arena_strdup(struct str_parms *str_parms, const char *str, size_t len)
 {
-    struct remove_ctxt ctxt = {
-        .str_parms = str_parms,
-    };
+    struct arena_chunk *chunk = str_parms->arena;
+    if (!chunk || chunk->size - chunk->used < len + 1) {
+        size_t size = len + 1 > MIN_CHUNK_SIZE ? len + 1 : MIN_CHUNK_SIZE;
+        chunk = static_cast<struct arena_chunk*>(malloc(sizeof(*chunk) + size));
+        if (!chunk)
+            return NULL;
+        chunk->next = str_parms->arena;
+        chunk->used = 0;
+        chunk->size = size;
+        str_parms->arena = chunk;
+    }
 
-    hashmapForEach(str_parms->map, remove_pair, &ctxt);
-    hashmapFree(str_parms->map);
-    free(str_parms);
+    char *copy = chunk->data + chunk->used;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    chunk->used += len + 1;
+    return copy;
+}
+
+void str_parms_del(struct str_parms *str_parms, const char *key)
+{
+    struct pair *pair = find_pair(str_parms, key);
+    if (!pair)
+        return;
+
+    size_t index = pair - str_parms->pairs;
+    memmove(pair, pair + 1, (str_parms->count - index - 1) * sizeof(*pair));
+    str_parms->count--;
 }
 
 struct str_parms *str_parms_create_str(const char *_string)
 {
     struct str_parms *str_parms;
     char *str;
-    char *kvpair;
-    char *tmpstr;
+    char *end;
     int items = 0;
 
-    str_parms = str_parms_create();
+    size_t size = strlen(_string) + 1;
+    str_parms = str_parms_alloc(size);
     if (!str_parms)
-        goto err_create_str_parms;
+        return NULL;
 
-    str = strdup(_string);
-    if (!str)
-        goto err_strdup;
+    str = str_parms->input;
+    memcpy(str, _string, size);
+    end = str + size - 1;
 
     ALOGV("%s: source string == '%s'\n", __func__, _string);
 
-    kvpair = strtok_r(str, ";", &tmpstr);
-    while (kvpair && *kvpair) {
-        char *eq = strchr(kvpair, '='); /* would love strchrnul */
-        char *value;
-        char *key;
-        void *old_val;
-
+    /* Same tokenization as strtok_r(str, ";"): empty pairs are skipped. */
+    while (str < end) {
+        char *kvpair = str;
+        char *kvend = static_cast<char*>(memchr(kvpair, ';', end - kvpair));
+        if (!kvend)
+            kvend = end;
+        *kvend = '\0';
+        str = kvend + 1;
+        if (kvpair == kvend)
+            continue;
+
+        char *eq = static_cast<char*>(memchr(kvpair, '=', kvend - kvpair));
         if (eq == kvpair)
-            goto next_pair;
+            continue;
 
+        /* Point a missing value at the terminator, so that it can be rewritten like any other. */
+        const char *value = kvend;
+        size_t value_len = 0;
         if (eq) {
-            key = strndup(kvpair, eq - kvpair);
-            if (*(++eq))
-                value = strdup(eq);
-            else
-                value = strdup("");
-        } else {
-            key = strdup(kvpair);
-            value = strdup("");
+            *eq = '\0';
+            value = eq + 1;
+            value_len = kvend - value;
         }
 
-        /* if we replaced a value, free it */
-        old_val = hashmapPut(str_parms->map, key, value);
-        RELEASE_OWNERSHIP(value);
-        if (old_val) {
-            free(old_val);
-            free(key);
-        } else {
-            RELEASE_OWNERSHIP(key);
+        if (put_pair(str_parms, kvpair, value, value_len)) {
+            str_parms_destroy(str_parms);
+            return NULL;
         }
-
         items++;
-next_pair:
-        kvpair = strtok_r(NULL, ";", &tmpstr);
     }
 
     if (!items)
         ALOGV("%s: no items found in string\n", __func__);
 
-    free(str);
-
     return str_parms;
-
-err_strdup:
-    str_parms_destroy(str_parms);
-err_create_str_parms:
-    return NULL;
 }
 
 int str_parms_add_str(struct str_parms *str_parms, const char *key,
                       const char *value)
 {
-    void *tmp_key = NULL;
-    void *tmp_val = NULL;
-    void *old_val = NULL;
-
-    // strdup and hashmapPut both set errno on failure.
-    // Set errno to 0 so we can recognize whether anything went wrong.
-    int saved_errno = errno;
-    errno = 0;
-
-    tmp_key = strdup(key);
-    if (tmp_key == NULL) {
-        goto clean_up;
-    }
-
-    tmp_val = strdup(value);
-    if (tmp_val == NULL) {
-        goto clean_up;
+    struct pair *pair = find_pair(str_parms, key);
+    const char *tmp_key = pair ? pair->key : NULL;
+    size_t value_len = strlen(value);
+
+    if (pair && value_len <= pair->value_size) {
+        /* Every value lives in memory owned by str_parms, so the old space can be reused. */
+        char *slot = const_cast<char*>(pair->value);
+        memmove(slot, value, value_len);
+        slot[value_len] = '\0';
+        pair->value_len = value_len;
+        return 0;
     }
 
-    old_val = hashmapPut(str_parms->map, tmp_key, tmp_val);
-    if (old_val == NULL) {
-        // Did hashmapPut fail?
-        if (errno == ENOMEM) {
-            goto clean_up;
-        }
-        // For new keys, hashmap takes ownership of tmp_key and tmp_val.
-        RELEASE_OWNERSHIP(tmp_key);
-        RELEASE_OWNERSHIP(tmp_val);
-        tmp_key = tmp_val = NULL;
-    } else {
-        // For existing keys, hashmap takes ownership of tmp_val.
-        // (It also gives up ownership of old_val.)
-        RELEASE_OWNERSHIP(tmp_val);
-        tmp_val = NULL;
-    }
+    if (!tmp_key)
+        tmp_key = arena_strdup(str_parms, key, strlen(key));
+    const char *tmp_val = tmp_key ? arena_strdup(str_parms, value, value_len) : NULL;
+    if (!tmp_val)
+        return -ENOMEM;
 
-clean_up:
-    free(tmp_key);
-    free(tmp_val);
-    free(old_val);
-    int result = -errno;
-    errno = saved_errno;
-    return result;
+    return put_pair(str_parms, tmp_key, tmp_val, value_len);
 }
 
 int str_parms_add_int(struct str_parms *str_parms, const char *key, int value)
@@ -279,16 +306,15 @@ int str_parms_add_float(struct str_parms *str_parms, const char *key,
 }
 
 int str_parms_has_key(struct str_parms *str_parms, const char *key) {
-    return hashmapGet(str_parms->map, (void *)key) != NULL;
+    return find_pair(str_parms, key) != NULL;
 }
 
 int str_parms_get_str(struct str_parms *str_parms, const char *key, char *val,
                       int len)
 {
-    // TODO: hashmapGet should take a const* key.
-    char* value = static_cast<char*>(hashmapGet(str_parms->map, (void*)key));
-    if (value)
-        return strlcpy(val, value, len);
+    struct pair *pair = find_pair(str_parms, key);
+    if (pair)
+        return strlcpy(val, pair->value, len);
 
     return -ENOENT;
 }
@@ -297,11 +323,11 @@ int str_parms_get_int(struct str_parms *str_parms, const char *key, int *val)
 {
     char *end;
 
-    // TODO: hashmapGet should take a const* key.
-    char* value = static_cast<char*>(hashmapGet(str_parms->map, (void*)key));
-    if (!value)
+    struct pair *pair = find_pair(str_parms, key);
+    if (!pair)
         return -ENOENT;
 
+    const char *value = pair->value;
     *val = (int)strtol(value, &end, 0);
     if (*value != '\0' && *end == '\0')
         return 0;
@@ -315,11 +341,11 @@ int str_parms_get_float(struct str_parms *str_parms, const char *key,
     float out;
     char *end;
 
-    // TODO: hashmapGet should take a const* key.
-    char* value = static_cast<char*>(hashmapGet(str_parms->map, (void*)(key)));
-    if (!value)
+    struct pair *pair = find_pair(str_parms, key);
+    if (!pair)
         return -ENOENT;
 
+    const char *value = pair->value;
     out = strtof(value, &end);
     if (*value == '\0' || *end != '\0')
         return -EINVAL;
@@ -328,42 +354,34 @@ int str_parms_get_float(struct str_parms *str_parms, const char *key,
     return 0;
 }
 
-static bool combine_strings(void *key, void *value, void *context)
-{
-    char** old_str = static_cast<char**>(context);
-    char *new_str;
-    int ret;
-
-    ret = asprintf(&new_str, "%s%s%s=%s",
-                   *old_str ? *old_str : "",
-                   *old_str ? ";" : "",
-                   (char *)key,
-                   (char *)value);
-    if (*old_str)
-        free(*old_str);
-
-    if (ret >= 0) {
-        *old_str = new_str;
-        return true;
-    }
-
-    *old_str = NULL;
-    return false;
-}
-
 char *str_parms_to_str(struct str_parms *str_parms)
 {
-    char *str = NULL;
-    hashmapForEach(str_parms->map, combine_strings, &str);
-    return (str != NULL) ? str : strdup("");
-}
+    /* "key=value" for every pair, ';' between pairs, and the terminating NUL. */
+    size_t size = 1;
+    for (size_t i = 0; i < str_parms->count; i++)
+        size += str_parms->pairs[i].key_len + 1 + str_parms->pairs[i].value_len + (i ? 1 : 0);
 
-static bool dump_entry(void* key, void* value, void* /*context*/) {
-    ALOGI("key: '%s' value: '%s'\n", (char *)key, (char *)value);
-    return true;
+    char *str = static_cast<char*>(malloc(size));
+    if (!str)
+        return NULL;
+
+    char *p = str;
+    for (size_t i = 0; i < str_parms->count; i++) {
+        const struct pair *pair = &str_parms->pairs[i];
+        if (i)
+            *p++ = ';';
+        memcpy(p, pair->key, pair->key_len);
+        p += pair->key_len;
+        *p++ = '=';
+        memcpy(p, pair->value, pair->value_len);
+        p += pair->value_len;
+    }
+    *p = '\0';
+    return str;
 }
 
 void str_parms_dump(struct str_parms *str_parms)
 {
-    hashmapForEach(str_parms->map, dump_entry, str_parms);
+    for (size_t i = 0; i < str_parms->count; i++)
+        ALOGI("key: '%s' value: '%s'\n", str_parms->pairs[i].key, str_parms->pairs[i].value);
 }
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <benchmark/benchmark.h>
+#include <cutils/str_parms.h>
+
+// Counts heap allocations by interposing the allocator. Only glibc exports the __libc_*
+// entry points to forward to, so elsewhere the allocs_per_op counter is left out.
+#if defined(__GLIBC__)
+#define COUNT_ALLOCATIONS 1
+static size_t allocations;
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t n, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+extern "C" void* malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size) {
+    allocations++;
+    return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void* ptr) {
+    __libc_free(ptr);
+}
+#endif
+
+static void ReportAllocations(benchmark::State& state, size_t start) {
+#if defined(COUNT_ALLOCATIONS)
+    state.counters["allocs_per_op"] =
+            static_cast<double>(allocations - start) / static_cast<double>(state.iterations());
+#else
+    (void)state;
+    (void)start;
+#endif
+}
+
+static size_t Allocations() {
+#if defined(COUNT_ALLOCATIONS)
+    return allocations;
+#else
+    return 0;
+#endif
+}
+
+// A typical audio HAL set_parameters() string.
+static const char kParameters[] =
+        "routing=2;connect=4;bt_headset_name=Headset;bt_headset_nrec=on;bt_wbs=on;"
+        "screen_state=on;rotation=90;g_sco_samplerate=16000;tty_mode=tty_off;"
+        "A2dpSuspended=false";
+
+static void BM_str_parms_create_str(benchmark::State& state) {
+    size_t start = Allocations();
+    for (auto _ : state) {
+        str_parms* parms = str_parms_create_str(kParameters);
+        benchmark::DoNotOptimize(parms);
+        str_parms_destroy(parms);
+    }
+    ReportAllocations(state, start);
+}
+BENCHMARK(BM_str_parms_create_str);
+
+static void BM_str_parms_get(benchmark::State& state) {
+    str_parms* parms = str_parms_create_str(kParameters);
+    char value[32];
+    int i;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(str_parms_get_str(parms, "bt_headset_name", value, sizeof(value)));
+        benchmark::DoNotOptimize(str_parms_get_int(parms, "rotation", &i));
+        benchmark::DoNotOptimize(str_parms_has_key(parms, "missing"));
+    }
+    str_parms_destroy(parms);
+}
+BENCHMARK(BM_str_parms_get);
+
+static void BM_str_parms_add_to_str(benchmark::State& state) {
+    size_t start = Allocations();
+    for (auto _ : state) {
+        str_parms* parms = str_parms_create();
+        str_parms_add_str(parms, "routing", "2");
+        str_parms_add_int(parms, "rotation", 90);
+        str_parms_add_float(parms, "volume", 0.5f);
+        str_parms_add_str(parms, "bt_headset_name", "Headset");
+        char* str = str_parms_to_str(parms);
+        benchmark::DoNotOptimize(str);
+        free(str);
+        str_parms_destroy(parms);
+    }
+    ReportAllocations(state, start);
+}
+BENCHMARK(BM_str_parms_add_to_str);
+
+static void BM_str_parms_to_str(benchmark::State& state) {
+    str_parms* parms = str_parms_create_str(kParameters);
+    size_t start = Allocations();
+    for (auto _ : state) {
+        char* str = str_parms_to_str(parms);
+        benchmark::DoNotOptimize(str);
+        free(str);
+    }
+    ReportAllocations(state, start);
+    str_parms_destroy(parms);
+}
+BENCHMARK(BM_str_parms_to_str);
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include <cutils/str_parms.h>
+#include <fuzzer/FuzzedDataProvider.h>
+
+// Parses the input, mutates it, and checks that serializing and parsing again round-trips.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t length) {
+    FuzzedDataProvider provider(data, length);
+    // The C API sees everything up to the first NUL.
+    std::string key = provider.ConsumeRandomLengthString(16).c_str();
+    std::string value = provider.ConsumeRandomLengthString(16).c_str();
+    std::string contents = provider.ConsumeRemainingBytesAsString();
+
+    str_parms* str_parms = str_parms_create_str(contents.c_str());
+    if (str_parms == nullptr) return 0;
+
+    char buf[64];
+    int i;
+    float f;
+    str_parms_get_str(str_parms, key.c_str(), buf, sizeof(buf));
+    str_parms_get_int(str_parms, key.c_str(), &i);
+    str_parms_get_float(str_parms, key.c_str(), &f);
+
+    // Keys containing ';' or '=' or starting with '=' can't survive a round trip.
+    bool round_trips = key.find_first_of(";=") == std::string::npos && !key.empty() &&
+                       value.find(';') == std::string::npos;
+    if (round_trips) {
+        str_parms_add_str(str_parms, key.c_str(), value.c_str());
+        if (str_parms_get_str(str_parms, key.c_str(), buf, sizeof(buf)) < 0) abort();
+    } else {
+        str_parms_del(str_parms, key.c_str());
+    }
+
+    char* str = str_parms_to_str(str_parms);
+    struct str_parms* reparsed = str_parms_create_str(str);
+    char* restr = str_parms_to_str(reparsed);
+    if (strcmp(str, restr) != 0) abort();
+
+    free(restr);
+    free(str);
+    str_parms_destroy(reparsed);
+    str_parms_destroy(str_parms);
+    return 0;
+}
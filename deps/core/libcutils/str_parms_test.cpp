@@ -55,3 +55,76 @@ TEST(str_parms, put_ENOMEM) {
     ASSERT_EQ(ENOMEM, errno);
     test_str_parms_str("foo=bar;baz=", "foo=bar;baz=");
 }
+
+TEST(str_parms, get_and_add) {
+    str_parms* str_parms = str_parms_create_str("a=1;b=2.5;c;d=x=y");
+    ASSERT_NE(nullptr, str_parms);
+
+    char value[16];
+    EXPECT_EQ(1, str_parms_get_str(str_parms, "a", value, sizeof(value)));
+    EXPECT_STREQ("1", value);
+    EXPECT_EQ(0, str_parms_get_str(str_parms, "c", value, sizeof(value)));
+    EXPECT_STREQ("", value);
+    EXPECT_EQ(3, str_parms_get_str(str_parms, "d", value, sizeof(value)));
+    EXPECT_STREQ("x=y", value);
+    EXPECT_EQ(-ENOENT, str_parms_get_str(str_parms, "e", value, sizeof(value)));
+
+    int i;
+    EXPECT_EQ(0, str_parms_get_int(str_parms, "a", &i));
+    EXPECT_EQ(1, i);
+    EXPECT_EQ(-EINVAL, str_parms_get_int(str_parms, "b", &i));
+    float f;
+    EXPECT_EQ(0, str_parms_get_float(str_parms, "b", &f));
+    EXPECT_EQ(2.5f, f);
+
+    // Enough new keys to outgrow the inline pair table, and replacements of existing ones.
+    for (int n = 0; n < 100; ++n) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", n);
+        ASSERT_EQ(0, str_parms_add_int(str_parms, key, n));
+        ASSERT_EQ(0, str_parms_add_int(str_parms, "a", n));
+    }
+    EXPECT_TRUE(str_parms_has_key(str_parms, "key99"));
+    EXPECT_EQ(0, str_parms_get_int(str_parms, "key42", &i));
+    EXPECT_EQ(42, i);
+    EXPECT_EQ(0, str_parms_get_int(str_parms, "a", &i));
+    EXPECT_EQ(99, i);
+
+    str_parms_del(str_parms, "b");
+    EXPECT_FALSE(str_parms_has_key(str_parms, "b"));
+
+    char* out_str = str_parms_to_str(str_parms);
+    ASSERT_EQ(0, strncmp("a=99;c=;d=x=y;key0=0;key1=1;", out_str, 28)) << out_str;
+    free(out_str);
+    str_parms_destroy(str_parms);
+}
+
+TEST(str_parms, replace_values) {
+    str_parms* str_parms = str_parms_create_str("a=123;b;c=x");
+    ASSERT_NE(nullptr, str_parms);
+
+    // Shorter and longer values, for both parsed and added pairs, must not disturb their
+    // neighbors wherever the old value was kept.
+    ASSERT_EQ(0, str_parms_add_str(str_parms, "a", "9"));
+    ASSERT_EQ(0, str_parms_add_str(str_parms, "b", ""));
+    ASSERT_EQ(0, str_parms_add_str(str_parms, "c", "long value"));
+    ASSERT_EQ(0, str_parms_add_str(str_parms, "d", "1234"));
+    char* out_str = str_parms_to_str(str_parms);
+    EXPECT_STREQ("a=9;b=;c=long value;d=1234", out_str);
+    free(out_str);
+
+    ASSERT_EQ(0, str_parms_add_str(str_parms, "a", "12"));
+    ASSERT_EQ(0, str_parms_add_str(str_parms, "a", "1234"));
+    ASSERT_EQ(0, str_parms_add_str(str_parms, "b", "set"));
+    ASSERT_EQ(0, str_parms_add_str(str_parms, "c", "short"));
+    ASSERT_EQ(0, str_parms_add_str(str_parms, "d", ""));
+    char value[16];
+    EXPECT_EQ(4, str_parms_get_str(str_parms, "a", value, sizeof(value)));
+    EXPECT_STREQ("1234", value);
+    EXPECT_EQ(5, str_parms_get_str(str_parms, "c", value, sizeof(value)));
+    EXPECT_STREQ("short", value);
+    out_str = str_parms_to_str(str_parms);
+    EXPECT_STREQ("a=1234;b=set;c=short;d=", out_str);
+    free(out_str);
+    str_parms_destroy(str_parms);
+}
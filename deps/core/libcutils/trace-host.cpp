@@ -16,26 +16,430 @@
 
 #include <cutils/trace.h>
 
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+/*
+ * On the host there is no trace_marker to write to, so events are recorded in
+ * per-thread buffers and written out as a Chrome JSON trace (which Perfetto's
+ * UI and trace_processor both load) when the process exits.
+ *
+ * Tracing is off unless ATRACE_HOST_OUTPUT names the file to write. Any "%p"
+ * in that name is replaced by the pid, which is how to trace a process that
+ * forks: without "%p", a forked child stops tracing rather than overwrite its
+ * parent's output. ATRACE_HOST_TAGS optionally restricts tracing to a mask of
+ * ATRACE_TAG_* values (default: all of them).
+ *
+ * Each thread appends to its own chain of chunks and publishes each record
+ * with a release store, so recording takes no locks; only registering a new
+ * thread or chunk touches shared state. The trace is written at exit() (not
+ * _exit()), and events recorded by other threads while it is being written
+ * may be left out.
+ */
+
 atomic_bool             atrace_is_ready      = true;
 int                     atrace_marker_fd     = -1;
-uint64_t                atrace_enabled_tags  = 0;
+uint64_t                atrace_enabled_tags  = ATRACE_TAG_NOT_READY;
+
+namespace {
+
+enum EventType : uint8_t {
+    kBegin,
+    kEnd,
+    kAsyncBegin,
+    kAsyncEnd,
+    kInstant,
+    kCounter,
+};
+
+struct EventHeader {
+    uint64_t timestamp_ns;
+    int64_t value;  // The cookie of async events, or a counter's value.
+    uint16_t name_size;
+    uint16_t track_size;
+    EventType type;
+    // Followed by the name and then the track name, neither NUL-terminated.
+};
+
+// Longer names are truncated.
+constexpr size_t kMaxNameSize = 1024;
+
+struct alignas(8) TraceChunk {
+    static constexpr size_t kDataSize = 64 * 1024 - 2 * sizeof(void*);
+
+    std::atomic<TraceChunk*> next{nullptr};
+    std::atomic<size_t> used{0};
+    char data[kDataSize];
+};
+
+struct ThreadBuffer {
+    ThreadBuffer* next_thread = nullptr;
+    uint64_t tid = 0;
+    TraceChunk* head = nullptr;
+    TraceChunk* tail = nullptr;  // Only touched by the owning thread.
+};
+
+// Recording stops (and drops are counted) once this much has been buffered.
+constexpr size_t kMaxTraceBytes = 256 * 1024 * 1024;
+
+std::once_flag g_init_once;
+const char* g_output_path;
+bool g_output_has_pid;
+uint64_t g_configured_tags;
+
+std::atomic<ThreadBuffer*> g_threads;
+std::atomic<size_t> g_buffered_bytes;
+std::atomic<uint64_t> g_dropped_events;
+// Bumped in a forked child so that threads notice their buffer is stale.
+std::atomic<uint32_t> g_generation;
+
+thread_local ThreadBuffer* t_buffer;
+thread_local uint32_t t_generation;
+
+uint64_t GetTid() {
+#if defined(__linux__)
+    return syscall(__NR_gettid);
+#elif defined(__APPLE__)
+    uint64_t tid;
+    pthread_threadid_np(nullptr, &tid);
+    return tid;
+#elif defined(_WIN32)
+    return GetCurrentThreadId();
+#else
+    return 0;
+#endif
+}
+
+uint64_t GetPid() {
+#if defined(_WIN32)
+    return GetCurrentProcessId();
+#else
+    return getpid();
+#endif
+}
+
+// CLOCK_MONOTONIC on Linux, which is the clock Perfetto uses for host traces.
+uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+TraceChunk* NewChunk() {
+    if (g_buffered_bytes.fetch_add(sizeof(TraceChunk), std::memory_order_relaxed) +
+                sizeof(TraceChunk) > kMaxTraceBytes) {
+        return nullptr;
+    }
+    return new TraceChunk;
+}
+
+ThreadBuffer* GetThreadBuffer() {
+    uint32_t generation = g_generation.load(std::memory_order_relaxed);
+    if (CC_LIKELY(t_buffer != nullptr && t_generation == generation)) {
+        return t_buffer;
+    }
+
+    TraceChunk* chunk = NewChunk();
+    if (chunk == nullptr) return nullptr;
+
+    // Buffers are never freed: the trace is written after threads are gone.
+    ThreadBuffer* buffer = new ThreadBuffer;
+    buffer->tid = GetTid();
+    buffer->head = buffer->tail = chunk;
+    ThreadBuffer* head = g_threads.load(std::memory_order_relaxed);
+    do {
+        buffer->next_thread = head;
+    } while (!g_threads.compare_exchange_weak(head, buffer, std::memory_order_release,
+                                              std::memory_order_relaxed));
+    t_buffer = buffer;
+    t_generation = generation;
+    return buffer;
+}
+
+void RecordEvent(EventType type, const char* name, const char* track, int64_t value) {
+    // Without an output path nothing writes the events out, so don't buffer them.
+    if (g_output_path == nullptr) return;
+
+    uint64_t now = NowNs();
+    size_t name_size = name != nullptr ? strnlen(name, kMaxNameSize) : 0;
+    size_t track_size = track != nullptr ? strnlen(track, kMaxNameSize) : 0;
+    size_t record_size = (sizeof(EventHeader) + name_size + track_size + 7) & ~size_t{7};
+
+    ThreadBuffer* buffer = GetThreadBuffer();
+    if (buffer == nullptr) {
+        g_dropped_events.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    TraceChunk* chunk = buffer->tail;
+    size_t used = chunk->used.load(std::memory_order_relaxed);
+    if (CC_UNLIKELY(used + record_size > TraceChunk::kDataSize)) {
+        TraceChunk* next = NewChunk();
+        if (next == nullptr) {
+            g_dropped_events.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        chunk->next.store(next, std::memory_order_release);
+        buffer->tail = chunk = next;
+        used = 0;
+    }
+
+    char* p = chunk->data + used;
+    EventHeader header = {now, value, static_cast<uint16_t>(name_size),
+                          static_cast<uint16_t>(track_size), type};
+    memcpy(p, &header, sizeof(header));
+    if (name_size != 0) memcpy(p + sizeof(header), name, name_size);
+    if (track_size != 0) memcpy(p + sizeof(header) + name_size, track, track_size);
+    chunk->used.store(used + record_size, std::memory_order_release);
+}
+
+void AppendJsonString(std::string* out, const char* s, size_t size) {
+    out->push_back('"');
+    for (size_t i = 0; i < size; ++i) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            out->push_back('\\');
+            out->push_back(c);
+        } else if (c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out->append(escape);
+        } else {
+            out->push_back(c);
+        }
+    }
+    out->push_back('"');
+}
+
+void AppendEvent(std::string* out, uint64_t pid, uint64_t tid, const EventHeader& event,
+                 const char* name, const char* track) {
+    char buf[128];
+    static const char* const kPhases[] = {"B", "E", "b", "e", "i", "C"};
+    snprintf(buf, sizeof(buf), "{\"ph\":\"%s\",\"pid\":%" PRIu64 ",\"tid\":%" PRIu64
+             ",\"ts\":%" PRIu64 ".%03u", kPhases[event.type], pid, tid,
+             event.timestamp_ns / 1000, static_cast<unsigned>(event.timestamp_ns % 1000));
+    out->append(buf);
+
+    if (event.type != kEnd) {
+        out->append(",\"name\":");
+        // atrace_async_for_track_end() only knows the track; use it as the name.
+        if (event.name_size == 0 && event.track_size != 0) {
+            AppendJsonString(out, track, event.track_size);
+        } else {
+            AppendJsonString(out, name, event.name_size);
+        }
+    }
+    if (event.type == kAsyncBegin || event.type == kAsyncEnd) {
+        // Async events pair up by category and id, so each track is a category.
+        out->append(",\"cat\":");
+        if (event.track_size != 0) {
+            AppendJsonString(out, track, event.track_size);
+        } else {
+            out->append("\"atrace\"");
+        }
+        snprintf(buf, sizeof(buf), ",\"id\":%" PRId64, event.value);
+        out->append(buf);
+    } else if (event.type == kInstant) {
+        out->append(",\"s\":\"t\"");
+        if (event.track_size != 0) {
+            out->append(",\"args\":{\"track\":");
+            AppendJsonString(out, track, event.track_size);
+            out->push_back('}');
+        }
+    } else if (event.type == kCounter) {
+        snprintf(buf, sizeof(buf), ",\"args\":{\"value\":%" PRId64 "}", event.value);
+        out->append(buf);
+    }
+    out->append("},\n");
+}
+
+const char* ProcessName() {
+#if defined(__APPLE__) || defined(__BIONIC__)
+    return getprogname();
+#elif defined(__GLIBC__)
+    return program_invocation_short_name;
+#else
+    return "";
+#endif
+}
+
+std::string OutputPath() {
+    std::string path;
+    for (const char* p = g_output_path; *p != '\0'; ++p) {
+        if (p[0] == '%' && p[1] == 'p') {
+            path += std::to_string(GetPid());
+            ++p;
+        } else {
+            path.push_back(*p);
+        }
+    }
+    return path;
+}
+
+void WriteTrace(FILE* fp) {
+    uint64_t pid = GetPid();
+    std::string out = "{\"traceEvents\":[\n";
+    for (ThreadBuffer* buffer = g_threads.load(std::memory_order_acquire); buffer != nullptr;
+         buffer = buffer->next_thread) {
+        for (TraceChunk* chunk = buffer->head; chunk != nullptr;
+             chunk = chunk->next.load(std::memory_order_acquire)) {
+            size_t used = chunk->used.load(std::memory_order_acquire);
+            for (size_t offset = 0; offset < used;) {
+                EventHeader event;
+                memcpy(&event, chunk->data + offset, sizeof(event));
+                const char* name = chunk->data + offset + sizeof(event);
+                AppendEvent(&out, pid, buffer->tid, event, name, name + event.name_size);
+                offset += (sizeof(event) + event.name_size + event.track_size + 7) & ~size_t{7};
+            }
+            fwrite(out.data(), 1, out.size(), fp);
+            out.clear();
+        }
+    }
+    char buf[128];
+    snprintf(buf, sizeof(buf),
+             "{\"ph\":\"M\",\"pid\":%" PRIu64 ",\"name\":\"process_name\",\"args\":{\"name\":",
+             pid);
+    out.append(buf);
+    const char* process_name = ProcessName();
+    AppendJsonString(&out, process_name, strlen(process_name));
+    snprintf(buf, sizeof(buf), "}}\n],\"metadata\":{\"atrace-dropped-events\":%" PRIu64 "}}\n",
+             g_dropped_events.load(std::memory_order_relaxed));
+    out.append(buf);
+    fwrite(out.data(), 1, out.size(), fp);
+}
+
+void WriteTraceAtExit() {
+    if (g_output_path == nullptr) return;
+    std::string path = OutputPath();
+    FILE* fp = fopen(path.c_str(), "w");
+    if (fp == nullptr) {
+        fprintf(stderr, "atrace: couldn't open %s: %s\n", path.c_str(), strerror(errno));
+        return;
+    }
+    WriteTrace(fp);
+    fclose(fp);
+}
+
+#if !defined(_WIN32)
+void ResetInForkedChild() {
+    if (g_output_path == nullptr) return;
+    if (!g_output_has_pid) {
+        g_output_path = nullptr;
+        __atomic_store_n(&atrace_enabled_tags, 0, __ATOMIC_RELAXED);
+        return;
+    }
+    // The parent's buffers are abandoned; the child only writes its own events.
+    g_threads.store(nullptr, std::memory_order_relaxed);
+    g_buffered_bytes.store(0, std::memory_order_relaxed);
+    g_dropped_events.store(0, std::memory_order_relaxed);
+    g_generation.fetch_add(1, std::memory_order_relaxed);
+}
+#endif
+
+void InitHostTracing() {
+    const char* output = getenv("ATRACE_HOST_OUTPUT");
+    if (output == nullptr || *output == '\0') {
+        __atomic_store_n(&atrace_enabled_tags, 0, __ATOMIC_RELEASE);
+        return;
+    }
+    g_output_path = strdup(output);
+    g_output_has_pid = strstr(output, "%p") != nullptr;
+
+    g_configured_tags = ATRACE_TAG_VALID_MASK;
+    const char* tags = getenv("ATRACE_HOST_TAGS");
+    if (tags != nullptr && *tags != '\0') {
+        g_configured_tags = strtoull(tags, nullptr, 0) & ATRACE_TAG_VALID_MASK;
+    }
+
+    atexit(WriteTraceAtExit);
+#if !defined(_WIN32)
+    pthread_atfork(nullptr, nullptr, ResetInForkedChild);
+#endif
+    __atomic_store_n(&atrace_enabled_tags, g_configured_tags, __ATOMIC_RELEASE);
+}
+
+}  // namespace
+
+void atrace_set_tracing_enabled(bool enabled) {
+    atrace_init();
+    if (g_output_path == nullptr) return;
+    __atomic_store_n(&atrace_enabled_tags, enabled ? g_configured_tags : 0, __ATOMIC_RELAXED);
+}
 
-void atrace_set_tracing_enabled(bool /*enabled*/) {}
 void atrace_update_tags() { }
-void atrace_setup() { }
-void atrace_begin_body(const char* /*name*/) {}
-void atrace_end_body() { }
-void atrace_async_begin_body(const char* /*name*/, int32_t /*cookie*/) {}
-void atrace_async_end_body(const char* /*name*/, int32_t /*cookie*/) {}
-void atrace_async_for_track_begin_body(const char* /*track_name*/, const char* /*name*/,
-                                       int32_t /*cookie*/) {}
-void atrace_async_for_track_end_body(const char* /*track_name*/, int32_t /*cookie*/) {}
-void atrace_instant_body(const char* /*name*/) {}
-void atrace_instant_for_track_body(const char* /*track_name*/, const char* /*name*/) {}
-void atrace_int_body(const char* /*name*/, int32_t /*value*/) {}
-void atrace_int64_body(const char* /*name*/, int64_t /*value*/) {}
-void atrace_init() {}
+
+void atrace_setup() {
+    atrace_init();
+}
+
+void atrace_begin_body(const char* name) {
+    RecordEvent(kBegin, name, nullptr, 0);
+}
+
+void atrace_end_body() {
+    RecordEvent(kEnd, nullptr, nullptr, 0);
+}
+
+void atrace_async_begin_body(const char* name, int32_t cookie) {
+    RecordEvent(kAsyncBegin, name, nullptr, cookie);
+}
+
+void atrace_async_end_body(const char* name, int32_t cookie) {
+    RecordEvent(kAsyncEnd, name, nullptr, cookie);
+}
+
+void atrace_async_for_track_begin_body(const char* track_name, const char* name, int32_t cookie) {
+    RecordEvent(kAsyncBegin, name, track_name, cookie);
+}
+
+void atrace_async_for_track_end_body(const char* track_name, int32_t cookie) {
+    RecordEvent(kAsyncEnd, nullptr, track_name, cookie);
+}
+
+void atrace_instant_body(const char* name) {
+    RecordEvent(kInstant, name, nullptr, 0);
+}
+
+void atrace_instant_for_track_body(const char* track_name, const char* name) {
+    RecordEvent(kInstant, name, track_name, 0);
+}
+
+void atrace_int_body(const char* name, int32_t value) {
+    RecordEvent(kCounter, name, nullptr, value);
+}
+
+void atrace_int64_body(const char* name, int64_t value) {
+    RecordEvent(kCounter, name, nullptr, value);
+}
+
+void atrace_init() {
+    std::call_once(g_init_once, InitHostTracing);
+}
+
 uint64_t atrace_get_enabled_tags()
 {
-    return ATRACE_TAG_NOT_READY;
+    // The only cost when tracing is off: this load and the caller's test.
+    uint64_t tags = __atomic_load_n(&atrace_enabled_tags, __ATOMIC_ACQUIRE);
+    if (CC_UNLIKELY(tags == ATRACE_TAG_NOT_READY)) {
+        atrace_init();
+        tags = __atomic_load_n(&atrace_enabled_tags, __ATOMIC_ACQUIRE);
+    }
+    return tags;
 }
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/trace.h>
+
+#include <stdlib.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+// Tracing is configured once per process from the environment, so each test
+// sets it up in a freshly exec'd child and inspects the trace the child wrote.
+// The child re-runs the fixture, so the output path is passed down in the
+// environment rather than taken from its own TemporaryFile.
+class TraceHostTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        GTEST_FLAG_SET(death_test_style, "threadsafe");
+        const char* inherited = getenv("TRACE_HOST_TEST_OUTPUT");
+        if (inherited != nullptr) {
+            path_ = inherited;
+        } else {
+            path_ = tmp_file_.path;
+            setenv("TRACE_HOST_TEST_OUTPUT", tmp_file_.path, 1);
+        }
+    }
+
+    void TearDown() override { unsetenv("TRACE_HOST_TEST_OUTPUT"); }
+
+    std::string ReadTrace() {
+        std::string trace;
+        EXPECT_TRUE(android::base::ReadFileToString(path_, &trace));
+        return trace;
+    }
+
+    static size_t Count(const std::string& haystack, const std::string& needle) {
+        size_t count = 0;
+        for (size_t pos = haystack.find(needle); pos != std::string::npos;
+             pos = haystack.find(needle, pos + 1)) {
+            ++count;
+        }
+        return count;
+    }
+
+    TemporaryFile tmp_file_;
+    std::string path_;
+};
+
+TEST_F(TraceHostTest, disabled_without_output) {
+    EXPECT_EXIT(
+            {
+                unsetenv("ATRACE_HOST_OUTPUT");
+                atrace_begin(ATRACE_TAG_ALWAYS, "ignored");
+                atrace_end(ATRACE_TAG_ALWAYS);
+                exit(atrace_get_enabled_tags() == 0 ? 0 : 1);
+            },
+            ::testing::ExitedWithCode(0), "");
+}
+
+TEST_F(TraceHostTest, writes_chrome_json) {
+    EXPECT_EXIT(
+            {
+                setenv("ATRACE_HOST_OUTPUT", path_.c_str(), 1);
+                atrace_begin(ATRACE_TAG_ALWAYS, "outer \"quoted\"");
+                atrace_begin(ATRACE_TAG_ALWAYS, "inner");
+                atrace_end(ATRACE_TAG_ALWAYS);
+                atrace_end(ATRACE_TAG_ALWAYS);
+                atrace_async_begin(ATRACE_TAG_ALWAYS, "async", 42);
+                atrace_async_end(ATRACE_TAG_ALWAYS, "async", 42);
+                atrace_async_for_track_begin(ATRACE_TAG_ALWAYS, "track", "on-track", 7);
+                atrace_async_for_track_end(ATRACE_TAG_ALWAYS, "track", 7);
+                atrace_instant(ATRACE_TAG_ALWAYS, "instant");
+                atrace_int(ATRACE_TAG_ALWAYS, "counter", 123);
+                atrace_int64(ATRACE_TAG_ALWAYS, "counter64", 1LL << 40);
+                exit(0);
+            },
+            ::testing::ExitedWithCode(0), "");
+
+    std::string trace = ReadTrace();
+    EXPECT_EQ(0u, trace.find("{\"traceEvents\":[\n")) << trace;
+    EXPECT_NE(std::string::npos, trace.find("\"name\":\"outer \\\"quoted\\\"\"")) << trace;
+    EXPECT_NE(std::string::npos, trace.find("\"name\":\"inner\"")) << trace;
+    EXPECT_EQ(2u, Count(trace, "\"ph\":\"B\""));
+    EXPECT_EQ(2u, Count(trace, "\"ph\":\"E\""));
+    EXPECT_NE(std::string::npos, trace.find("\"name\":\"async\",\"cat\":\"atrace\",\"id\":42"))
+            << trace;
+    EXPECT_NE(std::string::npos, trace.find("\"name\":\"on-track\",\"cat\":\"track\",\"id\":7"))
+            << trace;
+    EXPECT_EQ(2u, Count(trace, "\"ph\":\"b\""));
+    EXPECT_EQ(2u, Count(trace, "\"ph\":\"e\""));
+    EXPECT_EQ(1u, Count(trace, "\"ph\":\"i\""));
+    EXPECT_NE(std::string::npos, trace.find("\"args\":{\"value\":123}")) << trace;
+    EXPECT_NE(std::string::npos, trace.find("\"args\":{\"value\":1099511627776}")) << trace;
+    EXPECT_NE(std::string::npos, trace.find("\"atrace-dropped-events\":0}}\n")) << trace;
+}
+
+TEST_F(TraceHostTest, tags) {
+    EXPECT_EXIT(
+            {
+                setenv("ATRACE_HOST_OUTPUT", path_.c_str(), 1);
+                setenv("ATRACE_HOST_TAGS", "0x2", 1);  // ATRACE_TAG_GRAPHICS
+                atrace_begin(ATRACE_TAG_GRAPHICS, "graphics");
+                atrace_end(ATRACE_TAG_GRAPHICS);
+                atrace_begin(ATRACE_TAG_CAMERA, "camera");
+                atrace_end(ATRACE_TAG_CAMERA);
+                exit(0);
+            },
+            ::testing::ExitedWithCode(0), "");
+
+    std::string trace = ReadTrace();
+    EXPECT_NE(std::string::npos, trace.find("\"name\":\"graphics\"")) << trace;
+    EXPECT_EQ(std::string::npos, trace.find("\"name\":\"camera\"")) << trace;
+}
+
+TEST_F(TraceHostTest, set_tracing_enabled) {
+    EXPECT_EXIT(
+            {
+                setenv("ATRACE_HOST_OUTPUT", path_.c_str(), 1);
+                atrace_set_tracing_enabled(false);
+                atrace_begin(ATRACE_TAG_ALWAYS, "off");
+                atrace_end(ATRACE_TAG_ALWAYS);
+                atrace_set_tracing_enabled(true);
+                atrace_begin(ATRACE_TAG_ALWAYS, "on");
+                atrace_end(ATRACE_TAG_ALWAYS);
+                exit(0);
+            },
+            ::testing::ExitedWithCode(0), "");
+
+    std::string trace = ReadTrace();
+    EXPECT_EQ(std::string::npos, trace.find("\"name\":\"off\"")) << trace;
+    EXPECT_NE(std::string::npos, trace.find("\"name\":\"on\"")) << trace;
+}
+
+TEST_F(TraceHostTest, threads) {
+    static constexpr size_t kThreads = 4;
+    static constexpr size_t kEvents = 10000;  // Enough to fill several chunks.
+    EXPECT_EXIT(
+            {
+                setenv("ATRACE_HOST_OUTPUT", path_.c_str(), 1);
+                std::vector<std::thread> threads;
+                for (size_t i = 0; i < kThreads; ++i) {
+                    threads.emplace_back([] {
+                        for (size_t j = 0; j < kEvents; ++j) {
+                            atrace_begin(ATRACE_TAG_ALWAYS, "work");
+                            atrace_end(ATRACE_TAG_ALWAYS);
+                        }
+                    });
+                }
+                for (auto& thread : threads) thread.join();
+                exit(0);
+            },
+            ::testing::ExitedWithCode(0), "");
+
+    std::string trace = ReadTrace();
+    EXPECT_EQ(kThreads * kEvents, Count(trace, "\"ph\":\"B\""));
+    EXPECT_EQ(kThreads * kEvents, Count(trace, "\"ph\":\"E\""));
+}
@@ -20,9 +20,22 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <memory>
+#include <vector>
+
 #include "backed_block.h"
 #include "sparse_defs.h"
 
+/*
+ * The blocks of a list are kept in a linked list in order, for iterating over
+ * them, and indexed by a treap keyed on their first block, so that blocks can
+ * be found, added and removed in O(log n) time wherever they are.  Each block's
+ * treap priority is a hash of its first block, which keeps the treap balanced
+ * however the blocks are added.
+ *
+ * Blocks are mostly added in order, so those added to the end of the list are
+ * only indexed once a block has to be found, all at once in linear time.
+ */
 struct backed_block {
   unsigned int block;
   uint64_t len;
@@ -44,14 +57,209 @@ struct backed_block {
     } fill;
   };
   struct backed_block* next;
+  struct backed_block* left;
+  struct backed_block* right;
+};
+
+/*
+ * Blocks are allocated from slabs rather than one at a time.  A list frees its
+ * slabs when it's destroyed, unless blocks from them were moved to another list,
+ * which then keeps them.
+ */
+static constexpr size_t kSlabBlocks = 1024;
+
+struct backed_block_slabs {
+  ~backed_block_slabs() {
+    for (struct backed_block* slab : slabs) free(slab);
+  }
+
+  std::vector<struct backed_block*> slabs;
+  /* How many blocks of the last slab have been handed out. */
+  size_t last_slab_used = kSlabBlocks;
 };
 
 struct backed_block_list {
-  struct backed_block* data_blocks;
-  struct backed_block* last_used;
-  unsigned int block_size;
+  struct backed_block* data_blocks = nullptr;
+  struct backed_block* tail = nullptr;
+  struct backed_block* root = nullptr;
+  /* The first of the blocks at the end of the list that aren't in the treap yet. */
+  struct backed_block* unindexed = nullptr;
+  unsigned int block_size = 0;
+
+  /* The slabs this list allocates from, and those of blocks moved in from other lists. */
+  std::shared_ptr<backed_block_slabs> slabs;
+  std::vector<std::shared_ptr<backed_block_slabs>> other_slabs;
+  /* Freed blocks, linked through next, to be reused. */
+  struct backed_block* free_blocks = nullptr;
 };
 
+static struct backed_block* backed_block_alloc(struct backed_block_list* bbl) {
+  struct backed_block* bb = bbl->free_blocks;
+
+  if (bb) {
+    bbl->free_blocks = bb->next;
+  } else {
+    if (!bbl->slabs) {
+      bbl->slabs = std::make_shared<backed_block_slabs>();
+    }
+    struct backed_block_slabs* slabs = bbl->slabs.get();
+    if (slabs->last_slab_used == kSlabBlocks) {
+      struct backed_block* slab =
+          reinterpret_cast<backed_block*>(malloc(kSlabBlocks * sizeof(struct backed_block)));
+      if (slab == nullptr) {
+        return nullptr;
+      }
+      slabs->slabs.push_back(slab);
+      slabs->last_slab_used = 0;
+    }
+    bb = slabs->slabs.back() + slabs->last_slab_used++;
+  }
+
+  memset(bb, 0, sizeof(*bb));
+  return bb;
+}
+
+static void backed_block_free(struct backed_block_list* bbl, struct backed_block* bb) {
+  if (bb->type == BACKED_BLOCK_FILE) {
+    free(bb->file.filename);
+  }
+
+  bb->next = bbl->free_blocks;
+  bbl->free_blocks = bb;
+}
+
+static uint32_t bb_priority(const struct backed_block* bb) {
+  uint32_t h = bb->block;
+
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+/* Splits the treap t into the blocks that start before block, and the rest. */
+static void index_split(struct backed_block* t, uint64_t block, struct backed_block** before,
+                        struct backed_block** rest) {
+  if (t == nullptr) {
+    *before = *rest = nullptr;
+  } else if (t->block < block) {
+    index_split(t->right, block, &t->right, rest);
+    *before = t;
+  } else {
+    index_split(t->left, block, before, &t->left);
+    *rest = t;
+  }
+}
+
+/* Joins the treaps a and b, where all of the blocks in a start before those in b. */
+static struct backed_block* index_join(struct backed_block* a, struct backed_block* b) {
+  if (a == nullptr) return b;
+  if (b == nullptr) return a;
+  if (bb_priority(a) >= bb_priority(b)) {
+    a->right = index_join(a->right, b);
+    return a;
+  }
+  b->left = index_join(a, b->left);
+  return b;
+}
+
+/* Returns the link to bb in the treap at *link, or nullptr if it isn't there. */
+static struct backed_block** index_find_link(struct backed_block** link, struct backed_block* bb) {
+  struct backed_block* t = *link;
+
+  if (t == nullptr || t == bb) {
+    return t ? link : nullptr;
+  }
+  /* Blocks that start at the same block may be on either side */
+  if (bb->block <= t->block) {
+    struct backed_block** found = index_find_link(&t->left, bb);
+    if (found) return found;
+  }
+  if (bb->block >= t->block) {
+    return index_find_link(&t->right, bb);
+  }
+  return nullptr;
+}
+
+static bool index_contains(struct backed_block_list* bbl, struct backed_block* bb) {
+  return bbl->unindexed == nullptr || bb->block < bbl->unindexed->block;
+}
+
+static void index_insert(struct backed_block_list* bbl, struct backed_block* bb) {
+  struct backed_block** link = &bbl->root;
+  uint32_t priority = bb_priority(bb);
+
+  while (*link && bb_priority(*link) >= priority) {
+    link = bb->block <= (*link)->block ? &(*link)->left : &(*link)->right;
+  }
+  index_split(*link, bb->block, &bb->left, &bb->right);
+  *link = bb;
+}
+
+static void index_erase(struct backed_block_list* bbl, struct backed_block* bb) {
+  struct backed_block** link = index_find_link(&bbl->root, bb);
+
+  if (link) {
+    *link = index_join(bb->left, bb->right);
+  }
+}
+
+/* Indexes the blocks at the end of the list that aren't yet.  They start after
+ * all of those in the treap, in order, so each one goes on its right spine. */
+static void index_flush(struct backed_block_list* bbl) {
+  std::vector<struct backed_block*> spine;
+
+  if (bbl->unindexed == nullptr) {
+    return;
+  }
+
+  for (struct backed_block* t = bbl->root; t; t = t->right) {
+    spine.push_back(t);
+  }
+  for (struct backed_block* bb = bbl->unindexed; bb; bb = bb->next) {
+    uint32_t priority = bb_priority(bb);
+    bb->left = bb->right = nullptr;
+    while (!spine.empty() && bb_priority(spine.back()) < priority) {
+      bb->left = spine.back();
+      spine.pop_back();
+    }
+    if (spine.empty()) {
+      bbl->root = bb;
+    } else {
+      spine.back()->right = bb;
+    }
+    spine.push_back(bb);
+  }
+  bbl->unindexed = nullptr;
+}
+
+/* Returns the last block that starts before block, or nullptr if there is none. */
+static struct backed_block* index_find_before(struct backed_block_list* bbl, uint64_t block) {
+  struct backed_block* found = nullptr;
+
+  for (struct backed_block* t = bbl->root; t;) {
+    if (t->block < block) {
+      found = t;
+      t = t->right;
+    } else {
+      t = t->left;
+    }
+  }
+  return found;
+}
+
+static struct backed_block* index_first(struct backed_block* t) {
+  while (t && t->left) t = t->left;
+  return t;
+}
+
+static struct backed_block* index_last(struct backed_block* t) {
+  while (t && t->right) t = t->right;
+  return t;
+}
+
 struct backed_block* backed_block_iter_new(struct backed_block_list* bbl) {
   return bbl->data_blocks;
 }
@@ -101,75 +309,109 @@ enum backed_block_type backed_block_type(struct backed_block* bb) {
   return bb->type;
 }
 
-void backed_block_destroy(struct backed_block* bb) {
-  if (bb->type == BACKED_BLOCK_FILE) {
-    free(bb->file.filename);
-  }
-
-  free(bb);
-}
-
 struct backed_block_list* backed_block_list_new(unsigned int block_size) {
-  struct backed_block_list* b =
-      reinterpret_cast<backed_block_list*>(calloc(sizeof(struct backed_block_list), 1));
+  struct backed_block_list* b = new backed_block_list;
   b->block_size = block_size;
   return b;
 }
 
 void backed_block_list_destroy(struct backed_block_list* bbl) {
-  if (bbl->data_blocks) {
-    struct backed_block* bb = bbl->data_blocks;
-    while (bb) {
-      struct backed_block* next = bb->next;
-      backed_block_destroy(bb);
-      bb = next;
+  for (struct backed_block* bb = bbl->data_blocks; bb; bb = bb->next) {
+    if (bb->type == BACKED_BLOCK_FILE) {
+      free(bb->file.filename);
     }
   }
 
-  free(bbl);
+  delete bbl;
+}
+
+/* Makes to keep the slabs of from alive, as some of their blocks are being moved to it. */
+static void adopt_slabs(struct backed_block_list* to, struct backed_block_list* from) {
+  auto adopt = [to](const std::shared_ptr<backed_block_slabs>& slabs) {
+    if (!slabs || slabs == to->slabs) return;
+    for (const auto& other : to->other_slabs) {
+      if (other == slabs) return;
+    }
+    to->other_slabs.push_back(slabs);
+  };
+
+  adopt(from->slabs);
+  for (const auto& slabs : from->other_slabs) {
+    adopt(slabs);
+  }
 }
 
 void backed_block_list_move(struct backed_block_list* from, struct backed_block_list* to,
                             struct backed_block* start, struct backed_block* end) {
   struct backed_block* bb;
+  struct backed_block* prev;
+  struct backed_block* moved;
+  struct backed_block* rest;
+  struct backed_block* after;
+
+  index_flush(from);
+  index_flush(to);
 
   if (start == nullptr) {
     start = from->data_blocks;
   }
 
   if (!end) {
-    for (end = start; end && end->next; end = end->next)
-      ;
+    end = from->tail;
   }
 
   if (start == nullptr || end == nullptr) {
     return;
   }
 
-  from->last_used = nullptr;
-  to->last_used = nullptr;
-  if (from->data_blocks == start) {
-    from->data_blocks = end->next;
+  adopt_slabs(to, from);
+
+  prev = index_find_before(from, start->block);
+  if (prev) {
+    prev->next = end->next;
   } else {
-    for (bb = from->data_blocks; bb; bb = bb->next) {
-      if (bb->next == start) {
-        bb->next = end->next;
-        break;
-      }
+    from->data_blocks = end->next;
+  }
+  if (from->tail == end) {
+    from->tail = prev;
+  }
+  index_split(from->root, start->block, &rest, &moved);
+  index_split(moved, (uint64_t)end->block + 1, &moved, &after);
+  from->root = index_join(rest, after);
+
+  index_split(to->root, start->block, &rest, &after);
+  if (after == nullptr || index_first(after)->block > end->block) {
+    bb = index_last(rest);
+    if (bb) {
+      end->next = bb->next;
+      bb->next = start;
+    } else {
+      end->next = to->data_blocks;
+      to->data_blocks = start;
+    }
+    if (end->next == nullptr) {
+      to->tail = end;
     }
+    to->root = index_join(index_join(rest, moved), after);
+    return;
   }
 
-  if (!to->data_blocks) {
-    to->data_blocks = start;
-    end->next = nullptr;
-  } else {
-    for (bb = to->data_blocks; bb; bb = bb->next) {
-      if (!bb->next || bb->next->block > start->block) {
-        end->next = bb->next;
-        bb->next = start;
-        break;
-      }
+  /* The moved blocks are interleaved with those in to, so add them one at a time */
+  to->root = index_join(rest, after);
+  for (bb = start; bb; bb = start) {
+    start = bb == end ? nullptr : bb->next;
+    prev = index_find_before(to, bb->block);
+    if (prev) {
+      bb->next = prev->next;
+      prev->next = bb;
+    } else {
+      bb->next = to->data_blocks;
+      to->data_blocks = bb;
+    }
+    if (bb->next == nullptr) {
+      to->tail = bb;
     }
+    index_insert(to, bb);
   }
 }
 
@@ -206,12 +448,13 @@ static int merge_bb(struct backed_block_list* bbl, struct backed_block* a, struc
       break;
     case BACKED_BLOCK_FILE:
       /* Already make sure b->type is BACKED_BLOCK_FILE */
-      if (strcmp(a->file.filename, b->file.filename) || a->file.offset + a->len != b->file.offset) {
+      if (strcmp(a->file.filename, b->file.filename) ||
+          a->file.offset + (int64_t)a->len != b->file.offset) {
         return -EINVAL;
       }
       break;
     case BACKED_BLOCK_FD:
-      if (a->fd.fd != b->fd.fd || a->fd.offset + a->len != b->fd.offset) {
+      if (a->fd.fd != b->fd.fd || a->fd.offset + (int64_t)a->len != b->fd.offset) {
         return -EINVAL;
       }
       break;
@@ -222,49 +465,52 @@ static int merge_bb(struct backed_block_list* bbl, struct backed_block* a, struc
   a->len += b->len;
   a->next = b->next;
 
-  backed_block_destroy(b);
+  if (bbl->tail == b) {
+    bbl->tail = a;
+  }
+  if (bbl->unindexed == b) {
+    bbl->unindexed = b->next;
+  } else if (index_contains(bbl, b)) {
+    index_erase(bbl, b);
+  }
+  backed_block_free(bbl, b);
 
   return 0;
 }
 
 static int queue_bb(struct backed_block_list* bbl, struct backed_block* new_bb) {
-  struct backed_block* bb;
+  struct backed_block* bb = bbl->tail;
 
-  if (bbl->data_blocks == nullptr) {
-    bbl->data_blocks = new_bb;
+  if (bb == nullptr) {
+    bbl->data_blocks = bbl->tail = bbl->unindexed = new_bb;
     return 0;
   }
 
-  if (bbl->data_blocks->block > new_bb->block) {
-    new_bb->next = bbl->data_blocks;
-    bbl->data_blocks = new_bb;
+  if (new_bb->block > bb->block) {
+    bb->next = new_bb;
+    bbl->tail = new_bb;
+    if (bbl->unindexed == nullptr) {
+      bbl->unindexed = new_bb;
+    }
+    merge_bb(bbl, bb, new_bb);
     return 0;
   }
 
-  /* Optimization: blocks are mostly queued in sequence, so save the
-     pointer to the last bb that was added, and start searching from
-     there if the next block number is higher */
-  if (bbl->last_used && new_bb->block > bbl->last_used->block)
-    bb = bbl->last_used;
-  else
-    bb = bbl->data_blocks;
-  bbl->last_used = new_bb;
+  index_flush(bbl);
+  bb = index_find_before(bbl, new_bb->block);
+  index_insert(bbl, new_bb);
 
-  for (; bb->next && bb->next->block < new_bb->block; bb = bb->next)
-    ;
-
-  if (bb->next == nullptr) {
-    bb->next = new_bb;
-  } else {
-    new_bb->next = bb->next;
-    bb->next = new_bb;
+  if (bb == nullptr) {
+    new_bb->next = bbl->data_blocks;
+    bbl->data_blocks = new_bb;
+    return 0;
   }
 
+  new_bb->next = bb->next;
+  bb->next = new_bb;
+
   merge_bb(bbl, new_bb, new_bb->next);
-  if (!merge_bb(bbl, bb, new_bb)) {
-    /* new_bb destroyed, point to retained as last_used */
-    bbl->last_used = bb;
-  }
+  merge_bb(bbl, bb, new_bb);
 
   return 0;
 }
@@ -272,7 +518,7 @@ static int queue_bb(struct backed_block_list* bbl, struct backed_block* new_bb)
 /* Queues a fill block of memory to be written to the specified data blocks */
 int backed_block_add_fill(struct backed_block_list* bbl, unsigned int fill_val, uint64_t len,
                           unsigned int block) {
-  struct backed_block* bb = reinterpret_cast<backed_block*>(calloc(1, sizeof(struct backed_block)));
+  struct backed_block* bb = backed_block_alloc(bbl);
   if (bb == nullptr) {
     return -ENOMEM;
   }
@@ -289,7 +535,7 @@ int backed_block_add_fill(struct backed_block_list* bbl, unsigned int fill_val,
 /* Queues a block of memory to be written to the specified data blocks */
 int backed_block_add_data(struct backed_block_list* bbl, void* data, uint64_t len,
                           unsigned int block) {
-  struct backed_block* bb = reinterpret_cast<backed_block*>(calloc(1, sizeof(struct backed_block)));
+  struct backed_block* bb = backed_block_alloc(bbl);
   if (bb == nullptr) {
     return -ENOMEM;
   }
@@ -306,7 +552,7 @@ int backed_block_add_data(struct backed_block_list* bbl, void* data, uint64_t le
 /* Queues a chunk of a file on disk to be written to the specified data blocks */
 int backed_block_add_file(struct backed_block_list* bbl, const char* filename, int64_t offset,
                           uint64_t len, unsigned int block) {
-  struct backed_block* bb = reinterpret_cast<backed_block*>(calloc(1, sizeof(struct backed_block)));
+  struct backed_block* bb = backed_block_alloc(bbl);
   if (bb == nullptr) {
     return -ENOMEM;
   }
@@ -316,7 +562,8 @@ int backed_block_add_file(struct backed_block_list* bbl, const char* filename, i
   bb->type = BACKED_BLOCK_FILE;
   bb->file.filename = strdup(filename);
   if (!bb->file.filename) {
-    free(bb);
+    bb->type = BACKED_BLOCK_FILL;
+    backed_block_free(bbl, bb);
     return -ENOMEM;
   }
   bb->file.offset = offset;
@@ -328,7 +575,7 @@ int backed_block_add_file(struct backed_block_list* bbl, const char* filename, i
 /* Queues a chunk of a fd to be written to the specified data blocks */
 int backed_block_add_fd(struct backed_block_list* bbl, int fd, int64_t offset, uint64_t len,
                         unsigned int block) {
-  struct backed_block* bb = reinterpret_cast<backed_block*>(calloc(1, sizeof(struct backed_block)));
+  struct backed_block* bb = backed_block_alloc(bbl);
   if (bb == nullptr) {
     return -ENOMEM;
   }
@@ -353,7 +600,7 @@ int backed_block_split(struct backed_block_list* bbl, struct backed_block* bb,
     return 0;
   }
 
-  new_bb = reinterpret_cast<backed_block*>(malloc(sizeof(struct backed_block)));
+  new_bb = backed_block_alloc(bbl);
   if (new_bb == nullptr) {
     return -ENOMEM;
   }
@@ -371,7 +618,8 @@ int backed_block_split(struct backed_block_list* bbl, struct backed_block* bb,
     case BACKED_BLOCK_FILE:
       new_bb->file.filename = strdup(bb->file.filename);
       if (!new_bb->file.filename) {
-        free(new_bb);
+        new_bb->type = BACKED_BLOCK_FILL;
+        backed_block_free(bbl, new_bb);
         return -ENOMEM;
       }
       new_bb->file.offset += max_len;
@@ -385,5 +633,11 @@ int backed_block_split(struct backed_block_list* bbl, struct backed_block* bb,
 
   bb->next = new_bb;
   bb->len = max_len;
+  if (bbl->tail == bb) {
+    bbl->tail = new_bb;
+  }
+  if (index_contains(bbl, bb)) {
+    index_insert(bbl, new_bb);
+  }
   return 0;
 }
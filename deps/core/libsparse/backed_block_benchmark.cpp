@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "backed_block.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+// Adds state.range(0) single block fills, which can't be merged, in random order.
+static void BM_backed_block_add_random(benchmark::State& state) {
+  std::vector<unsigned int> order(state.range(0));
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937(42));
+  for (auto _ : state) {
+    backed_block_list* bbl = backed_block_list_new(4096);
+    for (unsigned int i : order) {
+      backed_block_add_fill(bbl, i, 4096, i * 2);
+    }
+    state.PauseTiming();
+    backed_block_list_destroy(bbl);
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * order.size());
+}
+BENCHMARK(BM_backed_block_add_random)->Arg(1 << 16)->Arg(10000000)->Unit(benchmark::kMillisecond);
+
+// The same, in order, as most images are built.
+static void BM_backed_block_add_sequential(benchmark::State& state) {
+  for (auto _ : state) {
+    backed_block_list* bbl = backed_block_list_new(4096);
+    for (int64_t i = 0; i < state.range(0); i++) {
+      backed_block_add_fill(bbl, i, 4096, i * 2);
+    }
+    state.PauseTiming();
+    backed_block_list_destroy(bbl);
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_backed_block_add_sequential)
+    ->Arg(1 << 16)
+    ->Arg(10000000)
+    ->Unit(benchmark::kMillisecond);
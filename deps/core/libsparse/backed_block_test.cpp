@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "backed_block.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using ListPtr = std::unique_ptr<backed_block_list, decltype(&backed_block_list_destroy)>;
+
+static constexpr unsigned int kBlockSize = 4096;
+
+static ListPtr NewList() {
+  return ListPtr(backed_block_list_new(kBlockSize), backed_block_list_destroy);
+}
+
+// The first block and length in blocks of each backed block of bbl, in order.
+static std::vector<std::pair<unsigned int, uint64_t>> Blocks(backed_block_list* bbl) {
+  std::vector<std::pair<unsigned int, uint64_t>> blocks;
+  for (backed_block* bb = backed_block_iter_new(bbl); bb; bb = backed_block_iter_next(bb)) {
+    blocks.emplace_back(backed_block_block(bb), backed_block_len(bb) / kBlockSize);
+  }
+  return blocks;
+}
+
+TEST(BackedBlockTest, RandomOrder) {
+  std::vector<unsigned int> order(10000);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937(42));
+
+  // Every other block, with each pair either side of a gap sharing a fill value.
+  ListPtr bbl = NewList();
+  for (unsigned int i : order) {
+    ASSERT_EQ(0, backed_block_add_fill(bbl.get(), i / 2, kBlockSize, i * 2));
+  }
+  auto blocks = Blocks(bbl.get());
+  ASSERT_EQ(order.size(), blocks.size());
+  for (unsigned int i = 0; i < blocks.size(); i++) {
+    EXPECT_EQ(std::make_pair(i * 2, uint64_t{1}), blocks[i]);
+  }
+
+  // Filling those gaps merges each pair with the block between them.
+  for (unsigned int i : order) {
+    if (i % 2 == 0) {
+      ASSERT_EQ(0, backed_block_add_fill(bbl.get(), i / 2, kBlockSize, i * 2 + 1));
+    }
+  }
+  blocks = Blocks(bbl.get());
+  ASSERT_EQ(order.size() / 2, blocks.size());
+  for (unsigned int i = 0; i < blocks.size(); i++) {
+    EXPECT_EQ(std::make_pair(i * 4, uint64_t{3}), blocks[i]);
+  }
+}
+
+TEST(BackedBlockTest, Split) {
+  ListPtr bbl = NewList();
+  ASSERT_EQ(0, backed_block_add_fill(bbl.get(), 1, 10 * kBlockSize, 100));
+  ASSERT_EQ(0, backed_block_split(bbl.get(), backed_block_iter_new(bbl.get()), 4 * kBlockSize));
+  ASSERT_EQ(0, backed_block_add_fill(bbl.get(), 2, kBlockSize, 50));
+  ASSERT_EQ(0, backed_block_add_fill(bbl.get(), 1, kBlockSize, 110));
+  EXPECT_EQ((std::vector<std::pair<unsigned int, uint64_t>>{{50, 1}, {100, 4}, {104, 7}}),
+            Blocks(bbl.get()));
+}
+
+TEST(BackedBlockTest, Move) {
+  ListPtr from = NewList();
+  ListPtr to = NewList();
+  for (unsigned int i = 0; i < 3000; i++) {
+    ASSERT_EQ(0, backed_block_add_fill(i < 1000 || i >= 2000 ? to.get() : from.get(), i,
+                                       kBlockSize, i * 2));
+  }
+  backed_block_list_move(from.get(), to.get(), nullptr, nullptr);
+  from.reset();
+
+  // The moved blocks outlive the list they came from, and can still be found to merge.
+  for (unsigned int i = 0; i < 3000; i++) {
+    ASSERT_EQ(0, backed_block_add_fill(to.get(), i, kBlockSize, i * 2 + 1));
+  }
+  auto blocks = Blocks(to.get());
+  ASSERT_EQ(3000U, blocks.size());
+  for (unsigned int i = 0; i < blocks.size(); i++) {
+    EXPECT_EQ(std::make_pair(i * 2, uint64_t{2}), blocks[i]);
+  }
+}
+
+TEST(BackedBlockTest, MoveInterleaved) {
+  ListPtr from = NewList();
+  ListPtr to = NewList();
+  for (unsigned int i = 0; i < 100; i++) {
+    ASSERT_EQ(0, backed_block_add_fill(i % 2 ? from.get() : to.get(), i, kBlockSize, i * 2));
+  }
+  backed_block_list_move(from.get(), to.get(), nullptr, nullptr);
+  EXPECT_EQ(nullptr, backed_block_iter_new(from.get()));
+
+  auto blocks = Blocks(to.get());
+  ASSERT_EQ(100U, blocks.size());
+  for (unsigned int i = 0; i < blocks.size(); i++) {
+    EXPECT_EQ(std::make_pair(i * 2, uint64_t{1}), blocks[i]);
+  }
+}
@@ -38,13 +38,16 @@
 #endif
 
 void usage() {
-  fprintf(stderr, "Usage: img2simg [-s] <raw_image_file> <sparse_image_file> [<block_size>]\n");
+  fprintf(stderr, "Usage: img2simg [-s] [-z] <raw_image_file> <sparse_image_file> [<block_size>]\n");
+  fprintf(stderr, "  -s  write holes in the input as don't care chunks\n");
+  fprintf(stderr, "  -z  write blocks of zeros as don't care chunks\n");
 }
 
 int main(int argc, char* argv[]) {
   char *arg_in;
   char *arg_out;
   enum sparse_read_mode mode = SPARSE_READ_MODE_NORMAL;
+  bool zeros_dont_care = false;
   int extra;
   int in;
   int opt;
@@ -54,11 +57,14 @@ int main(int argc, char* argv[]) {
   unsigned int block_size = 4096;
   off64_t len;
 
-  while ((opt = getopt(argc, argv, "s")) != -1) {
+  while ((opt = getopt(argc, argv, "sz")) != -1) {
     switch (opt) {
       case 's':
         mode = SPARSE_READ_MODE_HOLE;
         break;
+      case 'z':
+        zeros_dont_care = true;
+        break;
       default:
         usage();
         exit(EXIT_FAILURE);
@@ -112,6 +118,9 @@ int main(int argc, char* argv[]) {
   }
 
   sparse_file_verbose(s);
+  if (zeros_dont_care) {
+    sparse_file_zeros_dont_care(s);
+  }
   ret = sparse_file_read(s, in, mode, false);
   if (ret) {
     fprintf(stderr, "Failed to read file\n");
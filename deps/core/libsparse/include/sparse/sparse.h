@@ -333,6 +333,34 @@ int sparse_file_resparse(struct sparse_file *in_s, unsigned int max_len,
  */
 void sparse_file_verbose(struct sparse_file *s);
 
+/**
+ * sparse_file_zeros_dont_care - read blocks of zeros as "don't care" chunks
+ *
+ * @s - sparse file cookie
+ *
+ * When sparse_file_read() reads a regular file into the sparse file cookie,
+ * skip the blocks of all zeros, so that they are written as "don't care"
+ * chunks rather than fill chunks.  This makes for smaller images, but those
+ * blocks then keep whatever they held before the image was written, so only
+ * use this when nothing relies on them reading back as zeros.
+ */
+void sparse_file_zeros_dont_care(struct sparse_file *s);
+
+/**
+ * sparse_file_write_threads - write a sparse file on more than one thread
+ *
+ * @s - sparse file cookie
+ * @threads - number of worker threads
+ *
+ * Has sparse_file_write() and sparse_file_callback() gzip the output and
+ * compute its crc on the given number of worker threads, while the calling
+ * thread writes it out in order.  With 0 or 1, the default, everything is done
+ * on the calling thread.  The output is the same either way, except that gzipped
+ * output is compressed in separate blocks, as pigz does, so its bytes differ
+ * but it decompresses to the same data.
+ */
+void sparse_file_write_threads(struct sparse_file *s, unsigned int threads);
+
 /**
  * sparse_print_verbose - function called to print verbose errors
  *
@@ -30,12 +30,25 @@
 #include <unistd.h>
 #include <zlib.h>
 
+#include <deque>
+#include <future>
+#include <memory>
+#include <vector>
+
 #include "defs.h"
 #include "output_file.h"
 #include "sparse_crc32.h"
 #include "sparse_format.h"
+#include "worker_pool.h"
 
 #include <android-base/mapped_file.h>
+#include <android-base/unique_fd.h>
+
+#if defined(__linux__)
+#include <linux/falloc.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
 
 #ifndef _WIN32
 #define O_BINARY 0
@@ -59,12 +72,29 @@
 #define container_of(inner, outer_t, elem) ((outer_t*)((char*)(inner)-offsetof(outer_t, elem)))
 
 static constexpr size_t kMaxMmapSize = 256 * 1024 * 1024;
+static constexpr size_t kMaxCopySize = 1024 * 1024 * 1024;
+/* The most data whose crc one worker thread computes at a time. */
+static constexpr size_t kCrc32PartSize = 16 * 1024 * 1024;
+/* The uncompressed size of the blocks that parallel gzip output deflates separately. */
+static constexpr size_t kPgzBlockSize = 1024 * 1024;
+static constexpr size_t kPgzWindowSize = 32 * 1024;
 
 struct output_file_ops {
   int (*open)(struct output_file*, int fd);
   int (*skip)(struct output_file*, int64_t);
   int (*pad)(struct output_file*, int64_t);
   int (*write)(struct output_file*, void*, size_t);
+  /*
+   * Optional.  Copies len bytes at offset in fd to the output without passing
+   * them through user space.  Returns how many were copied, which is short if
+   * the rest can't be copied that way and must be written, or -1 on error.
+   */
+  int64_t (*copy)(struct output_file*, int fd, int64_t offset, uint64_t len);
+  /*
+   * Optional.  Skips len bytes, leaving them reading as zero.  Returns 0 if it
+   * did, -EOPNOTSUPP if the zeros must be written instead, or -1 on error.
+   */
+  int (*zero)(struct output_file*, int64_t len);
   void (*close)(struct output_file*);
 };
 
@@ -88,6 +118,26 @@ struct output_file {
   char* zero_buf;
   uint32_t* fill_buf;
   char* buf;
+  /* Set when writing with more than one thread. */
+  struct output_threads* threads;
+};
+
+/* The crc of len bytes of the expanded data, unless computing it failed. */
+struct crc32_part {
+  uint32_t crc32;
+  uint64_t len;
+  bool ok;
+};
+
+struct output_threads {
+  explicit output_threads(unsigned int threads) : pool(threads), max_pending(2 * threads) {}
+
+  WorkerPool pool;
+  /* How many crc parts, or blocks of gzip output, are queued before the oldest is waited for. */
+  size_t max_pending;
+  /* The parts of the crc of the expanded data still being computed, oldest first. */
+  std::deque<std::future<crc32_part>> crc32_parts;
+  bool crc32_failed = false;
 };
 
 struct output_file_gz {
@@ -97,9 +147,43 @@ struct output_file_gz {
 
 #define to_output_file_gz(_o) container_of((_o), struct output_file_gz, out)
 
+/* A block of a gzip stream, deflated separately by a worker thread. */
+struct pgz_block {
+  std::vector<uint8_t> data;
+  /* The crc and length of the uncompressed block. */
+  uint32_t crc32;
+  uint64_t len;
+  bool ok;
+};
+
+struct pgz_stream {
+  /* The uncompressed block being filled, and the one before it. */
+  std::shared_ptr<std::vector<uint8_t>> block;
+  std::shared_ptr<std::vector<uint8_t>> prev_block;
+  /* The blocks being deflated, oldest first. */
+  std::deque<std::future<pgz_block>> pending;
+  /* The length of the uncompressed data written to the stream. */
+  uint64_t len = 0;
+  /* The crc of the uncompressed data written to the file so far. */
+  uint32_t crc32 = 0;
+  bool failed = false;
+};
+
+struct output_file_pgz {
+  struct output_file out;
+  int fd;
+  struct pgz_stream* stream;
+};
+
+#define to_output_file_pgz(_o) container_of((_o), struct output_file_pgz, out)
+
 struct output_file_normal {
   struct output_file out;
   int fd;
+  /* Cleared on the first failure, for outputs that don't support them. */
+  bool use_copy_file_range;
+  bool use_sendfile;
+  bool use_punch_hole;
 };
 
 #define to_output_file_normal(_o) container_of((_o), struct output_file_normal, out)
@@ -116,6 +200,15 @@ static int file_open(struct output_file* out, int fd) {
   struct output_file_normal* outn = to_output_file_normal(out);
 
   outn->fd = fd;
+
+#if defined(__linux__)
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    outn->use_copy_file_range = true;
+    outn->use_sendfile = true;
+    outn->use_punch_hole = true;
+  }
+#endif
   return 0;
 }
 
@@ -143,12 +236,11 @@ static int file_pad(struct output_file* out, int64_t len) {
   return 0;
 }
 
-static int file_write(struct output_file* out, void* data, size_t len) {
+static int write_all(int fd, const void* data, size_t len) {
   ssize_t ret;
-  struct output_file_normal* outn = to_output_file_normal(out);
 
   while (len > 0) {
-    ret = write(outn->fd, data, len);
+    ret = write(fd, data, len);
     if (ret < 0) {
       if (errno == EINTR) {
         continue;
@@ -157,13 +249,92 @@ static int file_write(struct output_file* out, void* data, size_t len) {
       return -1;
     }
 
-    data = (char*)data + ret;
+    data = (const char*)data + ret;
     len -= ret;
   }
 
   return 0;
 }
 
+static int file_write(struct output_file* out, void* data, size_t len) {
+  struct output_file_normal* outn = to_output_file_normal(out);
+
+  return write_all(outn->fd, data, len);
+}
+
+static int64_t file_copy(struct output_file* out, int fd, int64_t offset, uint64_t len) {
+  uint64_t copied = 0;
+#if defined(__linux__)
+  struct output_file_normal* outn = to_output_file_normal(out);
+
+  while (copied < len && (outn->use_copy_file_range || outn->use_sendfile)) {
+    size_t count = std::min(len - copied, (uint64_t)kMaxCopySize);
+    ssize_t ret;
+    if (outn->use_copy_file_range) {
+#if defined(__NR_copy_file_range)
+      int64_t in_offset = offset + copied;
+      ret = syscall(__NR_copy_file_range, fd, &in_offset, outn->fd, nullptr, count, 0);
+#else
+      ret = -1;
+      errno = ENOSYS;
+#endif
+      if (ret < 0 && (errno == EXDEV || errno == EINVAL || errno == EBADF ||
+                      errno == EOPNOTSUPP || errno == ENOSYS)) {
+        outn->use_copy_file_range = false;
+        continue;
+      }
+    } else {
+      off_t in_offset = offset + copied;
+      ret = sendfile(outn->fd, fd, &in_offset, count);
+      if (ret < 0 && (errno == EINVAL || errno == ENOSYS)) {
+        outn->use_sendfile = false;
+        continue;
+      }
+    }
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error_errno("copy");
+      return -1;
+    }
+    if (ret == 0) {
+      error("input ended %" PRIu64 " bytes early", len - copied);
+      return -1;
+    }
+    copied += ret;
+  }
+#else
+  (void)out;
+  (void)fd;
+  (void)offset;
+  (void)len;
+#endif
+  return copied;
+}
+
+static int file_zero(struct output_file* out, int64_t len) {
+#if defined(__linux__)
+  struct output_file_normal* outn = to_output_file_normal(out);
+
+  if (outn->use_punch_hole) {
+    off64_t pos = lseek64(outn->fd, 0, SEEK_CUR);
+    if (pos < 0) {
+      error_errno("lseek64");
+      return -1;
+    }
+    if (fallocate(outn->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, pos, len) == 0) {
+      return file_skip(out, len);
+    }
+    outn->use_punch_hole = false;
+  }
+#else
+  (void)out;
+  (void)len;
+#endif
+  return -EOPNOTSUPP;
+}
+
 static void file_close(struct output_file* out) {
   struct output_file_normal* outn = to_output_file_normal(out);
 
@@ -175,6 +346,8 @@ static struct output_file_ops file_ops = {
     .skip = file_skip,
     .pad = file_pad,
     .write = file_write,
+    .copy = file_copy,
+    .zero = file_zero,
     .close = file_close,
 };
 
@@ -254,9 +427,185 @@ static struct output_file_ops gz_file_ops = {
     .skip = gz_file_skip,
     .pad = gz_file_pad,
     .write = gz_file_write,
+    .copy = nullptr,
+    .zero = nullptr,
     .close = gz_file_close,
 };
 
+/*
+ * Parallel gzip output, as pigz writes it: the data is cut into blocks that
+ * worker threads deflate separately, each primed with the end of the block
+ * before it and ending on a byte boundary with a sync flush, so that they
+ * concatenate into a single deflate stream.  The crcs of the blocks are
+ * combined for the gzip trailer.
+ */
+static pgz_block pgz_deflate(const std::vector<uint8_t>& input, const std::vector<uint8_t>* prev,
+                             bool finish) {
+  pgz_block block = {.crc32 = sparse_crc32(0, input.data(), input.size()),
+                     .len = input.size(),
+                     .ok = false};
+  z_stream strm = {};
+  int ret;
+
+  /* Negative window bits for raw deflate, as the gzip header and trailer are written separately. */
+  if (deflateInit2(&strm, 9, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return block;
+  }
+  if (prev && !prev->empty()) {
+    size_t dict_len = std::min(prev->size(), kPgzWindowSize);
+    deflateSetDictionary(&strm, prev->data() + prev->size() - dict_len, dict_len);
+  }
+
+  block.data.resize(deflateBound(&strm, input.size()) + 16);
+  strm.next_in = const_cast<uint8_t*>(input.data());
+  strm.avail_in = input.size();
+  strm.next_out = block.data.data();
+  strm.avail_out = block.data.size();
+  for (;;) {
+    ret = deflate(&strm, finish ? Z_FINISH : Z_SYNC_FLUSH);
+    if (finish ? ret == Z_STREAM_END : (ret == Z_OK && strm.avail_out != 0)) {
+      block.ok = true;
+      break;
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      break;
+    }
+    size_t used = block.data.size() - strm.avail_out;
+    block.data.resize(block.data.size() * 2);
+    strm.next_out = block.data.data() + used;
+    strm.avail_out = block.data.size() - used;
+  }
+  block.data.resize(block.data.size() - strm.avail_out);
+  deflateEnd(&strm);
+
+  return block;
+}
+
+/* Writes the oldest deflated block to the file. */
+static int pgz_collect(struct output_file_pgz* outpgz) {
+  struct pgz_stream* stream = outpgz->stream;
+
+  pgz_block block = stream->pending.front().get();
+  stream->pending.pop_front();
+  if (!block.ok) {
+    error("deflate failed");
+    stream->failed = true;
+  }
+  if (stream->failed || write_all(outpgz->fd, block.data.data(), block.data.size()) < 0) {
+    stream->failed = true;
+    return -1;
+  }
+  stream->crc32 = sparse_crc32_combine(stream->crc32, block.crc32, block.len);
+  return 0;
+}
+
+/* Hands the block being filled to a worker thread, to be deflated. */
+static int pgz_submit(struct output_file_pgz* outpgz, bool finish) {
+  struct pgz_stream* stream = outpgz->stream;
+  struct output_threads* threads = outpgz->out.threads;
+
+  while (stream->pending.size() >= threads->max_pending) {
+    if (pgz_collect(outpgz) < 0) return -1;
+  }
+  std::shared_ptr<std::vector<uint8_t>> block = std::move(stream->block);
+  std::shared_ptr<std::vector<uint8_t>> prev = std::move(stream->prev_block);
+  stream->pending.emplace_back(threads->pool.Async(
+      [block, prev, finish] { return pgz_deflate(*block, prev.get(), finish); }));
+  stream->prev_block = std::move(block);
+  stream->block = std::make_shared<std::vector<uint8_t>>();
+  stream->block->reserve(kPgzBlockSize);
+  return 0;
+}
+
+static int pgz_flush(struct output_file_pgz* outpgz) {
+  while (!outpgz->stream->pending.empty()) {
+    if (pgz_collect(outpgz) < 0) return -1;
+  }
+  return 0;
+}
+
+static int pgz_file_open(struct output_file* out, int fd) {
+  struct output_file_pgz* outpgz = to_output_file_pgz(out);
+  /* The gzip header: deflate, no name or timestamp, maximum compression, from Unix. */
+  static const uint8_t header[] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 2, 3};
+
+  outpgz->fd = fd;
+  outpgz->stream = new pgz_stream;
+  outpgz->stream->block = std::make_shared<std::vector<uint8_t>>();
+  outpgz->stream->block->reserve(kPgzBlockSize);
+
+  return write_all(fd, header, sizeof(header));
+}
+
+static int pgz_file_write(struct output_file* out, void* data, size_t len) {
+  struct output_file_pgz* outpgz = to_output_file_pgz(out);
+  struct pgz_stream* stream = outpgz->stream;
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+
+  if (stream->failed) return -1;
+  while (len > 0) {
+    size_t n = std::min(len, kPgzBlockSize - stream->block->size());
+    stream->block->insert(stream->block->end(), p, p + n);
+    stream->len += n;
+    p += n;
+    len -= n;
+    if (stream->block->size() == kPgzBlockSize && pgz_submit(outpgz, false) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* Like gzseek(), skipping writes zeros. */
+static int pgz_file_skip(struct output_file* out, int64_t cnt) {
+  while (cnt > 0) {
+    size_t len = std::min(cnt, (int64_t)FILL_ZERO_BUFSIZE);
+    if (pgz_file_write(out, out->zero_buf, len) < 0) return -1;
+    cnt -= len;
+  }
+  return 0;
+}
+
+static int pgz_file_pad(struct output_file* out, int64_t len) {
+  struct pgz_stream* stream = to_output_file_pgz(out)->stream;
+
+  if ((int64_t)stream->len >= len) {
+    return 0;
+  }
+  return pgz_file_skip(out, len - stream->len);
+}
+
+static void pgz_file_close(struct output_file* out) {
+  struct output_file_pgz* outpgz = to_output_file_pgz(out);
+  struct pgz_stream* stream = outpgz->stream;
+
+  /* The last block ends the deflate stream, even if it's empty. */
+  if (!stream->failed && pgz_submit(outpgz, true) == 0 && pgz_flush(outpgz) == 0) {
+    /* The gzip trailer: the crc and the length mod 2^32 of the data, little-endian. */
+    uint32_t isize = static_cast<uint32_t>(stream->len);
+    uint8_t trailer[8];
+    for (int i = 0; i < 4; i++) {
+      trailer[i] = stream->crc32 >> (8 * i);
+      trailer[4 + i] = isize >> (8 * i);
+    }
+    write_all(outpgz->fd, trailer, sizeof(trailer));
+  }
+
+  delete stream;
+  free(outpgz);
+}
+
+static struct output_file_ops pgz_file_ops = {
+    .open = pgz_file_open,
+    .skip = pgz_file_skip,
+    .pad = pgz_file_pad,
+    .write = pgz_file_write,
+    .copy = nullptr,
+    .zero = nullptr,
+    .close = pgz_file_close,
+};
+
 static int callback_file_open(struct output_file* out __unused, int fd __unused) {
   return 0;
 }
@@ -299,6 +648,8 @@ static struct output_file_ops callback_file_ops = {
     .skip = callback_file_skip,
     .pad = callback_file_pad,
     .write = callback_file_write,
+    .copy = nullptr,
+    .zero = nullptr,
     .close = callback_file_close,
 };
 
@@ -341,6 +692,103 @@ static bool write_fd_chunk_range(int fd, int64_t offset, uint64_t len, T callbac
   return true;
 }
 
+/* Folds the oldest part still being computed into the crc. */
+static void collect_crc32_part(struct output_file* out) {
+  struct output_threads* threads = out->threads;
+
+  crc32_part part = threads->crc32_parts.front().get();
+  threads->crc32_parts.pop_front();
+  if (!part.ok) {
+    threads->crc32_failed = true;
+  }
+  out->crc32 = sparse_crc32_combine(out->crc32, part.crc32, part.len);
+}
+
+/* Appends len bytes whose crc is crc32 to the crc of the expanded data. */
+static void add_crc32(struct output_file* out, uint32_t crc32, uint64_t len) {
+  if (!out->threads || out->threads->crc32_parts.empty()) {
+    out->crc32 = sparse_crc32_combine(out->crc32, crc32, len);
+    return;
+  }
+  std::promise<crc32_part> part;
+  part.set_value({.crc32 = crc32, .len = len, .ok = true});
+  out->threads->crc32_parts.emplace_back(part.get_future());
+}
+
+/* Has a worker thread compute the crc of the next part of the expanded data. */
+template <typename F>
+static int add_crc32_job(struct output_file* out, F job) {
+  struct output_threads* threads = out->threads;
+
+  while (threads->crc32_parts.size() >= threads->max_pending) {
+    collect_crc32_part(out);
+  }
+  threads->crc32_parts.emplace_back(threads->pool.Async(std::move(job)));
+  return threads->crc32_failed ? -1 : 0;
+}
+
+/* Appends the crc of len bytes at data, which must outlive the output, to the crc. */
+static int add_data_crc32(struct output_file* out, const char* data, uint64_t len) {
+  if (!out->threads) {
+    out->crc32 = sparse_crc32(out->crc32, data, len);
+    return 0;
+  }
+  for (uint64_t pos = 0; pos < len; pos += kCrc32PartSize) {
+    uint64_t part_len = std::min(len - pos, (uint64_t)kCrc32PartSize);
+    if (add_crc32_job(out, [data = data + pos, part_len] {
+          return crc32_part{.crc32 = sparse_crc32(0, data, part_len), .len = part_len, .ok = true};
+        }) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Appends the crc of len bytes at offset in fd to the crc.  The worker threads
+ * read the data themselves, through their own copy of fd, so that they needn't
+ * wait for it to be written and fd may be closed once it has been.
+ */
+static int add_fd_crc32(struct output_file* out, int fd, int64_t offset, uint64_t len) {
+  auto part_fd = std::make_shared<android::base::unique_fd>(dup(fd));
+  if (*part_fd < 0) {
+    error_errno("dup");
+    return -1;
+  }
+  for (uint64_t pos = 0; pos < len; pos += kCrc32PartSize) {
+    uint64_t part_len = std::min(len - pos, (uint64_t)kCrc32PartSize);
+    if (add_crc32_job(out, [part_fd, part_offset = offset + pos, part_len] {
+          crc32_part part = {.crc32 = 0, .len = part_len, .ok = true};
+          part.ok = write_fd_chunk_range(part_fd->get(), part_offset, part_len,
+                                         [&part](char* data, size_t size) -> bool {
+                                           part.crc32 = sparse_crc32(part.crc32, data, size);
+                                           return true;
+                                         });
+          return part;
+        }) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int output_file_flush(struct output_file* out) {
+  if (!out->threads) {
+    return 0;
+  }
+  while (!out->threads->crc32_parts.empty()) {
+    collect_crc32_part(out);
+  }
+  if (out->threads->crc32_failed) {
+    error("failed to compute crc");
+    return -1;
+  }
+  if (out->ops == &pgz_file_ops) {
+    return pgz_flush(to_output_file_pgz(out));
+  }
+  return 0;
+}
+
 static int write_sparse_skip_chunk(struct output_file* out, uint64_t skip_len) {
   chunk_header_t chunk_header;
   int ret;
@@ -387,7 +835,7 @@ static int write_sparse_fill_chunk(struct output_file* out, uint64_t len, uint32
 
   if (out->use_crc) {
     count = out->block_size / sizeof(uint32_t);
-    while (count--) out->crc32 = sparse_crc32(out->crc32, &fill_val, sizeof(uint32_t));
+    add_crc32(out, sparse_crc32_fill(0, fill_val, count), count * sizeof(fill_val));
   }
 
   out->cur_out_ptr += rnd_up_len;
@@ -429,16 +877,8 @@ static int write_sparse_data_chunk(struct output_file* out, uint64_t len, void*
   }
 
   if (out->use_crc) {
-    out->crc32 = sparse_crc32(out->crc32, data, len);
-    if (zero_len) {
-      uint64_t len = zero_len;
-      uint64_t write_len;
-      while (len) {
-        write_len = std::min(len, (uint64_t)FILL_ZERO_BUFSIZE);
-        out->crc32 = sparse_crc32(out->crc32, out->zero_buf, write_len);
-        len -= write_len;
-      }
-    }
+    if (add_data_crc32(out, reinterpret_cast<char*>(data), len) < 0) return -1;
+    add_crc32(out, sparse_crc32_zeros(0, zero_len), zero_len);
   }
 
   out->cur_out_ptr += rnd_up_len;
@@ -464,10 +904,21 @@ static int write_sparse_fd_chunk(struct output_file* out, uint64_t len, int fd,
   ret = out->ops->write(out, &chunk_header, sizeof(chunk_header));
 
   if (ret < 0) return -1;
-  bool ok = write_fd_chunk_range(fd, offset, len, [&ret, out](char* data, size_t size) -> bool {
+  /* Worker threads read the data for the crc for themselves. */
+  bool crc_here = out->use_crc && !out->threads;
+  if (out->use_crc && out->threads && add_fd_crc32(out, fd, offset, len) < 0) return -1;
+  /* Computing the crc here needs the data in user space. */
+  if (!crc_here && out->ops->copy) {
+    int64_t copied = out->ops->copy(out, fd, offset, len);
+    if (copied < 0) return -1;
+    offset += copied;
+    len -= copied;
+  }
+  bool ok = write_fd_chunk_range(fd, offset, len, [&ret, out, crc_here](char* data,
+                                                                        size_t size) -> bool {
     ret = out->ops->write(out, data, size);
     if (ret < 0) return false;
-    if (out->use_crc) {
+    if (crc_here) {
       out->crc32 = sparse_crc32(out->crc32, data, size);
     }
     return true;
@@ -486,13 +937,7 @@ static int write_sparse_fd_chunk(struct output_file* out, uint64_t len, int fd,
     }
 
     if (out->use_crc) {
-      uint64_t len = zero_len;
-      uint64_t write_len;
-      while (len) {
-        write_len = std::min(len, (uint64_t)FILL_ZERO_BUFSIZE);
-        out->crc32 = sparse_crc32(out->crc32, out->zero_buf, write_len);
-        len -= write_len;
-      }
+      add_crc32(out, sparse_crc32_zeros(0, zero_len), zero_len);
     }
   }
 
@@ -507,6 +952,9 @@ int write_sparse_end_chunk(struct output_file* out) {
   int ret;
 
   if (out->use_crc) {
+    if (output_file_flush(out) < 0) {
+      return -1;
+    }
     chunk_header.chunk_type = CHUNK_TYPE_CRC32;
     chunk_header.reserved1 = 0;
     chunk_header.chunk_sz = 0;
@@ -556,6 +1004,13 @@ static int write_normal_fill_chunk(struct output_file* out, uint64_t len, uint32
   unsigned int i;
   uint64_t write_len;
 
+  if (fill_val == 0 && out->ops->zero) {
+    ret = out->ops->zero(out, len);
+    if (ret != -EOPNOTSUPP) {
+      return ret;
+    }
+  }
+
   /* Initialize fill_buf with the fill_val */
   for (i = 0; i < FILL_ZERO_BUFSIZE / sizeof(uint32_t); i++) {
     out->fill_buf[i] = fill_val;
@@ -575,17 +1030,23 @@ static int write_normal_fill_chunk(struct output_file* out, uint64_t len, uint32
 }
 
 static int write_normal_fd_chunk(struct output_file* out, uint64_t len, int fd, int64_t offset) {
-  int ret;
-  uint64_t rnd_up_len = ALIGN(len, out->block_size);
-
+  int ret = 0;
+  uint64_t pad_len = ALIGN(len, out->block_size) - len;
+
+  if (out->ops->copy) {
+    int64_t copied = out->ops->copy(out, fd, offset, len);
+    if (copied < 0) return -1;
+    offset += copied;
+    len -= copied;
+  }
   bool ok = write_fd_chunk_range(fd, offset, len, [&ret, out](char* data, size_t size) -> bool {
     ret = out->ops->write(out, data, size);
     return ret >= 0;
   });
   if (!ok) return ret;
 
-  if (rnd_up_len > len) {
-    ret = out->ops->skip(out, rnd_up_len - len);
+  if (pad_len) {
+    ret = out->ops->skip(out, pad_len);
   }
 
   return ret;
@@ -608,16 +1069,20 @@ static struct sparse_file_ops normal_file_ops = {
 };
 
 void output_file_close(struct output_file* out) {
+  /* Closing the output frees it, but may need the threads. */
+  struct output_threads* threads = out->threads;
+
   out->sparse_ops->write_end_chunk(out);
   free(out->zero_buf);
   free(out->fill_buf);
   out->zero_buf = nullptr;
   out->fill_buf = nullptr;
   out->ops->close(out);
+  delete threads;
 }
 
 static int output_file_init(struct output_file* out, int block_size, int64_t len, bool sparse,
-                            int chunks, bool crc) {
+                            int chunks, bool crc, unsigned int threads) {
   int ret;
 
   out->len = len;
@@ -642,6 +1107,10 @@ static int output_file_init(struct output_file* out, int block_size, int64_t len
     goto err_fill_buf;
   }
 
+  if (threads > 1) {
+    out->threads = new output_threads(threads);
+  }
+
   if (sparse) {
     out->sparse_ops = &sparse_file_ops;
   } else {
@@ -673,6 +1142,8 @@ static int output_file_init(struct output_file* out, int block_size, int64_t len
   return 0;
 
 err_write:
+  delete out->threads;
+  out->threads = nullptr;
   free(out->fill_buf);
 err_fill_buf:
   free(out->zero_buf);
@@ -692,6 +1163,19 @@ static struct output_file* output_file_new_gz(void) {
   return &outgz->out;
 }
 
+static struct output_file* output_file_new_pgz(void) {
+  struct output_file_pgz* outpgz =
+      reinterpret_cast<struct output_file_pgz*>(calloc(1, sizeof(struct output_file_pgz)));
+  if (!outpgz) {
+    error_errno("malloc struct outpgz");
+    return nullptr;
+  }
+
+  outpgz->out.ops = &pgz_file_ops;
+
+  return &outpgz->out;
+}
+
 static struct output_file* output_file_new_normal(void) {
   struct output_file_normal* outn =
       reinterpret_cast<struct output_file_normal*>(calloc(1, sizeof(struct output_file_normal)));
@@ -707,7 +1191,8 @@ static struct output_file* output_file_new_normal(void) {
 
 struct output_file* output_file_open_callback(int (*write)(void*, const void*, size_t), void* priv,
                                               unsigned int block_size, int64_t len, int gz __unused,
-                                              int sparse, int chunks, int crc) {
+                                              int sparse, int chunks, int crc,
+                                              unsigned int threads) {
   int ret;
   struct output_file_callback* outc;
 
@@ -722,7 +1207,8 @@ struct output_file* output_file_open_callback(int (*write)(void*, const void*, s
   outc->priv = priv;
   outc->write = write;
 
-  ret = output_file_init(&outc->out, block_size, len, sparse, chunks, crc);
+  /* Only the crc is worth computing on other threads. */
+  ret = output_file_init(&outc->out, block_size, len, sparse, chunks, crc, crc ? threads : 1);
   if (ret < 0) {
     free(outc);
     return nullptr;
@@ -732,11 +1218,18 @@ struct output_file* output_file_open_callback(int (*write)(void*, const void*, s
 }
 
 struct output_file* output_file_open_fd(int fd, unsigned int block_size, int64_t len, int gz,
-                                        int sparse, int chunks, int crc) {
+                                        int sparse, int chunks, int crc, unsigned int threads) {
   int ret;
   struct output_file* out;
 
-  if (gz) {
+  /* Only compression and the crc are worth doing on other threads. */
+  if (!gz && !crc) {
+    threads = 1;
+  }
+
+  if (gz && threads > 1) {
+    out = output_file_new_pgz();
+  } else if (gz) {
     out = output_file_new_gz();
   } else {
     out = output_file_new_normal();
@@ -747,7 +1240,7 @@ struct output_file* output_file_open_fd(int fd, unsigned int block_size, int64_t
 
   out->ops->open(out, fd);
 
-  ret = output_file_init(out, block_size, len, sparse, chunks, crc);
+  ret = output_file_init(out, block_size, len, sparse, chunks, crc, threads);
   if (ret < 0) {
     free(out);
     return nullptr;
@@ -25,16 +25,23 @@ extern "C" {
 
 struct output_file;
 
+/*
+ * With threads > 1, the output compresses and computes the crc of the data on
+ * that many worker threads, while writing it out in order on the caller's.
+ */
 struct output_file* output_file_open_fd(int fd, unsigned int block_size, int64_t len, int gz,
-                                        int sparse, int chunks, int crc);
+                                        int sparse, int chunks, int crc, unsigned int threads);
 struct output_file* output_file_open_callback(int (*write)(void*, const void*, size_t), void* priv,
                                               unsigned int block_size, int64_t len, int gz,
-                                              int sparse, int chunks, int crc);
+                                              int sparse, int chunks, int crc,
+                                              unsigned int threads);
 int write_data_chunk(struct output_file* out, uint64_t len, void* data);
 int write_fill_chunk(struct output_file* out, uint64_t len, uint32_t fill_val);
 int write_file_chunk(struct output_file* out, uint64_t len, const char* file, int64_t offset);
 int write_fd_chunk(struct output_file* out, uint64_t len, int fd, int64_t offset);
 int write_skip_chunk(struct output_file* out, uint64_t len);
+/* Waits for the worker threads to finish with the data written so far. */
+int output_file_flush(struct output_file* out);
 void output_file_close(struct output_file* out);
 
 int read_all(int fd, void* buf, size_t len);
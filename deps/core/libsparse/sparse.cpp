@@ -133,7 +133,7 @@ static int write_all_blocks(struct sparse_file* s, struct output_file* out) {
     write_skip_chunk(out, pad);
   }
 
-  return 0;
+  return output_file_flush(out);
 }
 
 /*
@@ -154,7 +154,7 @@ int sparse_file_write(struct sparse_file* s, int fd, bool gz, bool sparse, bool
   }
 
   chunks = sparse_count_chunks(s);
-  out = output_file_open_fd(fd, s->block_size, s->len, gz, sparse, chunks, crc);
+  out = output_file_open_fd(fd, s->block_size, s->len, gz, sparse, chunks, crc, s->write_threads);
 
   if (!out) return -ENOMEM;
 
@@ -172,7 +172,8 @@ int sparse_file_callback(struct sparse_file* s, bool sparse, bool crc,
   struct output_file* out;
 
   chunks = sparse_count_chunks(s);
-  out = output_file_open_callback(write, priv, s->block_size, s->len, false, sparse, chunks, crc);
+  out = output_file_open_callback(write, priv, s->block_size, s->len, false, sparse, chunks, crc,
+                                  s->write_threads);
 
   if (!out) return -ENOMEM;
 
@@ -211,7 +212,7 @@ int sparse_file_foreach_chunk(struct sparse_file* s, bool sparse, bool crc,
   chk.block = chk.nr_blocks = 0;
   chunks = sparse_count_chunks(s);
   out = output_file_open_callback(foreach_chunk_write, &chk, s->block_size, s->len, false, sparse,
-                                  chunks, crc);
+                                  chunks, crc, 1);
 
   if (!out) return -ENOMEM;
 
@@ -240,7 +241,7 @@ int64_t sparse_file_len(struct sparse_file* s, bool sparse, bool crc) {
   struct output_file* out;
 
   out = output_file_open_callback(out_counter_write, &count, s->block_size, s->len, false, sparse,
-                                  chunks, crc);
+                                  chunks, crc, 1);
   if (!out) {
     return -1;
   }
@@ -280,7 +281,7 @@ static int move_chunks_up_to_len(struct sparse_file* from, struct sparse_file* t
 
   start = backed_block_iter_new(from->backed_block_list);
   out_counter = output_file_open_callback(out_counter_write, &count, to->block_size, to->len, false,
-                                          true, 0, false);
+                                          true, 0, false, 1);
   if (!out_counter) {
     return -1;
   }
@@ -367,3 +368,11 @@ int sparse_file_resparse(struct sparse_file* in_s, unsigned int max_len, struct
 void sparse_file_verbose(struct sparse_file* s) {
   s->verbose = true;
 }
+
+void sparse_file_zeros_dont_care(struct sparse_file* s) {
+  s->zeros_dont_care = true;
+}
+
+void sparse_file_write_threads(struct sparse_file* s, unsigned int threads) {
+  s->write_threads = threads;
+}
@@ -43,10 +43,20 @@
  */
 
 /* Code taken from FreeBSD 8 */
+#include "sparse_crc32.h"
+
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <array>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SPARSE_CRC32_PCLMUL 1
+#endif
 
-static uint32_t crc32_tab[] = {
+static constexpr uint32_t crc32_tab[] = {
     0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3,
     0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91,
     0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
@@ -87,7 +97,7 @@ static uint32_t crc32_tab[] = {
  * in sys/libkern.h, where it can be inlined.
  */
 
-uint32_t sparse_crc32(uint32_t crc_in, const void* buf, size_t size) {
+uint32_t sparse_crc32_bytewise(uint32_t crc_in, const void* buf, size_t size) {
   const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
   uint32_t crc;
 
@@ -95,3 +105,222 @@ uint32_t sparse_crc32(uint32_t crc_in, const void* buf, size_t size) {
   while (size--) crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
   return crc ^ ~0U;
 }
+
+/*
+ * Slicing by 16: slice_tab[k][b] is the crc register after feeding byte b
+ * followed by k zero bytes, so 16 bytes are folded into the register with 16
+ * independent table lookups rather than 16 dependent ones.
+ */
+static constexpr std::array<std::array<uint32_t, 256>, 16> make_slice_tab() {
+  std::array<std::array<uint32_t, 256>, 16> tab = {};
+  for (int i = 0; i < 256; i++) tab[0][i] = crc32_tab[i];
+  for (int k = 1; k < 16; k++) {
+    for (int i = 0; i < 256; i++) {
+      tab[k][i] = (tab[k - 1][i] >> 8) ^ crc32_tab[tab[k - 1][i] & 0xFF];
+    }
+  }
+  return tab;
+}
+
+static constexpr std::array<std::array<uint32_t, 256>, 16> slice_tab = make_slice_tab();
+
+uint32_t sparse_crc32_slice16(uint32_t crc_in, const void* buf, size_t size) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+  uint32_t crc = crc_in ^ ~0U;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  while (size >= 16) {
+    uint32_t w[4];
+    memcpy(w, p, sizeof(w));
+    w[0] ^= crc;
+    crc = slice_tab[15][w[0] & 0xFF] ^ slice_tab[14][(w[0] >> 8) & 0xFF] ^
+          slice_tab[13][(w[0] >> 16) & 0xFF] ^ slice_tab[12][w[0] >> 24] ^
+          slice_tab[11][w[1] & 0xFF] ^ slice_tab[10][(w[1] >> 8) & 0xFF] ^
+          slice_tab[9][(w[1] >> 16) & 0xFF] ^ slice_tab[8][w[1] >> 24] ^
+          slice_tab[7][w[2] & 0xFF] ^ slice_tab[6][(w[2] >> 8) & 0xFF] ^
+          slice_tab[5][(w[2] >> 16) & 0xFF] ^ slice_tab[4][w[2] >> 24] ^
+          slice_tab[3][w[3] & 0xFF] ^ slice_tab[2][(w[3] >> 8) & 0xFF] ^
+          slice_tab[1][(w[3] >> 16) & 0xFF] ^ slice_tab[0][w[3] >> 24];
+    p += 16;
+    size -= 16;
+  }
+#endif
+  while (size--) crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  return crc ^ ~0U;
+}
+
+#ifdef SPARSE_CRC32_PCLMUL
+/*
+ * Folds 64 bytes at a time with carry-less multiplies, as described in
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+ * (Gopal et al., Intel, 2009), then Barrett reduces to 32 bits.  The constants
+ * are those of the paper for the bit-reflected CRC-32 polynomial.  Takes and
+ * returns the crc register, rather than the crc, and needs len >= 64 and a
+ * multiple of 16.
+ */
+__attribute__((target("pclmul"))) static uint32_t crc32_pclmul_fold(const uint8_t* buf,
+                                                                     size_t len, uint32_t crc) {
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+  __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x00));
+  __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x10));
+  __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x20));
+  __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  buf += 64;
+  len -= 64;
+
+  /* Fold four 128 bit lanes in parallel, 64 bytes at a time. */
+  while (len >= 64) {
+    __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x30)));
+    buf += 64;
+    len -= 64;
+  }
+
+  /* Fold the four lanes into one, then any remaining 16 byte blocks into it. */
+  __m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x4), x5);
+  while (len >= 16) {
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf));
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x2), x5);
+    buf += 16;
+    len -= 16;
+  }
+
+  /* Fold 128 bits to 64. */
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask32);
+  x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k5k0, 0x00), x2);
+
+  /* Barrett reduce to 32 bits. */
+  x2 = _mm_and_si128(x1, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+  x2 = _mm_and_si128(x2, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+#endif
+
+bool sparse_crc32_has_pclmul() {
+#ifdef SPARSE_CRC32_PCLMUL
+  static const bool has_pclmul = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("pclmul") != 0;
+  }();
+  return has_pclmul;
+#else
+  return false;
+#endif
+}
+
+uint32_t sparse_crc32_pclmul(uint32_t crc, const void* buf, size_t size) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+#ifdef SPARSE_CRC32_PCLMUL
+  if (size >= 64 && sparse_crc32_has_pclmul()) {
+    size_t len = size & ~size_t{15};
+    crc = ~crc32_pclmul_fold(p, len, ~crc);
+    p += len;
+    size -= len;
+  }
+#endif
+  return sparse_crc32_slice16(crc, p, size);
+}
+
+uint32_t sparse_crc32(uint32_t crc, const void* buf, size_t size) {
+  return sparse_crc32_pclmul(crc, buf, size);
+}
+
+/*
+ * Arithmetic on the crc register as a polynomial modulo the CRC-32 polynomial,
+ * with the same bit order as the register, as zlib does for crc32_combine().
+ * Appending n zero bytes to the data multiplies its register by x^(8n).
+ */
+
+/* Returns a * b modulo the polynomial. */
+static constexpr uint32_t multmodp(uint32_t a, uint32_t b) {
+  uint32_t m = 1U << 31;
+  uint32_t p = 0;
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0) break;
+    }
+    m >>= 1;
+    b = b & 1 ? (b >> 1) ^ 0xedb88320 : b >> 1;
+  }
+  return p;
+}
+
+/* x2n_tab[k] is x^(2^k) modulo the polynomial. */
+static constexpr std::array<uint32_t, 32> make_x2n_tab() {
+  std::array<uint32_t, 32> tab = {};
+  uint32_t p = 1U << 30; /* x^1 */
+  tab[0] = p;
+  for (int k = 1; k < 32; k++) {
+    tab[k] = p = multmodp(p, p);
+  }
+  return tab;
+}
+
+static constexpr std::array<uint32_t, 32> x2n_tab = make_x2n_tab();
+
+/* Returns x^(n * 2^k) modulo the polynomial. */
+static uint32_t x2nmodp(uint64_t n, unsigned k) {
+  uint32_t p = 1U << 31; /* x^0 */
+  while (n) {
+    if (n & 1) p = multmodp(x2n_tab[k & 31], p);
+    n >>= 1;
+    k++;
+  }
+  return p;
+}
+
+uint32_t sparse_crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+  return multmodp(x2nmodp(len2, 3), crc1) ^ crc2;
+}
+
+uint32_t sparse_crc32_zeros(uint32_t crc, uint64_t len) {
+  return ~multmodp(x2nmodp(len, 3), ~crc);
+}
+
+uint32_t sparse_crc32_fill(uint32_t crc, uint32_t fill_val, uint64_t count) {
+  /* Appends runs of 1, 2, 4, ... copies of fill_val, as count has bits set. */
+  uint32_t run_crc = sparse_crc32_bytewise(0, &fill_val, sizeof(fill_val));
+  uint64_t run_len = sizeof(fill_val);
+  while (count) {
+    if (count & 1) crc = sparse_crc32_combine(crc, run_crc, run_len);
+    count >>= 1;
+    if (count) {
+      run_crc = sparse_crc32_combine(run_crc, run_crc, run_len);
+      run_len *= 2;
+    }
+  }
+  return crc;
+}
@@ -17,8 +17,29 @@
 #ifndef _LIBSPARSE_SPARSE_CRC32_H_
 #define _LIBSPARSE_SPARSE_CRC32_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
+/* Returns the crc of the data whose crc is crc, followed by size bytes at buf. */
 uint32_t sparse_crc32(uint32_t crc, const void* buf, size_t size);
 
+/* Returns the crc of the data whose crc is crc1, followed by len2 bytes whose crc is crc2. */
+uint32_t sparse_crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+
+/* Returns the crc of the data whose crc is crc, followed by len zero bytes. */
+uint32_t sparse_crc32_zeros(uint32_t crc, uint64_t len);
+
+/* Returns the crc of the data whose crc is crc, followed by count copies of fill_val. */
+uint32_t sparse_crc32_fill(uint32_t crc, uint32_t fill_val, uint64_t count);
+
+/*
+ * The implementations sparse_crc32() picks from, exposed for testing and
+ * benchmarking.  sparse_crc32_pclmul() falls back to sparse_crc32_slice16()
+ * unless sparse_crc32_has_pclmul().
+ */
+uint32_t sparse_crc32_bytewise(uint32_t crc, const void* buf, size_t size);
+uint32_t sparse_crc32_slice16(uint32_t crc, const void* buf, size_t size);
+uint32_t sparse_crc32_pclmul(uint32_t crc, const void* buf, size_t size);
+bool sparse_crc32_has_pclmul();
+
 #endif
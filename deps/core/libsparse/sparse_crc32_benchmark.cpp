@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sparse_crc32.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+template <uint32_t (*crc_fn)(uint32_t, const void*, size_t)>
+static void BM_crc32(benchmark::State& state) {
+  std::vector<uint8_t> data(state.range(0));
+  for (size_t i = 0; i < data.size(); i++) data[i] = i * 7;
+  uint32_t crc = 0;
+  for (auto _ : state) {
+    crc = crc_fn(crc, data.data(), data.size());
+  }
+  benchmark::DoNotOptimize(crc);
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK_TEMPLATE(BM_crc32, sparse_crc32_bytewise)->Arg(4096)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_crc32, sparse_crc32_slice16)->Arg(4096)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_crc32, sparse_crc32_pclmul)->Arg(4096)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_crc32, sparse_crc32)->Arg(64)->Arg(4096)->Arg(1 << 20);
+
+// The crc of a don't care or fill chunk of the given length, as sparse_read.cpp computes it.
+static void BM_crc32_zeros(benchmark::State& state) {
+  uint32_t crc = 0;
+  for (auto _ : state) {
+    crc = sparse_crc32_zeros(crc, state.range(0));
+  }
+  benchmark::DoNotOptimize(crc);
+}
+BENCHMARK(BM_crc32_zeros)->Arg(4096)->Arg(1 << 30);
+
+static void BM_crc32_fill(benchmark::State& state) {
+  uint32_t crc = 0;
+  for (auto _ : state) {
+    crc = sparse_crc32_fill(crc, 0xdeadbeef, state.range(0) / sizeof(uint32_t));
+  }
+  benchmark::DoNotOptimize(crc);
+}
+BENCHMARK(BM_crc32_fill)->Arg(4096)->Arg(1 << 30);
+
+BENCHMARK_MAIN();
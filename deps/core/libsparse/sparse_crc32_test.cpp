@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sparse_crc32.h"
+
+#include <stdint.h>
+
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+static std::vector<uint8_t> RandomBytes(size_t size, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> bytes(size);
+  for (auto& b : bytes) b = rng();
+  return bytes;
+}
+
+TEST(sparse_crc32, bytewise_matches_zlib) {
+  auto data = RandomBytes(4096, 1);
+  for (size_t size : {0, 1, 3, 4096}) {
+    EXPECT_EQ(crc32(0, data.data(), size), sparse_crc32_bytewise(0, data.data(), size)) << size;
+  }
+  EXPECT_EQ(0xcbf43926U, sparse_crc32_bytewise(0, "123456789", 9));
+}
+
+// Every length up to a few folds, at every alignment, continuing from a non-zero crc.
+TEST(sparse_crc32, implementations_match_bytewise) {
+  if (!sparse_crc32_has_pclmul()) {
+    GTEST_LOG_(INFO) << "No PCLMULQDQ, sparse_crc32_pclmul() is only checked as a fallback";
+  }
+  auto data = RandomBytes(512 + 16, 2);
+  for (size_t align = 0; align < 16; align++) {
+    for (size_t size = 0; size <= 512; size++) {
+      const uint8_t* p = data.data() + align;
+      uint32_t expected = sparse_crc32_bytewise(0x12345678, p, size);
+      ASSERT_EQ(expected, sparse_crc32_slice16(0x12345678, p, size)) << align << " " << size;
+      ASSERT_EQ(expected, sparse_crc32_pclmul(0x12345678, p, size)) << align << " " << size;
+      ASSERT_EQ(expected, sparse_crc32(0x12345678, p, size)) << align << " " << size;
+    }
+  }
+}
+
+TEST(sparse_crc32, large_buffer) {
+  auto data = RandomBytes(3 * 1024 * 1024 + 13, 3);
+  uint32_t expected = sparse_crc32_bytewise(0, data.data(), data.size());
+  EXPECT_EQ(expected, sparse_crc32_slice16(0, data.data(), data.size()));
+  EXPECT_EQ(expected, sparse_crc32_pclmul(0, data.data(), data.size()));
+}
+
+TEST(sparse_crc32, combine) {
+  auto data = RandomBytes(10000, 4);
+  uint32_t expected = sparse_crc32_bytewise(0, data.data(), data.size());
+  for (size_t split : {0, 1, 4095, 4096, 9999, 10000}) {
+    uint32_t crc1 = sparse_crc32_bytewise(0, data.data(), split);
+    uint32_t crc2 = sparse_crc32_bytewise(0, data.data() + split, data.size() - split);
+    EXPECT_EQ(expected, sparse_crc32_combine(crc1, crc2, data.size() - split)) << split;
+  }
+}
+
+TEST(sparse_crc32, zeros) {
+  std::vector<uint8_t> zeros(1024 * 1024 + 7);
+  for (size_t len : {size_t{0}, size_t{1}, size_t{4096}, zeros.size()}) {
+    for (uint32_t crc : {0U, 0xdeadbeefU}) {
+      EXPECT_EQ(sparse_crc32_bytewise(crc, zeros.data(), len), sparse_crc32_zeros(crc, len))
+          << len;
+    }
+  }
+  // Lengths beyond 4GiB, by combining against the bytewise crc of a smaller number of zeros.
+  uint64_t big = (uint64_t{5} << 30) + 3;
+  uint32_t crc = sparse_crc32_zeros(0, big - zeros.size());
+  EXPECT_EQ(sparse_crc32_bytewise(crc, zeros.data(), zeros.size()), sparse_crc32_zeros(0, big));
+}
+
+TEST(sparse_crc32, fill) {
+  const uint32_t fill_val = 0x01020304;
+  std::vector<uint32_t> fill(300000, fill_val);
+  for (size_t count : {0, 1, 2, 3, 1024, 1025, 299999}) {
+    for (uint32_t crc : {0U, 0xdeadbeefU}) {
+      EXPECT_EQ(sparse_crc32_bytewise(crc, fill.data(), count * sizeof(fill_val)),
+                sparse_crc32_fill(crc, fill_val, count))
+          << count;
+    }
+  }
+}
@@ -27,6 +27,8 @@ struct sparse_file {
   unsigned int block_size;
   int64_t len;
   bool verbose;
+  bool zeros_dont_care;
+  unsigned int write_threads;
 
   struct backed_block_list* backed_block_list;
   struct output_file* out;
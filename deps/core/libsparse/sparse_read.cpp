@@ -247,11 +247,8 @@ static int process_fill_chunk(struct sparse_file* s, unsigned int chunk_size,
                               SparseFileSource* source, unsigned int blocks, unsigned int block,
                               uint32_t* crc32) {
   int ret;
-  int chunk;
   int64_t len = (int64_t)blocks * s->block_size;
   uint32_t fill_val;
-  uint32_t* fillbuf;
-  unsigned int i;
 
   if (chunk_size != sizeof(fill_val)) {
     return -EINVAL;
@@ -268,17 +265,7 @@ static int process_fill_chunk(struct sparse_file* s, unsigned int chunk_size,
   }
 
   if (crc32) {
-    /* Fill copy_buf with the fill value */
-    fillbuf = (uint32_t*)copybuf;
-    for (i = 0; i < (COPY_BUF_SIZE / sizeof(fill_val)); i++) {
-      fillbuf[i] = fill_val;
-    }
-
-    while (len) {
-      chunk = std::min(len, COPY_BUF_SIZE);
-      *crc32 = sparse_crc32(*crc32, copybuf, chunk);
-      len -= chunk;
-    }
+    *crc32 = sparse_crc32_fill(*crc32, fill_val, len / sizeof(fill_val));
   }
 
   return 0;
@@ -292,14 +279,7 @@ static int process_skip_chunk(struct sparse_file* s, unsigned int chunk_size,
   }
 
   if (crc32) {
-    int64_t len = (int64_t)blocks * s->block_size;
-    memset(copybuf, 0, COPY_BUF_SIZE);
-
-    while (len) {
-      int chunk = std::min(len, COPY_BUF_SIZE);
-      *crc32 = sparse_crc32(*crc32, copybuf, chunk);
-      len -= chunk;
-    }
+    *crc32 = sparse_crc32_zeros(*crc32, (int64_t)blocks * s->block_size);
   }
 
   return 0;
@@ -457,61 +437,122 @@ static int sparse_file_read_sparse(struct sparse_file* s, SparseFileSource* sour
   return 0;
 }
 
-static int do_sparse_file_read_normal(struct sparse_file* s, int fd, uint32_t* buf, int64_t offset,
-                                      int64_t remain) {
+/* Regular files are scanned in windows of about this size, rather than a block at a time. */
+static constexpr int64_t READ_WINDOW_SIZE = 4 * 1024 * 1024;
+
+static int64_t read_window_size(struct sparse_file* s) {
+  return std::max(ALIGN_DOWN(READ_WINDOW_SIZE, (int64_t)s->block_size), (int64_t)s->block_size);
+}
+
+/*
+ * Returns true if every 32 bit word of the block is the same, and stores it in
+ * fill_val.  Words are compared 64 bytes at a time with 16 byte vectors, which
+ * every target has registers for, so that data blocks, which mostly differ
+ * early on, are rejected after one comparison and fill blocks are cheap to
+ * confirm.
+ */
+static bool is_fill_block(const uint8_t* block, unsigned int block_size, uint32_t* fill_val) {
+  typedef uint32_t vec_t __attribute__((vector_size(16)));
+  uint32_t val;
+  memcpy(&val, block, sizeof(val));
+  const vec_t pattern = {val, val, val, val};
+
+  unsigned int i = 0;
+  for (; i + 4 * sizeof(vec_t) <= block_size; i += 4 * sizeof(vec_t)) {
+    vec_t v[4];
+    memcpy(v, block + i, sizeof(v));
+    vec_t diff = (v[0] ^ pattern) | (v[1] ^ pattern) | (v[2] ^ pattern) | (v[3] ^ pattern);
+    uint64_t lanes[2];
+    memcpy(lanes, &diff, sizeof(lanes));
+    if (lanes[0] | lanes[1]) {
+      return false;
+    }
+  }
+  for (; i + sizeof(val) <= block_size; i += sizeof(val)) {
+    uint32_t word;
+    memcpy(&word, block + i, sizeof(word));
+    if (word != val) {
+      return false;
+    }
+  }
+
+  *fill_val = val;
+  return true;
+}
+
+/* A run of consecutive blocks of the same kind, added to the sparse file as one backed block. */
+struct read_run {
+  bool fill;
+  uint32_t fill_val;
+  int64_t offset;
+  uint64_t len;
+  unsigned int block;
+};
+
+static int add_read_run(struct sparse_file* s, int fd, struct read_run* run) {
+  uint64_t len = run->len;
+  run->len = 0;
+  if (len == 0) {
+    return 0;
+  }
+  if (!run->fill) {
+    return sparse_file_add_fd(s, fd, run->offset, len, run->block);
+  }
+  if (run->fill_val == 0 && s->zeros_dont_care) {
+    return 0;
+  }
+  return sparse_file_add_fill(s, run->fill_val, len, run->block);
+}
+
+static int do_sparse_file_read_normal(struct sparse_file* s, int fd, uint8_t* buf, int64_t buf_len,
+                                      int64_t offset, int64_t remain) {
   int ret;
   unsigned int block = offset / s->block_size;
-  unsigned int to_read;
-  unsigned int i;
-  bool sparse_block;
+  struct read_run run = {};
 
   if (!buf) {
     return -ENOMEM;
   }
 
   while (remain > 0) {
-    to_read = std::min(remain, (int64_t)(s->block_size));
+    int64_t to_read = std::min(remain, buf_len);
     ret = read_all(fd, buf, to_read);
     if (ret < 0) {
       error("failed to read sparse file");
       return ret;
     }
 
-    if (to_read == s->block_size) {
-      sparse_block = true;
-      for (i = 1; i < s->block_size / sizeof(uint32_t); i++) {
-        if (buf[0] != buf[i]) {
-          sparse_block = false;
-          break;
+    for (int64_t pos = 0; pos < to_read; pos += s->block_size) {
+      int64_t len = std::min(to_read - pos, (int64_t)s->block_size);
+      uint32_t fill_val = 0;
+      bool fill = len == s->block_size && is_fill_block(buf + pos, s->block_size, &fill_val);
+      if (run.len == 0 || run.fill != fill || (fill && run.fill_val != fill_val)) {
+        ret = add_read_run(s, fd, &run);
+        if (ret < 0) {
+          return ret;
         }
+        run = {fill, fill_val, offset + pos, 0, block};
       }
-    } else {
-      sparse_block = false;
-    }
-
-    if (sparse_block) {
-      /* TODO: add flag to use skip instead of fill for buf[0] == 0 */
-      sparse_file_add_fill(s, buf[0], to_read, block);
-    } else {
-      sparse_file_add_fd(s, fd, offset, to_read, block);
+      run.len += len;
+      block++;
     }
 
     remain -= to_read;
     offset += to_read;
-    block++;
   }
 
-  return 0;
+  return add_read_run(s, fd, &run);
 }
 
 static int sparse_file_read_normal(struct sparse_file* s, int fd) {
   int ret;
-  uint32_t* buf = (uint32_t*)malloc(s->block_size);
+  int64_t buf_len = read_window_size(s);
+  uint8_t* buf = (uint8_t*)malloc(buf_len);
 
   if (!buf)
     return -ENOMEM;
 
-  ret = do_sparse_file_read_normal(s, fd, buf, 0, s->len);
+  ret = do_sparse_file_read_normal(s, fd, buf, buf_len, 0, s->len);
   free(buf);
   return ret;
 }
@@ -519,7 +560,8 @@ static int sparse_file_read_normal(struct sparse_file* s, int fd) {
 #ifdef __linux__
 static int sparse_file_read_hole(struct sparse_file* s, int fd) {
   int ret;
-  uint32_t* buf = (uint32_t*)malloc(s->block_size);
+  int64_t buf_len = read_window_size(s);
+  uint8_t* buf = (uint8_t*)malloc(buf_len);
   int64_t end = 0;
   int64_t start = 0;
 
@@ -556,7 +598,7 @@ static int sparse_file_read_hole(struct sparse_file* s, int fd) {
       return -errno;
     }
 
-    ret = do_sparse_file_read_normal(s, fd, buf, start, end - start);
+    ret = do_sparse_file_read_normal(s, fd, buf, buf_len, start, end - start);
     if (ret) {
       free(buf);
       return ret;
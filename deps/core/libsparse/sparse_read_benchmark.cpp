@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sparse/sparse.h>
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+static constexpr unsigned int kBlockSize = 4096;
+static constexpr unsigned int kImageBlocks = 16384;
+
+// Writes a 64 MiB image of runs of 1 to 64 blocks, about data_percent percent of which are data
+// and the rest split between zeros and another fill value.
+static void WriteImage(int fd, int data_percent) {
+  std::mt19937 rng(42);
+  std::vector<uint32_t> image(kImageBlocks * kBlockSize / sizeof(uint32_t));
+  for (size_t block = 0; block < kImageBlocks;) {
+    size_t blocks = std::min<size_t>(1 + rng() % 64, kImageBlocks - block);
+    int kind = rng() % 100;
+    uint32_t* words = &image[block * kBlockSize / sizeof(uint32_t)];
+    for (size_t i = 0; i < blocks * kBlockSize / sizeof(uint32_t); i++) {
+      if (kind < data_percent) {
+        words[i] = rng();
+      } else if (kind % 2) {
+        words[i] = 0xdeadbeef;
+      }
+    }
+    block += blocks;
+  }
+  android::base::WriteFully(fd, image.data(), image.size() * sizeof(uint32_t));
+}
+
+// Reads the image as a regular file, which looks at every block to find the fills.
+static void BM_sparse_file_read_normal(benchmark::State& state) {
+  TemporaryFile tf;
+  WriteImage(tf.fd, state.range(0));
+  for (auto _ : state) {
+    lseek(tf.fd, 0, SEEK_SET);
+    sparse_file* s = sparse_file_new(kBlockSize, int64_t{kImageBlocks} * kBlockSize);
+    if (state.range(1)) {
+      sparse_file_zeros_dont_care(s);
+    }
+    if (sparse_file_read(s, tf.fd, SPARSE_READ_MODE_NORMAL, false) < 0) {
+      state.SkipWithError("sparse_file_read failed");
+    }
+    state.PauseTiming();
+    sparse_file_destroy(s);
+    state.ResumeTiming();
+  }
+  state.SetBytesProcessed(state.iterations() * int64_t{kImageBlocks} * kBlockSize);
+}
+BENCHMARK(BM_sparse_file_read_normal)
+    ->ArgNames({"data_percent", "zeros_dont_care"})
+    ->ArgsProduct({{0, 10, 50, 90, 100}, {0, 1}});
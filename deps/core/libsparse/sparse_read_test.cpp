@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sparse/sparse.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "sparse_format.h"
+
+using SparsePtr = std::unique_ptr<sparse_file, decltype(&sparse_file_destroy)>;
+
+static constexpr unsigned int kBlockSize = 4096;
+// Regular files are read in windows of this many blocks.
+static constexpr unsigned int kWindowBlocks = 4 * 1024 * 1024 / kBlockSize;
+
+struct Chunk {
+  uint16_t type;
+  uint32_t blocks;
+  uint32_t fill_val;
+
+  bool operator==(const Chunk& other) const {
+    return type == other.type && blocks == other.blocks && fill_val == other.fill_val;
+  }
+};
+
+static void PrintTo(const Chunk& chunk, std::ostream* os) {
+  *os << std::hex << "{" << chunk.type << ", " << std::dec << chunk.blocks << ", " << std::hex
+      << chunk.fill_val << "}";
+}
+
+static int AppendCallback(void* priv, const void* data, size_t len) {
+  auto* out = reinterpret_cast<std::string*>(priv);
+  if (data) {
+    out->append(reinterpret_cast<const char*>(data), len);
+  } else {
+    out->append(len, '\0');
+  }
+  return 0;
+}
+
+// Returns the chunks of an image in the Android sparse format.
+static std::vector<Chunk> ParseChunks(const std::string& image) {
+  std::vector<Chunk> chunks;
+  sparse_header_t header;
+  memcpy(&header, image.data(), sizeof(header));
+  size_t pos = header.file_hdr_sz;
+  for (uint32_t i = 0; i < header.total_chunks; i++) {
+    chunk_header_t chunk_header;
+    memcpy(&chunk_header, image.data() + pos, sizeof(chunk_header));
+    Chunk chunk = {chunk_header.chunk_type, chunk_header.chunk_sz, 0};
+    if (chunk.type == CHUNK_TYPE_FILL) {
+      memcpy(&chunk.fill_val, image.data() + pos + header.chunk_hdr_sz, sizeof(chunk.fill_val));
+    }
+    chunks.push_back(chunk);
+    pos += chunk_header.total_sz;
+  }
+  EXPECT_EQ(image.size(), pos);
+  return chunks;
+}
+
+class SparseReadTest : public ::testing::Test {
+ protected:
+  void AddData(unsigned int blocks) {
+    for (size_t i = 0; i < blocks * kBlockSize; i++) {
+      image_.push_back((image_.size() + i) * 2654435761U >> 24);
+    }
+    chunks_.push_back({CHUNK_TYPE_RAW, blocks, 0});
+  }
+
+  void AddFill(uint32_t fill_val, unsigned int blocks, bool zeros_dont_care) {
+    for (size_t i = 0; i < blocks * kBlockSize / sizeof(fill_val); i++) {
+      image_.append(reinterpret_cast<const char*>(&fill_val), sizeof(fill_val));
+    }
+    if (fill_val == 0 && zeros_dont_care) {
+      chunks_.push_back({CHUNK_TYPE_DONT_CARE, blocks, 0});
+    } else {
+      chunks_.push_back({CHUNK_TYPE_FILL, blocks, fill_val});
+    }
+  }
+
+  // Runs of every kind, several of them crossing a read window boundary.
+  void MakeImage(bool zeros_dont_care) {
+    image_.clear();
+    chunks_.clear();
+    AddData(10);
+    AddFill(0, 5, zeros_dont_care);
+    AddFill(0xdeadbeef, 3, zeros_dont_care);
+    AddData(kWindowBlocks);
+    AddFill(0, kWindowBlocks + 300, zeros_dont_care);
+    AddFill(0x01020304, 600, zeros_dont_care);
+    // A block that only differs from a fill in its last word.
+    AddData(1);
+    memset(&image_[image_.size() - kBlockSize], 0x5a, kBlockSize - sizeof(uint32_t));
+    AddFill(0xdeadbeef, 2, zeros_dont_care);
+    AddFill(0x5a5a5a5a, 2, zeros_dont_care);
+    AddFill(0, 10, zeros_dont_care);
+
+    ASSERT_EQ(0, ftruncate(file_.fd, 0));
+    ASSERT_EQ(0, lseek(file_.fd, 0, SEEK_SET));
+    ASSERT_TRUE(android::base::WriteFully(file_.fd, image_.data(), image_.size()));
+    ASSERT_EQ(0, lseek(file_.fd, 0, SEEK_SET));
+  }
+
+  std::string image_;
+  std::vector<Chunk> chunks_;
+  TemporaryFile file_;
+};
+
+TEST_F(SparseReadTest, normal_mode_finds_runs) {
+  for (bool zeros_dont_care : {false, true}) {
+    SCOPED_TRACE(zeros_dont_care ? "zeros_dont_care" : "zeros kept");
+    MakeImage(zeros_dont_care);
+
+    SparsePtr s(sparse_file_new(kBlockSize, image_.size()), sparse_file_destroy);
+    if (zeros_dont_care) {
+      sparse_file_zeros_dont_care(s.get());
+    }
+    ASSERT_EQ(0, sparse_file_read(s.get(), file_.fd, SPARSE_READ_MODE_NORMAL, false));
+
+    std::string sparse_image;
+    ASSERT_EQ(0, sparse_file_callback(s.get(), true, false, AppendCallback, &sparse_image));
+    EXPECT_EQ(chunks_, ParseChunks(sparse_image));
+
+    std::string expanded;
+    ASSERT_EQ(0, sparse_file_callback(s.get(), false, false, AppendCallback, &expanded));
+    EXPECT_TRUE(image_ == expanded);
+  }
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sparse/sparse.h>
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+using SparsePtr = std::unique_ptr<sparse_file, decltype(&sparse_file_destroy)>;
+
+static constexpr unsigned int kBlockSize = 4096;
+
+class SparseWriteTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    data_.resize(40 * 1024 * 1024 + 1000);
+    for (size_t i = 0; i < data_.size(); i++) data_[i] = i * 2654435761U >> 24;
+    ASSERT_TRUE(android::base::WriteFully(file_.fd, data_.data(), data_.size()));
+  }
+
+  // Every kind of chunk, with gaps between them and data that isn't a whole number of blocks.
+  SparsePtr NewSparseFile(unsigned int threads) {
+    SparsePtr s(sparse_file_new(kBlockSize, 30000 * int64_t{kBlockSize}), sparse_file_destroy);
+    EXPECT_EQ(0, sparse_file_add_data(s.get(), data_.data(), 20 * 1024 * 1024 + 5, 0));
+    EXPECT_EQ(0, sparse_file_add_fill(s.get(), 0, 100 * kBlockSize, 6000));
+    EXPECT_EQ(0, sparse_file_add_fill(s.get(), 0xdeadbeef, 3 * kBlockSize, 6100));
+    EXPECT_EQ(0, sparse_file_add_fd(s.get(), file_.fd, 1000, 20 * 1024 * 1024 - 3, 7000));
+    EXPECT_EQ(0, sparse_file_add_file(s.get(), file_.path, 0, 5 * kBlockSize, 20000));
+    sparse_file_write_threads(s.get(), threads);
+    return s;
+  }
+
+  std::vector<uint8_t> data_;
+  TemporaryFile file_;
+};
+
+static int AppendCallback(void* priv, const void* data, size_t len) {
+  auto* out = reinterpret_cast<std::string*>(priv);
+  if (data) {
+    out->append(reinterpret_cast<const char*>(data), len);
+  } else {
+    out->append(len, '\0');
+  }
+  return 0;
+}
+
+TEST_F(SparseWriteTest, threads_write_the_same_sparse_file) {
+  for (bool crc : {false, true}) {
+    std::string expected, actual;
+    ASSERT_EQ(0, sparse_file_callback(NewSparseFile(1).get(), true, crc, AppendCallback,
+                                      &expected));
+    ASSERT_EQ(0, sparse_file_callback(NewSparseFile(4).get(), true, crc, AppendCallback,
+                                      &actual));
+    EXPECT_TRUE(expected == actual) << "crc " << crc;
+
+    TemporaryFile tf;
+    ASSERT_EQ(0, sparse_file_write(NewSparseFile(4).get(), tf.fd, false, true, crc));
+    std::string written;
+    ASSERT_TRUE(android::base::ReadFileToString(tf.path, &written));
+    EXPECT_TRUE(expected == written) << "crc " << crc;
+  }
+}
+
+static std::string Gunzip(const char* path) {
+  gzFile gz = gzopen(path, "rb");
+  std::string out;
+  char buf[65536];
+  int n;
+  while ((n = gzread(gz, buf, sizeof(buf))) > 0) out.append(buf, n);
+  EXPECT_EQ(0, n);
+  EXPECT_EQ(Z_OK, gzclose(gz));
+  return out;
+}
+
+TEST_F(SparseWriteTest, threads_write_the_same_gzipped_file) {
+  for (bool sparse : {false, true}) {
+    TemporaryFile expected, actual;
+    ASSERT_EQ(0, sparse_file_write(NewSparseFile(1).get(), expected.fd, true, sparse, true));
+    ASSERT_EQ(0, sparse_file_write(NewSparseFile(4).get(), actual.fd, true, sparse, true));
+    std::string expected_data = Gunzip(expected.path);
+    EXPECT_FALSE(expected_data.empty());
+    EXPECT_TRUE(expected_data == Gunzip(actual.path)) << "sparse " << sparse;
+  }
+}
+
+TEST_F(SparseWriteTest, threads_write_an_empty_gzipped_file) {
+  SparsePtr s(sparse_file_new(kBlockSize, 0), sparse_file_destroy);
+  sparse_file_write_threads(s.get(), 4);
+  TemporaryFile tf;
+  ASSERT_EQ(0, sparse_file_write(s.get(), tf.fd, true, false, false));
+  EXPECT_EQ("", Gunzip(tf.path));
+}
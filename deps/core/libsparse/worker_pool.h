@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBSPARSE_WORKER_POOL_H_
+#define _LIBSPARSE_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * A fixed set of threads that run jobs in the order they're queued.  Callers
+ * that need results in order keep the futures Async() returns in a queue of
+ * their own, and collect them from its front.
+ */
+class WorkerPool {
+ public:
+  explicit WorkerPool(unsigned int threads);
+  /* Runs the jobs still queued, then stops the threads. */
+  ~WorkerPool();
+
+  template <typename F>
+  auto Async(F&& job) -> std::future<decltype(job())> {
+    using Result = decltype(job());
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+    auto future = task->get_future();
+    Queue([task] { (*task)(); });
+    return future;
+  }
+
+  unsigned int threads() const { return threads_.size(); }
+
+ private:
+  void Queue(std::function<void()> job);
+  void Work();
+
+  std::mutex lock_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> jobs_;
+  bool stopping_ = false;
+  std::vector<std::thread> threads_;
+};
+
+#endif
@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -47,6 +48,7 @@
 
 #include "android-base/logging.h"  // and must be after windows.h for ERROR
 #include "android-base/macros.h"   // For TEMP_FAILURE_RETRY on Darwin.
+#include "android-base/mapped_file.h"
 #include "android-base/unique_fd.h"
 #include "android-base/utf8.h"
 
@@ -215,6 +217,21 @@ namespace base {
 // Versions of standard library APIs that support UTF-8 strings.
 using namespace android::base::utf8;
 
+// Large enough to keep the number of system calls down, small enough for
+// Windows' unsigned int read(2) count.
+static constexpr size_t kMaxReadSize = 1024 * 1024 * 1024;
+
+// Below this, read(2) into a copy is cheaper than mmap(2) and munmap(2).
+static constexpr off64_t kMinMappedFileSize = 64 * 1024;
+
+static void ResizeUninitialized(std::string* s, size_t size) {
+#if defined(__cpp_lib_string_resize_and_overwrite)
+  s->resize_and_overwrite(size, [](char*, size_t n) { return n; });
+#else
+  s->resize(size);
+#endif
+}
+
 bool ReadFdToString(borrowed_fd fd, std::string* content) {
   content->clear();
 
@@ -234,8 +251,25 @@ bool ReadFdToString(borrowed_fd fd, std::string* content) {
       content->shrink_to_fit();
       content->reserve(fd_size);
     }
+
+    // Read what fstat says is there straight into the string, in as few
+    // read(2) calls as the kernel allows, rather than 4 KiB at a time through
+    // a bounce buffer. The file may be shorter than fstat claimed (procfs, or
+    // an fd that isn't at offset 0), so stop at the first short read's EOF.
+    ResizeUninitialized(content, fd_size);
+    size_t size = 0;
+    while (size < fd_size) {
+      size_t chunk = std::min(fd_size - size, kMaxReadSize);
+      ssize_t n = TEMP_FAILURE_RETRY(read(fd.get(), content->data() + size, chunk));
+      if (n <= 0) {
+        content->resize(size);
+        return n == 0;
+      }
+      size += n;
+    }
   }
 
+  // Whatever fstat couldn't tell us about: files that grew, pipes, sockets...
   char buf[4096] __attribute__((__uninitialized__));
   ssize_t n;
   while ((n = TEMP_FAILURE_RETRY(read(fd.get(), &buf[0], sizeof(buf)))) > 0) {
@@ -255,6 +289,62 @@ bool ReadFileToString(const std::string& path, std::string* content, bool follow
   return ReadFdToString(fd, content);
 }
 
+FileView::FileView() = default;
+
+FileView::~FileView() = default;
+
+FileView::FileView(FileView&& other) noexcept {
+  *this = std::move(other);
+}
+
+FileView& FileView::operator=(FileView&& other) noexcept {
+  if (this != &other) {
+    mapping_ = std::move(other.mapping_);
+    content_ = std::move(other.content_);
+    // A short string's bytes live inside the std::string, so the view has to
+    // be rebuilt rather than copied.
+    view_ = mapping_ ? std::string_view(mapping_->data(), mapping_->size())
+                     : std::string_view(content_);
+    other.Reset();
+  }
+  return *this;
+}
+
+void FileView::Reset() {
+  mapping_.reset();
+  content_.clear();
+  view_ = {};
+}
+
+bool ReadFileToView(const std::string& path, FileView* view, bool follow_symlinks) {
+  view->Reset();
+
+  int flags = O_RDONLY | O_CLOEXEC | O_BINARY | (follow_symlinks ? 0 : O_NOFOLLOW);
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), flags)));
+  if (fd == -1) {
+    return false;
+  }
+
+  struct stat sb;
+  if (fstat(fd.get(), &sb) != -1 && S_ISREG(sb.st_mode) && sb.st_size >= kMinMappedFileSize &&
+      static_cast<uint64_t>(sb.st_size) <= SIZE_MAX) {
+    std::unique_ptr<MappedFile> mapping = MappedFile::FromFd(fd, 0, sb.st_size, PROT_READ);
+    if (mapping != nullptr) {
+      view->view_ = std::string_view(mapping->data(), mapping->size());
+      view->mapping_ = std::move(mapping);
+      return true;
+    }
+  }
+
+  // Too small to be worth mapping, or not mappable at all.
+  if (!ReadFdToString(fd, &view->content_)) {
+    view->Reset();
+    return false;
+  }
+  view->view_ = view->content_;
+  return true;
+}
+
 bool WriteStringToFd(std::string_view content, borrowed_fd fd) {
   const char* p = content.data();
   size_t left = content.size();
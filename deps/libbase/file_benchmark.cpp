@@ -35,4 +35,35 @@ static void BenchmarkReadFdToString(benchmark::State& state) {
   state.SetBytesProcessed(state.iterations() * state.range(0));
 }
 
-BENCHMARK_RANGE(BenchmarkReadFdToString, 0, 1024 * 1024);
+BENCHMARK_RANGE(BenchmarkReadFdToString, 0, 128 * 1024 * 1024);
+
+static void BenchmarkReadFileToString(benchmark::State& state) {
+  TemporaryFile tf;
+  CHECK(tf.fd != -1);
+  CHECK_EQ(ftruncate(tf.fd, state.range(0)), 0);
+  for (auto _ : state) {
+    std::string str;
+    benchmark::DoNotOptimize(android::base::ReadFileToString(tf.path, &str));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_RANGE(BenchmarkReadFileToString, 4096, 128 * 1024 * 1024);
+
+// Touches every page of the file, as a parser would, so that mapping and
+// reading are compared on equal terms.
+static void BenchmarkReadFileToView(benchmark::State& state) {
+  TemporaryFile tf;
+  CHECK(tf.fd != -1);
+  CHECK_EQ(ftruncate(tf.fd, state.range(0)), 0);
+  for (auto _ : state) {
+    android::base::FileView view;
+    CHECK(android::base::ReadFileToView(tf.path, &view));
+    char sum = 0;
+    for (size_t i = 0; i < view.size(); i += 4096) sum += view.data()[i];
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_RANGE(BenchmarkReadFileToView, 4096, 128 * 1024 * 1024);
@@ -414,6 +414,93 @@ TEST(file, ReadFileToString_capacity) {
   EXPECT_LT(s.capacity(), size + 16);
 }
 
+TEST(file, ReadFdToString_offset) {
+  TemporaryFile tf;
+  ASSERT_NE(tf.fd, -1) << tf.path;
+  std::string expected(256 * 1024, 'x');
+  for (size_t i = 0; i < expected.size(); i += 4096) expected[i] = 'a' + (i / 4096) % 26;
+  ASSERT_TRUE(android::base::WriteStringToFd(expected, tf.fd));
+
+  // fstat reports more than is left to read from the current offset.
+  ASSERT_EQ(1000, lseek(tf.fd, 1000, SEEK_SET)) << strerror(errno);
+  std::string s;
+  ASSERT_TRUE(android::base::ReadFdToString(tf.fd, &s)) << strerror(errno);
+  EXPECT_EQ(expected.substr(1000), s);
+}
+
+TEST(file, ReadFileToView_ENOENT) {
+  android::base::FileView view;
+  errno = 0;
+  ASSERT_FALSE(android::base::ReadFileToView("/this/does/not/exist", &view));
+  EXPECT_EQ(ENOENT, errno);
+  EXPECT_EQ(0u, view.size());
+}
+
+TEST(file, ReadFileToView_small) {
+  TemporaryFile tf;
+  ASSERT_NE(tf.fd, -1) << tf.path;
+  ASSERT_TRUE(android::base::WriteStringToFile("abc", tf.path));
+
+  android::base::FileView view;
+  ASSERT_TRUE(android::base::ReadFileToView(tf.path, &view)) << strerror(errno);
+  EXPECT_EQ("abc", view.view());
+  EXPECT_FALSE(view.mapped());
+
+  // The view must follow the bytes when they move with a short string.
+  android::base::FileView moved(std::move(view));
+  EXPECT_EQ("abc", moved.view());
+  EXPECT_EQ(0u, view.size());
+}
+
+TEST(file, ReadFileToView_empty) {
+  TemporaryFile tf;
+  ASSERT_NE(tf.fd, -1) << tf.path;
+
+  android::base::FileView view;
+  ASSERT_TRUE(android::base::ReadFileToView(tf.path, &view)) << strerror(errno);
+  EXPECT_EQ(0u, view.size());
+}
+
+TEST(file, ReadFileToView_large) {
+  TemporaryFile tf;
+  ASSERT_NE(tf.fd, -1) << tf.path;
+  std::string expected(4 * 1024 * 1024 + 123, 'x');
+  for (size_t i = 0; i < expected.size(); i += 4096) expected[i] = 'a' + (i / 4096) % 26;
+  ASSERT_TRUE(android::base::WriteStringToFile(expected, tf.path));
+
+  android::base::FileView view;
+  ASSERT_TRUE(android::base::ReadFileToView(tf.path, &view)) << strerror(errno);
+  EXPECT_TRUE(view.mapped());
+  ASSERT_EQ(expected.size(), view.size());
+  EXPECT_TRUE(view.view() == expected);
+
+  android::base::FileView moved;
+  moved = std::move(view);
+  EXPECT_TRUE(moved.mapped());
+  EXPECT_TRUE(moved.view() == expected);
+
+  // Reusing a view drops the old contents.
+  ASSERT_TRUE(android::base::WriteStringToFile("def", tf.path));
+  ASSERT_TRUE(android::base::ReadFileToView(tf.path, &moved)) << strerror(errno);
+  EXPECT_FALSE(moved.mapped());
+  EXPECT_EQ("def", moved.view());
+}
+
+#if !defined(_WIN32)
+TEST(file, ReadFileToView_pipe) {
+  android::base::unique_fd read_fd, write_fd;
+  ASSERT_TRUE(android::base::Pipe(&read_fd, &write_fd));
+  ASSERT_TRUE(android::base::WriteStringToFd("hello", write_fd));
+  write_fd.reset();
+
+  android::base::FileView view;
+  std::string path = "/proc/self/fd/" + std::to_string(read_fd.get());
+  ASSERT_TRUE(android::base::ReadFileToView(path, &view, true)) << strerror(errno);
+  EXPECT_FALSE(view.mapped());
+  EXPECT_EQ("hello", view.view());
+}
+#endif
+
 TEST(file, ReadFileToString_capacity_0) {
   TemporaryFile tf;
   ASSERT_NE(tf.fd, -1) << tf.path;
@@ -19,7 +19,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <memory>
 #include <string>
+#include <string_view>
 
 #include "android-base/macros.h"
 #include "android-base/off64_t.h"
@@ -82,6 +84,44 @@ bool ReadFdToString(borrowed_fd fd, std::string* content);
 bool ReadFileToString(const std::string& path, std::string* content,
                       bool follow_symlinks = false);
 
+class MappedFile;
+
+// The contents of a file, as returned by ReadFileToView(): either a read-only
+// mapping of the file or a private copy, depending on what the file is.
+class FileView {
+ public:
+  FileView();
+  ~FileView();
+  FileView(FileView&& other) noexcept;
+  FileView& operator=(FileView&& other) noexcept;
+
+  const char* data() const { return view_.data(); }
+  size_t size() const { return view_.size(); }
+  std::string_view view() const { return view_; }
+
+  // Returns true if the contents are mapped from the file rather than copied.
+  bool mapped() const { return mapping_ != nullptr; }
+
+ private:
+  friend bool ReadFileToView(const std::string& path, FileView* view, bool follow_symlinks);
+
+  void Reset();
+
+  std::unique_ptr<MappedFile> mapping_;
+  std::string content_;
+  std::string_view view_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileView);
+};
+
+// Like ReadFileToString(), but large regular files are mapped read-only
+// instead of being copied onto the heap. Use this for parsing big files that
+// only need to be looked at once. Pipes, device files, and small files are
+// read as usual. A mapping reflects later writes to the file, and accessing it
+// after the file is truncated raises SIGBUS, so only use this for files that
+// are not modified while the view is alive.
+bool ReadFileToView(const std::string& path, FileView* view, bool follow_symlinks = false);
+
 bool WriteStringToFile(const std::string& content, const std::string& path,
                        bool follow_symlinks = false);
 bool WriteStringToFd(std::string_view content, borrowed_fd fd);
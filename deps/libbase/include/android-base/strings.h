@@ -17,7 +17,10 @@
 #pragma once
 
 #include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
 
+#include <iterator>
 #include <sstream>
 #include <string>
 #include <string_view>
@@ -50,6 +53,141 @@ std::vector<std::string> Split(const std::string& s,
 // The empty string is not a valid delimiter list.
 std::vector<std::string> Tokenize(const std::string& s, const std::string& delimiters);
 
+// A set of delimiter bytes, for SplitView() and TokenizeView(). Finding the
+// next delimiter is vectorized on x86 and arm64: a byte compare against each
+// delimiter for sets of up to four, a nibble table lookup for larger sets
+// where the instruction set has one.
+//
+// The empty string is not a valid delimiter list.
+class DelimiterSet {
+ public:
+  explicit DelimiterSet(std::string_view delimiters);
+
+  bool Contains(char c) const {
+    auto b = static_cast<unsigned char>(c);
+    return (bitmap_[b >> 3] >> (b & 7)) & 1;
+  }
+
+  // Returns the position of the first delimiter in s at or after pos, or npos.
+  size_t Find(std::string_view s, size_t pos = 0) const;
+  // Returns the position of the first non-delimiter in s at or after pos, or npos.
+  size_t FindNot(std::string_view s, size_t pos = 0) const;
+
+ private:
+  template <bool kMatch>
+  size_t FindImpl(std::string_view s, size_t pos) const;
+
+  uint8_t bitmap_[32] = {};
+  // For each low nibble, which high nibbles 0-7 ([0]) and 8-15 ([1]) make a delimiter.
+  uint8_t nibble_table_[2][16] = {};
+  // The delimiters themselves when there are no more than four, padded by repetition.
+  char small_[4] = {};
+  size_t small_count_ = 0;
+};
+
+namespace internal {
+
+// The range behind SplitView() and TokenizeView().
+template <bool kTokenize>
+class SplitRange {
+ public:
+  class iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::string_view*;
+    using reference = const std::string_view&;
+
+    iterator() = default;
+
+    reference operator*() const { return field_; }
+    pointer operator->() const { return &field_; }
+
+    iterator& operator++() {
+      Advance(next_);
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator result = *this;
+      Advance(next_);
+      return result;
+    }
+
+    bool operator==(const iterator& other) const {
+      return range_ == other.range_ && next_ == other.next_;
+    }
+    bool operator!=(const iterator& other) const { return !(*this == other); }
+
+   private:
+    friend class SplitRange;
+
+    explicit iterator(const SplitRange* range) : range_(range) { Advance(0); }
+
+    void Advance(size_t pos) {
+      std::string_view s = range_->s_;
+      if constexpr (kTokenize) {
+        pos = range_->delimiters_.FindNot(s, pos);
+        if (pos == std::string_view::npos) {
+          range_ = nullptr;
+          next_ = 0;
+          return;
+        }
+      } else if (pos > s.size()) {
+        range_ = nullptr;
+        next_ = 0;
+        return;
+      }
+      size_t end = range_->delimiters_.Find(s, pos);
+      if (end == std::string_view::npos) end = s.size();
+      field_ = s.substr(pos, end - pos);
+      next_ = kTokenize ? end : end + 1;
+    }
+
+    const SplitRange* range_ = nullptr;
+    size_t next_ = 0;  // Where to look for the field after this one.
+    std::string_view field_;
+  };
+
+  SplitRange(std::string_view s, std::string_view delimiters) : s_(s), delimiters_(delimiters) {}
+
+  iterator begin() const { return iterator(this); }
+  iterator end() const { return iterator(); }
+
+ private:
+  std::string_view s_;
+  DelimiterSet delimiters_;
+};
+
+}  // namespace internal
+
+// Like Split(), but lazily yields std::string_views into s instead of
+// allocating a vector of copies. s must outlive the range and its views.
+//
+// Example:
+//   for (std::string_view field : SplitView(line, ":")) { ... }
+inline internal::SplitRange<false> SplitView(std::string_view s, std::string_view delimiters) {
+  return internal::SplitRange<false>(s, delimiters);
+}
+
+// Like Tokenize(), but lazily yields std::string_views into s instead of
+// allocating a vector of copies. s must outlive the range and its views.
+inline internal::SplitRange<true> TokenizeView(std::string_view s, std::string_view delimiters) {
+  return internal::SplitRange<true>(s, delimiters);
+}
+
+// Calls f(std::string_view) for each field Split() would return, without allocating.
+template <typename F>
+void SplitForEach(std::string_view s, std::string_view delimiters, F&& f) {
+  for (std::string_view field : SplitView(s, delimiters)) f(field);
+}
+
+// Calls f(std::string_view) for each token Tokenize() would return, without allocating.
+template <typename F>
+void TokenizeForEach(std::string_view s, std::string_view delimiters, F&& f) {
+  for (std::string_view token : TokenizeView(s, delimiters)) f(token);
+}
+
 namespace internal {
 template <typename>
 constexpr bool always_false_v = false;
@@ -24,6 +24,15 @@
 #include <string>
 #include <vector>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 // Wraps the posix version of strerror_r to make it available in translation units
 // that define _GNU_SOURCE.
 extern "C" int posix_strerror_r(int errnum, char* buf, size_t buflen);
@@ -34,37 +43,166 @@ namespace base {
 #define CHECK_NE(a, b) \
   if ((a) == (b)) abort();
 
-std::vector<std::string> Split(const std::string& s,
-                               const std::string& delimiters) {
+DelimiterSet::DelimiterSet(std::string_view delimiters) {
   CHECK_NE(delimiters.size(), 0U);
 
-  std::vector<std::string> result;
+  for (char c : delimiters) {
+    auto b = static_cast<unsigned char>(c);
+    bitmap_[b >> 3] |= 1 << (b & 7);
+    nibble_table_[b >> 7][b & 0xf] |= 1 << ((b >> 4) & 7);
+  }
+
+  // Duplicates don't count against the limit of four.
+  char unique[4];
+  size_t unique_count = 0;
+  for (size_t b = 0; b < 256; ++b) {
+    if (!Contains(static_cast<char>(b))) continue;
+    if (++unique_count > sizeof(unique)) break;
+    unique[unique_count - 1] = static_cast<char>(b);
+  }
+  if (unique_count <= sizeof(unique)) {
+    small_count_ = unique_count;
+    for (size_t i = 0; i < sizeof(small_); ++i) small_[i] = unique[i % unique_count];
+  }
+}
+
+// The vector scanners below look at 16 bytes at a time, starting at i, and return the index
+// of the first byte that is (kMatch) or isn't (!kMatch) a delimiter. If there is none, they
+// return where they stopped, with fewer than 16 bytes left, for the scalar loop to finish.
+
+#if defined(__SSE2__)
+
+template <bool kMatch>
+static size_t ScanSmall(const char* p, size_t n, size_t i, const char* small) {
+  const __m128i d0 = _mm_set1_epi8(small[0]);
+  const __m128i d1 = _mm_set1_epi8(small[1]);
+  const __m128i d2 = _mm_set1_epi8(small[2]);
+  const __m128i d3 = _mm_set1_epi8(small[3]);
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, d0), _mm_cmpeq_epi8(v, d1)),
+                             _mm_or_si128(_mm_cmpeq_epi8(v, d2), _mm_cmpeq_epi8(v, d3)));
+    unsigned mask = _mm_movemask_epi8(m);
+    if (!kMatch) mask ^= 0xffff;
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  return i;
+}
+
+#if defined(__SSSE3__)
+template <bool kMatch>
+static size_t ScanNibbles(const char* p, size_t n, size_t i, const uint8_t (*table)[16]) {
+  const __m128i low_table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table[0]));
+  const __m128i high_table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table[1]));
+  const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+  const __m128i nibble_mask = _mm_set1_epi8(0xf);
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    __m128i lo = _mm_and_si128(v, nibble_mask);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble_mask);
+    // Rows for high nibbles 8-15 come from the second table.
+    __m128i upper = _mm_cmpgt_epi8(hi, _mm_set1_epi8(7));
+    __m128i rows = _mm_or_si128(_mm_and_si128(upper, _mm_shuffle_epi8(high_table, lo)),
+                                _mm_andnot_si128(upper, _mm_shuffle_epi8(low_table, lo)));
+    __m128i bit = _mm_shuffle_epi8(bits, hi);
+    __m128i m = _mm_cmpeq_epi8(_mm_and_si128(rows, bit), bit);
+    unsigned mask = _mm_movemask_epi8(m);
+    if (!kMatch) mask ^= 0xffff;
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  return i;
+}
+#endif
+
+#elif defined(__aarch64__)
+
+// Returns a mask with four bits per byte of m, which must be all ones or all zeros per byte.
+static inline uint64_t NeonMask(uint8x16_t m) {
+  return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+}
 
-  size_t base = 0;
-  size_t found;
-  while (true) {
-    found = s.find_first_of(delimiters, base);
-    result.push_back(s.substr(base, found - base));
-    if (found == s.npos) break;
-    base = found + 1;
+template <bool kMatch>
+static size_t ScanSmall(const char* p, size_t n, size_t i, const char* small) {
+  const uint8x16_t d0 = vdupq_n_u8(small[0]);
+  const uint8x16_t d1 = vdupq_n_u8(small[1]);
+  const uint8x16_t d2 = vdupq_n_u8(small[2]);
+  const uint8x16_t d3 = vdupq_n_u8(small[3]);
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p + i));
+    uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, d0), vceqq_u8(v, d1)),
+                            vorrq_u8(vceqq_u8(v, d2), vceqq_u8(v, d3)));
+    if (!kMatch) m = vmvnq_u8(m);
+    uint64_t mask = NeonMask(m);
+    if (mask != 0) return i + (__builtin_ctzll(mask) >> 2);
   }
+  return i;
+}
+
+template <bool kMatch>
+static size_t ScanNibbles(const char* p, size_t n, size_t i, const uint8_t (*table)[16]) {
+  const uint8x16_t low_table = vld1q_u8(table[0]);
+  const uint8x16_t high_table = vld1q_u8(table[1]);
+  static const uint8_t kBits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+  const uint8x16_t bits = vld1q_u8(kBits);
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p + i));
+    uint8x16_t lo = vandq_u8(v, vdupq_n_u8(0xf));
+    uint8x16_t hi = vshrq_n_u8(v, 4);
+    // Rows for high nibbles 8-15 come from the second table.
+    uint8x16_t rows = vbslq_u8(vcgtq_u8(hi, vdupq_n_u8(7)), vqtbl1q_u8(high_table, lo),
+                               vqtbl1q_u8(low_table, lo));
+    uint8x16_t m = vtstq_u8(rows, vqtbl1q_u8(bits, hi));
+    if (!kMatch) m = vmvnq_u8(m);
+    uint64_t mask = NeonMask(m);
+    if (mask != 0) return i + (__builtin_ctzll(mask) >> 2);
+  }
+  return i;
+}
+
+#endif
+
+template <bool kMatch>
+size_t DelimiterSet::FindImpl(std::string_view s, size_t pos) const {
+  const char* p = s.data();
+  size_t n = s.size();
+  size_t i = pos;
+#if defined(__SSE2__) || defined(__aarch64__)
+  if (small_count_ != 0) {
+    i = ScanSmall<kMatch>(p, n, i, small_);
+  }
+#if defined(__SSSE3__) || defined(__aarch64__)
+  else {
+    i = ScanNibbles<kMatch>(p, n, i, nibble_table_);
+  }
+#endif
+#endif
+  for (; i < n; ++i) {
+    if (Contains(p[i]) == kMatch) return i;
+  }
+  return std::string_view::npos;
+}
 
+size_t DelimiterSet::Find(std::string_view s, size_t pos) const {
+  return FindImpl<true>(s, pos);
+}
+
+size_t DelimiterSet::FindNot(std::string_view s, size_t pos) const {
+  return FindImpl<false>(s, pos);
+}
+
+std::vector<std::string> Split(const std::string& s,
+                               const std::string& delimiters) {
+  std::vector<std::string> result;
+  for (std::string_view field : SplitView(s, delimiters)) {
+    result.emplace_back(field);
+  }
   return result;
 }
 
 std::vector<std::string> Tokenize(const std::string& s, const std::string& delimiters) {
-  CHECK_NE(delimiters.size(), 0U);
-
   std::vector<std::string> result;
-  size_t end = 0;
-
-  while (true) {
-    size_t base = s.find_first_not_of(delimiters, end);
-    if (base == s.npos) {
-      break;
-    }
-    end = s.find_first_of(delimiters, base);
-    result.push_back(s.substr(base, end - base));
+  for (std::string_view token : TokenizeView(s, delimiters)) {
+    result.emplace_back(token);
   }
   return result;
 }
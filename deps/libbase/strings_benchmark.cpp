@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "android-base/strings.h"
+
+#include <string>
+#include <string_view>
+
+#include <benchmark/benchmark.h>
+
+// Something shaped like /proc/self/maps: a few hundred lines of space-separated fields.
+static const std::string& MapsLikeText() {
+  static const std::string* text = [] {
+    auto* text = new std::string;
+    for (int i = 0; i < 400; ++i) {
+      *text += "7f3c2a" + std::to_string(100000 + i) + "-7f3c2a" + std::to_string(200000 + i) +
+               " r-xp 00028000 fd:01 " + std::to_string(3000000 + i) +
+               "                    /system/lib64/libexample_" + std::to_string(i) + ".so\n";
+    }
+    return text;
+  }();
+  return *text;
+}
+
+static void BenchmarkSplitLines(benchmark::State& state) {
+  const std::string& text = MapsLikeText();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(android::base::Split(text, "\n"));
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BenchmarkSplitLines);
+
+static void BenchmarkSplitViewLines(benchmark::State& state) {
+  const std::string& text = MapsLikeText();
+  for (auto _ : state) {
+    for (std::string_view line : android::base::SplitView(text, "\n")) {
+      benchmark::DoNotOptimize(line);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BenchmarkSplitViewLines);
+
+// The loop Split() used to be, with views instead of copies, for reference.
+static void BenchmarkFindFirstOfLines(benchmark::State& state) {
+  const std::string& text = MapsLikeText();
+  std::string_view s = text;
+  for (auto _ : state) {
+    size_t base = 0;
+    while (true) {
+      size_t found = s.find_first_of("\n", base);
+      benchmark::DoNotOptimize(s.substr(base, found - base));
+      if (found == s.npos) break;
+      base = found + 1;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BenchmarkFindFirstOfLines);
+
+static void BenchmarkTokenizeFields(benchmark::State& state) {
+  const std::string& text = MapsLikeText();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(android::base::Tokenize(text, " \n"));
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BenchmarkTokenizeFields);
+
+static void BenchmarkTokenizeViewFields(benchmark::State& state) {
+  const std::string& text = MapsLikeText();
+  for (auto _ : state) {
+    android::base::TokenizeForEach(text, " \n",
+                                   [](std::string_view field) { benchmark::DoNotOptimize(field); });
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BenchmarkTokenizeViewFields);
+
+// Six delimiters is too many for the byte compare, so this uses the nibble lookup if there is one.
+static void BenchmarkTokenizeViewWhitespace(benchmark::State& state) {
+  const std::string& text = MapsLikeText();
+  for (auto _ : state) {
+    android::base::TokenizeForEach(text, " \t\n\r\v\f",
+                                   [](std::string_view field) { benchmark::DoNotOptimize(field); });
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BenchmarkTokenizeViewWhitespace);
+
+BENCHMARK_MAIN();
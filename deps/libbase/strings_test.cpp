@@ -19,6 +19,7 @@
 #include <gtest/gtest.h>
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <set>
 #include <unordered_set>
@@ -129,6 +130,81 @@ TEST(strings, tokenize_beginning_trailing_delimiters) {
   ASSERT_EQ("baz", parts[2]);
 }
 
+TEST(strings, split_view) {
+  std::vector<std::string_view> parts;
+  for (std::string_view part : android::base::SplitView("foo:,bar:", ",:")) {
+    parts.push_back(part);
+  }
+  ASSERT_EQ((std::vector<std::string_view>{"foo", "", "bar", ""}), parts);
+
+  parts.clear();
+  for (std::string_view part : android::base::SplitView("", ",")) parts.push_back(part);
+  ASSERT_EQ((std::vector<std::string_view>{""}), parts);
+}
+
+TEST(strings, split_view_points_into_input) {
+  std::string s = "a b";
+  auto range = android::base::SplitView(s, " ");
+  auto it = range.begin();
+  ASSERT_EQ(s.data(), it->data());
+  ++it;
+  ASSERT_EQ(s.data() + 2, it->data());
+  ++it;
+  ASSERT_TRUE(it == range.end());
+}
+
+TEST(strings, tokenize_view) {
+  std::vector<std::string_view> parts;
+  for (std::string_view part : android::base::TokenizeView(" foo \tbar\t\t baz \t", " \t")) {
+    parts.push_back(part);
+  }
+  ASSERT_EQ((std::vector<std::string_view>{"foo", "bar", "baz"}), parts);
+
+  parts.clear();
+  for (std::string_view part : android::base::TokenizeView("  \t ", " \t")) parts.push_back(part);
+  ASSERT_EQ(0U, parts.size());
+}
+
+TEST(strings, split_for_each) {
+  std::vector<std::string_view> fields;
+  android::base::SplitForEach("1,2,,3", ",", [&](std::string_view f) { fields.push_back(f); });
+  ASSERT_EQ((std::vector<std::string_view>{"1", "2", "", "3"}), fields);
+
+  std::vector<std::string_view> tokens;
+  android::base::TokenizeForEach(",1,2,,3,", ",", [&](std::string_view t) { tokens.push_back(t); });
+  ASSERT_EQ((std::vector<std::string_view>{"1", "2", "3"}), tokens);
+}
+
+// The delimiter scanner has separate paths for small and large delimiter sets and for the
+// bytes before and after the last full vector, so compare it against std::string over many
+// lengths and sets, including bytes with the high bit set.
+TEST(strings, delimiter_set_matches_find_first_of) {
+  const std::string delimiter_sets[] = {
+      ",", " \t", ":;,", "\n\r\t ", "\x80\xff", " \t\n\r\v\f",
+      "aeiouAEIOU", std::string("\0\x7f\x80\xc3\xff,", 6),
+  };
+  std::string alphabet = "abc,:; \t\n\reiouAEIOU";
+  alphabet += std::string("\0\x7f\x80\xc3\xff", 5);
+
+  uint32_t seed = 1;
+  auto next = [&seed]() {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+  };
+  for (const std::string& delimiters : delimiter_sets) {
+    android::base::DelimiterSet set(delimiters);
+    for (size_t length = 0; length < 70; ++length) {
+      std::string s;
+      for (size_t i = 0; i < length; ++i) s += alphabet[next() % alphabet.size()];
+      for (size_t pos = 0; pos <= length; ++pos) {
+        ASSERT_EQ(s.find_first_of(delimiters, pos), set.Find(s, pos)) << length << " " << pos;
+        ASSERT_EQ(s.find_first_not_of(delimiters, pos), set.FindNot(s, pos))
+            << length << " " << pos;
+      }
+    }
+  }
+}
+
 TEST(strings, trim_empty) {
   ASSERT_EQ("", android::base::Trim(""));
 }
@@ -0,0 +1,499 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "async_logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+
+#include <private/android_logger.h>
+
+#if !defined(_WIN32)
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <android-base/macros.h>
+
+#if defined(__linux__) && !defined(__BIONIC__)
+#include <syscall.h>
+#endif
+
+// How the asynchronous logger works:
+//
+// Every thread that logs gets its own single-producer, single-consumer ring buffer. The thread
+// formats the complete line straight into its ring, with no locks and no system calls beyond
+// clock_gettime(): the "mm-DD HH:MM:SS" prefix is cached per thread and only rebuilt with
+// localtime_r()/strftime() when the second changes, and the pid and tid are cached too.
+//
+// A single background thread drains all rings, gathering the queued lines into iovecs and
+// handing them to writev() in large batches. It sleeps when there is nothing to do and producers
+// only wake it, through a mutex, when it is asleep.
+//
+// Memory is bounded by kRingSize per logging thread. A message that doesn't fit in its thread's
+// ring is dropped and counted, and the writer reports the number of dropped messages in the
+// output. FATAL messages and messages too large for a ring are written synchronously by the
+// calling thread, after everything queued before them.
+
+namespace {
+
+constexpr size_t kRingSize = 64 * 1024;  // Must be a power of two.
+constexpr size_t kMaxRecordSize = kRingSize / 4;
+constexpr uint32_t kWrapMarker = UINT32_MAX;
+constexpr size_t kMaxBatch = 1024;  // iovecs per writev(); POSIX guarantees IOV_MAX >= 16.
+constexpr auto kIdleWakeup = std::chrono::milliseconds(100);
+
+struct RecordHeader {
+  uint32_t size;  // Of the text that follows, or kWrapMarker to continue at the start.
+  int32_t fd;
+};
+
+constexpr size_t RecordSize(size_t text_size) {
+  return (sizeof(RecordHeader) + text_size + alignof(RecordHeader) - 1) &
+         ~(alignof(RecordHeader) - 1);
+}
+
+class ThreadRing {
+ public:
+  // Producer side. Returns false without writing anything if the ring is too full.
+  bool Push(int fd, const char* prefix, size_t prefix_size, const char* message,
+            size_t message_size) {
+    size_t text_size = prefix_size + message_size + 1;
+    size_t record_size = RecordSize(text_size);
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    size_t offset = head & (kRingSize - 1);
+    size_t contiguous = kRingSize - offset;
+    size_t needed = record_size > contiguous ? contiguous + record_size : record_size;
+    if (needed > kRingSize - (head - tail)) return false;
+
+    if (record_size > contiguous) {
+      reinterpret_cast<RecordHeader*>(&data_[offset])->size = kWrapMarker;
+      head += contiguous;
+      offset = 0;
+    }
+    RecordHeader* header = reinterpret_cast<RecordHeader*>(&data_[offset]);
+    header->size = text_size;
+    header->fd = fd;
+    char* text = reinterpret_cast<char*>(header + 1);
+    memcpy(text, prefix, prefix_size);
+    memcpy(text + prefix_size, message, message_size);
+    text[prefix_size + message_size] = '\n';
+    head_.store(head + record_size, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns the record at tail, or nullptr if there is none, skipping over wrap
+  // markers.
+  const RecordHeader* Peek(uint64_t* tail) const {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    while (*tail != head) {
+      size_t offset = *tail & (kRingSize - 1);
+      const RecordHeader* header = reinterpret_cast<const RecordHeader*>(&data_[offset]);
+      if (header->size != kWrapMarker) return header;
+      *tail += kRingSize - offset;
+    }
+    return nullptr;
+  }
+
+  uint64_t tail() const { return tail_.load(std::memory_order_relaxed); }
+  void Commit(uint64_t tail) { tail_.store(tail, std::memory_order_release); }
+  bool Empty() const {
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_relaxed);
+  }
+
+  std::atomic<bool> exited = false;
+
+ private:
+  alignas(64) std::atomic<uint64_t> head_ = 0;
+  alignas(64) std::atomic<uint64_t> tail_ = 0;
+  alignas(RecordHeader) char data_[kRingSize];
+};
+
+std::atomic<int> async_enabled = -1;  // -1 until the environment has been checked.
+std::atomic<uint64_t> dropped_count = 0;
+std::atomic<int> dropped_fd = STDERR_FILENO;
+// Bumped in the child after fork(), invalidating every per-thread cache.
+std::atomic<uint64_t> fork_generation = 0;
+
+uint64_t GetThreadId() {
+#if defined(__BIONIC__)
+  return gettid();
+#elif defined(__APPLE__)
+  uint64_t tid;
+  pthread_threadid_np(NULL, &tid);
+  return tid;
+#else
+  return syscall(__NR_gettid);
+#endif
+}
+
+struct ThreadCache {
+  uint64_t generation;
+  bool valid;
+  pid_t pid;
+  uint64_t tid;
+  time_t second;
+  char timestamp[sizeof("mm-DD HH:MM:SS")];
+};
+thread_local ThreadCache thread_cache;
+
+// Formats everything that precedes the message, exactly as filestream_logger() does. Returns the
+// size of the whole prefix, which may exceed size, as snprintf() does.
+size_t FormatPrefix(char* buf, size_t size, const struct __android_log_message* log_message) {
+  ThreadCache& cache = thread_cache;
+  uint64_t generation = fork_generation.load(std::memory_order_relaxed);
+  if (!cache.valid || cache.generation != generation) {
+    cache.valid = true;
+    cache.generation = generation;
+    cache.pid = getpid();
+    cache.tid = GetThreadId();
+    cache.second = -1;
+  }
+
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  if (ts.tv_sec != cache.second) {
+    struct tm now;
+    localtime_r(&ts.tv_sec, &now);
+    strftime(cache.timestamp, sizeof(cache.timestamp), "%m-%d %H:%M:%S", &now);
+    cache.second = ts.tv_sec;
+  }
+
+  static const char log_characters[] = "XXVDIWEF";
+  static_assert(arraysize(log_characters) - 1 == ANDROID_LOG_SILENT,
+                "Mismatch in size of log_characters and values in android_LogPriority");
+  int32_t priority =
+      log_message->priority > ANDROID_LOG_SILENT ? ANDROID_LOG_FATAL : log_message->priority;
+  char priority_char = log_characters[priority];
+  const char* tag = log_message->tag ? log_message->tag : " nullptr";
+  long millis = ts.tv_nsec / (1000 * 1000);
+
+  int n;
+  if (log_message->file != nullptr) {
+    n = snprintf(buf, size, "%s.%03ld %5d %5" PRIu64 " %c %-8s: %s:%u ", cache.timestamp, millis,
+                 cache.pid, cache.tid, priority_char, tag, log_message->file, log_message->line);
+  } else {
+    n = snprintf(buf, size, "%s.%03ld %5d %5" PRIu64 " %c %-8s: ", cache.timestamp, millis,
+                 cache.pid, cache.tid, priority_char, tag);
+  }
+  return n < 0 ? 0 : n;
+}
+
+bool WriteAll(int fd, struct iovec* iov, size_t count) {
+  while (count > 0) {
+    ssize_t written = writev(fd, iov, count > IOV_MAX ? IOV_MAX : count);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    while (count > 0 && static_cast<size_t>(written) >= iov->iov_len) {
+      written -= iov->iov_len;
+      ++iov;
+      --count;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+      iov->iov_len -= written;
+    }
+  }
+  return true;
+}
+
+class AsyncLogger {
+ public:
+  // Never destroyed, so that logging during or after exit() stays safe. After fork() the child
+  // starts over with a new instance, since the writer thread didn't survive.
+  static AsyncLogger* Get() {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, [] {
+      pthread_key_create(&ring_key, [](void* ring) {
+        static_cast<ThreadRing*>(ring)->exited.store(true, std::memory_order_release);
+      });
+      pthread_atfork(nullptr, nullptr, [] {
+        fork_generation.fetch_add(1, std::memory_order_relaxed);
+        pthread_setspecific(ring_key, nullptr);
+        instance.store(nullptr, std::memory_order_relaxed);
+        pthread_mutex_init(&instance_lock, nullptr);
+      });
+      atexit([] {
+        if (AsyncLogger* logger = instance.load(std::memory_order_acquire); logger) {
+          logger->Drain();
+        }
+      });
+    });
+
+    AsyncLogger* logger = instance.load(std::memory_order_acquire);
+    if (logger == nullptr) {
+      pthread_mutex_lock(&instance_lock);
+      logger = instance.load(std::memory_order_relaxed);
+      if (logger == nullptr) {
+        logger = new AsyncLogger();
+        instance.store(logger, std::memory_order_release);
+      }
+      pthread_mutex_unlock(&instance_lock);
+    }
+    return logger;
+  }
+
+  static AsyncLogger* GetIfCreated() { return instance.load(std::memory_order_acquire); }
+
+  void Write(int fd, const struct __android_log_message* log_message) {
+    char prefix[256];
+    size_t prefix_size = FormatPrefix(prefix, sizeof(prefix), log_message);
+    size_t message_size = strlen(log_message->message);
+
+    if (log_message->priority >= ANDROID_LOG_FATAL || prefix_size >= sizeof(prefix) ||
+        prefix_size + message_size + 1 > kMaxRecordSize) {
+      WriteSync(fd, prefix, prefix_size, log_message);
+      return;
+    }
+
+    ThreadRing* ring = RingForThisThread();
+    if (!ring->Push(fd, prefix, prefix_size, log_message->message, message_size)) {
+      dropped_fd.store(fd, std::memory_order_relaxed);
+      dropped_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Pairs with the fence in Run(): either the writer sees our record before going to sleep,
+    // or we see that it is asleep and wake it.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_relaxed)) {
+      std::lock_guard lock(wake_lock_);
+      wake_.notify_one();
+    }
+  }
+
+  // Writes everything queued so far. Returns whether there was anything to write.
+  bool Drain() {
+    std::lock_guard drain_lock(drain_lock_);
+    std::vector<ThreadRing*>& rings = drain_rings_;
+    CollectRings(&rings);
+
+    struct iovec iov[kMaxBatch];
+    size_t count = 0;
+    int batch_fd = -1;
+    std::vector<std::pair<ThreadRing*, uint64_t>>& pending = drain_pending_;
+    auto flush = [&] {
+      if (count > 0) WriteAll(batch_fd, iov, count);
+      count = 0;
+      for (auto& [ring, tail] : pending) ring->Commit(tail);
+      pending.clear();
+    };
+
+    bool wrote = false;
+    for (ThreadRing* ring : rings) {
+      uint64_t tail = ring->tail();
+      const RecordHeader* header;
+      while ((header = ring->Peek(&tail)) != nullptr) {
+        if (count == kMaxBatch || (count > 0 && header->fd != batch_fd)) {
+          pending.emplace_back(ring, tail);
+          flush();
+        }
+        batch_fd = header->fd;
+        iov[count].iov_base = const_cast<RecordHeader*>(header + 1);
+        iov[count].iov_len = header->size;
+        ++count;
+        tail += RecordSize(header->size);
+        wrote = true;
+      }
+      pending.emplace_back(ring, tail);
+    }
+    flush();
+
+    ReportDropped();
+    return wrote;
+  }
+
+ private:
+  AsyncLogger() { std::thread([this] { Run(); }).detach(); }
+
+  ThreadRing* RingForThisThread() {
+    ThreadRing* ring = static_cast<ThreadRing*>(pthread_getspecific(ring_key));
+    if (ring == nullptr) {
+      ring = new ThreadRing();
+      pthread_setspecific(ring_key, ring);
+      std::lock_guard lock(rings_lock_);
+      rings_.push_back(ring);
+    }
+    return ring;
+  }
+
+  // Copies the current rings into *rings, first freeing those whose thread has exited and which
+  // have been drained.
+  void CollectRings(std::vector<ThreadRing*>* rings) {
+    std::lock_guard lock(rings_lock_);
+    std::erase_if(rings_, [](ThreadRing* ring) {
+      if (!ring->exited.load(std::memory_order_acquire) || !ring->Empty()) return false;
+      delete ring;
+      return true;
+    });
+    rings->assign(rings_.begin(), rings_.end());
+  }
+
+  bool HasPending() {
+    std::lock_guard lock(rings_lock_);
+    for (ThreadRing* ring : rings_) {
+      if (!ring->Empty()) return true;
+    }
+    return false;
+  }
+
+  void ReportDropped() {
+    uint64_t dropped = dropped_count.load(std::memory_order_relaxed);
+    if (dropped == reported_dropped_) return;
+
+    char message[64];
+    snprintf(message, sizeof(message), "%" PRIu64 " log messages dropped",
+             dropped - reported_dropped_);
+    reported_dropped_ = dropped;
+    __android_log_message log_message = {
+        sizeof(__android_log_message), LOG_ID_DEFAULT, ANDROID_LOG_WARN, "liblog", nullptr, 0,
+        message};
+    char prefix[256];
+    size_t prefix_size = FormatPrefix(prefix, sizeof(prefix), &log_message);
+    struct iovec iov[] = {{prefix, prefix_size}, {message, strlen(message)}, {(void*)"\n", 1}};
+    WriteAll(dropped_fd.load(std::memory_order_relaxed), iov, arraysize(iov));
+  }
+
+  void WriteSync(int fd, const char* prefix, size_t prefix_size,
+                 const struct __android_log_message* log_message) {
+    char* long_prefix = nullptr;
+    if (prefix_size >= 256) {
+      long_prefix = static_cast<char*>(malloc(prefix_size + 1));
+      if (long_prefix == nullptr) return;
+      prefix_size = FormatPrefix(long_prefix, prefix_size + 1, log_message);
+      prefix = long_prefix;
+    }
+
+    Drain();
+    struct iovec iov[] = {{const_cast<char*>(prefix), prefix_size},
+                          {const_cast<char*>(log_message->message), strlen(log_message->message)},
+                          {(void*)"\n", 1}};
+    WriteAll(fd, iov, arraysize(iov));
+    free(long_prefix);
+  }
+
+  void Run() {
+    while (true) {
+      if (Drain()) continue;
+
+      std::unique_lock lock(wake_lock_);
+      sleeping_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!HasPending()) {
+        // The timeout also gets dropped-message reports out when nothing else is logged.
+        wake_.wait_for(lock, kIdleWakeup);
+      }
+      sleeping_.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  static pthread_key_t ring_key;
+  static std::atomic<AsyncLogger*> instance;
+  static pthread_mutex_t instance_lock;
+
+  std::mutex rings_lock_;
+  std::vector<ThreadRing*> rings_;
+  std::mutex drain_lock_;
+  // Only used by Drain(), kept around to save allocating them every time.
+  std::vector<ThreadRing*> drain_rings_;
+  std::vector<std::pair<ThreadRing*, uint64_t>> drain_pending_;
+  uint64_t reported_dropped_ = 0;
+  std::mutex wake_lock_;
+  std::condition_variable wake_;
+  std::atomic<bool> sleeping_ = false;
+};
+
+pthread_key_t AsyncLogger::ring_key;
+std::atomic<AsyncLogger*> AsyncLogger::instance = nullptr;
+pthread_mutex_t AsyncLogger::instance_lock = PTHREAD_MUTEX_INITIALIZER;
+
+}  // namespace
+
+bool AsyncLoggerEnabled() {
+  int enabled = async_enabled.load(std::memory_order_relaxed);
+  if (enabled == -1) {
+#if defined(__ANDROID__)
+    enabled = 0;
+#else
+    const char* env = getenv("ANDROID_LOG_ASYNC");
+    enabled = env != nullptr && strcmp(env, "1") == 0;
+#endif
+    int expected = -1;
+    async_enabled.compare_exchange_strong(expected, enabled, std::memory_order_relaxed);
+    enabled = async_enabled.load(std::memory_order_relaxed);
+  }
+  return enabled == 1;
+}
+
+void AsyncLoggerWrite(int fd, const struct __android_log_message* log_message) {
+  AsyncLogger::Get()->Write(fd, log_message);
+}
+
+void __android_log_set_async_logging(bool enabled) {
+  if (enabled) {
+    // Anything the synchronous loggers left in stdio buffers goes out first.
+    fflush(nullptr);
+  }
+  async_enabled.store(enabled, std::memory_order_relaxed);
+  if (!enabled) {
+    __android_log_async_flush();
+  }
+}
+
+void __android_log_async_flush() {
+  if (AsyncLogger* logger = AsyncLogger::GetIfCreated(); logger) {
+    logger->Drain();
+  }
+}
+
+uint64_t __android_log_get_async_dropped_count() {
+  return dropped_count.load(std::memory_order_relaxed);
+}
+
+#else  // defined(_WIN32)
+
+bool AsyncLoggerEnabled() {
+  return false;
+}
+
+void AsyncLoggerWrite(int, const struct __android_log_message*) {}
+
+void __android_log_set_async_logging(bool) {}
+
+void __android_log_async_flush() {}
+
+uint64_t __android_log_get_async_dropped_count() {
+  return 0;
+}
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android/log.h>
+
+// Whether text loggers writing to a file descriptor should go through AsyncLoggerWrite(), as
+// enabled by __android_log_set_async_logging() or ANDROID_LOG_ASYNC=1 on host.
+bool AsyncLoggerEnabled();
+
+// Formats log_message on the calling thread and queues it for the background writer, which
+// appends it to fd. FATAL messages are written, along with everything queued before them,
+// before this returns.
+void AsyncLoggerWrite(int fd, const struct __android_log_message* log_message);
@@ -20,7 +20,14 @@
 #include <stdint.h>
 
 #ifdef __cplusplus
+#include <string.h>
+
+#include <algorithm>
 #include <string>
+#if __cplusplus >= 201703L
+#include <string_view>
+#include <type_traits>
+#endif
 #endif
 
 #include <log/log.h>
@@ -270,6 +277,158 @@ class android_log_event_list {
     return ret >= 0;
   }
 };
+
+#if __cplusplus >= 201703L
+/*
+ * Encoding of one element of type T in an android_log_event_builder.
+ * Integers of up to 32 bits are written as EVENT_TYPE_INT, 64-bit integers
+ * as EVENT_TYPE_LONG, float as EVENT_TYPE_FLOAT, and const char*,
+ * std::string and std::string_view as EVENT_TYPE_STRING.
+ */
+template <typename T, typename = void>
+struct android_log_event_element {
+  static_assert(sizeof(T) == 0, "unsupported event element type");
+};
+
+template <typename T>
+struct android_log_event_element<
+    T, std::enable_if_t<std::is_integral_v<T> && (sizeof(T) <= sizeof(int32_t))>> {
+  static constexpr size_t fixed_size = 1 + sizeof(int32_t);
+  static uint8_t* encode(uint8_t* p, T value, size_t*) {
+    int32_t data = static_cast<int32_t>(value);
+    *p = EVENT_TYPE_INT;
+    memcpy(p + 1, &data, sizeof(data));
+    return p + fixed_size;
+  }
+};
+
+template <typename T>
+struct android_log_event_element<
+    T, std::enable_if_t<std::is_integral_v<T> && (sizeof(T) == sizeof(int64_t))>> {
+  static constexpr size_t fixed_size = 1 + sizeof(int64_t);
+  static uint8_t* encode(uint8_t* p, T value, size_t*) {
+    int64_t data = static_cast<int64_t>(value);
+    *p = EVENT_TYPE_LONG;
+    memcpy(p + 1, &data, sizeof(data));
+    return p + fixed_size;
+  }
+};
+
+template <>
+struct android_log_event_element<float> {
+  static constexpr size_t fixed_size = 1 + sizeof(float);
+  static uint8_t* encode(uint8_t* p, float value, size_t*) {
+    *p = EVENT_TYPE_FLOAT;
+    memcpy(p + 1, &value, sizeof(value));
+    return p + fixed_size;
+  }
+};
+
+/* Strings only count their header as fixed; their text is truncated to fit. */
+template <>
+struct android_log_event_element<std::string_view> {
+  static constexpr size_t fixed_size = 1 + sizeof(int32_t);
+  static uint8_t* encode(uint8_t* p, std::string_view value, size_t* string_space) {
+    int32_t length = static_cast<int32_t>(std::min(value.size(), *string_space));
+    *string_space -= length;
+    *p = EVENT_TYPE_STRING;
+    memcpy(p + 1, &length, sizeof(length));
+    memcpy(p + fixed_size, value.data(), length);
+    return p + fixed_size + length;
+  }
+};
+
+template <>
+struct android_log_event_element<std::string>
+    : android_log_event_element<std::string_view> {};
+
+template <>
+struct android_log_event_element<const char*> {
+  static constexpr size_t fixed_size = 1 + sizeof(int32_t);
+  static uint8_t* encode(uint8_t* p, const char* value, size_t* string_space) {
+    return android_log_event_element<std::string_view>::encode(p, value ? value : "",
+                                                               string_space);
+  }
+};
+
+template <>
+struct android_log_event_element<char*> : android_log_event_element<const char*> {};
+
+/*
+ * Encodes a whole event in one go, without an android_log_context, into a
+ * buffer that is handed to the writer as is. The size of an event without
+ * strings is known at compile time, and so is its buffer. With strings, the
+ * buffer is the maximum payload, and strings are truncated to fit it.
+ *
+ * The encoding is the same as android_log_event_list produces for the same
+ * elements: a single element stands alone, more are wrapped in a list.
+ *
+ *   android_log_event_builder(pid, uid, name).write(LOG_ID_EVENTS, tag);
+ *   android_log_write_event(LOG_ID_EVENTS, tag, pid, uid, name);
+ */
+template <typename... Args>
+class android_log_event_builder {
+ private:
+  static constexpr size_t max_size = LOGGER_ENTRY_MAX_PAYLOAD - sizeof(int32_t);
+  static constexpr size_t header_size = sizeof...(Args) == 1 ? 0 : 2;
+  static constexpr size_t fixed_size =
+      header_size + (android_log_event_element<Args>::fixed_size + ... + 0);
+  static constexpr bool has_strings =
+      (std::is_convertible_v<Args, std::string_view> || ...);
+
+  static_assert(sizeof...(Args) > 0, "an event needs at least one element");
+  static_assert(sizeof...(Args) <= UINT8_MAX, "too many elements for one event list");
+  static_assert(fixed_size <= max_size, "event does not fit in a log entry");
+
+  uint8_t buffer[has_strings ? max_size : fixed_size];
+  size_t len;
+
+ public:
+  explicit android_log_event_builder(const Args&... args) {
+    uint8_t* p = buffer;
+    if constexpr (header_size != 0) {
+      p[0] = EVENT_TYPE_LIST;
+      p[1] = sizeof...(Args);
+      p += header_size;
+    }
+    size_t string_space = sizeof(buffer) - fixed_size;
+    ((p = android_log_event_element<Args>::encode(p, args, &string_space)), ...);
+    len = p - buffer;
+  }
+
+  android_log_event_builder(const android_log_event_builder&) = delete;
+  void operator=(const android_log_event_builder&) = delete;
+
+  const void* data() const {
+    return buffer;
+  }
+  size_t size() const {
+    return len;
+  }
+
+  /* NB: LOG_ID_EVENTS and LOG_ID_STATS only */
+  int write(log_id_t id, uint32_t tag) const {
+    switch (id) {
+      case LOG_ID_EVENTS:
+        return __android_log_bwrite(tag, buffer, len);
+      case LOG_ID_STATS:
+        return __android_log_stats_bwrite(tag, buffer, len);
+      default:
+        return -EINVAL;
+    }
+  }
+};
+
+/* The const keeps string literals as const char* rather than char*. */
+template <typename... Args>
+android_log_event_builder(const Args&...)
+    -> android_log_event_builder<std::decay_t<const Args>...>;
+
+template <typename... Args>
+int android_log_write_event(log_id_t id, uint32_t tag, const Args&... args) {
+  return android_log_event_builder<std::decay_t<const Args>...>(args...).write(id, tag);
+}
+#endif /* __cplusplus >= 201703L */
 }
 #endif
 
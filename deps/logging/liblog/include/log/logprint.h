@@ -113,6 +113,14 @@ int android_log_addFilterString(AndroidLogFormat* p_format,
 int android_log_shouldPrintLine(AndroidLogFormat* p_format, const char* tag,
                                 android_LogPriority pri);
 
+/**
+ * returns 1 if a log line of this priority would be printed for some tag,
+ * and 0 if it would be filtered out whatever its tag, in which case there's
+ * no need to decode it with android_log_processLogBuffer() first
+ */
+int android_log_shouldPrintPriority(AndroidLogFormat* p_format,
+                                    android_LogPriority pri);
+
 /**
  * Splits a wire-format buffer into an AndroidLogEntry
  * entry allocated by caller. Pointers will point directly into buf
@@ -152,6 +160,49 @@ char* android_log_formatLogLine(AndroidLogFormat* p_format, char* defaultBuffer,
  */
 size_t android_log_printLogLine(AndroidLogFormat* p_format, FILE* fp, const AndroidLogEntry* entry);
 
+/**
+ * A batch formats many log messages into one large buffer, as
+ * android_log_formatLogLine() would, and writes them to a file descriptor
+ * whenever the buffer fills up.  It breaks down each second of log time into
+ * a local date once, so the timezone must not change while it's in use.
+ *
+ * Assumes single threaded execution
+ */
+typedef struct AndroidLogBatch_t AndroidLogBatch;
+
+/**
+ * Creates a batch that formats with p_format, which must outlive it, and
+ * writes to fd.
+ */
+AndroidLogBatch* android_log_batch_new(AndroidLogFormat* p_format, int fd);
+
+/**
+ * Flushes the batch and frees it.
+ */
+void android_log_batch_free(AndroidLogBatch* batch);
+
+/**
+ * Formats a log message into the batch.
+ *
+ * Returns the length of the formatted message, or -1 if writing out the
+ * batch failed, with errno set.
+ */
+ssize_t android_log_batch_printLogLine(AndroidLogBatch* batch, const AndroidLogEntry* entry);
+
+/**
+ * Adds len bytes of already formatted text to the batch.
+ *
+ * Returns len, or -1 if writing out the batch failed, with errno set.
+ */
+ssize_t android_log_batch_write(AndroidLogBatch* batch, const char* buf, size_t len);
+
+/**
+ * Writes out everything in the batch.
+ *
+ * Returns 0 on success and -1 on failure, with errno set.
+ */
+int android_log_batch_flush(AndroidLogBatch* batch);
+
 #ifdef __cplusplus
 }
 #endif
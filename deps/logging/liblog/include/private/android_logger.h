@@ -146,6 +146,19 @@ int __android_log_security(); /* Device Owner is present */
 /* Retrieve the composed event buffer */
 int android_log_write_list_buffer(android_log_context ctx, const char** msg);
 
+/*
+ * Route the stderr and file loggers through a background writer thread. Lines
+ * are formatted by the logging thread into a per-thread ring buffer and written
+ * in batches; when a thread's ring is full its messages are dropped and
+ * counted. FATAL messages are always written synchronously. On host this is
+ * also enabled by ANDROID_LOG_ASYNC=1 in the environment.
+ */
+void __android_log_set_async_logging(bool enabled);
+/* Write out everything queued by the asynchronous logger. */
+void __android_log_async_flush();
+/* Number of messages the asynchronous logger has dropped so far. */
+uint64_t __android_log_get_async_dropped_count();
+
 #if defined(__cplusplus)
 }
 #endif
@@ -37,6 +37,7 @@
 #include <private/android_logger.h>
 
 #include "android/log.h"
+#include "async_logger.h"
 #include "log/log_read.h"
 #include "logger.h"
 #include "uio.h"
@@ -254,6 +255,11 @@ static uint64_t GetThreadId() {
 }
 
 static void filestream_logger(const struct __android_log_message* log_message, FILE* stream) {
+  if (AsyncLoggerEnabled()) {
+    AsyncLoggerWrite(fileno(stream), log_message);
+    return;
+  }
+
   struct timespec ts;
   clock_gettime(CLOCK_REALTIME, &ts);
 
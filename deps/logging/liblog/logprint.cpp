@@ -31,11 +31,17 @@
 #include <string.h>
 #include <sys/param.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include <wchar.h>
 
 #include <cutils/list.h>
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include <log/log.h>
 #include <log/log_read.h>
@@ -44,15 +50,145 @@
 #define MS_PER_NSEC 1000000
 #define US_PER_NSEC 1000
 
-typedef struct FilterInfo_t {
-  char* mTag;
-  android_LogPriority mPri;
-  struct FilterInfo_t* p_next;
-} FilterInfo;
+namespace {
+
+/*
+ * The filter rules of an AndroidLogFormat, compiled into an open-addressed hash table of interned
+ * tags, since android_log_shouldPrintLine() looks up the tag of every line that's read.
+ */
+class FilterTable {
+ public:
+  FilterTable() : generation_(NextGeneration()) {}
+
+  /* Sets the priority of the rule for tag, replacing any earlier rule for it. */
+  void Set(std::string_view tag, android_LogPriority pri);
+
+  /* Returns the priority of the rule for tag, or ANDROID_LOG_UNKNOWN if there's none. */
+  android_LogPriority Find(std::string_view tag) const;
+
+  /* The lowest priority of any rule, or ANDROID_LOG_SILENT if there are none. */
+  android_LogPriority min_pri() const { return min_pri_; }
+
+ private:
+  struct Rule {
+    std::string tag;
+    uint64_t hash;
+    android_LogPriority pri;
+  };
+
+  /* The last tag looked up on this thread and its result, since logs come in bursts. */
+  struct LastLookup {
+    static constexpr size_t kMaxTagLen = 64;
+
+    uint64_t generation = 0;
+    size_t tag_len;
+    char tag[kMaxTagLen];
+    android_LogPriority pri;
+  };
+
+  static constexpr size_t kMaxLinearRules = 4;
+
+  static uint64_t Hash(std::string_view tag);
+  static uint64_t NextGeneration();
+
+  std::vector<Rule> rules_;
+  /* Each slot is 1 + an index into rules_, or 0 if unused.  The size is a power of two. */
+  std::vector<uint32_t> slots_;
+  android_LogPriority min_pri_ = ANDROID_LOG_SILENT;
+  /* Identifies this table and its rules to the LastLookup of each thread. */
+  uint64_t generation_;
+
+  static thread_local LastLookup last_lookup_;
+};
+
+thread_local FilterTable::LastLookup FilterTable::last_lookup_;
+
+uint64_t FilterTable::Hash(std::string_view tag) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (char c : tag) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+uint64_t FilterTable::NextGeneration() {
+  static std::atomic<uint64_t> generation = 0;
+  return ++generation;
+}
+
+void FilterTable::Set(std::string_view tag, android_LogPriority pri) {
+  generation_ = NextGeneration();
+
+  uint64_t hash = Hash(tag);
+  size_t mask = slots_.size() - 1;
+  for (size_t i = hash; !slots_.empty() && slots_[i & mask] != 0; ++i) {
+    Rule& rule = rules_[slots_[i & mask] - 1];
+    if (rule.hash == hash && rule.tag == tag) {
+      rule.pri = pri;
+      min_pri_ = ANDROID_LOG_SILENT;
+      for (const Rule& r : rules_) min_pri_ = std::min(min_pri_, r.pri);
+      return;
+    }
+  }
+
+  rules_.push_back({std::string(tag), hash, pri});
+  min_pri_ = std::min(min_pri_, pri);
+
+  /* Keep the table at most half full, growing it and reinserting every rule as needed. */
+  if (rules_.size() * 2 > slots_.size()) {
+    slots_.assign(std::max<size_t>(16, slots_.size() * 2), 0);
+    mask = slots_.size() - 1;
+    for (size_t index = 0; index < rules_.size() - 1; ++index) {
+      size_t i = rules_[index].hash;
+      while (slots_[i & mask] != 0) ++i;
+      slots_[i & mask] = index + 1;
+    }
+  }
+  size_t i = hash;
+  while (slots_[i & mask] != 0) ++i;
+  slots_[i & mask] = rules_.size();
+}
+
+android_LogPriority FilterTable::Find(std::string_view tag) const {
+  /* A few rules are quicker to compare than to hash the tag. */
+  if (rules_.size() <= kMaxLinearRules) {
+    for (const Rule& rule : rules_) {
+      if (rule.tag == tag) return rule.pri;
+    }
+    return ANDROID_LOG_UNKNOWN;
+  }
+
+  LastLookup& last = last_lookup_;
+  if (last.generation == generation_ && last.tag_len == tag.size() &&
+      memcmp(last.tag, tag.data(), tag.size()) == 0) {
+    return last.pri;
+  }
+
+  android_LogPriority pri = ANDROID_LOG_UNKNOWN;
+  uint64_t hash = Hash(tag);
+  size_t mask = slots_.size() - 1;
+  for (size_t i = hash; slots_[i & mask] != 0; ++i) {
+    const Rule& rule = rules_[slots_[i & mask] - 1];
+    if (rule.hash == hash && rule.tag == tag) {
+      pri = rule.pri;
+      break;
+    }
+  }
+
+  if (tag.size() <= LastLookup::kMaxTagLen) {
+    last.generation = generation_;
+    last.tag_len = tag.size();
+    memcpy(last.tag, tag.data(), tag.size());
+    last.pri = pri;
+  }
+  return pri;
+}
+
+}  // namespace
 
 struct AndroidLogFormat_t {
   android_LogPriority global_pri;
-  FilterInfo* filters;
+  FilterTable filters;
   AndroidLogPrintFormat format;
   bool colored_output;
   bool usec_time_output;
@@ -89,18 +225,6 @@ static bool descriptive_output = false;
 #define ANDROID_COLOR_RED 31
 #define ANDROID_COLOR_YELLOW 33
 
-static FilterInfo* filterinfo_new(const char* tag, android_LogPriority pri) {
-  FilterInfo* p_ret;
-
-  p_ret = (FilterInfo*)calloc(1, sizeof(FilterInfo));
-  p_ret->mTag = strdup(tag);
-  p_ret->mPri = pri;
-
-  return p_ret;
-}
-
-/* balance to above, filterinfo_free left unimplemented */
-
 /*
  * Note: also accepts 0-9 priorities
  * returns ANDROID_LOG_UNKNOWN if the character is unrecognized
@@ -176,19 +300,11 @@ static int colorFromPri(android_LogPriority pri) {
 }
 
 static android_LogPriority filterPriForTag(AndroidLogFormat* p_format, const char* tag) {
-  FilterInfo* p_curFilter;
-
-  for (p_curFilter = p_format->filters; p_curFilter != NULL; p_curFilter = p_curFilter->p_next) {
-    if (0 == strcmp(tag, p_curFilter->mTag)) {
-      if (p_curFilter->mPri == ANDROID_LOG_DEFAULT) {
-        return p_format->global_pri;
-      } else {
-        return p_curFilter->mPri;
-      }
-    }
+  android_LogPriority pri = p_format->filters.Find(tag);
+  if (pri == ANDROID_LOG_UNKNOWN || pri == ANDROID_LOG_DEFAULT) {
+    return p_format->global_pri;
   }
-
-  return p_format->global_pri;
+  return pri;
 }
 
 /**
@@ -200,10 +316,20 @@ int android_log_shouldPrintLine(AndroidLogFormat* p_format, const char* tag,
   return pri >= filterPriForTag(p_format, tag);
 }
 
+/**
+ * returns 1 if a log line of this priority would be printed for some tag,
+ * and 0 if it would be filtered out whatever its tag
+ */
+int android_log_shouldPrintPriority(AndroidLogFormat* p_format, android_LogPriority pri) {
+  android_LogPriority min_pri = p_format->filters.min_pri();
+  if (min_pri == ANDROID_LOG_DEFAULT) min_pri = ANDROID_LOG_VERBOSE;
+  return pri >= std::min(p_format->global_pri, min_pri);
+}
+
 AndroidLogFormat* android_log_format_new() {
   AndroidLogFormat* p_ret;
 
-  p_ret = static_cast<AndroidLogFormat*>(calloc(1, sizeof(AndroidLogFormat)));
+  p_ret = new AndroidLogFormat();
 
   p_ret->global_pri = ANDROID_LOG_VERBOSE;
   p_ret->format = FORMAT_BRIEF;
@@ -225,18 +351,7 @@ AndroidLogFormat* android_log_format_new() {
 static list_declare(convertHead);
 
 void android_log_format_free(AndroidLogFormat* p_format) {
-  FilterInfo *p_info, *p_info_old;
-
-  p_info = p_format->filters;
-
-  while (p_info != NULL) {
-    p_info_old = p_info;
-    p_info = p_info->p_next;
-
-    free(p_info_old);
-  }
-
-  free(p_format);
+  delete p_format;
 
   /* Free conversion resource, can always be reconstructed */
   while (!list_empty(&convertHead)) {
@@ -401,25 +516,7 @@ int android_log_addFilterRule(AndroidLogFormat* p_format, const char* filterExpr
       pri = ANDROID_LOG_VERBOSE;
     }
 
-    char* tagName;
-
-/*
- * Presently HAVE_STRNDUP is never defined, so the second case is always taken
- * Darwin doesn't have strndup, everything else does
- */
-#ifdef HAVE_STRNDUP
-    tagName = strndup(filterExpression, tagNameLength);
-#else
-    /* a few extra bytes copied... */
-    tagName = strdup(filterExpression);
-    tagName[tagNameLength] = '\0';
-#endif /*HAVE_STRNDUP*/
-
-    FilterInfo* p_fi = filterinfo_new(tagName, pri);
-    free(tagName);
-
-    p_fi->p_next = p_format->filters;
-    p_format->filters = p_fi;
+    p_format->filters.Set(std::string_view(filterExpression, tagNameLength), pri);
   }
 
   return 0;
@@ -1613,6 +1710,8 @@ char* android_log_formatLogLine(AndroidLogFormat* p_format, char* defaultBuffer,
     }
     /* plus one line for anything not newline-terminated at the end */
     if (pm > entry->message && *(pm - 1) != '\n') numLines++;
+    /* an empty message is still printed as one line */
+    if (numLines == 0) numLines = 1;
   }
 
   /*
@@ -1704,3 +1803,391 @@ size_t android_log_printLogLine(AndroidLogFormat* p_format, FILE* fp,
   if (line != buf) free(line);
   return bytesWritten;
 }
+
+namespace {
+
+/* Appends to a fixed size buffer, truncating whatever doesn't fit, as snprintf() does. */
+class TruncatingWriter {
+ public:
+  TruncatingWriter(char* buf, size_t size) : begin_(buf), p_(buf), end_(buf + size) {}
+
+  size_t size() const { return p_ - begin_; }
+
+  void Append(char c) {
+    if (p_ < end_) *p_++ = c;
+  }
+
+  void Append(const char* s, size_t n) {
+    n = std::min(n, static_cast<size_t>(end_ - p_));
+    memcpy(p_, s, n);
+    p_ += n;
+  }
+
+  /* Like "%-*.*s", where n is the length of s. */
+  void AppendLeftJustified(const char* s, size_t n, size_t width) {
+    Append(s, n);
+    for (; n < width; ++n) Append(' ');
+  }
+
+  /* Like "%*lld". */
+  void AppendInt(long long value, size_t width) {
+    char digits[24];
+    char* d = digits + sizeof(digits);
+    unsigned long long magnitude = value < 0 ? 0ULL - value : value;
+    do {
+      *--d = '0' + magnitude % 10;
+      magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) *--d = '-';
+    size_t n = digits + sizeof(digits) - d;
+    for (size_t i = n; i < width; ++i) Append(' ');
+    Append(d, n);
+  }
+
+  /* Like "%0*lu". */
+  void AppendZeroPadded(unsigned long value, size_t width) {
+    char digits[24];
+    char* d = digits + sizeof(digits);
+    do {
+      *--d = '0' + value % 10;
+      value /= 10;
+    } while (value != 0);
+    size_t n = digits + sizeof(digits) - d;
+    for (size_t i = n; i < width; ++i) Append('0');
+    Append(d, n);
+  }
+
+ private:
+  char* begin_;
+  char* p_;
+  char* end_;
+};
+
+int writeFully(int fd, const char* buf, size_t len) {
+  while (len > 0) {
+    ssize_t rc = write(fd, buf, len);
+    if (rc < 0 && errno == EINTR) continue;
+    if (rc <= 0) return -1;
+    buf += rc;
+    len -= rc;
+  }
+  return 0;
+}
+
+}  // namespace
+
+struct AndroidLogBatch_t {
+  static constexpr size_t kBufferSize = 128 * 1024;
+
+  AndroidLogFormat* format;
+  int fd;
+  std::unique_ptr<char[]> buffer{new char[kBufferSize]};
+  size_t used = 0;
+
+  /* The local date, time and zone of the second last formatted. */
+  bool has_cached_time = false;
+  time_t cached_time_sec;
+  bool cached_time_year;
+  char cached_date[48];
+  size_t cached_date_len;
+  char cached_zone[16];
+  size_t cached_zone_len;
+};
+
+AndroidLogBatch* android_log_batch_new(AndroidLogFormat* p_format, int fd) {
+  AndroidLogBatch* batch = new AndroidLogBatch();
+  batch->format = p_format;
+  batch->fd = fd;
+  return batch;
+}
+
+void android_log_batch_free(AndroidLogBatch* batch) {
+  android_log_batch_flush(batch);
+  delete batch;
+}
+
+int android_log_batch_flush(AndroidLogBatch* batch) {
+  size_t used = batch->used;
+  batch->used = 0;
+  return writeFully(batch->fd, batch->buffer.get(), used);
+}
+
+/* Makes room for len more bytes in the buffer, returning NULL if they can't ever fit. */
+static char* batchReserve(AndroidLogBatch* batch, size_t len, int* err) {
+  if (batch->used + len > AndroidLogBatch::kBufferSize) {
+    *err = android_log_batch_flush(batch);
+  }
+  if (len > AndroidLogBatch::kBufferSize) return NULL;
+  return batch->buffer.get() + batch->used;
+}
+
+ssize_t android_log_batch_write(AndroidLogBatch* batch, const char* buf, size_t len) {
+  int err = 0;
+  char* p = batchReserve(batch, len, &err);
+  if (p == NULL) {
+    if (err == 0) err = writeFully(batch->fd, buf, len);
+  } else {
+    memcpy(p, buf, len);
+    batch->used += len;
+  }
+  return err < 0 ? -1 : static_cast<ssize_t>(len);
+}
+
+/* Formats the time of entry as android_log_formatLogLine() does. */
+static size_t batchFormatTime(AndroidLogBatch* batch, const AndroidLogEntry* entry,
+                              char* timeBuf, size_t timeBufSize) {
+  AndroidLogFormat* p_format = batch->format;
+  TruncatingWriter writer(timeBuf, timeBufSize);
+
+  time_t now = entry->tv_sec;
+  unsigned long nsec = entry->tv_nsec;
+#if __ANDROID__
+  if (p_format->monotonic_output) {
+    struct timespec time;
+    convertMonotonic(&time, entry);
+    now = time.tv_sec;
+    nsec = time.tv_nsec;
+  }
+#endif
+  if (now < 0) {
+    nsec = NS_PER_SEC - nsec;
+  }
+
+  bool local_time = !p_format->epoch_output && !p_format->monotonic_output;
+  if (!local_time) {
+    writer.AppendInt(now, p_format->monotonic_output ? 6 : 19);
+  } else {
+    if (!batch->has_cached_time || batch->cached_time_sec != now ||
+        batch->cached_time_year != p_format->year_output) {
+      struct tm tmBuf;
+      struct tm* ptm = localtime_r(&now, &tmBuf);
+      batch->cached_date_len = 0;
+      batch->cached_zone_len = 0;
+      if (ptm) {
+        batch->cached_date_len =
+            strftime(batch->cached_date, sizeof(batch->cached_date),
+                     &"%Y-%m-%d %H:%M:%S"[p_format->year_output ? 0 : 3], ptm);
+        batch->cached_zone_len =
+            strftime(batch->cached_zone, sizeof(batch->cached_zone), " %z", ptm);
+      }
+      batch->has_cached_time = true;
+      batch->cached_time_sec = now;
+      batch->cached_time_year = p_format->year_output;
+    }
+    writer.Append(batch->cached_date, batch->cached_date_len);
+  }
+
+  writer.Append('.');
+  if (p_format->nsec_time_output) {
+    writer.AppendZeroPadded(nsec, 9);
+  } else if (p_format->usec_time_output) {
+    writer.AppendZeroPadded(nsec / US_PER_NSEC, 6);
+  } else {
+    writer.AppendZeroPadded(nsec / MS_PER_NSEC, 3);
+  }
+
+  if (p_format->zone_output && local_time) {
+    writer.Append(batch->cached_zone, batch->cached_zone_len);
+  }
+  return writer.size();
+}
+
+ssize_t android_log_batch_printLogLine(AndroidLogBatch* batch, const AndroidLogEntry* entry) {
+  AndroidLogFormat* p_format = batch->format;
+  char priChar = filterPriToChar(entry->priority);
+  const char* tag = entry->tag ? entry->tag : "";
+  size_t tagLen = entry->tag ? strnlen(entry->tag, entry->tagLen) : 0;
+
+  char timeBuf[64];
+  size_t timeLen = 0;
+  if (p_format->format == FORMAT_TIME || p_format->format == FORMAT_THREADTIME ||
+      p_format->format == FORMAT_LONG) {
+    timeLen = batchFormatTime(batch, entry, timeBuf, sizeof(timeBuf));
+  }
+
+  char uid[16];
+  size_t uidLen = 0;
+  if (p_format->uid_output) {
+    if (entry->uid >= 0) {
+#ifdef __ANDROID__
+      struct passwd* pwd = getpwuid(entry->uid);
+      if (pwd && (strlen(pwd->pw_name) <= 5)) {
+        uidLen = snprintf(uid, sizeof(uid), "%5s:", pwd->pw_name);
+      } else
+#endif
+      {
+        TruncatingWriter writer(uid, sizeof(uid));
+        writer.AppendInt(entry->uid, 5);
+        writer.Append(':');
+        uidLen = writer.size();
+      }
+    } else {
+      uidLen = 6;
+      memset(uid, ' ', uidLen);
+    }
+  }
+
+  /*
+   * The prefix and suffix are truncated to the 127 bytes that android_log_formatLogLine()
+   * allows them, with the suffix still ending in a newline.
+   */
+  char prefixBuf[127], suffixBuf[128];
+  TruncatingWriter prefix(prefixBuf, sizeof(prefixBuf));
+  TruncatingWriter suffix(suffixBuf, sizeof(suffixBuf));
+  bool prefixSuffixIsHeaderFooter = false;
+
+  if (p_format->colored_output) {
+    prefix.Append("\x1B[", 2);
+    prefix.AppendInt(colorFromPri(entry->priority), 0);
+    prefix.Append('m');
+    suffix.Append("\x1B[0m", 4);
+  }
+
+  switch (p_format->format) {
+    case FORMAT_TAG:
+      prefix.Append(priChar);
+      prefix.Append('/');
+      prefix.AppendLeftJustified(tag, tagLen, 8);
+      prefix.Append(": ", 2);
+      suffix.Append('\n');
+      break;
+    case FORMAT_PROCESS:
+      prefix.Append(priChar);
+      prefix.Append('(');
+      prefix.Append(uid, uidLen);
+      prefix.AppendInt(entry->pid, 5);
+      prefix.Append(") ", 2);
+      suffix.Append("  (", 3);
+      suffix.Append(tag, tagLen);
+      suffix.Append(")\n", 2);
+      break;
+    case FORMAT_THREAD:
+      prefix.Append(priChar);
+      prefix.Append('(');
+      prefix.Append(uid, uidLen);
+      prefix.AppendInt(entry->pid, 5);
+      prefix.Append(':');
+      prefix.AppendInt(entry->tid, 5);
+      prefix.Append(") ", 2);
+      suffix.Append('\n');
+      break;
+    case FORMAT_RAW:
+      suffix.Append('\n');
+      break;
+    case FORMAT_TIME:
+      prefix.Append(timeBuf, timeLen);
+      prefix.Append(' ');
+      prefix.Append(priChar);
+      prefix.Append('/');
+      prefix.AppendLeftJustified(tag, tagLen, 8);
+      prefix.Append('(');
+      prefix.Append(uid, uidLen);
+      prefix.AppendInt(entry->pid, 5);
+      prefix.Append("): ", 3);
+      suffix.Append('\n');
+      break;
+    case FORMAT_THREADTIME: {
+      char* colon = static_cast<char*>(memchr(uid, ':', uidLen));
+      if (colon) *colon = ' ';
+      prefix.Append(timeBuf, timeLen);
+      prefix.Append(' ');
+      prefix.Append(uid, uidLen);
+      prefix.AppendInt(entry->pid, 5);
+      prefix.Append(' ');
+      prefix.AppendInt(entry->tid, 5);
+      prefix.Append(' ');
+      prefix.Append(priChar);
+      prefix.Append(' ');
+      prefix.AppendLeftJustified(tag, tagLen, 8);
+      prefix.Append(": ", 2);
+      suffix.Append('\n');
+      break;
+    }
+    case FORMAT_LONG:
+      prefix.Append("[ ", 2);
+      prefix.Append(timeBuf, timeLen);
+      prefix.Append(' ');
+      prefix.Append(uid, uidLen);
+      prefix.AppendInt(entry->pid, 5);
+      prefix.Append(':');
+      prefix.AppendInt(entry->tid, 5);
+      prefix.Append(' ');
+      prefix.Append(priChar);
+      prefix.Append('/');
+      prefix.AppendLeftJustified(tag, tagLen, 8);
+      prefix.Append(" ]\n", 3);
+      suffix.Append("\n\n", 2);
+      prefixSuffixIsHeaderFooter = true;
+      break;
+    case FORMAT_BRIEF:
+    default:
+      prefix.Append(priChar);
+      prefix.Append('/');
+      prefix.AppendLeftJustified(tag, tagLen, 8);
+      prefix.Append('(');
+      prefix.Append(uid, uidLen);
+      prefix.AppendInt(entry->pid, 5);
+      prefix.Append("): ", 3);
+      suffix.Append('\n');
+      break;
+  }
+
+  size_t prefixLen = prefix.size();
+  size_t suffixLen = suffix.size();
+  if (suffixLen == sizeof(suffixBuf)) {
+    suffixLen = sizeof(suffixBuf) - 1;
+    suffixBuf[suffixLen - 1] = '\n';
+  }
+
+  const char* msg = entry->message;
+  const char* msgEnd = msg + entry->messageLen;
+  size_t numLines = 1;
+  if (!prefixSuffixIsHeaderFooter) {
+    for (const char* pm = msg; pm < msgEnd; ++numLines) {
+      pm = static_cast<const char*>(memchr(pm, '\n', msgEnd - pm));
+      if (!pm) break;
+      ++pm;
+    }
+  }
+
+  /* convertPrintable() expands each byte to at most 4, and terminates what it converts. */
+  size_t bound = numLines * (prefixLen + suffixLen) +
+                 entry->messageLen * (p_format->printable_output ? 4 : 1) + 1;
+  int err = 0;
+  char* ret = batchReserve(batch, bound, &err);
+  if (ret == NULL) {
+    size_t lineLen;
+    char* line = android_log_formatLogLine(p_format, NULL, 0, entry, &lineLen);
+    if (line == NULL) return -1;
+    if (err == 0) err = writeFully(batch->fd, line, lineLen);
+    free(line);
+    return err < 0 ? -1 : static_cast<ssize_t>(lineLen);
+  }
+
+  char* p = ret;
+  const char* pm = msg;
+  do {
+    const char* lineEnd = msgEnd;
+    if (!prefixSuffixIsHeaderFooter && pm < msgEnd) {
+      lineEnd = static_cast<const char*>(memchr(pm, '\n', msgEnd - pm));
+      if (!lineEnd) lineEnd = msgEnd;
+    }
+
+    memcpy(p, prefixBuf, prefixLen);
+    p += prefixLen;
+    if (p_format->printable_output) {
+      p += convertPrintable(p, pm, lineEnd - pm);
+    } else {
+      memcpy(p, pm, lineEnd - pm);
+      p += lineEnd - pm;
+    }
+    memcpy(p, suffixBuf, suffixLen);
+    p += suffixLen;
+
+    pm = lineEnd;
+    if (pm < msgEnd) pm++;
+  } while (pm < msgEnd);
+
+  batch->used += p - ret;
+  return err < 0 ? -1 : p - ret;
+}
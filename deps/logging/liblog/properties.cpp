@@ -18,11 +18,16 @@
 
 #include <ctype.h>
 #include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 
 #include <android-base/macros.h>
 
@@ -30,6 +35,58 @@
 
 #include "logger_write.h"
 
+#define BOOLEAN_TRUE 0xFF
+#define BOOLEAN_FALSE 0xFE
+
+// Reduces a log.tag property value to the one character that matters, mapping "true" and
+// "false" to BOOLEAN_TRUE and BOOLEAN_FALSE.
+static unsigned char property_value_char(const char* buf) {
+  switch (buf[0]) {
+    case 't':
+    case 'T':
+      return strcasecmp(buf + 1, "rue") ? buf[0] : BOOLEAN_TRUE;
+    case 'f':
+    case 'F':
+      return strcasecmp(buf + 1, "alse") ? buf[0] : BOOLEAN_FALSE;
+    default:
+      return buf[0];
+  }
+}
+
+// Whether c, as returned by property_value_char(), names a log level.
+static bool is_log_level_char(char c) {
+  switch (toupper(c)) {
+    case 'V':
+    case 'D':
+    case 'I':
+    case 'W':
+    case 'E':
+    case 'F': /* Not officially supported */
+    case 'A':
+    case 'S':
+    case BOOLEAN_FALSE: /* Not officially supported */
+      return true;
+  }
+  return false;
+}
+
+static int log_level_from_char(char c) {
+  switch (toupper(c)) {
+    /* clang-format off */
+    case 'V': return ANDROID_LOG_VERBOSE;
+    case 'D': return ANDROID_LOG_DEBUG;
+    case 'I': return ANDROID_LOG_INFO;
+    case 'W': return ANDROID_LOG_WARN;
+    case 'E': return ANDROID_LOG_ERROR;
+    case 'F': /* FALLTHRU */ /* Not officially supported */
+    case 'A': return ANDROID_LOG_FATAL;
+    case BOOLEAN_FALSE: /* FALLTHRU */ /* Not Officially supported */
+    case 'S': return ANDROID_LOG_SILENT;
+      /* clang-format on */
+  }
+  return -1;
+}
+
 #ifdef __ANDROID__
 #include <sys/system_properties.h>
 
@@ -66,9 +123,6 @@ static int check_cache(struct cache* cache) {
   return cache->pinfo && __system_property_serial(cache->pinfo) != cache->serial;
 }
 
-#define BOOLEAN_TRUE 0xFF
-#define BOOLEAN_FALSE 0xFE
-
 static void refresh_cache(struct cache_char* cache, const char* key) {
   char buf[PROP_VALUE_MAX];
 
@@ -80,18 +134,7 @@ static void refresh_cache(struct cache_char* cache, const char* key) {
   }
   cache->cache.serial = __system_property_serial(cache->cache.pinfo);
   __system_property_read(cache->cache.pinfo, 0, buf);
-  switch (buf[0]) {
-    case 't':
-    case 'T':
-      cache->c = strcasecmp(buf + 1, "rue") ? buf[0] : BOOLEAN_TRUE;
-      break;
-    case 'f':
-    case 'F':
-      cache->c = strcasecmp(buf + 1, "alse") ? buf[0] : BOOLEAN_FALSE;
-      break;
-    default:
-      cache->c = buf[0];
-  }
+  cache->c = property_value_char(buf);
 }
 
 static int __android_log_level(const char* tag, size_t tag_len) {
@@ -180,43 +223,31 @@ static int __android_log_level(const char* tag, size_t tag_len) {
     }
   }
 
-  switch (toupper(c)) { /* if invalid, resort to global */
-    case 'V':
-    case 'D':
-    case 'I':
-    case 'W':
-    case 'E':
-    case 'F': /* Not officially supported */
-    case 'A':
-    case 'S':
-    case BOOLEAN_FALSE: /* Not officially supported */
-      break;
-    default:
-      /* clear '.' after log.tag */
-      key[strlen(log_namespace) - 1] = '\0';
-
-      for (size_t i = 0; i < arraysize(global_cache); ++i) {
-        cache_char* cache = &global_cache[i];
-        cache_char temp_cache;
-
-        if (!locked) {
-          temp_cache = *cache;
-          if (temp_cache.cache.pinfo != cache->cache.pinfo) {  // check atomic
-            temp_cache.cache.pinfo = NULL;
-            temp_cache.c = '\0';
-          }
-          cache = &temp_cache;
-        }
-        if (global_change_detected) {
-          refresh_cache(cache, i == 0 ? key : key + strlen("persist."));
-        }
+  if (!is_log_level_char(c)) { /* if invalid, resort to global */
+    /* clear '.' after log.tag */
+    key[strlen(log_namespace) - 1] = '\0';
+
+    for (size_t i = 0; i < arraysize(global_cache); ++i) {
+      cache_char* cache = &global_cache[i];
+      cache_char temp_cache;
 
-        if (cache->c) {
-          c = cache->c;
-          break;
+      if (!locked) {
+        temp_cache = *cache;
+        if (temp_cache.cache.pinfo != cache->cache.pinfo) {  // check atomic
+          temp_cache.cache.pinfo = NULL;
+          temp_cache.c = '\0';
         }
+        cache = &temp_cache;
       }
-      break;
+      if (global_change_detected) {
+        refresh_cache(cache, i == 0 ? key : key + strlen("persist."));
+      }
+
+      if (cache->c) {
+        c = cache->c;
+        break;
+      }
+    }
   }
 
   if (locked) {
@@ -224,40 +255,11 @@ static int __android_log_level(const char* tag, size_t tag_len) {
     unlock();
   }
 
-  switch (toupper(c)) {
-    /* clang-format off */
-    case 'V': return ANDROID_LOG_VERBOSE;
-    case 'D': return ANDROID_LOG_DEBUG;
-    case 'I': return ANDROID_LOG_INFO;
-    case 'W': return ANDROID_LOG_WARN;
-    case 'E': return ANDROID_LOG_ERROR;
-    case 'F': /* FALLTHRU */ /* Not officially supported */
-    case 'A': return ANDROID_LOG_FATAL;
-    case BOOLEAN_FALSE: /* FALLTHRU */ /* Not Officially supported */
-    case 'S': return ANDROID_LOG_SILENT;
-      /* clang-format on */
-  }
-  return -1;
+  return log_level_from_char(c);
 }
 
-int __android_log_is_loggable_len(int prio, const char* tag, size_t len, int default_prio) {
-  int minimum_log_priority = __android_log_get_minimum_priority();
-  int property_log_level = __android_log_level(tag, len);
-
-  if (property_log_level >= 0 && minimum_log_priority != ANDROID_LOG_DEFAULT) {
-    return prio >= std::min(property_log_level, minimum_log_priority);
-  } else if (property_log_level >= 0) {
-    return prio >= property_log_level;
-  } else if (minimum_log_priority != ANDROID_LOG_DEFAULT) {
-    return prio >= minimum_log_priority;
-  } else {
-    return prio >= default_prio;
-  }
-}
-
-int __android_log_is_loggable(int prio, const char* tag, int default_prio) {
-  auto len = tag ? strlen(tag) : 0;
-  return __android_log_is_loggable_len(prio, tag, len, default_prio);
+static uint32_t log_property_serial() {
+  return __system_property_area_serial();
 }
 
 int __android_log_is_debuggable() {
@@ -298,16 +300,75 @@ int __android_log_security() {
 
 #else
 
-int __android_log_is_loggable(int prio, const char*, int) {
-  int minimum_priority = __android_log_get_minimum_priority();
-  if (minimum_priority == ANDROID_LOG_DEFAULT) {
-    minimum_priority = ANDROID_LOG_INFO;
+/*
+ * There are no system properties on host, but the log.tag properties can be
+ * supplied in a file named by ANDROID_LOG_PROPERTIES, one "key=value" per line,
+ * with '#' starting a comment. The file is read once, on first use.
+ */
+static const std::unordered_map<std::string, std::string>& host_log_properties() {
+  static auto* properties = [] {
+    auto* properties = new std::unordered_map<std::string, std::string>;
+    const char* path = getenv("ANDROID_LOG_PROPERTIES");
+    FILE* fp = path ? fopen(path, "r") : nullptr;
+    if (fp == nullptr) {
+      return properties;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), fp) != nullptr) {
+      std::string_view entry(line);
+      entry = entry.substr(0, entry.find_first_of("#\r\n"));
+      size_t equals = entry.find('=');
+      if (equals == std::string_view::npos) {
+        continue;
+      }
+      auto trim = [](std::string_view s) {
+        while (!s.empty() && isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+        while (!s.empty() && isspace(static_cast<unsigned char>(s.back()))) s.remove_suffix(1);
+        return s;
+      };
+      (*properties)[std::string(trim(entry.substr(0, equals)))] =
+          std::string(trim(entry.substr(equals + 1)));
+    }
+    fclose(fp);
+    return properties;
+  }();
+  return *properties;
+}
+
+/* Same lookup order as on device: log.tag.<tag>, persist.log.tag.<tag>, log.tag, persist.log.tag */
+static int __android_log_level(const char* tag, size_t tag_len) {
+  const auto& properties = host_log_properties();
+  if (properties.empty()) {
+    return -1;
+  }
+
+  if (tag == nullptr || tag_len == 0) {
+    auto& tag_string = GetDefaultTag();
+    tag = tag_string.c_str();
+    tag_len = tag_string.size();
+  }
+
+  auto lookup = [&](const std::string& key) -> char {
+    auto it = properties.find(key);
+    return it == properties.end() ? '\0' : property_value_char(it->second.c_str());
+  };
+
+  char c = '\0';
+  if (tag_len != 0) {
+    std::string key = "persist.log.tag.";
+    key.append(tag, tag_len);
+    c = lookup(key.substr(strlen("persist.")));
+    if (!c) c = lookup(key);
+  }
+  if (!is_log_level_char(c)) {
+    c = lookup("log.tag");
+    if (!c) c = lookup("persist.log.tag");
   }
-  return prio >= minimum_priority;
+  return log_level_from_char(c);
 }
 
-int __android_log_is_loggable_len(int prio, const char*, size_t, int def) {
-  return __android_log_is_loggable(prio, nullptr, def);
+static uint32_t log_property_serial() {
+  return 0;  // The properties never change on host.
 }
 
 int __android_log_is_debuggable() {
@@ -319,3 +380,91 @@ int __android_log_security() {
 }
 
 #endif
+
+/*
+ * Per-thread cache of __android_log_level() results, so that checking a tag
+ * that has been seen before costs a few loads and compares rather than a
+ * property lookup. Entries are found by tag pointer, since most tags are
+ * string literals, but also hold a copy of the tag so that a buffer reused
+ * for a different tag can't return a stale level. The cache is invalidated
+ * whenever any property changes.
+ *
+ * An entry is marked invalid while it is being written, so a signal handler
+ * that logs on the same thread sees either the old entry or a miss.
+ */
+static constexpr size_t kLevelCacheSets = 16;  // Indexed by the top 4 bits of a hash.
+static constexpr size_t kLevelCacheWays = 2;
+static constexpr size_t kLevelCacheMaxTagLen = 32;
+
+struct level_cache_entry {
+  bool valid;
+  uint32_t serial;
+  const char* tag;
+  size_t tag_len;
+  int level;
+  char tag_copy[kLevelCacheMaxTagLen];
+};
+
+static thread_local level_cache_entry level_cache[kLevelCacheSets][kLevelCacheWays];
+static thread_local uint8_t level_cache_victim[kLevelCacheSets];
+
+static int cached_log_level(const char* tag, size_t tag_len) {
+  if (tag == nullptr || tag_len == 0 || tag_len > kLevelCacheMaxTagLen) {
+    return __android_log_level(tag, tag_len);
+  }
+
+  uint32_t serial = log_property_serial();
+  uint64_t hash = (reinterpret_cast<uintptr_t>(tag) + tag_len) * 0x9e3779b97f4a7c15ULL;
+  level_cache_entry* set = level_cache[hash >> 60];
+  for (size_t i = 0; i < kLevelCacheWays; ++i) {
+    level_cache_entry& entry = set[i];
+    if (entry.valid && entry.serial == serial && entry.tag == tag && entry.tag_len == tag_len &&
+        memcmp(entry.tag_copy, tag, tag_len) == 0) {
+      return entry.level;
+    }
+  }
+
+  int level = __android_log_level(tag, tag_len);
+  // Replace an unused or stale way if there is one, otherwise take turns.
+  size_t victim = level_cache_victim[hash >> 60]++ % kLevelCacheWays;
+  for (size_t i = 0; i < kLevelCacheWays; ++i) {
+    if (!set[i].valid || set[i].serial != serial) {
+      victim = i;
+      break;
+    }
+  }
+  level_cache_entry& entry = set[victim];
+  entry.valid = false;
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  entry.serial = serial;
+  entry.tag = tag;
+  entry.tag_len = tag_len;
+  entry.level = level;
+  memcpy(entry.tag_copy, tag, tag_len);
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  entry.valid = true;
+  return level;
+}
+
+int __android_log_is_loggable_len(int prio, const char* tag, size_t len, int default_prio) {
+#ifndef __ANDROID__
+  default_prio = ANDROID_LOG_INFO;  // The host default has always been INFO.
+#endif
+  int minimum_log_priority = __android_log_get_minimum_priority();
+  int property_log_level = cached_log_level(tag, len);
+
+  if (property_log_level >= 0 && minimum_log_priority != ANDROID_LOG_DEFAULT) {
+    return prio >= std::min(property_log_level, minimum_log_priority);
+  } else if (property_log_level >= 0) {
+    return prio >= property_log_level;
+  } else if (minimum_log_priority != ANDROID_LOG_DEFAULT) {
+    return prio >= minimum_log_priority;
+  } else {
+    return prio >= default_prio;
+  }
+}
+
+int __android_log_is_loggable(int prio, const char* tag, int default_prio) {
+  auto len = tag ? strlen(tag) : 0;
+  return __android_log_is_loggable_len(prio, tag, len, default_prio);
+}
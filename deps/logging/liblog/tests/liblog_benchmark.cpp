@@ -25,14 +25,18 @@
 #include <sys/uio.h>
 #include <unistd.h>
 
+#include <string>
 #include <unordered_set>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/properties.h>
 #include <benchmark/benchmark.h>
 #include <cutils/sockets.h>
 #include <log/event_tag_map.h>
+#include <log/log_event_list.h>
 #include <log/log_read.h>
+#include <log/logprint.h>
 #include <private/android_logger.h>
 
 #include "test_utils.h"
@@ -585,6 +589,52 @@ static void BM_log_event_overhead(benchmark::State& state) {
 }
 BENCHMARK(BM_log_event_overhead);
 
+/*
+ *	Measure the time it takes to encode a typical stats event (three ints,
+ * a long and a string) with the android_log_context calls, up to the buffer
+ * that would be handed to the writer.
+ */
+static void BM_log_event_list_encode(benchmark::State& state) {
+  static const char name[] = "com.android.example";
+  for (int64_t i = 0; state.KeepRunning(); ++i) {
+    android_log_context ctx = create_android_logger(0);
+    android_log_write_int32(ctx, 1000);
+    android_log_write_int32(ctx, 10123);
+    android_log_write_int32(ctx, i);
+    android_log_write_int64(ctx, i);
+    android_log_write_string8(ctx, name);
+    const char* buffer;
+    benchmark::DoNotOptimize(android_log_write_list_buffer(ctx, &buffer));
+    android_log_destroy(&ctx);
+  }
+}
+BENCHMARK(BM_log_event_list_encode);
+
+/*
+ *	The same event as BM_log_event_list_encode, with android_log_event_builder.
+ */
+static void BM_log_event_builder_encode(benchmark::State& state) {
+  static const char name[] = "com.android.example";
+  for (int64_t i = 0; state.KeepRunning(); ++i) {
+    android_log_event_builder builder(1000, 10123, static_cast<int32_t>(i), i, name);
+    benchmark::DoNotOptimize(builder.data());
+    benchmark::DoNotOptimize(builder.size());
+  }
+}
+BENCHMARK(BM_log_event_builder_encode);
+
+/*
+ *	The same event without the string, whose size is known at compile time.
+ */
+static void BM_log_event_builder_encode_fixed(benchmark::State& state) {
+  for (int64_t i = 0; state.KeepRunning(); ++i) {
+    android_log_event_builder builder(1000, 10123, static_cast<int32_t>(i), i);
+    benchmark::DoNotOptimize(builder.data());
+    benchmark::DoNotOptimize(builder.size());
+  }
+}
+BENCHMARK(BM_log_event_builder_encode_fixed);
+
 /*
  *	Measure the time it takes to submit the android event logging call
  * using discrete acquisition under light load with a known logtag.  Expect
@@ -792,6 +842,24 @@ static void BM_is_loggable(benchmark::State& state) {
 }
 BENCHMARK(BM_is_loggable);
 
+/*
+ *	Measure __android_log_is_loggable when a process alternates between
+ * several tags, from one or more threads.
+ */
+static void BM_is_loggable_many_tags(benchmark::State& state) {
+  static const char* const tags[] = {"ActivityManager", "PackageManager", "WindowManager",
+                                     "InputDispatcher", "SurfaceFlinger", "AudioFlinger",
+                                     "ConnectivityService", "logd"};
+  size_t i = 0;
+
+  for (auto _ : state) {
+    const char* tag = tags[i++ % arraysize(tags)];
+    benchmark::DoNotOptimize(
+        __android_log_is_loggable(ANDROID_LOG_WARN, tag, ANDROID_LOG_VERBOSE));
+  }
+}
+BENCHMARK(BM_is_loggable_many_tags)->ThreadRange(1, 8);
+
 static void BM_security(benchmark::State& state) {
   while (state.KeepRunning()) {
     __android_log_security();
@@ -1029,3 +1097,60 @@ static void BM_log_convertPrintable_non_ascii(benchmark::State& state) {
   }
 }
 BENCHMARK(BM_log_convertPrintable_non_ascii);
+
+/*
+ *	Measure filtering lines, as logcat does, with range(0) tag filter rules
+ * and lines from 8 tags in bursts of 4, half of which match a rule.
+ */
+static void BM_log_shouldPrintLine(benchmark::State& state) {
+  AndroidLogFormat* p_format = android_log_format_new();
+  android_log_addFilterRule(p_format, "*:S");
+  for (int i = 0; i < state.range(0); ++i) {
+    std::string rule = "BenchmarkTag" + std::to_string(i * 2) + ":I";
+    android_log_addFilterRule(p_format, rule.c_str());
+  }
+  std::vector<std::string> tags;
+  for (int i = 0; i < 8; ++i) {
+    tags.emplace_back("BenchmarkTag" + std::to_string(i));
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        android_log_shouldPrintLine(p_format, tags[(i++ / 4) % 8].c_str(), ANDROID_LOG_INFO));
+  }
+  android_log_format_free(p_format);
+}
+BENCHMARK(BM_log_shouldPrintLine)->Arg(1)->Arg(8)->Arg(64);
+
+/*
+ *	Measure the cost of the stderr logger, writing to a file, with and
+ * without the asynchronous writer (Arg 0/1), from one or more threads.
+ */
+static void BM_log_stderr(benchmark::State& state) {
+  static TemporaryFile* tf;
+  static int saved_stderr;
+  if (state.thread_index() == 0) {
+    tf = new TemporaryFile();
+    saved_stderr = dup(STDERR_FILENO);
+    dup2(tf->fd, STDERR_FILENO);
+    __android_log_set_logger(__android_log_stderr_logger);
+    __android_log_set_async_logging(state.range(0));
+  }
+  uint64_t dropped = __android_log_get_async_dropped_count();
+
+  for (auto _ : state) {
+    __android_log_print(ANDROID_LOG_INFO, "liblog_benchmark", "%s test log message %d %d",
+                        "test test", 123, 456);
+  }
+
+  if (state.thread_index() == 0) {
+    __android_log_set_async_logging(false);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    __android_log_set_logger(__android_log_logd_logger);
+    delete tf;
+    state.counters["dropped"] = __android_log_get_async_dropped_count() - dropped;
+  }
+}
+BENCHMARK(BM_log_stderr)->Arg(0)->Arg(1)->ThreadRange(1, 8)->UseRealTime();
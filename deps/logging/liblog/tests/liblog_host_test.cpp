@@ -22,7 +22,10 @@
 
 #include <regex>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/macros.h>
 #include <android-base/stringprintf.h>
@@ -164,3 +167,123 @@ TEST(liblog, binary_no_write) {
 
   EXPECT_EQ("", captured_stderr.str());
 }
+
+TEST(liblog, async_write) {
+  CapturedStderr captured_stderr;
+  InitLogging(nullptr, StderrLogger);
+  __android_log_set_async_logging(true);
+  GenerateLogContent();
+  __android_log_set_async_logging(false);
+
+  CheckMessage(false, captured_stderr.str(), ANDROID_LOG_VERBOSE, "tag", "verbose main");
+  CheckMessage(true, captured_stderr.str(), ANDROID_LOG_INFO, "tag", "info main");
+  CheckMessage(true, captured_stderr.str(), ANDROID_LOG_ERROR, "tag", "error main");
+
+  CheckMessage(true, captured_stderr.str(), ANDROID_LOG_ERROR, "tag", "error radio");
+  CheckMessage(true, captured_stderr.str(), ANDROID_LOG_ERROR, "tag", "error system");
+  CheckMessage(true, captured_stderr.str(), ANDROID_LOG_ERROR, "tag", "error crash");
+}
+
+TEST(liblog, async_write_threads) {
+  static constexpr int kThreads = 8;
+  static constexpr int kMessages = 200;
+
+  CapturedStderr captured_stderr;
+  InitLogging(nullptr, StderrLogger);
+  __android_log_set_async_logging(true);
+  uint64_t dropped = __android_log_get_async_dropped_count();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back([i] {
+      for (int j = 0; j < kMessages; ++j) {
+        __android_log_buf_print(LOG_ID_MAIN, ANDROID_LOG_INFO, "tag", "thread %d message %d", i, j);
+        // Keep the rings from overflowing, so that nothing is dropped.
+        if (j % 50 == 49) __android_log_async_flush();
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  __android_log_set_async_logging(false);
+  ASSERT_EQ(dropped, __android_log_get_async_dropped_count());
+
+  // Every message is there, and each thread's messages are in order.
+  std::string output = captured_stderr.str();
+  for (int i = 0; i < kThreads; ++i) {
+    size_t last = 0;
+    for (int j = 0; j < kMessages; ++j) {
+      size_t pos = output.find(StringPrintf("thread %d message %d\n", i, j));
+      ASSERT_NE(std::string::npos, pos) << i << " " << j;
+      EXPECT_LE(last, pos) << i << " " << j;
+      last = pos;
+    }
+  }
+}
+
+TEST(liblog, async_write_long_message) {
+  CapturedStderr captured_stderr;
+  InitLogging(nullptr, StderrLogger);
+  __android_log_set_async_logging(true);
+  __android_log_buf_print(LOG_ID_MAIN, ANDROID_LOG_INFO, "tag", "before");
+  std::string long_message(128 * 1024, 'x');
+  __android_log_buf_write(LOG_ID_MAIN, ANDROID_LOG_INFO, "tag", long_message.c_str());
+  __android_log_set_async_logging(false);
+
+  std::string output = captured_stderr.str();
+  size_t before = output.find("before\n");
+  size_t after = output.find(long_message + "\n");
+  ASSERT_NE(std::string::npos, before);
+  ASSERT_NE(std::string::npos, after);
+  EXPECT_LT(before, after);
+}
+
+// The properties file is only read once, so each check runs in a freshly executed child.
+static void CheckLoggableWithProperties(bool expected, const std::string& properties, int prio,
+                                        const char* tag) {
+  GTEST_FLAG_SET(death_test_style, "threadsafe");
+  TemporaryFile tf;
+  ASSERT_TRUE(android::base::WriteStringToFd(properties, tf.fd));
+  setenv("ANDROID_LOG_PROPERTIES", tf.path, 1);
+  EXPECT_EXIT(exit(__android_log_is_loggable(prio, tag, ANDROID_LOG_INFO)),
+              testing::ExitedWithCode(expected), "")
+      << tag << " " << prio;
+  unsetenv("ANDROID_LOG_PROPERTIES");
+}
+
+TEST(liblog, is_loggable_host_properties) {
+  std::string properties =
+      "# comment\n"
+      "log.tag.verbose_tag = V\n"
+      "persist.log.tag.persist_tag=d\n"
+      "log.tag.silent_tag=false\n"
+      "log.tag=W\n";
+
+  CheckLoggableWithProperties(true, properties, ANDROID_LOG_VERBOSE, "verbose_tag");
+  CheckLoggableWithProperties(true, properties, ANDROID_LOG_DEBUG, "persist_tag");
+  CheckLoggableWithProperties(false, properties, ANDROID_LOG_VERBOSE, "persist_tag");
+  CheckLoggableWithProperties(false, properties, ANDROID_LOG_FATAL, "silent_tag");
+  CheckLoggableWithProperties(false, properties, ANDROID_LOG_INFO, "other_tag");
+  CheckLoggableWithProperties(true, properties, ANDROID_LOG_WARN, "other_tag");
+
+  // Without properties, the default is still INFO.
+  CheckLoggableWithProperties(false, "", ANDROID_LOG_DEBUG, "verbose_tag");
+  CheckLoggableWithProperties(true, "", ANDROID_LOG_INFO, "verbose_tag");
+}
+
+static bool CheckReusedTagBuffer() {
+  // The same buffer holding different tags must not hit the same cache entry.
+  char tag[] = "aaa";
+  bool ok = __android_log_is_loggable(ANDROID_LOG_DEBUG, tag, ANDROID_LOG_INFO);
+  memcpy(tag, "bbb", 3);
+  ok = ok && !__android_log_is_loggable(ANDROID_LOG_DEBUG, tag, ANDROID_LOG_INFO);
+  memcpy(tag, "aaa", 3);
+  return ok && __android_log_is_loggable(ANDROID_LOG_DEBUG, tag, ANDROID_LOG_INFO);
+}
+
+TEST(liblog, is_loggable_host_properties_reused_buffer) {
+  GTEST_FLAG_SET(death_test_style, "threadsafe");
+  TemporaryFile tf;
+  ASSERT_TRUE(android::base::WriteStringToFd("log.tag.aaa=V\nlog.tag.bbb=E\n", tf.fd));
+  setenv("ANDROID_LOG_PROPERTIES", tf.path, 1);
+  EXPECT_EXIT(exit(CheckReusedTagBuffer() ? 0 : 1), testing::ExitedWithCode(0), "");
+  unsetenv("ANDROID_LOG_PROPERTIES");
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <string>
+#include <string_view>
+
+#include <gtest/gtest.h>
+#include <log/log_event_list.h>
+#include <private/android_logger.h>
+
+static std::string ListBuffer(android_log_event_list& list) {
+  const char* buffer;
+  int len = android_log_write_list_buffer(list, &buffer);
+  if (len < 0) return "";
+  return std::string(buffer, len);
+}
+
+template <typename Builder>
+static std::string BuilderBuffer(const Builder& builder) {
+  return std::string(static_cast<const char*>(builder.data()), builder.size());
+}
+
+TEST(liblog, android_log_event_builder_single) {
+  android_log_event_list list(0);
+  list << int32_t(42);
+  EXPECT_EQ(ListBuffer(list), BuilderBuffer(android_log_event_builder(42)));
+
+  android_log_event_list string_list(0);
+  string_list << "hello";
+  EXPECT_EQ(ListBuffer(string_list), BuilderBuffer(android_log_event_builder("hello")));
+}
+
+TEST(liblog, android_log_event_builder_list) {
+  std::string name = "name";
+  android_log_event_list list(0);
+  list << int32_t(-1) << uint32_t(2) << true << int64_t(-3) << uint64_t(4) << 5.5f << "literal"
+       << name;
+  android_log_event_builder builder(-1, 2u, true, int64_t(-3), uint64_t(4), 5.5f, "literal",
+                                    name);
+  EXPECT_EQ(ListBuffer(list), BuilderBuffer(builder));
+  EXPECT_EQ(sizeof(android_event_list_t) + 3 * sizeof(android_event_int_t) +
+                2 * sizeof(android_event_long_t) + sizeof(android_event_float_t) +
+                2 * sizeof(android_event_string_t) + strlen("literal") + name.size(),
+            builder.size());
+
+  const char* null_string = nullptr;
+  android_log_event_list null_list(0);
+  null_list << null_string << std::string("view");
+  EXPECT_EQ(ListBuffer(null_list),
+            BuilderBuffer(android_log_event_builder(null_string, std::string_view("view"))));
+}
+
+TEST(liblog, android_log_event_builder_truncates_strings) {
+  std::string long_string(LOGGER_ENTRY_MAX_PAYLOAD, 'x');
+  android_log_event_builder builder(long_string, 1, long_string, 2);
+  const size_t max_payload = LOGGER_ENTRY_MAX_PAYLOAD - sizeof(int32_t);
+  ASSERT_EQ(max_payload, builder.size());
+
+  // The first string takes all the room left; the elements after it are all there.
+  const uint8_t* data = static_cast<const uint8_t*>(builder.data());
+  EXPECT_EQ(EVENT_TYPE_LIST, data[0]);
+  EXPECT_EQ(4, data[1]);
+  const auto* first = reinterpret_cast<const android_event_string_t*>(data + 2);
+  EXPECT_EQ(EVENT_TYPE_STRING, first->type);
+  size_t fixed = sizeof(android_event_list_t) + 2 * sizeof(android_event_string_t) +
+                 2 * sizeof(android_event_int_t);
+  EXPECT_EQ(max_payload - fixed, static_cast<size_t>(first->length));
+  const auto* last = reinterpret_cast<const android_event_int_t*>(
+      data + max_payload - sizeof(android_event_int_t));
+  EXPECT_EQ(EVENT_TYPE_INT, last->type);
+  EXPECT_EQ(2, last->data);
+}
+
+TEST(liblog, android_log_event_builder_fixed_size) {
+  // Without strings, the buffer is exactly as large as the event.
+  android_log_event_builder builder(1, int64_t(2), 3.0f);
+  EXPECT_EQ(sizeof(android_event_list_t) + sizeof(android_event_int_t) +
+                sizeof(android_event_long_t) + sizeof(android_event_float_t),
+            builder.size());
+  EXPECT_LE(sizeof(builder), builder.size() + 2 * sizeof(size_t));
+}
+
+TEST(liblog, android_log_event_builder_bad_id) {
+  EXPECT_EQ(-EINVAL, android_log_write_event(LOG_ID_MAIN, 0, 1));
+}
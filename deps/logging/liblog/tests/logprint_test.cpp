@@ -167,3 +167,154 @@ TEST(liblog, log_print_different_header_size) {
   ASSERT_EQ(0, android_log_processLogBuffer(reinterpret_cast<logger_entry*>(buf), &entry_odd_size));
   check_entry(entry_odd_size);
 }
+
+TEST(liblog, filter_many_tags) {
+  AndroidLogFormat* p_format = android_log_format_new();
+  EXPECT_EQ(1, android_log_shouldPrintPriority(p_format, ANDROID_LOG_VERBOSE));
+
+  ASSERT_EQ(0, android_log_addFilterString(p_format, "*:S"));
+  EXPECT_EQ(0, android_log_shouldPrintPriority(p_format, ANDROID_LOG_FATAL));
+
+  // Enough rules to grow the table a few times.
+  for (int i = 0; i < 100; ++i) {
+    std::string rule = "Tag" + std::to_string(i) + (i % 2 ? ":W" : ":D");
+    ASSERT_EQ(0, android_log_addFilterRule(p_format, rule.c_str()));
+  }
+  EXPECT_EQ(0, android_log_shouldPrintPriority(p_format, ANDROID_LOG_VERBOSE));
+  EXPECT_EQ(1, android_log_shouldPrintPriority(p_format, ANDROID_LOG_DEBUG));
+
+  for (int i = 0; i < 100; ++i) {
+    std::string tag = "Tag" + std::to_string(i);
+    // Twice, to look up both through the table and through the last lookup.
+    for (int j = 0; j < 2; ++j) {
+      EXPECT_EQ(i % 2 == 0, android_log_shouldPrintLine(p_format, tag.c_str(), ANDROID_LOG_DEBUG))
+          << tag;
+      EXPECT_EQ(1, android_log_shouldPrintLine(p_format, tag.c_str(), ANDROID_LOG_WARN)) << tag;
+    }
+  }
+  EXPECT_EQ(0, android_log_shouldPrintLine(p_format, "Tag", ANDROID_LOG_FATAL));
+  EXPECT_EQ(0, android_log_shouldPrintLine(p_format, "Tag100", ANDROID_LOG_FATAL));
+
+  // A later rule for the same tag replaces the earlier one, and is seen by the last lookup.
+  EXPECT_EQ(1, android_log_shouldPrintLine(p_format, "Tag0", ANDROID_LOG_DEBUG));
+  ASSERT_EQ(0, android_log_addFilterRule(p_format, "Tag0:E"));
+  EXPECT_EQ(0, android_log_shouldPrintLine(p_format, "Tag0", ANDROID_LOG_DEBUG));
+  EXPECT_EQ(1, android_log_shouldPrintLine(p_format, "Tag0", ANDROID_LOG_ERROR));
+
+  // The last lookup of one format doesn't apply to another.
+  AndroidLogFormat* other_format = android_log_format_new();
+  EXPECT_EQ(1, android_log_shouldPrintLine(other_format, "Tag0", ANDROID_LOG_DEBUG));
+  android_log_format_free(other_format);
+
+  android_log_format_free(p_format);
+}
+
+TEST(liblog, batch_matches_formatLogLine) {
+  std::string long_tag(200, 't');
+  std::string long_message = "first line\n\nthird line\n" + std::string(5000, 'x') + "\n";
+  struct {
+    const char* tag;
+    size_t tagLen;
+    const char* message;
+  } contents[] = {
+      {"Tag", 4, "msg!"},
+      {"ShortTag", 9, "with\nseveral\nlines\n"},
+      {"Tag", 4, ""},
+      {"Tag", 4, "\n"},
+      {"Unprintable", 12, "bell\a and \x7f and \xC2"},
+      {long_tag.c_str(), long_tag.size(), "long tag"},
+      {"Tag", 4, long_message.c_str()},
+  };
+  AndroidLogPrintFormat formats[] = {FORMAT_BRIEF, FORMAT_PROCESS,    FORMAT_TAG,
+                                     FORMAT_THREAD, FORMAT_RAW,       FORMAT_TIME,
+                                     FORMAT_THREADTIME, FORMAT_LONG};
+  AndroidLogPrintFormat modifiers[] = {FORMAT_MODIFIER_COLOR,     FORMAT_MODIFIER_TIME_USEC,
+                                       FORMAT_MODIFIER_TIME_NSEC, FORMAT_MODIFIER_PRINTABLE,
+                                       FORMAT_MODIFIER_YEAR,      FORMAT_MODIFIER_ZONE,
+                                       FORMAT_MODIFIER_EPOCH,     FORMAT_MODIFIER_UID};
+
+  for (AndroidLogPrintFormat format : formats) {
+    for (size_t modifier_set = 0; modifier_set < (1u << std::size(modifiers)); ++modifier_set) {
+      AndroidLogFormat* p_format = android_log_format_new();
+      android_log_setPrintFormat(p_format, format);
+      for (size_t i = 0; i < std::size(modifiers); ++i) {
+        if (modifier_set & (1u << i)) android_log_setPrintFormat(p_format, modifiers[i]);
+      }
+
+      FILE* fp = tmpfile();
+      ASSERT_NE(nullptr, fp);
+      AndroidLogBatch* batch = android_log_batch_new(p_format, fileno(fp));
+      std::string expected;
+      size_t batch_length = 0;
+      for (size_t i = 0; i < std::size(contents); ++i) {
+        AndroidLogEntry entry = {};
+        entry.tv_sec = 1500000000 + i / 2;
+        entry.tv_nsec = 123456789 * i;
+        entry.priority = static_cast<android_LogPriority>(ANDROID_LOG_VERBOSE + i % 6);
+        entry.uid = i % 3 == 0 ? -1 : 10000 * i;
+        entry.pid = i == 1 ? 1234567 : 1000 + i;
+        entry.tid = -static_cast<int32_t>(i);
+        entry.tag = contents[i].tag;
+        entry.tagLen = contents[i].tagLen;
+        entry.message = contents[i].message;
+        entry.messageLen = strlen(contents[i].message);
+
+        size_t length;
+        char* line = android_log_formatLogLine(p_format, nullptr, 0, &entry, &length);
+        ASSERT_NE(nullptr, line);
+        expected.append(line, length);
+        free(line);
+
+        ssize_t batch_line_length = android_log_batch_printLogLine(batch, &entry);
+        ASSERT_EQ(static_cast<ssize_t>(length), batch_line_length);
+        batch_length += batch_line_length;
+        if (i == 3) {
+          // Text written in between, as logcat's dividers are.
+          ASSERT_EQ(2, android_log_batch_write(batch, "--", 2));
+          expected += "--";
+          batch_length += 2;
+        }
+      }
+      android_log_batch_free(batch);
+
+      std::string actual(batch_length, '\0');
+      rewind(fp);
+      ASSERT_EQ(batch_length, fread(actual.data(), 1, actual.size(), fp));
+      fclose(fp);
+      EXPECT_EQ(expected, actual) << "format " << format << " modifiers " << modifier_set;
+      android_log_format_free(p_format);
+      if (expected != actual) return;
+    }
+  }
+
+  // A message with more lines than the batch can buffer is written out on its own, in order.
+  AndroidLogFormat* p_format = android_log_format_new();
+  android_log_setPrintFormat(p_format, FORMAT_THREADTIME);
+  FILE* fp = tmpfile();
+  ASSERT_NE(nullptr, fp);
+  AndroidLogBatch* batch = android_log_batch_new(p_format, fileno(fp));
+  std::string many_lines;
+  for (size_t i = 0; i < 5000; ++i) many_lines += "line\n";
+  std::string expected;
+  for (const std::string& message : {"before"s, many_lines, "after"s}) {
+    AndroidLogEntry entry = {};
+    entry.priority = ANDROID_LOG_INFO;
+    entry.tag = "Tag";
+    entry.tagLen = 4;
+    entry.message = message.c_str();
+    entry.messageLen = message.size();
+    size_t length;
+    char* line = android_log_formatLogLine(p_format, nullptr, 0, &entry, &length);
+    ASSERT_NE(nullptr, line);
+    expected.append(line, length);
+    free(line);
+    ASSERT_EQ(static_cast<ssize_t>(length), android_log_batch_printLogLine(batch, &entry));
+  }
+  android_log_batch_free(batch);
+  std::string actual(expected.size(), '\0');
+  rewind(fp);
+  ASSERT_EQ(expected.size(), fread(actual.data(), 1, actual.size(), fp));
+  fclose(fp);
+  EXPECT_EQ(expected, actual);
+  android_log_format_free(p_format);
+}
@@ -96,6 +96,8 @@ class Logcat {
     uint64_t PrintToProto(const AndroidLogEntry& entry);
     void PrintDividers(log_id_t log_id, bool print_dividers);
     void SetupOutputAndSchedulingPolicy(bool blocking);
+    void OpenBatch();
+    void FlushBatch();
     int SetLogFormat(const char* format_string);
     void WriteFully(const void* p, size_t n) {
         if (fwrite(p, 1, n, output_file_) != n) {
@@ -111,6 +113,10 @@ class Logcat {
     // This isn't a unique_ptr because it's usually stdout;
     // stdio's atexit handler ensures we flush on exit.
     FILE* output_file_ = stdout;
+    // When dumping logs, text output is formatted into large batches that are written straight to
+    // output_file_'s descriptor, bypassing stdio.
+    std::unique_ptr<AndroidLogBatch, decltype(&android_log_batch_free)> batch_{
+            nullptr, &android_log_batch_free};
 
     // For logging to a file and log rotation
     const char* output_file_name_ = nullptr;
@@ -172,6 +178,9 @@ void Logcat::RotateLogs() {
     // Can't rotate logs if we're not outputting to a file
     if (!output_file_name_) return;
 
+    bool batched = batch_ != nullptr;
+    FlushBatch();
+    batch_.reset();
     fclose(output_file_);
     output_file_ = nullptr;
 
@@ -211,6 +220,18 @@ void Logcat::RotateLogs() {
 
     output_file_ = OpenLogFile(output_file_name_);
     out_byte_count_ = 0;
+    if (batched) OpenBatch();
+}
+
+void Logcat::OpenBatch() {
+    fflush(output_file_);
+    batch_.reset(android_log_batch_new(logformat_.get(), fileno(output_file_)));
+}
+
+void Logcat::FlushBatch() {
+    if (batch_ && android_log_batch_flush(batch_.get()) != 0) {
+        error(EXIT_FAILURE, errno, "Write to output file failed");
+    }
 }
 
 void Logcat::ProcessBuffer(struct log_msg* buf) {
@@ -219,6 +240,17 @@ void Logcat::ProcessBuffer(struct log_msg* buf) {
 
     bool is_binary =
             buf->id() == LOG_ID_EVENTS || buf->id() == LOG_ID_STATS || buf->id() == LOG_ID_SECURITY;
+
+    // Skip decoding logs that no filter rule would print.  Binary logs are printed as INFO, or as
+    // WARN for the security log, and text logs start with their priority.
+    android_LogPriority priority = ANDROID_LOG_INFO;
+    if (buf->id() == LOG_ID_SECURITY) {
+        priority = ANDROID_LOG_WARN;
+    } else if (!is_binary && buf->entry.len > 0 && buf->msg() != nullptr) {
+        priority = static_cast<android_LogPriority>(buf->msg()[0]);
+    }
+    if (!android_log_shouldPrintPriority(logformat_.get(), priority)) return;
+
     int err;
     if (is_binary) {
         if (!event_tag_map_ && !has_opened_event_tag_map_) {
@@ -246,8 +278,16 @@ void Logcat::ProcessBuffer(struct log_msg* buf) {
             switch (output_type_) {
                 case TEXT: {
                     PrintDividers(buf->id(), print_dividers_);
-                    out_byte_count_ +=
-                            android_log_printLogLine(logformat_.get(), output_file_, &entry);
+                    if (batch_) {
+                        ssize_t length = android_log_batch_printLogLine(batch_.get(), &entry);
+                        if (length < 0) {
+                            error(EXIT_FAILURE, errno, "Write to output file failed");
+                        }
+                        out_byte_count_ += length;
+                    } else {
+                        out_byte_count_ +=
+                                android_log_printLogLine(logformat_.get(), output_file_, &entry);
+                    }
                     break;
                 }
                 case PROTO: {
@@ -324,9 +364,14 @@ void Logcat::PrintDividers(log_id_t log_id, bool print_dividers) {
         return;
     }
     if (!printed_start_[log_id] || print_dividers) {
-        if (fprintf(output_file_, "--------- %s %s\n",
-                    printed_start_[log_id] ? "switch to" : "beginning of",
-                    android_log_id_to_name(log_id)) < 0) {
+        std::string divider = StringPrintf("--------- %s %s\n",
+                                           printed_start_[log_id] ? "switch to" : "beginning of",
+                                           android_log_id_to_name(log_id));
+        if (batch_) {
+            if (android_log_batch_write(batch_.get(), divider.data(), divider.size()) < 0) {
+                error(EXIT_FAILURE, errno, "Output error");
+            }
+        } else if (fputs(divider.c_str(), output_file_) < 0) {
             error(EXIT_FAILURE, errno, "Output error");
         }
     }
@@ -1155,6 +1200,8 @@ int Logcat::Run(int argc, char** argv) {
 
     bool blocking = !(mode & ANDROID_LOG_NONBLOCK);
     SetupOutputAndSchedulingPolicy(blocking);
+    // Logs read while blocking are written as they arrive, as before.
+    if (!blocking && output_type_ == TEXT) OpenBatch();
 
     // Purge as much memory as possible before going into the log reading loop.
     // Do this before checking if logd is ready just in case logd isn't
@@ -1169,6 +1216,8 @@ int Logcat::Run(int argc, char** argv) {
         struct log_msg log_msg;
         int ret = android_logger_list_read(logger_list.get(), &log_msg);
         if (!ret) {
+            // Write out the logs read so far before giving up.
+            FlushBatch();
             error(EXIT_FAILURE, 0, R"init(Unexpected EOF!
 
 This means that either the device shut down, logd crashed, or this instance of logcat was unable to read log
@@ -1185,16 +1234,19 @@ If you have enabled significant logging, look into using the -G option to increa
                 // In either case, the caller should call logcat again at a later time.
                 break;
             }
+            int read_errno = errno;
+            FlushBatch();
             if (ret == -EIO) {
                 error(EXIT_FAILURE, 0, "Unexpected EOF!");
             }
             if (ret == -EINVAL) {
                 error(EXIT_FAILURE, 0, "Unexpected length.");
             }
-            error(EXIT_FAILURE, errno, "Logcat read failure");
+            error(EXIT_FAILURE, read_errno, "Logcat read failure");
         }
 
         if (log_msg.id() > LOG_ID_MAX) {
+            FlushBatch();
             error(EXIT_FAILURE, 0, "Unexpected log id (%d) over LOG_ID_MAX (%d).", log_msg.id(),
                   LOG_ID_MAX);
         }
@@ -1214,6 +1266,7 @@ If you have enabled significant logging, look into using the -G option to increa
         }
         if (blocking && output_file_ == stdout) fflush(stdout);
     }
+    FlushBatch();
     return EXIT_SUCCESS;
 }
 
@@ -16,18 +16,52 @@
 
 #include "CompressionEngine.h"
 
+#include <time.h>
+
 #include <limits>
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <zlib.h>
 #include <zstd.h>
 
+static constexpr int kZstdCompressionLevel = 1;
+
+static uint64_t ThreadCpuTimeNs() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
 CompressionEngine& CompressionEngine::GetInstance() {
     static CompressionEngine* engine = new ZstdCompressionEngine();
     return *engine;
 }
 
+CompressionStats CompressionEngine::stats() const {
+    return {
+            .uncompressed_bytes = uncompressed_bytes_.load(std::memory_order_relaxed),
+            .compressed_bytes = compressed_bytes_.load(std::memory_order_relaxed),
+            .compress_cpu_ns = compress_cpu_ns_.load(std::memory_order_relaxed),
+            .decompressed_bytes = decompressed_bytes_.load(std::memory_order_relaxed),
+            .decompress_cpu_ns = decompress_cpu_ns_.load(std::memory_order_relaxed),
+    };
+}
+
+void CompressionEngine::AddCompressStats(size_t uncompressed_bytes, size_t compressed_bytes,
+                                         uint64_t cpu_ns) {
+    uncompressed_bytes_.fetch_add(uncompressed_bytes, std::memory_order_relaxed);
+    compressed_bytes_.fetch_add(compressed_bytes, std::memory_order_relaxed);
+    compress_cpu_ns_.fetch_add(cpu_ns, std::memory_order_relaxed);
+}
+
+void CompressionEngine::AddDecompressStats(size_t decompressed_bytes, uint64_t cpu_ns) {
+    decompressed_bytes_.fetch_add(decompressed_bytes, std::memory_order_relaxed);
+    decompress_cpu_ns_.fetch_add(cpu_ns, std::memory_order_relaxed);
+}
+
 bool ZlibCompressionEngine::Compress(SerializedData& in, size_t data_length, SerializedData& out) {
+    uint64_t start_ns = ThreadCpuTimeNs();
     z_stream strm;
     strm.zalloc = Z_NULL;
     strm.zfree = Z_NULL;
@@ -55,10 +89,12 @@ bool ZlibCompressionEngine::Compress(SerializedData& in, size_t data_length, Ser
 
     out.Resize(compressed_size);
 
+    AddCompressStats(data_length, compressed_size, ThreadCpuTimeNs() - start_ns);
     return true;
 }
 
 bool ZlibCompressionEngine::Decompress(SerializedData& in, SerializedData& out) {
+    uint64_t start_ns = ThreadCpuTimeNs();
     z_stream strm;
     strm.zalloc = Z_NULL;
     strm.zfree = Z_NULL;
@@ -76,29 +112,87 @@ bool ZlibCompressionEngine::Decompress(SerializedData& in, SerializedData& out)
     CHECK_EQ(ret, Z_STREAM_END);
     inflateEnd(&strm);
 
+    AddDecompressStats(out.size(), ThreadCpuTimeNs() - start_ns);
+    return true;
+}
+
+// Contexts hold zstd's working memory, so each thread that compresses or decompresses keeps one
+// rather than allocating it for every chunk.
+static ZSTD_CCtx* ThreadCCtx() {
+    thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> cctx(ZSTD_createCCtx(),
+                                                                           ZSTD_freeCCtx);
+    return cctx.get();
+}
+
+static ZSTD_DCtx* ThreadDCtx() {
+    thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> dctx(ZSTD_createDCtx(),
+                                                                           ZSTD_freeDCtx);
+    return dctx.get();
+}
+
+ZstdCompressionEngine::~ZstdCompressionEngine() {
+    ZSTD_freeCDict(cdict_);
+    ZSTD_freeDDict(ddict_);
+}
+
+bool ZstdCompressionEngine::LoadDictionary(const std::string& path) {
+    if (cdict_ != nullptr || stats().uncompressed_bytes != 0) {
+        LOG(ERROR) << "A compression dictionary must be loaded once, before compressing any logs";
+        return false;
+    }
+
+    std::string dictionary;
+    if (!android::base::ReadFileToString(path, &dictionary)) {
+        PLOG(ERROR) << "Could not read compression dictionary " << path;
+        return false;
+    }
+    ZSTD_CDict* cdict =
+            ZSTD_createCDict(dictionary.data(), dictionary.size(), kZstdCompressionLevel);
+    ZSTD_DDict* ddict = ZSTD_createDDict(dictionary.data(), dictionary.size());
+    if (cdict == nullptr || ddict == nullptr) {
+        LOG(ERROR) << "Invalid compression dictionary " << path;
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+        return false;
+    }
+    cdict_ = cdict;
+    ddict_ = ddict;
     return true;
 }
 
 bool ZstdCompressionEngine::Compress(SerializedData& in, size_t data_length, SerializedData& out) {
+    uint64_t start_ns = ThreadCpuTimeNs();
     CHECK_LE(data_length, in.size());
 
     size_t compress_bound = ZSTD_compressBound(data_length);
     out.Resize(compress_bound);
 
-    size_t out_size = ZSTD_compress(out.data(), out.size(), in.data(), data_length, 1);
+    size_t out_size =
+            cdict_ != nullptr
+                    ? ZSTD_compress_usingCDict(ThreadCCtx(), out.data(), out.size(), in.data(),
+                                               data_length, cdict_)
+                    : ZSTD_compressCCtx(ThreadCCtx(), out.data(), out.size(), in.data(),
+                                        data_length, kZstdCompressionLevel);
     if (ZSTD_isError(out_size)) {
         LOG(FATAL) << "ZSTD_compress failed: " << ZSTD_getErrorName(out_size);
     }
     out.Resize(out_size);
 
+    AddCompressStats(data_length, out_size, ThreadCpuTimeNs() - start_ns);
     return true;
 }
 
 bool ZstdCompressionEngine::Decompress(SerializedData& in, SerializedData& out) {
-    size_t result = ZSTD_decompress(out.data(), out.size(), in.data(), in.size());
+    uint64_t start_ns = ThreadCpuTimeNs();
+    size_t result = ddict_ != nullptr
+                            ? ZSTD_decompress_usingDDict(ThreadDCtx(), out.data(), out.size(),
+                                                         in.data(), in.size(), ddict_)
+                            : ZSTD_decompressDCtx(ThreadDCtx(), out.data(), out.size(), in.data(),
+                                                  in.size());
     if (ZSTD_isError(result)) {
         LOG(FATAL) << "ZSTD_decompress failed: " << ZSTD_getErrorName(result);
     }
     CHECK_EQ(result, out.size());
+    AddDecompressStats(result, ThreadCpuTimeNs() - start_ns);
     return true;
 }
@@ -16,10 +16,26 @@
 
 #pragma once
 
+#include <stdint.h>
+
+#include <atomic>
 #include <memory>
+#include <string>
 
 #include "SerializedData.h"
 
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+// Totals over all Compress() and Decompress() calls, in bytes and thread CPU time.
+struct CompressionStats {
+    uint64_t uncompressed_bytes;
+    uint64_t compressed_bytes;
+    uint64_t compress_cpu_ns;
+    uint64_t decompressed_bytes;
+    uint64_t decompress_cpu_ns;
+};
+
 class CompressionEngine {
   public:
     static CompressionEngine& GetInstance();
@@ -30,6 +46,25 @@ class CompressionEngine {
     // Decompress the contents of `in` into `out`.  `out.size()` must be set to the decompressed
     // size of the contents.
     virtual bool Decompress(SerializedData& in, SerializedData& out) = 0;
+
+    // Loads a dictionary, such as one trained by `replay_messages train_dictionary`, that primes
+    // the compression of every chunk.  Since chunks compressed with a dictionary can only be
+    // decompressed with it, this fails once anything has been compressed, as it does if the engine
+    // doesn't support dictionaries or the file can't be loaded.
+    virtual bool LoadDictionary(const std::string&) { return false; }
+
+    CompressionStats stats() const;
+
+  protected:
+    void AddCompressStats(size_t uncompressed_bytes, size_t compressed_bytes, uint64_t cpu_ns);
+    void AddDecompressStats(size_t decompressed_bytes, uint64_t cpu_ns);
+
+  private:
+    std::atomic<uint64_t> uncompressed_bytes_ = 0;
+    std::atomic<uint64_t> compressed_bytes_ = 0;
+    std::atomic<uint64_t> compress_cpu_ns_ = 0;
+    std::atomic<uint64_t> decompressed_bytes_ = 0;
+    std::atomic<uint64_t> decompress_cpu_ns_ = 0;
 };
 
 class ZlibCompressionEngine : public CompressionEngine {
@@ -40,6 +75,14 @@ class ZlibCompressionEngine : public CompressionEngine {
 
 class ZstdCompressionEngine : public CompressionEngine {
   public:
+    ~ZstdCompressionEngine() override;
+
     bool Compress(SerializedData& in, size_t data_length, SerializedData& out) override;
     bool Decompress(SerializedData& in, SerializedData& out) override;
-};
\ No newline at end of file
+    bool LoadDictionary(const std::string& path) override;
+
+  private:
+    // Set once by LoadDictionary(), before any chunk is compressed, and immutable afterwards.
+    ZSTD_CDict_s* cdict_ = nullptr;
+    ZSTD_DDict_s* ddict_ = nullptr;
+};
@@ -20,6 +20,7 @@
 
 #include <functional>
 #include <memory>
+#include <span>
 
 #include <android-base/thread_annotations.h>
 #include <log/log.h>
@@ -43,9 +44,19 @@ class FlushToState {
 
     LogMask log_mask() const { return log_mask_; }
 
+    // Hints of which logs the filter passed to FlushTo() reads: only those from pid(), unless it is
+    // 0, and only those with a realtime of at least min_realtime().  A LogBuffer may use them to
+    // skip logs without reading them, but must still pass everything else through the filter.
+    pid_t pid() const { return pid_; }
+    void set_pid(pid_t pid) { pid_ = pid; }
+    log_time min_realtime() const { return min_realtime_; }
+    void set_min_realtime(log_time min_realtime) { min_realtime_ = min_realtime; }
+
   private:
     uint64_t start_;
     LogMask log_mask_;
+    pid_t pid_ = 0;
+    log_time min_realtime_;
 };
 
 // Enum for the return values of the `filter` function passed to FlushTo().
@@ -55,6 +66,17 @@ enum class FilterResult {
     kWrite,
 };
 
+// The arguments of one LogBuffer::Log() call, for passing several at once to LogBatch().
+struct LogBatchEntry {
+    log_id_t log_id;
+    log_time realtime;
+    uid_t uid;
+    pid_t pid;
+    pid_t tid;
+    const char* msg;
+    uint16_t len;
+};
+
 class LogBuffer {
   public:
     virtual ~LogBuffer() {}
@@ -63,6 +85,18 @@ class LogBuffer {
 
     virtual int Log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid, pid_t tid,
                     const char* msg, uint16_t len) = 0;
+    // Logs each entry as Log() would, returning how many were accepted.  Implementations may take
+    // their locks and notify readers once for the whole batch rather than once per message.
+    virtual size_t LogBatch(std::span<const LogBatchEntry> entries) {
+        size_t logged = 0;
+        for (const auto& entry : entries) {
+            if (Log(entry.log_id, entry.realtime, entry.uid, entry.pid, entry.tid, entry.msg,
+                    entry.len) > 0) {
+                ++logged;
+            }
+        }
+        return logged;
+    }
 
     virtual std::unique_ptr<FlushToState> CreateFlushToState(uint64_t start, LogMask log_mask)
             REQUIRES(logd_lock) = 0;
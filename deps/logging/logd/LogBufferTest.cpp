@@ -285,6 +285,47 @@ TEST_P(LogBufferTest, random_messages) {
     CompareLogMessages(log_messages, read_log_messages);
 }
 
+TEST_P(LogBufferTest, log_batch) {
+    auto log_messages = GenerateRandomLogMessages(1000);
+
+    // Batches of an odd size, so that they don't line up with any internal grouping.
+    std::vector<LogBatchEntry> batch;
+    size_t logged = 0;
+    for (size_t i = 0; i < log_messages.size(); ++i) {
+        auto& [entry, message, _] = log_messages[i];
+        batch.push_back({static_cast<log_id_t>(entry.lid), log_time(entry.sec, entry.nsec),
+                         entry.uid, entry.pid, static_cast<pid_t>(entry.tid), message.c_str(),
+                         static_cast<uint16_t>(message.size())});
+        if (batch.size() == 37 || i == log_messages.size() - 1) {
+            logged += log_buffer_->LogBatch(batch);
+            batch.clear();
+        }
+    }
+    EXPECT_EQ(log_messages.size(), logged);
+
+    auto read_log_messages = ReadLogMessagesNonBlockingThread({});
+    CompareLogMessages(log_messages, read_log_messages);
+}
+
+TEST_P(LogBufferTest, log_batch_rejects_invalid) {
+    std::string message = "\x04tag\0message";
+    std::vector<LogBatchEntry> batch = {
+            {LOG_ID_MAIN, log_time(1, 1), 0, 1, 1, message.c_str(),
+             static_cast<uint16_t>(message.size() + 1)},
+            {LOG_ID_MAX, log_time(1, 2), 0, 1, 1, message.c_str(),
+             static_cast<uint16_t>(message.size() + 1)},
+            {LOG_ID_SYSTEM, log_time(1, 4), 0, 1, 1, message.c_str(),
+             static_cast<uint16_t>(message.size() + 1)},
+    };
+    EXPECT_EQ(2U, log_buffer_->LogBatch(batch));
+
+    auto flush_result = FlushMessages();
+    ASSERT_EQ(2U, flush_result.messages.size());
+    EXPECT_EQ(LOG_ID_MAIN, flush_result.messages[0].entry.lid);
+    EXPECT_EQ(LOG_ID_SYSTEM, flush_result.messages[1].entry.lid);
+    EXPECT_EQ(3ULL, flush_result.next_sequence);
+}
+
 TEST_P(LogBufferTest, read_last_sequence) {
     std::vector<LogMessage> log_messages = {
             {{.pid = 1, .tid = 2, .sec = 10000, .nsec = 20001, .lid = LOG_ID_MAIN, .uid = 0},
@@ -447,4 +488,5 @@ TEST_P(LogBufferTest, tail100_blocking_50total_then1000more) {
     CompareLogMessages(expected_log_messages, blocking_reader.read_log_messages());
 }
 
-INSTANTIATE_TEST_CASE_P(LogBufferTests, LogBufferTest, testing::Values("serialized", "simple"));
+INSTANTIATE_TEST_CASE_P(LogBufferTests, LogBufferTest,
+                        testing::Values("serialized", "serialized_persistent", "simple"));
@@ -21,6 +21,7 @@
 #include <string>
 #include <vector>
 
+#include <android-base/file.h>
 #include <gtest/gtest.h>
 
 #include "LogBuffer.h"
@@ -75,6 +76,10 @@ class LogBufferTest : public testing::TestWithParam<std::string> {
     void SetUp() override {
         if (GetParam() == "serialized") {
             log_buffer_.reset(new SerializedLogBuffer(&reader_list_, &tags_, &stats_));
+        } else if (GetParam() == "serialized_persistent") {
+            auto* log_buffer = new SerializedLogBuffer(&reader_list_, &tags_, &stats_);
+            log_buffer->EnablePersistence(persistent_dir_.path);
+            log_buffer_.reset(log_buffer);
         } else if (GetParam() == "simple") {
             log_buffer_.reset(new SimpleLogBuffer(&reader_list_, &tags_, &stats_));
         } else {
@@ -197,5 +202,6 @@ class LogBufferTest : public testing::TestWithParam<std::string> {
     LogTags tags_;
     PruneList prune_;
     LogStatistics stats_{false, true};
+    TemporaryDir persistent_dir_;
     std::unique_ptr<LogBuffer> log_buffer_;
 };
@@ -32,7 +32,21 @@
 #include "LogListener.h"
 #include "LogPermissions.h"
 
-LogListener::LogListener(LogBuffer* buf) : socket_(GetLogSocket()), logbuf_(buf) {}
+LogListener::LogListener(LogBuffer* buf)
+    : socket_(GetLogSocket()),
+      logbuf_(buf),
+      datagrams_(new Datagram[kMaxBatchSize]),
+      headers_(new mmsghdr[kMaxBatchSize]()),
+      entries_(new LogBatchEntry[kMaxBatchSize]) {
+    for (size_t i = 0; i < kMaxBatchSize; ++i) {
+        Datagram& datagram = datagrams_[i];
+        datagram.iov = {datagram.buffer, sizeof(datagram.buffer) - 1};
+        struct msghdr& hdr = headers_[i].msg_hdr;
+        hdr.msg_iov = &datagram.iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = datagram.control;
+    }
+}
 
 bool LogListener::StartListener() {
     if (socket_ <= 0) {
@@ -52,25 +66,41 @@ void LogListener::ThreadFunction() {
 }
 
 void LogListener::HandleData() {
-    // + 1 to ensure null terminator if MAX_PAYLOAD buffer is received
-    __attribute__((uninitialized)) char
-            buffer[sizeof(android_log_header_t) + LOGGER_ENTRY_MAX_PAYLOAD + 1];
-    struct iovec iov = {buffer, sizeof(buffer) - 1};
-
-    alignas(4) char control[CMSG_SPACE(sizeof(struct ucred))];
-    struct msghdr hdr = {
-        nullptr, 0, &iov, 1, control, sizeof(control), 0,
-    };
+    // recvmmsg() overwrites these with what it received.
+    for (size_t i = 0; i < kMaxBatchSize; ++i) {
+        headers_[i].msg_hdr.msg_controllen = sizeof(datagrams_[i].control);
+        headers_[i].msg_hdr.msg_flags = 0;
+    }
 
-    ssize_t n = recvmsg(socket_, &hdr, 0);
-    if (n <= (ssize_t)(sizeof(android_log_header_t))) {
+    // Block until there is one datagram, then take whatever else is already queued, so a log
+    // storm costs one system call, one round of buffer locking and one reader wakeup per batch.
+    int count = recvmmsg(socket_, headers_.get(), kMaxBatchSize, MSG_WAITFORONE, nullptr);
+    if (count <= 0) {
         return;
     }
 
+    size_t batch_size = 0;
+    for (int i = 0; i < count; ++i) {
+        if (ParseDatagram(datagrams_[i], headers_[i].msg_hdr, headers_[i].msg_len,
+                          &entries_[batch_size])) {
+            ++batch_size;
+        }
+    }
+    if (batch_size > 0) {
+        logbuf_->LogBatch({entries_.get(), batch_size});
+    }
+}
+
+bool LogListener::ParseDatagram(Datagram& datagram, struct msghdr& hdr, size_t n,
+                                LogBatchEntry* entry) {
+    if (n <= sizeof(android_log_header_t)) {
+        return false;
+    }
+
     // To clear the entire buffer would be safe, but this contributes to 1.68%
     // overhead under logging load. We are safe because we check counts, but
     // still need to clear null terminator
-    buffer[n] = 0;
+    datagram.buffer[n] = 0;
 
     struct ucred* cred = nullptr;
 
@@ -85,41 +115,48 @@ void LogListener::HandleData() {
     }
 
     if (cred == nullptr) {
-        return;
+        return false;
     }
 
     if (cred->uid == AID_LOGD) {
         // ignore log messages we send to ourself.
         // Such log messages are often generated by libraries we depend on
         // which use standard Android logging.
-        return;
+        return false;
     }
 
     android_log_header_t* header =
-        reinterpret_cast<android_log_header_t*>(buffer);
+        reinterpret_cast<android_log_header_t*>(datagram.buffer);
     log_id_t logId = static_cast<log_id_t>(header->id);
     if (/* logId < LOG_ID_MIN || */ logId >= LOG_ID_MAX ||
         logId == LOG_ID_KERNEL) {
-        return;
+        return false;
     }
 
     if (logId == LOG_ID_SECURITY) {
         if (!__android_log_security()) {
-            return;
+            return false;
         }
         if (!clientCanWriteSecurityLog(cred->uid, cred->gid, cred->pid)) {
-            return;
+            return false;
         }
     }
 
-    char* msg = ((char*)buffer) + sizeof(android_log_header_t);
     n -= sizeof(android_log_header_t);
 
     // NB: hdr.msg_flags & MSG_TRUNC is not tested, silently passing a
     // truncated message to the logs.
 
-    logbuf_->Log(logId, header->realtime, cred->uid, cred->pid, header->tid, msg,
-                 ((size_t)n <= UINT16_MAX) ? (uint16_t)n : UINT16_MAX);
+    *entry = {
+            .log_id = logId,
+            .realtime = header->realtime,
+            .uid = cred->uid,
+            .pid = cred->pid,
+            .tid = header->tid,
+            .msg = datagram.buffer + sizeof(android_log_header_t),
+            .len = (n <= UINT16_MAX) ? (uint16_t)n : (uint16_t)UINT16_MAX,
+    };
+    return true;
 }
 
 int LogListener::GetLogSocket() {
@@ -16,6 +16,12 @@
 
 #pragma once
 
+#include <sys/socket.h>
+
+#include <memory>
+
+#include <private/android_logger.h>
+
 #include "LogBuffer.h"
 
 class LogListener {
@@ -24,10 +30,26 @@ class LogListener {
     bool StartListener();
 
   private:
+    // The most datagrams read by one recvmmsg() call and passed to one LogBuffer::LogBatch().
+    static constexpr size_t kMaxBatchSize = 64;
+
+    struct Datagram {
+        // + 1 to ensure null terminator if MAX_PAYLOAD buffer is received
+        char buffer[sizeof(android_log_header_t) + LOGGER_ENTRY_MAX_PAYLOAD + 1];
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct ucred))];
+        struct iovec iov;
+    };
+
     void ThreadFunction();
     void HandleData();
+    bool ParseDatagram(Datagram& datagram, struct msghdr& hdr, size_t n, LogBatchEntry* entry);
     static int GetLogSocket();
 
     int socket_;
     LogBuffer* logbuf_;
+
+    // Allocated once and reused for every batch.
+    std::unique_ptr<Datagram[]> datagrams_;
+    std::unique_ptr<struct mmsghdr[]> headers_;
+    std::unique_ptr<LogBatchEntry[]> entries_;
 };
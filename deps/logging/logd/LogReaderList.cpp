@@ -81,6 +81,7 @@ bool LogReaderList::HandlePendingThread(uid_t uid, gid_t gid, pid_t pid, int32_t
 }
 
 void LogReaderList::AddAndRunThread(std::unique_ptr<LogReaderThread> thread) {
+    running_reader_count_.fetch_add(1);
     thread->Run();
     running_reader_threads_.emplace_front(std::move(thread));
 }
@@ -98,6 +99,7 @@ void LogReaderList::RemoveRunningThread(LogReaderThread* thread) {
     // dependency on system_server for the native processes.
     if (!thread->track_flag()) {
         running_reader_threads_.erase(iter);
+        running_reader_count_.fetch_sub(1);
         return;
     }
 
@@ -107,6 +109,7 @@ void LogReaderList::RemoveRunningThread(LogReaderThread* thread) {
         service->finishThread(key.uid, key.gid, key.pid, key.fd);
     }
     running_reader_threads_.erase(iter);
+    running_reader_count_.fetch_sub(1);
 }
 
 void LogReaderList::AddPendingThread(std::unique_ptr<LogReaderThread> thread) {
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <list>
 #include <memory>
 #include <vector>
@@ -39,7 +40,15 @@ class LogReaderList {
         return running_reader_threads_;
     }
 
+    // May be checked without logd_lock by writers that have already made their logs visible:
+    // a reader that starts running after this returns false reads those logs on its first pass,
+    // so skipping NotifyNewLog() is safe.
+    bool has_running_readers() const {
+        return running_reader_count_.load(std::memory_order_seq_cst) != 0;
+    }
+
   private:
     std::list<std::unique_ptr<LogReaderThread>> running_reader_threads_ GUARDED_BY(logd_lock);
     std::vector<std::unique_ptr<LogReaderThread>> pending_reader_threads_ GUARDED_BY(logd_lock);
+    std::atomic<size_t> running_reader_count_ = 0;
 };
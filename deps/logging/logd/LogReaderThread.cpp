@@ -70,12 +70,16 @@ void LogReaderThread::ThreadFunction() {
         if (tail_) {
             auto first_pass_state = log_buffer_->CreateFlushToState(flush_to_state_->start(),
                                                                     flush_to_state_->log_mask());
+            first_pass_state->set_pid(pid_);
+            first_pass_state->set_min_realtime(start_time_);
             log_buffer_->FlushTo(writer_.get(), *first_pass_state,
                                  [this](log_id_t log_id, pid_t pid, uint64_t sequence,
                                         log_time realtime) REQUIRES(logd_lock) {
                                      return FilterFirstPass(log_id, pid, sequence, realtime);
                                  });
         }
+        flush_to_state_->set_pid(pid_);
+        flush_to_state_->set_min_realtime(start_time_);
         bool flush_success = log_buffer_->FlushTo(
                 writer_.get(), *flush_to_state_,
                 [this](log_id_t log_id, pid_t pid, uint64_t sequence, log_time realtime) REQUIRES(
@@ -39,9 +39,20 @@ static const uint64_t monthSec = 31 * 24 * hourSec;
 
 std::atomic<size_t> LogStatistics::SizesTotal;
 
-static std::string TagNameKey(const LogStatisticsElement& element) {
+// The tag of a text log, as it appears in its message.  Empty for binary logs.
+static std::string_view TextTag(const LogStatisticsElement& element) {
     if (IsBinary(element.log_id)) {
-        uint32_t tag = element.tag;
+        return {};
+    }
+    const char* msg = element.msg;
+    ++msg;
+    uint16_t len = element.msg_len;
+    len = (len <= 1) ? 0 : strnlen(msg, len - 1);
+    return std::string_view(msg, len);
+}
+
+static std::string TagNameKey(log_id_t log_id, uint32_t tag, const std::string& text_tag) {
+    if (IsBinary(log_id)) {
         if (tag) {
             const char* cp = android::tagToName(tag);
             if (cp) {
@@ -50,14 +61,71 @@ static std::string TagNameKey(const LogStatisticsElement& element) {
         }
         return android::base::StringPrintf("[%" PRIu32 "]", tag);
     }
-    const char* msg = element.msg;
-    ++msg;
-    uint16_t len = element.msg_len;
-    len = (len <= 1) ? 0 : strnlen(msg, len - 1);
-    if (!len) {
+    if (text_tag.empty()) {
         return "<NULL>";
     }
-    return std::string(msg, len);
+    return text_tag;
+}
+
+PendingStatsTable::Slot* PendingStatsTable::Find(const LogStatisticsElement& element,
+                                                 std::string_view text_tag) {
+    uint64_t uid_pid =
+            static_cast<uint64_t>(element.uid) << 32 | static_cast<uint32_t>(element.pid);
+    uint64_t tid_tag = static_cast<uint64_t>(element.tid) << 32 | element.tag;
+    auto matches = [&](const Slot& slot) {
+        return slot.uid_pid == uid_pid && slot.tid_tag == tid_tag && slot.text_tag == text_tag;
+    };
+    // Logs tend to come in bursts from the same thread with the same tag.
+    if (last_ != nullptr && matches(*last_)) {
+        return last_;
+    }
+
+    if (slots_.empty()) {
+        slots_.resize(kSlots);
+    }
+    size_t hash = text_tag.empty() ? 0 : std::hash<std::string_view>{}(text_tag);
+    hash ^= uid_pid * 0x9e3779b97f4a7c15 ^ tid_tag * 0xc2b2ae3d27d4eb4f;
+    for (size_t i = hash >> 32;; ++i) {
+        Slot& slot = slots_[i & (kSlots - 1)];
+        if (!slot.used) {
+            if (used_ == kMaxUsed) {
+                return nullptr;
+            }
+            ++used_;
+            slot.used = true;
+            slot.uid_pid = uid_pid;
+            slot.tid_tag = tid_tag;
+            slot.text_tag.assign(text_tag);
+            slot.added = 0;
+            slot.subtracted = 0;
+            last_ = &slot;
+            return &slot;
+        }
+        if (matches(slot)) {
+            last_ = &slot;
+            return &slot;
+        }
+    }
+}
+
+void PendingStatsTable::Clear() {
+    for (auto& slot : slots_) {
+        slot.used = false;
+    }
+    used_ = 0;
+    last_ = nullptr;
+}
+
+size_t PendingStatsTable::sizeOf() const {
+    size_t size = slots_.capacity() * sizeof(Slot);
+    for (const auto& slot : slots_) {
+        // As in LogStatistics::sizeOf(), short strings don't need an allocation.
+        size_t len = slot.text_tag.capacity();
+        if ((sizeof(std::string) == 24 && len > 22) || (sizeof(std::string) != 24 && len > 10)) {
+            size += len;
+        }
+    }
+    return size;
 }
 
 LogStatistics::LogStatistics(bool enable_statistics, bool track_total_size,
@@ -76,6 +144,9 @@ LogStatistics::LogStatistics(bool enable_statistics, bool track_total_size,
             mOldest[id] = now;
             mNewest[id] = now;
         }
+        auto lock = std::lock_guard{log_id_stats_[id].lock};
+        log_id_stats_[id].oldest = mOldest[id];
+        log_id_stats_[id].newest = mNewest[id];
     }
 }
 
@@ -111,43 +182,45 @@ char* pidToName(pid_t pid) {
 }
 
 void LogStatistics::AddTotal(log_id_t log_id, uint16_t size) {
-    auto lock = std::lock_guard{lock_};
+    LogIdStats& stats = log_id_stats_[log_id];
+    auto lock = std::lock_guard{stats.lock};
 
-    mSizesTotal[log_id] += size;
+    stats.sizes_total += size;
     SizesTotal += size;
-    ++mElementsTotal[log_id];
+    ++stats.elements_total;
 }
 
 void LogStatistics::Add(LogStatisticsElement element) {
-    auto lock = std::lock_guard{lock_};
+    log_id_t log_id = element.log_id;
+    LogIdStats& stats = log_id_stats_[log_id];
+    auto log_lock = std::lock_guard{stats.lock};
 
     if (!track_total_size_) {
         element.total_len = element.msg_len;
     }
 
-    log_id_t log_id = element.log_id;
-    uint16_t size = element.total_len;
-    mSizes[log_id] += size;
-    ++mElements[log_id];
+    size_t size = element.total_len;
+    stats.sizes += size;
+    ++stats.elements;
 
-    mSizesTotal[log_id] += size;
+    stats.sizes_total += size;
     SizesTotal += size;
-    ++mElementsTotal[log_id];
+    ++stats.elements_total;
 
     log_time stamp(element.realtime);
-    if (mNewest[log_id] < stamp) {
+    if (stats.newest < stamp) {
         // A major time update invalidates the statistics :-(
-        log_time diff = stamp - mNewest[log_id];
-        mNewest[log_id] = stamp;
+        log_time diff = stamp - stats.newest;
+        stats.newest = stamp;
 
         if (diff.tv_sec > hourSec) {
             // approximate Do-Your-Best fixup
-            diff += mOldest[log_id];
+            diff += stats.oldest;
             if ((diff > stamp) && ((diff - stamp).tv_sec < hourSec)) {
                 diff = stamp;
             }
             if (diff <= stamp) {
-                mOldest[log_id] = diff;
+                stats.oldest = diff;
             }
         }
     }
@@ -156,6 +229,46 @@ void LogStatistics::Add(LogStatisticsElement element) {
         return;
     }
 
+    std::string_view text_tag = PendingKey(&element);
+    auto* slot = stats.pending.Find(element, text_tag);
+    if (slot == nullptr) {
+        auto lock = std::lock_guard{lock_};
+        FoldPendingStatsLocked(log_id);
+        slot = stats.pending.Find(element, text_tag);
+    }
+    if (slot->added == 0 && (enable || element.uid == AID_SYSTEM)) {
+        auto lock = std::lock_guard{lock_};
+        ReserveEntriesLocked(element);
+    }
+    slot->added += size;
+}
+
+// Drops the parts of element that the tables don't use, so that more logs share a key, and returns
+// the tag of a text log.
+std::string_view LogStatistics::PendingKey(LogStatisticsElement* element) const {
+    if (!enable) {
+        element->tid = 0;
+        element->tag = 0;
+        return {};
+    }
+    return TextTag(*element);
+}
+
+void LogStatistics::ReserveEntriesLocked(const LogStatisticsElement& element) {
+    if (element.uid == AID_SYSTEM) {
+        pidSystemTable[element.log_id].Reserve(element.pid, element);
+    }
+
+    if (!enable) {
+        return;
+    }
+
+    pidTable.Reserve(element.pid, element);
+    tidTable.Reserve(element.tid, element);
+}
+
+void LogStatistics::AddToTables(const LogStatisticsElement& element, const std::string& text_tag) {
+    log_id_t log_id = element.log_id;
     uidTable[log_id].Add(element.uid, element);
     if (element.uid == AID_SYSTEM) {
         pidSystemTable[log_id].Add(element.pid, element);
@@ -177,29 +290,43 @@ void LogStatistics::Add(LogStatisticsElement element) {
         }
     }
 
-    tagNameTable.Add(TagNameKey(element), element);
+    tagNameTable.Add(TagNameKey(log_id, tag, text_tag), element);
 }
 
 void LogStatistics::Subtract(LogStatisticsElement element) {
-    auto lock = std::lock_guard{lock_};
+    log_id_t log_id = element.log_id;
+    LogIdStats& stats = log_id_stats_[log_id];
+    auto log_lock = std::lock_guard{stats.lock};
 
     if (!track_total_size_) {
         element.total_len = element.msg_len;
     }
 
-    log_id_t log_id = element.log_id;
-    uint16_t size = element.total_len;
-    mSizes[log_id] -= size;
-    --mElements[log_id];
+    size_t size = element.total_len;
+    stats.sizes -= size;
+    --stats.elements;
 
-    if (mOldest[log_id] < element.realtime) {
-        mOldest[log_id] = element.realtime;
+    if (stats.oldest < element.realtime) {
+        stats.oldest = element.realtime;
     }
 
     if (log_id == LOG_ID_KERNEL) {
         return;
     }
 
+    std::string_view text_tag = PendingKey(&element);
+    auto* slot = stats.pending.Find(element, text_tag);
+    if (slot == nullptr) {
+        auto lock = std::lock_guard{lock_};
+        FoldPendingStatsLocked(log_id);
+        slot = stats.pending.Find(element, text_tag);
+    }
+    slot->subtracted += size;
+}
+
+void LogStatistics::SubtractFromTables(const LogStatisticsElement& element,
+                                       const std::string& text_tag) {
+    log_id_t log_id = element.log_id;
     uidTable[log_id].Subtract(element.uid, element);
     if (element.uid == AID_SYSTEM) {
         pidSystemTable[log_id].Subtract(element.pid, element);
@@ -221,7 +348,55 @@ void LogStatistics::Subtract(LogStatisticsElement element) {
         }
     }
 
-    tagNameTable.Subtract(TagNameKey(element), element);
+    tagNameTable.Subtract(TagNameKey(log_id, tag, text_tag), element);
+}
+
+void LogStatistics::FoldPendingStatsLocked(log_id_t log_id) {
+    LogIdStats& stats = log_id_stats_[log_id];
+    mSizes[log_id] = stats.sizes;
+    mElements[log_id] = stats.elements;
+    mSizesTotal[log_id] = stats.sizes_total;
+    mElementsTotal[log_id] = stats.elements_total;
+    mOldest[log_id] = stats.oldest;
+    mNewest[log_id] = stats.newest;
+    overhead_[log_id] = stats.overhead;
+
+    // Every log is added before it is subtracted, so applying all of the additions before any of
+    // the subtractions never subtracts more than a table holds, even from the entries of a pid or
+    // a tid that several keys share.
+    auto element_of = [log_id](const PendingStatsTable::Slot& slot) {
+        return LogStatisticsElement{
+                .uid = slot.uid(),
+                .pid = slot.pid(),
+                .tid = slot.tid(),
+                .tag = slot.tag(),
+                .log_id = log_id,
+        };
+    };
+    stats.pending.ForEach([&](PendingStatsTable::Slot& slot) REQUIRES(lock_) {
+        if (slot.added) {
+            LogStatisticsElement element = element_of(slot);
+            element.total_len = slot.added;
+            AddToTables(element, slot.text_tag);
+        }
+    });
+    stats.pending.ForEach([&](PendingStatsTable::Slot& slot) REQUIRES(lock_) {
+        if (slot.subtracted) {
+            LogStatisticsElement element = element_of(slot);
+            element.total_len = slot.subtracted;
+            SubtractFromTables(element, slot.text_tag);
+        }
+    });
+    stats.pending.Clear();
+    pending_sizes_[log_id] = stats.pending.sizeOf();
+}
+
+void LogStatistics::FoldPendingStats() {
+    log_id_for_each(id) {
+        auto log_lock = std::lock_guard{log_id_stats_[id].lock};
+        auto lock = std::lock_guard{lock_};
+        FoldPendingStatsLocked(id);
+    }
 }
 
 const char* LogStatistics::UidToName(uid_t uid) const {
@@ -293,13 +468,13 @@ bool LogStatistics::ShouldPrune(log_id id, unsigned long max_size,
     static constexpr size_t kMinPrune = 4;
     static constexpr size_t kMaxPrune = 256;
 
-    auto lock = std::lock_guard{lock_};
-    size_t sizes = mSizes[id];
+    auto lock = std::lock_guard{log_id_stats_[id].lock};
+    size_t sizes = log_id_stats_[id].sizes;
     if (sizes <= max_size) {
         return false;
     }
     size_t size_over = sizes - ((max_size * 9) / 10);
-    size_t elements = mElements[id];
+    size_t elements = log_id_stats_[id].elements;
     size_t min_elements = elements / 100;
     if (min_elements < kMinPrune) {
         min_elements = kMinPrune;
@@ -572,6 +747,8 @@ std::string LogStatistics::FormatTable(const LogHashtable<TKey, TEntry>& table,
 }
 
 std::string LogStatistics::ReportInteresting() const {
+    // Like PidToName(), reporting the statistics may need to update them first.
+    const_cast<LogStatistics*>(this)->FoldPendingStats();
     auto lock = std::lock_guard{lock_};
 
     std::vector<std::string> items;
@@ -597,6 +774,7 @@ std::string LogStatistics::ReportInteresting() const {
 }
 
 std::string LogStatistics::Format(uid_t uid, pid_t pid, unsigned int logMask) const {
+    const_cast<LogStatistics*>(this)->FoldPendingStats();
     auto lock = std::lock_guard{lock_};
 
     static const uint16_t spaces_total = 19;
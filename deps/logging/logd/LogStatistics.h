@@ -30,6 +30,7 @@
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #include <android-base/stringprintf.h>
 #include <android-base/thread_annotations.h>
@@ -56,7 +57,9 @@ struct LogStatisticsElement {
     const char* msg;
     uint16_t msg_len;
     log_id_t log_id;
-    uint16_t total_len;
+    // The size of one log, or when LogStatistics folds its pending statistics into its tables, of
+    // all of the logs with the same key.
+    size_t total_len;
 };
 
 template <typename TKey, typename TEntry>
@@ -158,6 +161,14 @@ class LogHashtable {
         return it;
     }
 
+    // Creates the entry for key from element, without counting element, if there isn't one yet.
+    void Reserve(const TKey& key, LogStatisticsElement element) {
+        if (map.find(key) == map.end()) {
+            element.total_len = 0;
+            map.insert(std::make_pair(key, TEntry(element)));
+        }
+    }
+
     void Subtract(const TKey& key, const LogStatisticsElement& element) {
         iterator it = map.find(key);
         if (it != map.end() && it->second.Subtract(element)) {
@@ -407,11 +418,59 @@ class TagNameEntry : public EntryBase {
     uid_t uid_;
 };
 
+// Accumulates the bytes added and subtracted for each distinct uid, pid, tid and tag of one log in
+// a flat, open-addressed table, so that accounting for a log costs a single probe instead of
+// updates to every LogHashtable.  LogStatistics later folds these totals into its tables, one
+// update per key rather than one per log.
+class PendingStatsTable {
+  public:
+    struct Slot {
+        uid_t uid() const { return uid_pid >> 32; }
+        pid_t pid() const { return static_cast<uint32_t>(uid_pid); }
+        pid_t tid() const { return tid_tag >> 32; }
+        uint32_t tag() const { return static_cast<uint32_t>(tid_tag); }
+
+        // The ids are packed in pairs to compare them quickly.
+        uint64_t uid_pid;
+        uint64_t tid_tag;
+        // The tag of a text log.  Binary logs are keyed by their numeric tag alone.
+        std::string text_tag;
+        bool used = false;
+        size_t added;
+        size_t subtracted;
+    };
+
+    // Returns the slot for the key of element, a text log with the given tag if text_tag isn't
+    // empty, creating it if needed.  Returns nullptr if the table is too full for a new key, in
+    // which case it must be folded and cleared first.
+    Slot* Find(const LogStatisticsElement& element, std::string_view text_tag);
+
+    template <typename F>
+    void ForEach(F&& f) {
+        for (auto& slot : slots_) {
+            if (slot.used) f(slot);
+        }
+    }
+
+    void Clear();
+    bool empty() const { return used_ == 0; }
+    size_t sizeOf() const;
+
+  private:
+    static constexpr size_t kSlots = 128;  // Must be a power of two.
+    static constexpr size_t kMaxUsed = kSlots * 3 / 4;
+
+    std::vector<Slot> slots_;  // Allocated on first use, since some logs never see any.
+    size_t used_ = 0;
+    Slot* last_ = nullptr;
+};
+
 class LogStatistics {
     friend UidEntry;
     friend PidEntry;
     friend TidEntry;
 
+    // The counts of log_id_stats_ as of the last time they were folded, for reporting.
     size_t mSizes[LOG_ID_MAX] GUARDED_BY(lock_);
     size_t mElements[LOG_ID_MAX] GUARDED_BY(lock_);
     size_t mSizesTotal[LOG_ID_MAX] GUARDED_BY(lock_);
@@ -448,6 +507,39 @@ class LogStatistics {
     typedef LogHashtable<std::string, TagNameEntry> tagNameTable_t;
     tagNameTable_t tagNameTable;
 
+    // The statistics of a single log as logs are added and removed.  They are updated under the
+    // log's own lock, which is taken before lock_, so that logs written to different log buffers
+    // don't contend and so that the tables behind lock_ are only updated when the pending
+    // statistics are folded into them: when pending fills up or when the tables are reported.
+    // Sizes(), SizeReadable() and ShouldPrune(), which pruning relies on, read the counts here and
+    // are always exact.
+    struct LogIdStats {
+        mutable std::mutex lock;
+        size_t sizes GUARDED_BY(lock) = 0;
+        size_t elements GUARDED_BY(lock) = 0;
+        size_t sizes_total GUARDED_BY(lock) = 0;
+        size_t elements_total GUARDED_BY(lock) = 0;
+        log_time oldest GUARDED_BY(lock);
+        log_time newest GUARDED_BY(lock);
+        std::optional<size_t> overhead GUARDED_BY(lock);
+        PendingStatsTable pending GUARDED_BY(lock);
+    };
+    LogIdStats log_id_stats_[LOG_ID_MAX];
+    // The size of each log's pending table as of the last fold, for sizeOf().
+    size_t pending_sizes_[LOG_ID_MAX] GUARDED_BY(lock_) = {};
+
+    std::string_view PendingKey(LogStatisticsElement* element) const;
+    // Creates the pid and tid entries of a log whose key is new to pending, so that their names are
+    // read from /proc while the process is still alive rather than when pending is folded.
+    void ReserveEntriesLocked(const LogStatisticsElement& element) REQUIRES(lock_);
+    void AddToTables(const LogStatisticsElement& element, const std::string& text_tag)
+            REQUIRES(lock_);
+    void SubtractFromTables(const LogStatisticsElement& element, const std::string& text_tag)
+            REQUIRES(lock_);
+    // Brings the tables and the counts behind lock_ up to date with log_id's pending statistics.
+    void FoldPendingStatsLocked(log_id_t log_id) REQUIRES(lock_);
+    void FoldPendingStats() EXCLUDES(lock_);
+
     size_t sizeOf() const REQUIRES(lock_) {
         size_t size = sizeof(*this) + pidTable.sizeOf() + tidTable.sizeOf() +
                       tagTable.sizeOf() + securityTagTable.sizeOf() +
@@ -473,6 +565,7 @@ class LogStatistics {
             }
         }
         log_id_for_each(id) {
+            size += pending_sizes_[id];
             size += uidTable[id].sizeOf();
             size += uidTable[id].size() * sizeof(uidTable_t::iterator);
             size += pidSystemTable[id].sizeOf();
@@ -498,18 +591,18 @@ class LogStatistics {
             EXCLUDES(lock_);
 
     // Return the consumed size of the given buffer.
-    size_t Sizes(log_id_t id) const EXCLUDES(lock_) {
-        auto lock = std::lock_guard{lock_};
-        if (overhead_[id]) {
-            return *overhead_[id];
+    size_t Sizes(log_id_t id) const {
+        auto lock = std::lock_guard{log_id_stats_[id].lock};
+        if (log_id_stats_[id].overhead) {
+            return *log_id_stats_[id].overhead;
         }
-        return mSizes[id];
+        return log_id_stats_[id].sizes;
     }
 
     // Return the uncompressed size of the contents of the given buffer.
-    size_t SizeReadable(log_id_t id) const EXCLUDES(lock_) {
-        auto lock = std::lock_guard{lock_};
-        return mSizes[id];
+    size_t SizeReadable(log_id_t id) const {
+        auto lock = std::lock_guard{log_id_stats_[id].lock};
+        return log_id_stats_[id].sizes;
     }
 
     // TODO: Get rid of this entirely.
@@ -525,8 +618,8 @@ class LogStatistics {
     const char* UidToName(uid_t uid) const EXCLUDES(lock_);
 
     void set_overhead(log_id_t id, size_t size) {
-        auto lock = std::lock_guard{lock_};
-        overhead_[id] = size;
+        auto lock = std::lock_guard{log_id_stats_[id].lock};
+        log_id_stats_[id].overhead = size;
     }
 
   private:
@@ -541,5 +634,6 @@ class LogStatistics {
     mutable std::mutex lock_;
     bool track_total_size_;
 
+    // As with mSizes, a copy of log_id_stats_[id].overhead for reporting.
     std::optional<size_t> overhead_[LOG_ID_MAX] GUARDED_BY(lock_);
 };
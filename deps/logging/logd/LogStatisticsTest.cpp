@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "LogStatistics.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+#include <gtest/gtest.h>
+
+using android::base::Split;
+
+// Returns the line of the `logcat -S` output that reports on the given tag.
+static std::string TagLine(const LogStatistics& stats, const std::string& tag) {
+    for (const auto& line : Split(stats.Format(AID_ROOT, 0, 1 << LOG_ID_MAIN), "\n")) {
+        if (line.ends_with(" " + tag) || line.find(" " + tag + " ") != std::string::npos) {
+            return line;
+        }
+    }
+    return "";
+}
+
+// Statistics are gathered per log and folded into the reported tables later, either when too many
+// distinct threads and tags have logged or when they are reported.  Either way, the tables must
+// end up the same as if each log had been added to them directly.
+TEST(LogStatistics, fold_pending) {
+    LogStatistics stats(true, true);
+    const std::string first_msg = std::string("\x04") + "first" + '\0' + "message" + '\0';
+    const std::string second_msg = std::string("\x04") + "second" + '\0' + "message" + '\0';
+    auto element = [&](pid_t tid, const std::string& msg, size_t total_len) {
+        return LogStatisticsElement{
+                .uid = 1234,
+                .pid = getpid(),
+                .tid = tid,
+                .tag = 0,
+                .realtime = log_time(1, tid),
+                .msg = msg.data(),
+                .msg_len = static_cast<uint16_t>(msg.size()),
+                .log_id = LOG_ID_MAIN,
+                .total_len = total_len,
+        };
+    };
+
+    // Enough threads that the pending statistics fill up and are folded along the way.
+    constexpr pid_t kThreads = 200;
+    for (pid_t tid = 1; tid <= kThreads; ++tid) {
+        stats.Add(element(tid, first_msg, 100));
+        stats.Add(element(tid, second_msg, 50));
+    }
+    for (pid_t tid = 1; tid <= kThreads / 2; ++tid) {
+        stats.Subtract(element(tid, second_msg, 50));
+    }
+
+    // These are always exact, since pruning depends on them.
+    EXPECT_EQ(kThreads * 100 + kThreads / 2 * 50, stats.Sizes(LOG_ID_MAIN));
+    EXPECT_EQ(stats.Sizes(LOG_ID_MAIN), stats.SizeReadable(LOG_ID_MAIN));
+
+    std::string first_line = TagLine(stats, "first");
+    EXPECT_NE(std::string::npos, first_line.find(std::to_string(kThreads * 100))) << first_line;
+    std::string second_line = TagLine(stats, "second");
+    EXPECT_NE(std::string::npos, second_line.find(std::to_string(kThreads / 2 * 50)))
+            << second_line;
+
+    // Once every log of a tag is gone, so is its entry.
+    for (pid_t tid = kThreads / 2 + 1; tid <= kThreads; ++tid) {
+        stats.Subtract(element(tid, second_msg, 50));
+    }
+    EXPECT_EQ("", TagLine(stats, "second"));
+    EXPECT_NE("", TagLine(stats, "first"));
+}
+
+// The name of a pid is read from /proc when it first logs, as the process that logged may well be
+// gone by the time its statistics are folded and reported.
+TEST(LogStatistics, pid_name_resolved_when_logged) {
+    pid_t child = fork();
+    ASSERT_NE(-1, child);
+    if (child == 0) {
+        execlp("sleep", "sleep", "60", nullptr);
+        _exit(1);
+    }
+    std::string cmdline;
+    for (int i = 0; i < 1000 && !cmdline.starts_with("sleep"); ++i) {
+        usleep(1000);
+        android::base::ReadFileToString("/proc/" + std::to_string(child) + "/cmdline", &cmdline);
+    }
+    ASSERT_TRUE(cmdline.starts_with("sleep")) << cmdline;
+
+    LogStatistics stats(true, true);
+    const std::string msg = std::string("\x04") + "tag" + '\0' + "message" + '\0';
+    stats.Add(LogStatisticsElement{
+            .uid = 1234,
+            .pid = child,
+            .tid = child,
+            .tag = 0,
+            .realtime = log_time(1, 0),
+            .msg = msg.data(),
+            .msg_len = static_cast<uint16_t>(msg.size()),
+            .log_id = LOG_ID_MAIN,
+            .total_len = 100,
+    });
+
+    kill(child, SIGKILL);
+    ASSERT_EQ(child, waitpid(child, nullptr, 0));
+
+    // Every table that is keyed by the pid or the tid reports the name.
+    std::string output = stats.Format(AID_ROOT, 0, 1 << LOG_ID_MAIN);
+    std::string prefix = " " + std::to_string(child) + "/1234 ";
+    size_t named = 0;
+    for (const auto& line : Split(output, "\n")) {
+        if (line.starts_with(prefix)) {
+            EXPECT_NE(std::string::npos, line.find("sleep")) << line;
+            ++named;
+        }
+    }
+    EXPECT_EQ(2U, named) << output;
+}
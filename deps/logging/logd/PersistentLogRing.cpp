@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PersistentLogRing.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+
+using android::base::unique_fd;
+
+static constexpr uint32_t kRingMagic = 0x474e524c;  // "LRNG"
+static constexpr uint32_t kRingVersion = 1;
+static constexpr uint32_t kSlotFree = 0;
+static constexpr uint32_t kSlotInUse = 1;
+static constexpr size_t kPageSize = 4096;
+
+struct PersistentLogRing::RingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t log_id;
+    uint32_t slot_count;
+    uint64_t slot_size;
+    // The generation of the next slot to be taken, which orders the chunks in the ring.
+    uint64_t next_generation;
+};
+
+struct PersistentLogRing::SlotHeader {
+    // Written last when a slot is taken, and first when it's freed.
+    uint32_t state;
+    // The length of the logs in the slot, as published by SerializedLogChunk::Log().
+    uint32_t write_offset;
+    uint64_t generation;
+};
+
+PersistentLogRing::PersistentLogRing(int fd, uint8_t* map, size_t map_size, size_t slot_size,
+                                     size_t slot_count)
+    : fd_(fd), map_(map), map_size_(map_size), slot_size_(slot_size), slot_count_(slot_count) {}
+
+PersistentLogRing::~PersistentLogRing() {
+    munmap(map_, map_size_);
+    close(fd_);
+}
+
+size_t PersistentLogRing::SlotStride(size_t slot_size) {
+    return (slot_size + kPageSize - 1) & ~(kPageSize - 1);
+}
+
+size_t PersistentLogRing::HeadersSize(size_t slot_count) {
+    size_t size = sizeof(RingHeader) + slot_count * sizeof(SlotHeader);
+    return (size + kPageSize - 1) & ~(kPageSize - 1);
+}
+
+PersistentLogRing::RingHeader* PersistentLogRing::header() const {
+    return reinterpret_cast<RingHeader*>(map_);
+}
+
+PersistentLogRing::SlotHeader* PersistentLogRing::slot_header(size_t index) const {
+    return reinterpret_cast<SlotHeader*>(map_ + sizeof(RingHeader)) + index;
+}
+
+uint8_t* PersistentLogRing::slot_data(size_t index) const {
+    return map_ + HeadersSize(slot_count_) + index * SlotStride(slot_size_);
+}
+
+std::shared_ptr<PersistentLogRing> PersistentLogRing::Map(const std::string& path, int fd,
+                                                          size_t slot_size, size_t slot_count) {
+    size_t map_size = HeadersSize(slot_count) + slot_count * SlotStride(slot_size);
+    void* map = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        PLOG(ERROR) << "Could not map " << path;
+        close(fd);
+        return nullptr;
+    }
+    return std::shared_ptr<PersistentLogRing>(new PersistentLogRing(
+            fd, reinterpret_cast<uint8_t*>(map), map_size, slot_size, slot_count));
+}
+
+std::shared_ptr<PersistentLogRing> PersistentLogRing::Create(const std::string& path,
+                                                             log_id_t log_id, size_t slot_size,
+                                                             size_t slot_count) {
+    // The new ring is set up under a temporary name, so that a ring at path is only ever replaced
+    // by a complete one.  Chunks in the old ring keep its mapping, of the now unlinked file.
+    std::string tmp_path = path + ".tmp";
+    unique_fd fd(TEMP_FAILURE_RETRY(
+            open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW, 0600)));
+    if (fd == -1) {
+        PLOG(ERROR) << "Could not create " << tmp_path;
+        return nullptr;
+    }
+    // The file starts out sparse and zeroed, so with every slot free.
+    off_t file_size = HeadersSize(slot_count) + slot_count * SlotStride(slot_size);
+    if (ftruncate(fd, file_size) != 0) {
+        PLOG(ERROR) << "Could not size " << tmp_path;
+        unlink(tmp_path.c_str());
+        return nullptr;
+    }
+    auto ring = Map(tmp_path, fd.release(), slot_size, slot_count);
+    if (ring == nullptr) {
+        unlink(tmp_path.c_str());
+        return nullptr;
+    }
+    *ring->header() = RingHeader{
+            .magic = kRingMagic,
+            .version = kRingVersion,
+            .log_id = log_id,
+            .slot_count = static_cast<uint32_t>(slot_count),
+            .slot_size = slot_size,
+            .next_generation = 1,
+    };
+    if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+        PLOG(ERROR) << "Could not rename " << tmp_path << " to " << path;
+        unlink(tmp_path.c_str());
+        return nullptr;
+    }
+    return ring;
+}
+
+// Returns the length of the whole logs at the start of data, which holds write_offset bytes of
+// them if it was left intact, with sequence numbers above *sequence, which is updated to the last.
+static int ValidLogsLength(const uint8_t* data, size_t write_offset, uint64_t* sequence) {
+    size_t offset = 0;
+    while (offset + sizeof(SerializedLogEntry) <= write_offset) {
+        auto* entry = reinterpret_cast<const SerializedLogEntry*>(data + offset);
+        if (entry->msg_len() == 0 || entry->msg_len() > LOGGER_ENTRY_MAX_PAYLOAD ||
+            offset + entry->total_len() > write_offset || entry->sequence() <= *sequence) {
+            break;
+        }
+        *sequence = entry->sequence();
+        offset += entry->total_len();
+    }
+    return offset;
+}
+
+std::shared_ptr<PersistentLogRing> PersistentLogRing::Reattach(
+        const std::string& path, log_id_t log_id, size_t slot_size, size_t slot_count,
+        std::list<SerializedLogChunk>* chunks) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDWR | O_CLOEXEC | O_NOFOLLOW)));
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            PLOG(ERROR) << "Could not open " << path;
+        }
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) !=
+                HeadersSize(slot_count) + slot_count * SlotStride(slot_size)) {
+        LOG(INFO) << "Not reattaching to " << path << ", which has a different size";
+        return nullptr;
+    }
+    auto ring = Map(path, fd.release(), slot_size, slot_count);
+    if (ring == nullptr) {
+        return nullptr;
+    }
+    const RingHeader& header = *ring->header();
+    if (header.magic != kRingMagic || header.version != kRingVersion || header.log_id != log_id ||
+        header.slot_count != slot_count || header.slot_size != slot_size) {
+        LOG(INFO) << "Not reattaching to " << path << ", which is for another log or geometry";
+        return nullptr;
+    }
+
+    std::vector<size_t> in_use;
+    for (size_t i = 0; i < slot_count; ++i) {
+        SlotHeader* slot = ring->slot_header(i);
+        if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != kSlotInUse) {
+            continue;
+        }
+        if (slot->generation >= header.next_generation || slot->write_offset > slot_size) {
+            LOG(WARNING) << "Discarding corrupt slot " << i << " of " << path;
+            ring->FreeSlot(i);
+            continue;
+        }
+        in_use.emplace_back(i);
+    }
+    std::sort(in_use.begin(), in_use.end(), [&ring](size_t a, size_t b) {
+        return ring->slot_header(a)->generation < ring->slot_header(b)->generation;
+    });
+
+    // Logs are validated as they were in order, so a chunk whose logs don't follow those of the
+    // chunk before it loses them, but those before it are kept.
+    uint64_t sequence = 0;
+    size_t restored = 0;
+    for (size_t i : in_use) {
+        SlotHeader* slot = ring->slot_header(i);
+        int length = ValidLogsLength(ring->slot_data(i), slot->write_offset, &sequence);
+        if (static_cast<size_t>(length) != slot->write_offset) {
+            LOG(WARNING) << "Slot " << i << " of " << path << " has " << slot->write_offset
+                         << " bytes of logs, but only " << length << " are valid";
+        }
+        if (length == 0) {
+            ring->FreeSlot(i);
+            continue;
+        }
+        slot->write_offset = length;
+        SerializedLogChunk chunk(ring->SlotContents(i), &slot->write_offset);
+        chunk.RestoreLogs(length);
+        chunk.FinishWriting();
+        chunks->emplace_back(std::move(chunk));
+        restored += length;
+    }
+    LOG(INFO) << "Reattached to " << path << ", restoring " << restored << " bytes of logs";
+    return ring;
+}
+
+SerializedData PersistentLogRing::SlotContents(size_t index) {
+    // The deleter holds a reference to the ring, so that its mapping outlives the chunk.
+    auto deleter = [ring = shared_from_this(), index](uint8_t*) { ring->FreeSlot(index); };
+    return SerializedData(std::shared_ptr<uint8_t[]>(slot_data(index), std::move(deleter)),
+                          slot_size_);
+}
+
+std::optional<SerializedLogChunk> PersistentLogRing::NewChunk() {
+    auto lock = std::lock_guard{lock_};
+    for (size_t i = 0; i < slot_count_; ++i) {
+        SlotHeader* slot = slot_header(i);
+        if (slot->state != kSlotFree) {
+            continue;
+        }
+        slot->write_offset = 0;
+        slot->generation = header()->next_generation++;
+        __atomic_store_n(&slot->state, kSlotInUse, __ATOMIC_RELEASE);
+        return SerializedLogChunk(SlotContents(i), &slot->write_offset);
+    }
+    return std::nullopt;
+}
+
+void PersistentLogRing::FreeSlot(size_t index) {
+    auto lock = std::lock_guard{lock_};
+    if (detached_) {
+        return;
+    }
+    __atomic_store_n(&slot_header(index)->state, kSlotFree, __ATOMIC_RELEASE);
+}
+
+void PersistentLogRing::Detach() {
+    auto lock = std::lock_guard{lock_};
+    detached_ = true;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include <android-base/thread_annotations.h>
+#include <log/log.h>
+
+#include "SerializedLogChunk.h"
+
+// A file of fixed size slots, memory-mapped shared, that holds the chunks of one log so that they
+// outlive logd.  The file starts with a RingHeader, then a SlotHeader for each slot, then the slots
+// themselves, each page aligned.
+//
+// A slot's header is only marked in use once the rest of it is written, and a chunk publishes its
+// write offset to it with a release store after each log it appends, so whatever logd dies in the
+// middle of, the in use slots and the logs up to their write offsets are whole.  Reattach() then
+// hands them back, oldest first, as finished chunks.
+//
+// Chunks hold their slot through the deleter of their contents, which frees it again and keeps the
+// ring mapped until then, even if the ring itself has been replaced.
+class PersistentLogRing : public std::enable_shared_from_this<PersistentLogRing> {
+  public:
+    ~PersistentLogRing();
+
+    // Creates a ring with every slot free at path, replacing any file there.  Returns nullptr if
+    // the file could not be created or mapped.
+    static std::shared_ptr<PersistentLogRing> Create(const std::string& path, log_id_t log_id,
+                                                     size_t slot_size, size_t slot_count);
+    // Maps a ring left at path by a previous logd, and appends the chunks it holds to chunks,
+    // oldest first, with their logs validated.  Returns nullptr, and appends nothing, if there is
+    // no such ring or it is for a different log or has a different geometry.
+    static std::shared_ptr<PersistentLogRing> Reattach(const std::string& path, log_id_t log_id,
+                                                       size_t slot_size, size_t slot_count,
+                                                       std::list<SerializedLogChunk>* chunks);
+
+    // Returns a chunk backed by a free slot, or std::nullopt if every slot is in use.
+    std::optional<SerializedLogChunk> NewChunk();
+
+    // Stops chunks from freeing their slots when they're destroyed, so that destroying the log
+    // buffer leaves its logs in the file, as if logd had been killed.
+    void Detach();
+
+    size_t slot_size() const { return slot_size_; }
+
+  private:
+    struct RingHeader;
+    struct SlotHeader;
+
+    PersistentLogRing(int fd, uint8_t* map, size_t map_size, size_t slot_size, size_t slot_count);
+
+    static std::shared_ptr<PersistentLogRing> Map(const std::string& path, int fd,
+                                                  size_t slot_size, size_t slot_count);
+    static size_t SlotStride(size_t slot_size);
+    static size_t HeadersSize(size_t slot_count);
+
+    RingHeader* header() const;
+    SlotHeader* slot_header(size_t index) const;
+    uint8_t* slot_data(size_t index) const;
+    SerializedData SlotContents(size_t index);
+    void FreeSlot(size_t index);
+
+    int fd_;
+    uint8_t* map_;
+    size_t map_size_;
+    size_t slot_size_;
+    size_t slot_count_;
+
+    std::mutex lock_;
+    bool detached_ GUARDED_BY(lock_) = false;
+};
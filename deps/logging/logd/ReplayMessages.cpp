@@ -16,8 +16,12 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <map>
+#include <thread>
+#include <unordered_map>
 
 #include <android-base/file.h>
 #include <android-base/mapped_file.h>
@@ -27,12 +31,15 @@
 #include <android/log.h>
 #include <log/log_time.h>
 #include <log/logprint.h>
+#include <zdict.h>
 
+#include "CompressionEngine.h"
 #include "LogBuffer.h"
 #include "LogStatistics.h"
 #include "PruneList.h"
 #include "RecordedLogMessage.h"
 #include "SerializedLogBuffer.h"
+#include "SerializedLogEntry.h"
 #include "SimpleLogBuffer.h"
 
 using android::base::MappedFile;
@@ -148,6 +155,13 @@ class StdoutWriter : public LogWriter {
     std::string name() const override { return "stdout writer"; }
 };
 
+class DiscardWriter : public LogWriter {
+  public:
+    DiscardWriter() : LogWriter(0, true) {}
+    bool Write(const logger_entry&, const char*) override { return true; }
+    std::string name() const override { return "discard writer"; }
+};
+
 class Operation {
   public:
     virtual ~Operation() {}
@@ -159,9 +173,14 @@ class Operation {
 
 class PrintInteresting : public Operation {
   public:
-    PrintInteresting(log_time first_log_timestamp)
+    PrintInteresting(log_time first_log_timestamp, const char* dictionary)
         : stats_simple_{false, false, first_log_timestamp},
-          stats_serialized_{false, true, first_log_timestamp} {}
+          stats_serialized_{false, true, first_log_timestamp} {
+        if (dictionary != nullptr && !CompressionEngine::GetInstance().LoadDictionary(dictionary)) {
+            fprintf(stderr, "Could not load compression dictionary '%s'\n", dictionary);
+            exit(1);
+        }
+    }
 
     void Begin() override {
         printf("message_count,simple_main_lines,simple_radio_lines,simple_events_lines,simple_"
@@ -188,7 +207,8 @@ class PrintInteresting : public Operation {
                "events_range,"
                "serialized_system_range,serialized_crash_range,serialized_stats_range,serialized_"
                "security_range,"
-               "serialized_kernel_range\n");
+               "serialized_kernel_range,serialized_uncompressed_bytes,serialized_compressed_bytes,"
+               "serialized_compress_cpu_us\n");
     }
 
     void Log(const RecordedLogMessage& meta, const char* msg) override {
@@ -199,13 +219,42 @@ class PrintInteresting : public Operation {
                                    meta.pid, meta.tid, msg, meta.msg_len);
 
         if (num_message_ % 10000 == 0) {
-            printf("%" PRIu64 ",%s,%s\n", num_message_, stats_simple_.ReportInteresting().c_str(),
-                   stats_serialized_.ReportInteresting().c_str());
+            CompressionStats compression = CompressionEngine::GetInstance().stats();
+            printf("%" PRIu64 ",%s,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", num_message_,
+                   stats_simple_.ReportInteresting().c_str(),
+                   stats_serialized_.ReportInteresting().c_str(), compression.uncompressed_bytes,
+                   compression.compressed_bytes, compression.compress_cpu_ns / 1000);
         }
 
         num_message_++;
     }
 
+    // Reads back what the serialized buffer holds, as a reader would, to also measure the cost of
+    // decompression, then summarizes both on stderr so the CSV on stdout stays intact.
+    void End() override {
+        {
+            auto lock = std::lock_guard{logd_lock};
+            DiscardWriter writer;
+            auto flush_to_state = serialized_log_buffer_.CreateFlushToState(1, kLogMaskAll);
+            serialized_log_buffer_.FlushTo(&writer, *flush_to_state, nullptr);
+        }
+
+        CompressionStats compression = CompressionEngine::GetInstance().stats();
+        auto ns_per_kib = [](uint64_t ns, uint64_t bytes) {
+            return bytes == 0 ? 0.0 : static_cast<double>(ns) * 1024 / bytes;
+        };
+        fprintf(stderr,
+                "compressed %" PRIu64 " bytes to %" PRIu64 " (ratio %.2f), compress %.0f ns/KiB, "
+                "decompress %.0f ns/KiB\n",
+                compression.uncompressed_bytes, compression.compressed_bytes,
+                compression.compressed_bytes == 0 ? 0.0
+                                                  : static_cast<double>(
+                                                            compression.uncompressed_bytes) /
+                                                            compression.compressed_bytes,
+                ns_per_kib(compression.compress_cpu_ns, compression.uncompressed_bytes),
+                ns_per_kib(compression.decompress_cpu_ns, compression.decompressed_bytes));
+    }
+
   private:
     uint64_t num_message_ = 1;
 
@@ -222,7 +271,15 @@ class PrintInteresting : public Operation {
 
 class SingleBufferOperation : public Operation {
   public:
-    SingleBufferOperation(log_time first_log_timestamp, const char* buffer) {
+    SingleBufferOperation(log_time first_log_timestamp, const char* buffer,
+                          const char* batch_size = nullptr) {
+        if (batch_size != nullptr && !ParseUint(batch_size, &batch_size_, size_t{1024}, false)) {
+            fprintf(stderr, "Could not parse batch size '%s'\n", batch_size);
+            exit(1);
+        }
+        if (batch_size_ == 0) {
+            batch_size_ = 1;
+        }
         if (!strcmp(buffer, "simple")) {
             stats_.reset(new LogStatistics{false, false, first_log_timestamp});
             log_buffer_.reset(new SimpleLogBuffer(&reader_list_, &tags_, stats_.get()));
@@ -236,6 +293,17 @@ class SingleBufferOperation : public Operation {
     }
 
     void Log(const RecordedLogMessage& meta, const char* msg) override {
+        if (batch_size_ > 1) {
+            // The messages stay mapped, so the batch can point into the input file.
+            batch_.push_back({static_cast<log_id_t>(meta.log_id), meta.realtime, meta.uid,
+                              static_cast<pid_t>(meta.pid), static_cast<pid_t>(meta.tid), msg,
+                              meta.msg_len});
+            if (batch_.size() == batch_size_) {
+                LogBatch();
+            }
+            return;
+        }
+
         PreOperation();
         log_buffer_->Log(static_cast<log_id_t>(meta.log_id), meta.realtime, meta.uid, meta.pid,
                          meta.tid, msg, meta.msg_len);
@@ -245,10 +313,28 @@ class SingleBufferOperation : public Operation {
         num_message_++;
     }
 
+    void End() override {
+        if (!batch_.empty()) {
+            LogBatch();
+        }
+    }
+
     virtual void PreOperation() {}
     virtual void Operation() {}
 
   protected:
+    // With a batch size, each Pre/Operation() pair surrounds a LogBatch() call rather than a Log().
+    void LogBatch() {
+        PreOperation();
+        log_buffer_->LogBatch(batch_);
+        num_message_ += batch_.size();
+        batch_.clear();
+        Operation();
+    }
+
+    size_t batch_size_ = 1;
+    std::vector<LogBatchEntry> batch_;
+
     uint64_t num_message_ = 1;
 
     LogReaderList reader_list_;
@@ -299,6 +385,7 @@ class PrintLogs : public SingleBufferOperation {
     }
 
     void End() override {
+        SingleBufferOperation::End();
         auto lock = std::lock_guard{logd_lock};
         std::unique_ptr<LogWriter> test_writer(new StdoutWriter());
         std::unique_ptr<FlushToState> flush_to_state = log_buffer_->CreateFlushToState(1, mask_);
@@ -315,8 +402,8 @@ class PrintLogs : public SingleBufferOperation {
 
 class PrintLatency : public SingleBufferOperation {
   public:
-    PrintLatency(log_time first_log_timestamp, const char* buffer)
-        : SingleBufferOperation(first_log_timestamp, buffer) {}
+    PrintLatency(log_time first_log_timestamp, const char* buffer, const char* batch_size)
+        : SingleBufferOperation(first_log_timestamp, buffer, batch_size) {}
 
     void PreOperation() override { operation_start_ = std::chrono::steady_clock::now(); }
 
@@ -327,6 +414,7 @@ class PrintLatency : public SingleBufferOperation {
     }
 
     void End() override {
+        SingleBufferOperation::End();
         std::sort(durations_.begin(), durations_.end());
         auto q1 = durations_.size() / 4;
         auto q2 = durations_.size() / 2;
@@ -346,6 +434,25 @@ class PrintLatency : public SingleBufferOperation {
     std::vector<long long> durations_;
 };
 
+class PrintThroughput : public SingleBufferOperation {
+  public:
+    PrintThroughput(log_time first_log_timestamp, const char* buffer, const char* batch_size)
+        : SingleBufferOperation(first_log_timestamp, buffer, batch_size) {}
+
+    void Begin() override { start_ = std::chrono::steady_clock::now(); }
+
+    void End() override {
+        SingleBufferOperation::End();
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start_;
+        uint64_t messages = num_message_ - 1;
+        printf("messages: %" PRIu64 " seconds: %.3f messages/s: %.0f\n", messages,
+               seconds.count(), messages / seconds.count());
+    }
+
+  private:
+    std::chrono::steady_clock::time_point start_;
+};
+
 class PrintAllLogs : public SingleBufferOperation {
   public:
     PrintAllLogs(log_time first_log_timestamp, const char* buffer, const char* buffers)
@@ -367,6 +474,8 @@ class PrintAllLogs : public SingleBufferOperation {
     }
 
     void End() override {
+        SingleBufferOperation::End();
+
         // Release the reader thread.
         {
             auto lock = std::lock_guard{logd_lock};
@@ -384,6 +493,433 @@ class PrintAllLogs : public SingleBufferOperation {
     }
 };
 
+// Returns the p-th percentile of sorted, or 0 if it's empty.
+template <typename T>
+static T Percentile(const std::vector<T>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size() / 100))];
+}
+
+// Replays the messages into each of the given buffer types in turn, from `writers` threads at once,
+// while `readers` blocking readers follow the buffer, and prints one CSV row of results per buffer
+// type.  Messages are sharded across the writers by their pid and tid, so each thread's messages
+// are still logged in order by a single writer.  Unless `pace` is "max", each writer sleeps to
+// preserve the recorded time between its messages, sped up by a factor of `pace`.
+//
+// Messages are logged with the time they're replayed at rather than their recorded time, so that
+// the readers can measure how far behind the writers they are.  Readers cycle through four
+// filters: every log, only the main log, only the pid with the most messages, and only the events
+// log.  The locks are not instrumented, so how long they are held is measured by a probe thread
+// that every millisecond takes logd_lock and records how long it waited, and does the same for the
+// lock of each log in turn through GetSize(), which takes only that lock.  The simple buffer has no
+// per log locks, so there the second measures logd_lock again.
+class ConcurrentReplay : public Operation {
+  public:
+    ConcurrentReplay(const char* buffers, const char* writers, const char* readers,
+                     const char* pace)
+        : buffer_types_(Split(buffers, ",")), pace_name_(pace ?: "max") {
+        if (!strcmp(buffers, "all")) {
+            buffer_types_ = {"simple", "serialized"};
+        }
+        for (const auto& buffer_type : buffer_types_) {
+            if (buffer_type != "simple" && buffer_type != "serialized") {
+                fprintf(stderr, "invalid log buffer type '%s'\n", buffer_type.c_str());
+                exit(1);
+            }
+        }
+        if (writers == nullptr || !ParseUint(writers, &writers_, size_t{256}) || writers_ == 0) {
+            fprintf(stderr, "Could not parse writer count '%s'\n", writers ?: "");
+            exit(1);
+        }
+        if (readers != nullptr && !ParseUint(readers, &readers_, size_t{256})) {
+            fprintf(stderr, "Could not parse reader count '%s'\n", readers);
+            exit(1);
+        }
+        if (pace != nullptr && strcmp(pace, "max") != 0) {
+            char* end;
+            pace_ = strtod(pace, &end);
+            if (*end != '\0' || pace_ <= 0) {
+                fprintf(stderr, "Could not parse pace '%s'\n", pace);
+                exit(1);
+            }
+        }
+        shards_.resize(writers_);
+    }
+
+    void Log(const RecordedLogMessage& meta, const char* msg) override {
+        if (meta.log_id >= LOG_ID_MAX) {
+            return;
+        }
+        if (first_realtime_ == log_time{}) {
+            first_realtime_ = meta.realtime;
+        }
+        // The messages stay mapped, so the shards can point into the input file.
+        size_t shard = (static_cast<uint64_t>(meta.pid) * 0x9e3779b1 + meta.tid) % writers_;
+        shards_[shard].push_back({&meta, msg});
+        ++pid_counts_[meta.pid];
+    }
+
+    void End() override {
+        if (!pid_counts_.empty()) {
+            busiest_pid_ = std::max_element(pid_counts_.begin(), pid_counts_.end(),
+                                            [](const auto& a, const auto& b) {
+                                                return a.second < b.second;
+                                            })->first;
+        }
+        printf("buffer,writers,readers,pace,messages,seconds,messages_per_second,log_p50_ns,"
+               "log_p99_ns,log_p9999_ns,log_max_ns,reader_messages,reader_lag_p50_us,"
+               "reader_lag_p99_us,reader_lag_max_us,readers_disconnected,lock_wait_p50_ns,"
+               "lock_wait_p99_ns,lock_wait_max_ns,log_lock_wait_p50_ns,log_lock_wait_p99_ns,"
+               "log_lock_wait_max_ns\n");
+        for (const auto& buffer_type : buffer_types_) {
+            Run(buffer_type);
+        }
+    }
+
+  private:
+    struct Message {
+        const RecordedLogMessage* meta;
+        const char* msg;
+    };
+
+    // Owned by ConcurrentReplay, since the LogReaderThread deletes its writer when it exits.
+    struct ReaderResult {
+        std::vector<int64_t> lags_us;
+        std::atomic<uint64_t> read = 0;
+    };
+
+    class LagWriter : public LogWriter {
+      public:
+        LagWriter(ReaderResult* result) : LogWriter(0, true), result_(result) {}
+
+        bool Write(const logger_entry& entry, const char*) override {
+            log_time now(CLOCK_REALTIME);
+            log_time logged(entry.sec, entry.nsec);
+            result_->lags_us.emplace_back(now >= logged ? (now - logged).nsec() / 1000 : 0);
+            result_->read.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        std::string name() const override { return "lag writer"; }
+
+      private:
+        ReaderResult* result_;
+    };
+
+    void Run(const std::string& buffer_type) {
+        LogReaderList reader_list;
+        LogTags tags;
+        std::unique_ptr<LogStatistics> stats;
+        std::unique_ptr<LogBuffer> log_buffer;
+        if (buffer_type == "simple") {
+            stats.reset(new LogStatistics{false, false});
+            log_buffer.reset(new SimpleLogBuffer(&reader_list, &tags, stats.get()));
+        } else {
+            stats.reset(new LogStatistics{false, true});
+            log_buffer.reset(new SerializedLogBuffer(&reader_list, &tags, stats.get()));
+        }
+
+        std::vector<ReaderResult> reader_results(readers_);
+        {
+            auto lock = std::lock_guard{logd_lock};
+            for (size_t i = 0; i < readers_; ++i) {
+                static constexpr LogMask kReaderMasks[] = {kLogMaskAll, 1 << LOG_ID_MAIN,
+                                                           kLogMaskAll, 1 << LOG_ID_EVENTS};
+                LogMask log_mask = kReaderMasks[i % std::size(kReaderMasks)];
+                pid_t pid = i % std::size(kReaderMasks) == 2 ? busiest_pid_ : 0;
+                reader_list.AddAndRunThread(std::make_unique<LogReaderThread>(
+                        log_buffer.get(), &reader_list,
+                        std::make_unique<LagWriter>(&reader_results[i]), false, 0, log_mask, pid,
+                        log_time{}, 1, std::chrono::steady_clock::time_point{}));
+            }
+        }
+
+        std::atomic<bool> writers_done = false;
+        std::vector<int64_t> lock_waits_ns;
+        std::vector<int64_t> log_lock_waits_ns;
+        std::thread probe([&] {
+            for (int i = 0; !writers_done.load(std::memory_order_relaxed); ++i) {
+                auto start = std::chrono::steady_clock::now();
+                logd_lock.lock();
+                auto acquired = std::chrono::steady_clock::now();
+                logd_lock.unlock();
+                lock_waits_ns.emplace_back((acquired - start).count());
+
+                start = std::chrono::steady_clock::now();
+                log_buffer->GetSize(static_cast<log_id_t>(i % LOG_ID_MAX));
+                log_lock_waits_ns.emplace_back((std::chrono::steady_clock::now() - start).count());
+                usleep(1000);
+            }
+        });
+
+        std::vector<std::vector<int64_t>> log_durations_ns(writers_);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w < writers_; ++w) {
+            threads.emplace_back([&, w] {
+                auto& durations = log_durations_ns[w];
+                durations.reserve(shards_[w].size());
+                for (const auto& [meta, msg] : shards_[w]) {
+                    // Recorded messages are only roughly in time order, so those recorded before
+                    // the first are logged right away.
+                    if (pace_ > 0 && meta->realtime > first_realtime_) {
+                        std::chrono::nanoseconds offset(
+                                static_cast<int64_t>((meta->realtime - first_realtime_).nsec() /
+                                                     pace_));
+                        std::this_thread::sleep_until(start + offset);
+                    }
+                    auto log_start = std::chrono::steady_clock::now();
+                    log_buffer->Log(static_cast<log_id_t>(meta->log_id), log_time(CLOCK_REALTIME),
+                                    meta->uid, meta->pid, meta->tid, msg, meta->msg_len);
+                    durations.emplace_back((std::chrono::steady_clock::now() - log_start).count());
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+        // Readers are done once they've stopped reading for 100ms, or after 10 seconds.  They're
+        // only woken by logs that they watch, so they're woken here to also read past the rest.
+        size_t readers_disconnected = 0;
+        uint64_t read = 0;
+        for (int idle = 0, i = 0; idle < 10 && i < 1000; ++i) {
+            {
+                auto lock = std::lock_guard{logd_lock};
+                readers_disconnected = readers_ - reader_list.running_reader_threads().size();
+                for (const auto& reader : reader_list.running_reader_threads()) {
+                    reader->TriggerReader();
+                }
+            }
+            usleep(10000);
+            uint64_t now_read = 0;
+            for (const auto& result : reader_results) {
+                now_read += result.read.load(std::memory_order_relaxed);
+            }
+            idle = now_read == read ? idle + 1 : 0;
+            read = now_read;
+        }
+        writers_done = true;
+        probe.join();
+        {
+            auto lock = std::lock_guard{logd_lock};
+            for (const auto& reader : reader_list.running_reader_threads()) {
+                reader->Release();
+            }
+        }
+        while (true) {
+            {
+                auto lock = std::lock_guard{logd_lock};
+                if (reader_list.running_reader_threads().empty()) {
+                    break;
+                }
+            }
+            usleep(1000);
+        }
+
+        std::vector<int64_t> durations;
+        for (const auto& writer_durations : log_durations_ns) {
+            durations.insert(durations.end(), writer_durations.begin(), writer_durations.end());
+        }
+        std::vector<int64_t> lags;
+        for (const auto& result : reader_results) {
+            lags.insert(lags.end(), result.lags_us.begin(), result.lags_us.end());
+        }
+        std::sort(durations.begin(), durations.end());
+        std::sort(lags.begin(), lags.end());
+        std::sort(lock_waits_ns.begin(), lock_waits_ns.end());
+        std::sort(log_lock_waits_ns.begin(), log_lock_waits_ns.end());
+
+        printf("%s,%zu,%zu,%s,%zu,%.3f,%.0f,%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRId64
+               ",%zu,%" PRId64 ",%" PRId64 ",%" PRId64 ",%zu,%" PRId64 ",%" PRId64 ",%" PRId64
+               ",%" PRId64 ",%" PRId64 ",%" PRId64 "\n",
+               buffer_type.c_str(), writers_, readers_, pace_name_.c_str(), durations.size(),
+               seconds.count(), durations.size() / seconds.count(), Percentile(durations, 50),
+               Percentile(durations, 99), Percentile(durations, 99.99), Percentile(durations, 100),
+               lags.size(), Percentile(lags, 50), Percentile(lags, 99), Percentile(lags, 100),
+               readers_disconnected, Percentile(lock_waits_ns, 50),
+               Percentile(lock_waits_ns, 99), Percentile(lock_waits_ns, 100),
+               Percentile(log_lock_waits_ns, 50), Percentile(log_lock_waits_ns, 99),
+               Percentile(log_lock_waits_ns, 100));
+        fflush(stdout);
+    }
+
+    std::vector<std::string> buffer_types_;
+    size_t writers_ = 0;
+    size_t readers_ = 0;
+    std::string pace_name_;
+    double pace_ = 0;
+    log_time first_realtime_;
+    std::vector<std::vector<Message>> shards_;
+    std::unordered_map<pid_t, size_t> pid_counts_;
+    pid_t busiest_pid_ = 0;
+};
+
+// Formats every message, as logcat does, into /dev/null and prints how long formatting took.
+// The messages are decoded up front so that only formatting is timed.  `format` is a comma
+// separated list of logcat -v arguments.  Lines are formatted one at a time with
+// android_log_printLogLine() unless `batch` is "batch", in which case they are formatted with an
+// AndroidLogBatch.
+class FormatLogs : public Operation {
+  public:
+    FormatLogs(const char* format, const char* batch) : batch_(batch && !strcmp(batch, "batch")) {
+        for (const auto& word : Split(format, ",")) {
+            AndroidLogPrintFormat print_format = android_log_formatFromString(word.c_str());
+            if (print_format == FORMAT_OFF) {
+                fprintf(stderr, "Could not parse format '%s'\n", word.c_str());
+                exit(1);
+            }
+            android_log_setPrintFormat(format_.get(), print_format);
+        }
+    }
+
+    void Log(const RecordedLogMessage& meta, const char* msg) override {
+        if (meta.msg_len > LOGGER_ENTRY_MAX_PAYLOAD) {
+            return;
+        }
+        struct log_msg log_msg = {};
+        log_msg.entry.len = meta.msg_len;
+        log_msg.entry.hdr_size = sizeof(log_msg.entry);
+        log_msg.entry.pid = meta.pid;
+        log_msg.entry.tid = meta.tid;
+        log_msg.entry.sec = meta.realtime.tv_sec;
+        log_msg.entry.nsec = meta.realtime.tv_nsec;
+        log_msg.entry.lid = meta.log_id;
+        log_msg.entry.uid = meta.uid;
+        memcpy(log_msg.msg(), msg, meta.msg_len);
+
+        bool is_binary = log_msg.id() == LOG_ID_EVENTS || log_msg.id() == LOG_ID_STATS ||
+                         log_msg.id() == LOG_ID_SECURITY;
+        AndroidLogEntry entry;
+        char binary_msg_buf[1024];
+        int err = is_binary ? android_log_processBinaryLogBuffer(&log_msg.entry, &entry, nullptr,
+                                                                 binary_msg_buf,
+                                                                 sizeof(binary_msg_buf))
+                            : android_log_processLogBuffer(&log_msg.entry, &entry);
+        if (err < 0) {
+            return;
+        }
+        DecodedEntry& decoded = entries_.emplace_back();
+        decoded.entry = entry;
+        if (entry.tag != nullptr) decoded.tag.assign(entry.tag, entry.tagLen);
+        if (entry.message != nullptr) decoded.message.assign(entry.message, entry.messageLen);
+    }
+
+    void End() override {
+        for (auto& decoded : entries_) {
+            decoded.entry.tag = decoded.tag.c_str();
+            decoded.entry.message = decoded.message.c_str();
+        }
+
+        android::base::unique_fd null_fd(open("/dev/null", O_WRONLY | O_CLOEXEC));
+        uint64_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        if (batch_) {
+            AndroidLogBatch* batch = android_log_batch_new(format_.get(), null_fd.get());
+            for (const auto& decoded : entries_) {
+                bytes += android_log_batch_printLogLine(batch, &decoded.entry);
+            }
+            android_log_batch_free(batch);
+        } else {
+            FILE* file = fdopen(null_fd.release(), "w");
+            for (const auto& decoded : entries_) {
+                bytes += android_log_printLogLine(format_.get(), file, &decoded.entry);
+            }
+            fclose(file);
+        }
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        printf("messages: %zu bytes: %" PRIu64 " seconds: %.3f ns/message: %.1f\n",
+               entries_.size(), bytes, seconds.count(), seconds.count() * 1e9 / entries_.size());
+    }
+
+  private:
+    struct DecodedEntry {
+        AndroidLogEntry entry;
+        std::string tag;
+        std::string message;
+    };
+
+    std::unique_ptr<AndroidLogFormat, decltype(&android_log_format_free)> format_{
+            android_log_format_new(), &android_log_format_free};
+    bool batch_;
+    std::vector<DecodedEntry> entries_;
+};
+
+// Trains a zstd dictionary for CompressionEngine::LoadDictionary().  Samples are runs of messages
+// from a single log, serialized as SerializedLogBuffer stores them, so that the dictionary learns
+// both the repeated message contents and the entry headers around them.
+class TrainDictionary : public Operation {
+  public:
+    // Dictionaries help most at the start of a compressed chunk, before zstd has seen much of it,
+    // so samples are kept short relative to the chunks.
+    static constexpr size_t kSampleSize = 4096;
+    static constexpr size_t kDefaultDictionarySize = 112 * 1024;
+
+    TrainDictionary(const char* output, const char* dictionary_size) : output_(output) {
+        if (dictionary_size != nullptr &&
+            !ParseUint(dictionary_size, &dictionary_size_, size_t{16 * 1024 * 1024})) {
+            fprintf(stderr, "Could not parse dictionary size '%s'\n", dictionary_size);
+            exit(1);
+        }
+    }
+
+    void Log(const RecordedLogMessage& meta, const char* msg) override {
+        if (meta.log_id >= LOG_ID_MAX) {
+            return;
+        }
+        std::string& sample = pending_samples_[meta.log_id];
+        size_t total_len = sizeof(SerializedLogEntry) + meta.msg_len;
+        if (sample.size() + total_len > kSampleSize) {
+            AddSample(sample);
+        }
+        size_t offset = sample.size();
+        sample.resize(offset + total_len);
+        auto* entry = new (&sample[offset]) SerializedLogEntry(
+                meta.uid, meta.pid, meta.tid, ++sequence_, meta.realtime, meta.msg_len);
+        memcpy(entry->msg(), msg, meta.msg_len);
+    }
+
+    void End() override {
+        for (auto& sample : pending_samples_) {
+            AddSample(sample);
+        }
+
+        std::string dictionary(dictionary_size_, '\0');
+        size_t size = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), samples_.data(),
+                                            sample_sizes_.data(), sample_sizes_.size());
+        if (ZDICT_isError(size)) {
+            fprintf(stderr, "Could not train dictionary: %s\n", ZDICT_getErrorName(size));
+            exit(1);
+        }
+        dictionary.resize(size);
+        if (!android::base::WriteStringToFile(dictionary, output_)) {
+            fprintf(stderr, "Could not write dictionary to '%s': %s\n", output_, strerror(errno));
+            exit(1);
+        }
+        printf("Trained a %zu byte dictionary from %zu samples (%zu bytes)\n", size,
+               sample_sizes_.size(), samples_.size());
+    }
+
+  private:
+    void AddSample(std::string& sample) {
+        if (sample.empty()) {
+            return;
+        }
+        samples_ += sample;
+        sample_sizes_.emplace_back(sample.size());
+        sample.clear();
+    }
+
+    const char* output_;
+    size_t dictionary_size_ = kDefaultDictionarySize;
+    uint64_t sequence_ = 0;
+    std::string pending_samples_[LOG_ID_MAX];
+    std::string samples_;
+    std::vector<size_t> sample_sizes_;
+};
+
 int main(int argc, char** argv) {
     if (argc < 3) {
         fprintf(stderr, "Usage: %s FILE OPERATION [BUFFER] [OPTIONS]\n", argv[0]);
@@ -418,11 +954,23 @@ int main(int argc, char** argv) {
 
     std::unique_ptr<Operation> operation;
     if (!strcmp(argv[2], "interesting")) {
-        operation.reset(new PrintInteresting(first_log_timestamp));
+        operation.reset(new PrintInteresting(first_log_timestamp, argc > 3 ? argv[3] : nullptr));
+    } else if (!strcmp(argv[2], "concurrent")) {
+        operation.reset(new ConcurrentReplay(argv[3], argc > 4 ? argv[4] : nullptr,
+                                             argc > 5 ? argv[5] : nullptr,
+                                             argc > 6 ? argv[6] : nullptr));
+    } else if (!strcmp(argv[2], "format_logs")) {
+        operation.reset(new FormatLogs(argv[3], argc > 4 ? argv[4] : nullptr));
+    } else if (!strcmp(argv[2], "train_dictionary")) {
+        operation.reset(new TrainDictionary(argv[3], argc > 4 ? argv[4] : nullptr));
     } else if (!strcmp(argv[2], "memory_usage")) {
         operation.reset(new PrintMemory(first_log_timestamp, argv[3]));
     } else if (!strcmp(argv[2], "latency")) {
-        operation.reset(new PrintLatency(first_log_timestamp, argv[3]));
+        operation.reset(
+                new PrintLatency(first_log_timestamp, argv[3], argc > 4 ? argv[4] : nullptr));
+    } else if (!strcmp(argv[2], "throughput")) {
+        operation.reset(
+                new PrintThroughput(first_log_timestamp, argv[3], argc > 4 ? argv[4] : nullptr));
     } else if (!strcmp(argv[2], "print_logs")) {
         operation.reset(new PrintLogs(first_log_timestamp, argv[3], argc > 4 ? argv[4] : nullptr,
                                       argc > 5 ? argv[5] : nullptr));
@@ -430,7 +978,8 @@ int main(int argc, char** argv) {
         operation.reset(
                 new PrintAllLogs(first_log_timestamp, argv[3], argc > 4 ? argv[4] : nullptr));
     } else if (!strcmp(argv[2], "nothing")) {
-        operation.reset(new SingleBufferOperation(first_log_timestamp, argv[3]));
+        operation.reset(new SingleBufferOperation(first_log_timestamp, argv[3],
+                                                  argc > 4 ? argv[4] : nullptr));
     } else {
         fprintf(stderr, "unknown operation '%s'\n", argv[2]);
         return 1;
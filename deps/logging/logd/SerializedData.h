@@ -28,6 +28,22 @@ class SerializedData {
   public:
     SerializedData() {}
     SerializedData(size_t size) : data_(new uint8_t[size]), size_(size) {}
+    // Refers to size bytes of memory that data's deleter releases, such as a PersistentLogRing slot.
+    SerializedData(std::shared_ptr<uint8_t[]> data, size_t size)
+        : data_(std::move(data)), size_(size) {}
+    SerializedData(SerializedData&& other) noexcept = default;
+    SerializedData& operator=(SerializedData&& other) noexcept = default;
+    SerializedData(const SerializedData&) = delete;
+    SerializedData& operator=(const SerializedData&) = delete;
+
+    // Returns a SerializedData that refers to the same contents as this one and keeps them alive
+    // after this object is resized or destroyed.  Neither must write to the contents afterwards.
+    SerializedData Share() const {
+        SerializedData shared;
+        shared.data_ = data_;
+        shared.size_ = size_;
+        return shared;
+    }
 
     void Resize(size_t new_size) {
         if (size_ == 0) {
@@ -37,7 +53,7 @@ class SerializedData {
             data_.reset();
             size_ = 0;
         } else if (new_size != size_) {
-            std::unique_ptr<uint8_t[]> new_data(new uint8_t[new_size]);
+            std::shared_ptr<uint8_t[]> new_data(new uint8_t[new_size]);
             size_t copy_size = std::min(size_, new_size);
             memcpy(new_data.get(), data_.get(), copy_size);
             data_.swap(new_data);
@@ -50,6 +66,6 @@ class SerializedData {
     size_t size() const { return size_; }
 
   private:
-    std::unique_ptr<uint8_t[]> data_;
+    std::shared_ptr<uint8_t[]> data_;
     size_t size_ = 0;
 };
\ No newline at end of file
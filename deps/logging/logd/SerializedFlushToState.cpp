@@ -21,8 +21,9 @@
 #include <android-base/logging.h>
 
 SerializedFlushToState::SerializedFlushToState(uint64_t start, LogMask log_mask,
-                                               std::list<SerializedLogChunk>* logs)
-    : FlushToState(start, log_mask), logs_(logs) {
+                                               std::list<SerializedLogChunk>* logs,
+                                               std::mutex* log_locks)
+    : FlushToState(start, log_mask), logs_(logs), log_locks_(log_locks) {
     log_id_for_each(i) {
         if (((1 << i) & log_mask) == 0) {
             continue;
@@ -33,6 +34,10 @@ SerializedFlushToState::SerializedFlushToState(uint64_t start, LogMask log_mask,
 
 SerializedFlushToState::~SerializedFlushToState() {
     log_id_for_each(i) {
+        if ((log_mask() & (1 << i)) == 0) {
+            continue;
+        }
+        auto lock = log_locks_ ? std::unique_lock{log_locks_[i]} : std::unique_lock<std::mutex>{};
         if (log_positions_[i]) {
             log_positions_[i]->buffer_it->DetachReader(this);
         }
@@ -49,6 +54,7 @@ void SerializedFlushToState::CreateLogPosition(log_id_t log_id) {
     if (it == logs_[log_id].end()) {
         --it;
     }
+    it = SkipUnreadChunks(log_id, it);
     it->AttachReader(this);
     log_position.buffer_it = it;
 
@@ -81,7 +87,7 @@ void SerializedFlushToState::UpdateLogsNeeded(log_id_t log_id) {
         } else {
             // Otherwise, if there is another buffer piece, move to that and do the same check.
             buffer_it->DetachReader(this);
-            ++buffer_it;
+            buffer_it = SkipUnreadChunks(log_id, std::next(buffer_it));
             buffer_it->AttachReader(this);
             log_positions_[log_id]->read_offset = 0;
             if (buffer_it->write_offset() == 0) {
@@ -97,6 +103,15 @@ void SerializedFlushToState::UpdateLogsNeeded(log_id_t log_id) {
     }
 }
 
+std::list<SerializedLogChunk>::iterator SerializedFlushToState::SkipUnreadChunks(
+        log_id_t log_id, std::list<SerializedLogChunk>::iterator it) {
+    while (std::next(it) != logs_[log_id].end() &&
+           !it->MayContainLogsFor(pid(), uid_, min_realtime())) {
+        ++it;
+    }
+    return it;
+}
+
 void SerializedFlushToState::CheckForNewLogs() {
     log_id_for_each(i) {
         if (!logs_needed_from_next_position_[i]) {
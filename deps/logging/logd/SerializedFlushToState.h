@@ -18,8 +18,12 @@
 
 #include <bitset>
 #include <list>
+#include <mutex>
+#include <optional>
 #include <queue>
 
+#include <android-base/thread_annotations.h>
+
 #include "LogBuffer.h"
 #include "LogdLock.h"
 #include "SerializedLogChunk.h"
@@ -37,52 +41,92 @@ struct LogWithId {
     const SerializedLogEntry* entry;
 };
 
+// Holds the per-log_id locks of a SerializedLogBuffer for every log in log_mask.  Taking them in
+// ascending log_id order here is what lets readers that merge several logs run alongside writers
+// and pruners that each hold a single one.
+class ScopedLogLocks {
+  public:
+    ScopedLogLocks(std::mutex* log_locks, LogMask log_mask) NO_THREAD_SAFETY_ANALYSIS
+        : log_locks_(log_locks),
+          log_mask_(log_mask) {
+        for (int i = LOG_ID_MIN; i < LOG_ID_MAX; ++i) {
+            if (log_mask_ & (1 << i)) log_locks_[i].lock();
+        }
+    }
+    ~ScopedLogLocks() NO_THREAD_SAFETY_ANALYSIS {
+        for (int i = LOG_ID_MAX - 1; i >= LOG_ID_MIN; --i) {
+            if (log_mask_ & (1 << i)) log_locks_[i].unlock();
+        }
+    }
+
+    ScopedLogLocks(const ScopedLogLocks&) = delete;
+    ScopedLogLocks& operator=(const ScopedLogLocks&) = delete;
+
+  private:
+    std::mutex* log_locks_;
+    LogMask log_mask_;
+};
+
 // This class tracks the specific point where a FlushTo client has read through the logs.  It
 // directly references the std::list<> iterators from the parent SerializedLogBuffer and the offset
 // into each log chunk where it has last read.  All interactions with this class, except for its
-// construction, must be done with SerializedLogBuffer::lock_ held.
+// construction and destruction, must be done with the log locks of every log in log_mask() held.
+// The exception is Prune(), which the pruning thread calls holding only the pruned log's lock.
 class SerializedFlushToState : public FlushToState {
   public:
     // Initializes this state object.  For each log buffer set in log_mask, this sets
-    // logs_needed_from_next_position_.
-    SerializedFlushToState(uint64_t start, LogMask log_mask, std::list<SerializedLogChunk>* logs)
-            REQUIRES(logd_lock);
+    // logs_needed_from_next_position_.  If log_locks is given, the destructor takes the locks of
+    // the logs it still references before releasing them; otherwise the caller must hold them.
+    SerializedFlushToState(uint64_t start, LogMask log_mask, std::list<SerializedLogChunk>* logs,
+                           std::mutex* log_locks = nullptr);
 
     // Decrease the reference of all referenced logs.  This happens when a reader is disconnected.
     ~SerializedFlushToState() override;
 
     // Updates the state of log_positions_ and logs_needed_from_next_position_ then returns true if
     // there are any unread logs, false otherwise.
-    bool HasUnreadLogs() REQUIRES(logd_lock);
+    bool HasUnreadLogs();
 
     // Returns the next unread log and sets logs_needed_from_next_position_ to indicate that we're
     // waiting for more logs from the associated log buffer.
-    LogWithId PopNextUnreadLog() REQUIRES(logd_lock);
+    LogWithId PopNextUnreadLog();
 
     // If the parent log buffer prunes logs, the reference that this class contains may become
     // invalid, so this must be called first to drop the reference to buffer_it, if any.
-    void Prune(log_id_t log_id) REQUIRES(logd_lock);
+    void Prune(log_id_t log_id);
+
+    // Restricts this reader to the logs of uid, for readers without the credentials to read every
+    // log.  Like pid() and min_realtime(), this only lets whole chunks be skipped; the caller still
+    // has to check each log that it is given.
+    void set_uid(std::optional<uid_t> uid) { uid_ = uid; }
 
   private:
     // Set logs_needed_from_next_position_[i] to indicate if log_positions_[i] points to an unread
     // log or to the point at which the next log will appear.
-    void UpdateLogsNeeded(log_id_t log_id) REQUIRES(logd_lock);
+    void UpdateLogsNeeded(log_id_t log_id);
 
     // Create a LogPosition object for the given log_id by searching through the log chunks for the
     // first chunk and then first log entry within that chunk that is greater or equal to start().
-    void CreateLogPosition(log_id_t log_id) REQUIRES(logd_lock);
+    void CreateLogPosition(log_id_t log_id);
+
+    // Returns the first chunk from it onwards that may hold logs that this reader reads, without
+    // reading the chunks it skips.  The last chunk is never skipped, since it may get more logs.
+    std::list<SerializedLogChunk>::iterator SkipUnreadChunks(
+            log_id_t log_id, std::list<SerializedLogChunk>::iterator it);
 
     // Checks to see if any log buffers set in logs_needed_from_next_position_ have new logs and
     // calls UpdateLogsNeeded() if so.
-    void CheckForNewLogs() REQUIRES(logd_lock);
+    void CheckForNewLogs();
 
-    std::list<SerializedLogChunk>* logs_ GUARDED_BY(logd_lock) = nullptr;
+    std::list<SerializedLogChunk>* logs_ = nullptr;
+    std::mutex* log_locks_ = nullptr;
+    std::optional<uid_t> uid_;
     // An optional structure that contains an iterator to the serialized log buffer and offset into
     // it that this logger should handle next.
-    std::optional<LogPosition> log_positions_[LOG_ID_MAX] GUARDED_BY(logd_lock);
+    std::optional<LogPosition> log_positions_[LOG_ID_MAX];
     // A bit for each log that is set if a given log_id has no logs or if this client has read all
     // of its logs. In order words: `logs_[i].empty() || (buffer_it == std::prev(logs_.end) &&
     // next_log_position == logs_write_position_)`.  These will be re-checked in each
     // loop in case new logs came in.
-    std::bitset<LOG_ID_MAX> logs_needed_from_next_position_ GUARDED_BY(logd_lock) = {};
+    std::bitset<LOG_ID_MAX> logs_needed_from_next_position_ = {};
 };
@@ -292,6 +292,44 @@ TEST_F(SerializedFlushToStateTest, no_dangling_references) {
     EXPECT_FALSE(state.HasUnreadLogs());
 }
 
+// Chunks that the summaries show have no logs for the reader are skipped, except for the last one,
+// which may still get more logs.
+TEST(SerializedFlushToState, skip_chunks) {
+    auto lock = std::lock_guard{logd_lock};
+    std::list<SerializedLogChunk> log_chunks[LOG_ID_MAX];
+    auto add_chunk = [&](uint64_t sequence, uid_t uid, pid_t pid, log_time realtime) {
+        auto chunk = SerializedLogChunk{kChunkSize};
+        chunk.Log(sequence, realtime, uid, pid, 1, "abc", 3);
+        chunk.FinishWriting();
+        log_chunks[LOG_ID_MAIN].emplace_back(std::move(chunk));
+    };
+    add_chunk(1, 1000, 10, log_time(100, 0));
+    add_chunk(2, 1001, 20, log_time(200, 0));
+    add_chunk(3, 1000, 10, log_time(300, 0));
+    add_chunk(4, 1001, 20, log_time(400, 0));
+
+    auto read = [&](pid_t pid, std::optional<uid_t> uid,
+                    log_time min_realtime) REQUIRES(logd_lock) {
+        auto state = SerializedFlushToState{1, kLogMaskAll, log_chunks};
+        state.set_pid(pid);
+        state.set_uid(uid);
+        state.set_min_realtime(min_realtime);
+        std::vector<uint64_t> sequences;
+        while (state.HasUnreadLogs()) {
+            sequences.emplace_back(state.PopNextUnreadLog().entry->sequence());
+        }
+        return sequences;
+    };
+
+    EXPECT_EQ((std::vector<uint64_t>{1, 2, 3, 4}), read(0, std::nullopt, log_time{}));
+    EXPECT_EQ((std::vector<uint64_t>{1, 3, 4}), read(10, std::nullopt, log_time{}));
+    EXPECT_EQ((std::vector<uint64_t>{2, 4}), read(20, std::nullopt, log_time{}));
+    EXPECT_EQ((std::vector<uint64_t>{4}), read(30, std::nullopt, log_time{}));
+    EXPECT_EQ((std::vector<uint64_t>{1, 3, 4}), read(0, 1000, log_time{}));
+    EXPECT_EQ((std::vector<uint64_t>{3, 4}), read(0, std::nullopt, log_time(250, 0)));
+    EXPECT_EQ((std::vector<uint64_t>{4}), read(20, std::nullopt, log_time(250, 0)));
+}
+
 TEST(SerializedFlushToState, Prune) {
     auto lock = std::lock_guard{logd_lock};
     auto chunk = SerializedLogChunk{kChunkSize};
@@ -17,28 +17,48 @@
 #include "SerializedLogBuffer.h"
 
 #include <sys/prctl.h>
+#include <sys/resource.h>
 
+#include <algorithm>
 #include <limits>
 
 #include <android-base/logging.h>
 #include <android-base/scopeguard.h>
+#include <system/thread_defs.h>
 
+#include "CompressionEngine.h"
 #include "LogSize.h"
 #include "LogStatistics.h"
 #include "SerializedFlushToState.h"
 
+// Chunks are taken from ring when it has a free slot, and allocated on the heap otherwise.
+static SerializedLogChunk NewChunk(size_t max_size, PersistentLogRing* ring) {
+    if (ring != nullptr) {
+        if (auto chunk = ring->NewChunk()) {
+            return std::move(*chunk);
+        }
+    }
+    return SerializedLogChunk(max_size / SerializedLogBuffer::kChunkSizeDivisor);
+}
+
+// If finished_chunk is set, a chunk that fills up is left for the caller to compress and returned
+// there, otherwise it's compressed right away.
 static SerializedLogEntry* LogToLogBuffer(std::list<SerializedLogChunk>& log_buffer,
-                                          size_t max_size, uint64_t sequence, log_time realtime,
-                                          uid_t uid, pid_t pid, pid_t tid, const char* msg,
-                                          uint16_t len) {
+                                          size_t max_size, PersistentLogRing* ring,
+                                          uint64_t sequence, log_time realtime, uid_t uid,
+                                          pid_t pid, pid_t tid, const char* msg, uint16_t len,
+                                          SerializedLogChunk** finished_chunk = nullptr) {
     if (log_buffer.empty()) {
-        log_buffer.push_back(SerializedLogChunk(max_size / SerializedLogBuffer::kChunkSizeDivisor));
+        log_buffer.push_back(NewChunk(max_size, ring));
     }
 
     auto total_len = sizeof(SerializedLogEntry) + len;
     if (!log_buffer.back().CanLog(total_len)) {
-        log_buffer.back().FinishWriting();
-        log_buffer.push_back(SerializedLogChunk(max_size / SerializedLogBuffer::kChunkSizeDivisor));
+        log_buffer.back().FinishWriting(finished_chunk == nullptr);
+        if (finished_chunk != nullptr) {
+            *finished_chunk = &log_buffer.back();
+        }
+        log_buffer.push_back(NewChunk(max_size, ring));
     }
 
     return log_buffer.back().Log(sequence, realtime, uid, pid, tid, msg, len);
@@ -49,13 +69,21 @@ static SerializedLogEntry* LogToLogBuffer(std::list<SerializedLogChunk>& log_buf
 // There is an optimization that chunks are copied as-is until a log message from the UID is found,
 // to ensure that back-to-back clears of the same UID do not require reflowing the entire buffer.
 void ClearLogsByUid(std::list<SerializedLogChunk>& log_buffer, uid_t uid, size_t max_size,
-                    log_id_t log_id, LogStatistics* stats) REQUIRES(logd_lock) {
+                    log_id_t log_id, LogStatistics* stats, PersistentLogRing* ring)
+        REQUIRES(logd_lock) {
     bool contains_uid_logs = false;
     std::list<SerializedLogChunk> new_logs;
     auto it = log_buffer.begin();
     while (it != log_buffer.end()) {
         auto chunk = it++;
         chunk->NotifyReadersOfPrune(log_id);
+
+        // Chunks from before the first log from uid are kept as they are, and those that can't
+        // have any are kept without even decompressing them.
+        if (!contains_uid_logs && !chunk->MayContainLogsFor(0, uid, log_time{})) {
+            new_logs.splice(new_logs.end(), log_buffer, chunk);
+            continue;
+        }
         chunk->IncReaderRefCount();
 
         if (!contains_uid_logs) {
@@ -71,8 +99,7 @@ void ClearLogsByUid(std::list<SerializedLogChunk>& log_buffer, uid_t uid, size_t
                 continue;
             }
             // We found a UID log, so push a writable chunk to prepare for the next loop.
-            new_logs.push_back(
-                    SerializedLogChunk(max_size / SerializedLogBuffer::kChunkSizeDivisor));
+            new_logs.push_back(NewChunk(max_size, ring));
         }
 
         for (const auto& entry : *chunk) {
@@ -81,8 +108,8 @@ void ClearLogsByUid(std::list<SerializedLogChunk>& log_buffer, uid_t uid, size_t
                     stats->Subtract(entry.ToLogStatisticsElement(log_id));
                 }
             } else {
-                LogToLogBuffer(new_logs, max_size, entry.sequence(), entry.realtime(), entry.uid(),
-                               entry.pid(), entry.tid(), entry.msg(), entry.msg_len());
+                LogToLogBuffer(new_logs, max_size, ring, entry.sequence(), entry.realtime(),
+                               entry.uid(), entry.pid(), entry.tid(), entry.msg(), entry.msg_len());
             }
         }
         chunk->DecReaderRefCount();
@@ -97,6 +124,26 @@ SerializedLogBuffer::SerializedLogBuffer(LogReaderList* reader_list, LogTags* ta
     Init();
 }
 
+SerializedLogBuffer::~SerializedLogBuffer() {
+    std::thread compression_thread;
+    {
+        auto lock = std::lock_guard{compression_lock_};
+        compression_stop_ = true;
+        compression_thread = std::move(compression_thread_);
+    }
+    compression_condition_.notify_one();
+    if (compression_thread.joinable()) {
+        compression_thread.join();
+    }
+
+    // Leave the logs in the persistent rings for the next logd, as if this one had been killed.
+    for (auto& ring : persistent_rings_) {
+        if (ring != nullptr) {
+            ring->Detach();
+        }
+    }
+}
+
 void SerializedLogBuffer::Init() {
     log_id_for_each(i) {
         if (!SetSize(i, GetBufferSizeFromProperties(i))) {
@@ -148,19 +195,109 @@ int SerializedLogBuffer::Log(log_id_t log_id, log_time realtime, uid_t uid, pid_
         return -EACCES;
     }
 
-    auto sequence = sequence_.fetch_add(1, std::memory_order_relaxed);
+    bool needs_prune;
+    {
+        auto lock = std::lock_guard{log_locks_[log_id]};
+        // Sequence numbers are taken under the log lock so that they increase within each log,
+        // which readers rely on to find their position in it.
+        auto sequence = sequence_.fetch_add(1, std::memory_order_relaxed);
+        needs_prune = LogLocked(log_id, sequence, realtime, uid, pid, tid, msg, len);
+    }
+    if (!needs_prune && !reader_list_->has_running_readers()) {
+        return len;
+    }
 
     auto lock = std::lock_guard{logd_lock};
-    auto entry = LogToLogBuffer(logs_[log_id], max_size_[log_id], sequence, realtime, uid, pid, tid,
-                                msg, len);
-    stats_->Add(entry->ToLogStatisticsElement(log_id));
-
-    MaybePrune(log_id);
-
+    if (needs_prune) {
+        auto log_lock = std::lock_guard{log_locks_[log_id]};
+        MaybePrune(log_id);
+    }
     reader_list_->NotifyNewLog(1 << log_id);
     return len;
 }
 
+size_t SerializedLogBuffer::LogBatch(std::span<const LogBatchEntry> entries) {
+    // ShouldLog() consults tags and properties, so as in Log() it runs before taking any lock.  The
+    // accepted messages are then appended in groups that share one acquisition of the locks of the
+    // logs they touch, and one notification.
+    static constexpr size_t kMaxGroupSize = 64;
+    size_t logged = 0;
+    while (!entries.empty()) {
+        const LogBatchEntry* group[kMaxGroupSize];
+        uint16_t lens[kMaxGroupSize];
+        size_t group_size = 0;
+        size_t consumed = 0;
+        LogMask log_mask = 0;
+        for (; consumed < entries.size() && group_size < kMaxGroupSize; ++consumed) {
+            const LogBatchEntry& entry = entries[consumed];
+            if (entry.log_id >= LOG_ID_MAX || entry.len == 0) {
+                continue;
+            }
+            uint16_t len = std::min<uint16_t>(entry.len, LOGGER_ENTRY_MAX_PAYLOAD);
+            if (!ShouldLog(entry.log_id, entry.msg, len)) {
+                stats_->AddTotal(entry.log_id, len);
+                continue;
+            }
+            group[group_size] = &entry;
+            lens[group_size] = len;
+            ++group_size;
+            log_mask |= 1 << entry.log_id;
+        }
+        entries = entries.subspan(consumed);
+        if (group_size == 0) {
+            continue;
+        }
+
+        LogMask prune_mask = 0;
+        {
+            auto lock = ScopedLogLocks(log_locks_, log_mask);
+            auto sequence = sequence_.fetch_add(group_size, std::memory_order_relaxed);
+            for (size_t i = 0; i < group_size; ++i) {
+                const LogBatchEntry& entry = *group[i];
+                if (LogLocked(entry.log_id, sequence + i, entry.realtime, entry.uid, entry.pid,
+                              entry.tid, entry.msg, lens[i])) {
+                    prune_mask |= 1 << entry.log_id;
+                }
+            }
+        }
+        logged += group_size;
+        if (prune_mask == 0 && !reader_list_->has_running_readers()) {
+            continue;
+        }
+
+        auto lock = std::lock_guard{logd_lock};
+        log_id_for_each(i) {
+            if (prune_mask & (1 << i)) {
+                auto log_lock = std::lock_guard{log_locks_[i]};
+                MaybePrune(i);
+            }
+        }
+        reader_list_->NotifyNewLog(log_mask);
+    }
+    return logged;
+}
+
+bool SerializedLogBuffer::LogLocked(log_id_t log_id, uint64_t sequence, log_time realtime,
+                                    uid_t uid, pid_t pid, pid_t tid, const char* msg,
+                                    uint16_t len) {
+    SerializedLogChunk* finished_chunk = nullptr;
+    auto entry = LogToLogBuffer(logs_[log_id], max_size_[log_id], persistent_rings_[log_id].get(),
+                                sequence, realtime, uid, pid, tid, msg, len, &finished_chunk);
+    stats_->Add(entry->ToLogStatisticsElement(log_id));
+    if (finished_chunk != nullptr && finished_chunk->compression_pending()) {
+        QueueCompression(log_id, finished_chunk);
+    }
+
+    // Pruning moves readers off of the pruned chunks, which needs logd_lock, so the caller does it
+    // once it has dropped this log's lock and taken logd_lock first.
+    size_t total_size = GetSizeUsed(log_id);
+    if (total_size > max_size_[log_id]) {
+        return true;
+    }
+    stats_->set_overhead(log_id, total_size);
+    return false;
+}
+
 void SerializedLogBuffer::MaybePrune(log_id_t log_id) {
     size_t total_size = GetSizeUsed(log_id);
     size_t after_size = total_size;
@@ -174,6 +311,67 @@ void SerializedLogBuffer::MaybePrune(log_id_t log_id) {
     stats_->set_overhead(log_id, after_size);
 }
 
+void SerializedLogBuffer::QueueCompression(log_id_t log_id, SerializedLogChunk* chunk) {
+    {
+        auto lock = std::lock_guard{compression_lock_};
+        compression_queue_.emplace_back(log_id, chunk);
+        if (!compression_thread_.joinable()) {
+            compression_thread_ = std::thread(&SerializedLogBuffer::CompressionThread, this);
+            return;
+        }
+    }
+    compression_condition_.notify_one();
+}
+
+void SerializedLogBuffer::CompressionThread() {
+    prctl(PR_SET_NAME, "logd.compress");
+    // Pending chunks only cost memory, so don't compete for CPU with the threads serving clients.
+    setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_BACKGROUND);
+
+    while (true) {
+        log_id_t log_id;
+        SerializedLogChunk* chunk;
+        {
+            auto lock = std::unique_lock{compression_lock_};
+            compression_condition_.wait(lock, [this]() REQUIRES(compression_lock_) {
+                return compression_stop_ || !compression_queue_.empty();
+            });
+            if (compression_stop_) {
+                return;
+            }
+            std::tie(log_id, chunk) = compression_queue_.front();
+            compression_queue_.pop_front();
+        }
+
+        auto is_live = [&]() {
+            return std::any_of(logs_[log_id].begin(), logs_[log_id].end(),
+                               [chunk](const auto& other) { return &other == chunk; });
+        };
+
+        // Compress a shared reference to the contents without any lock held, so that the chunk may
+        // be read, or even pruned, meanwhile.  If it was pruned, its address may have been reused
+        // by a newer chunk, but not the address of the still-referenced contents.
+        SerializedData contents;
+        int length;
+        {
+            auto lock = std::lock_guard{log_locks_[log_id]};
+            if (!is_live() || !chunk->compression_pending()) {
+                continue;
+            }
+            contents = chunk->ShareContents();
+            length = chunk->write_offset();
+        }
+
+        SerializedData compressed_log;
+        CompressionEngine::GetInstance().Compress(contents, length, compressed_log);
+
+        auto lock = std::lock_guard{log_locks_[log_id]};
+        if (is_live() && chunk->compression_pending() && chunk->data() == contents.data()) {
+            chunk->SetCompressedLog(std::move(compressed_log));
+        }
+    }
+}
+
 void SerializedLogBuffer::RemoveChunkFromStats(log_id_t log_id, SerializedLogChunk& chunk) {
     chunk.IncReaderRefCount();
     for (const auto& entry : chunk) {
@@ -240,12 +438,13 @@ void SerializedLogBuffer::UidClear(log_id_t log_id, uid_t uid) {
             reader_thread->TriggerReader();
         }
     }
-    ClearLogsByUid(logs_[log_id], uid, max_size_[log_id], log_id, stats_);
+    ClearLogsByUid(logs_[log_id], uid, max_size_[log_id], log_id, stats_,
+                   persistent_rings_[log_id].get());
 }
 
 std::unique_ptr<FlushToState> SerializedLogBuffer::CreateFlushToState(uint64_t start,
                                                                       LogMask log_mask) {
-    return std::make_unique<SerializedFlushToState>(start, log_mask, logs_);
+    return std::make_unique<SerializedFlushToState>(start, log_mask, logs_, log_locks_);
 }
 
 bool SerializedLogBuffer::FlushTo(
@@ -253,53 +452,84 @@ bool SerializedLogBuffer::FlushTo(
         const std::function<FilterResult(log_id_t log_id, pid_t pid, uint64_t sequence,
                                          log_time realtime)>& filter) {
     auto& state = reinterpret_cast<SerializedFlushToState&>(abstract_state);
+    state.set_uid(writer->privileged() ? std::nullopt : std::optional{writer->uid()});
+
+    // Walking the logs only needs the locks of the logs being read, so logd_lock is dropped here
+    // and only re-taken around the filter, which reads and updates the reader's own state.  This
+    // way, a reader that is merging or decompressing logs does not hold up writers, which take
+    // logd_lock to wake readers.
+    logd_lock.unlock();
+
+    constexpr size_t kMaxEntrySize = sizeof(SerializedLogEntry) + LOGGER_ENTRY_MAX_PAYLOAD + 1;
+    unsigned char entry_copy[kMaxEntrySize] __attribute__((uninitialized));
+    auto* entry = reinterpret_cast<SerializedLogEntry*>(entry_copy);
+    while (true) {
+        // We copy the log entry such that we can filter and flush it without the log locks.  We
+        // never block pruning waiting for this Flush() to complete.
+        log_id_t log_id = LOG_ID_MAX;
+        {
+            auto lock = ScopedLogLocks(log_locks_, state.log_mask());
+            while (state.HasUnreadLogs()) {
+                LogWithId top = state.PopNextUnreadLog();
+                if (top.entry->sequence() < state.start()) {
+                    continue;
+                }
+                // Move start past this log as soon as it's taken.  A writer that logs while this
+                // reader isn't holding logd_lock may wake it for a log it has already read, and
+                // that empty pass must not move start any further.
+                state.set_start(top.entry->sequence() + 1);
 
-    while (state.HasUnreadLogs()) {
-        LogWithId top = state.PopNextUnreadLog();
-        auto* entry = top.entry;
-        auto log_id = top.log_id;
+                if (!writer->privileged() && top.entry->uid() != writer->uid()) {
+                    continue;
+                }
 
-        if (entry->sequence() < state.start()) {
-            continue;
+                CHECK_LT(top.entry->msg_len(), LOGGER_ENTRY_MAX_PAYLOAD + 1);
+                memcpy(entry_copy, top.entry, sizeof(*top.entry) + top.entry->msg_len());
+                log_id = top.log_id;
+                break;
+            }
         }
-        state.set_start(entry->sequence());
-
-        if (!writer->privileged() && entry->uid() != writer->uid()) {
+        if (log_id == LOG_ID_MAX) {
+            // A writer may have added a log since the check above, and notified the readers
+            // before this one waits for it, which would lose the notification.  Writers notify
+            // under logd_lock, so checking again with it held catches any such log.
+            logd_lock.lock();
+            bool has_unread_logs;
+            {
+                auto lock = ScopedLogLocks(log_locks_, state.log_mask());
+                has_unread_logs = state.HasUnreadLogs();
+            }
+            if (!has_unread_logs) {
+                break;
+            }
+            logd_lock.unlock();
             continue;
         }
 
         if (filter) {
+            logd_lock.lock();
             auto ret = filter(log_id, entry->pid(), entry->sequence(), entry->realtime());
-            if (ret == FilterResult::kSkip) {
-                continue;
-            }
             if (ret == FilterResult::kStop) {
                 break;
             }
+            logd_lock.unlock();
+            if (ret == FilterResult::kSkip) {
+                continue;
+            }
         }
 
-        // We copy the log entry such that we can flush it without the lock.  We never block pruning
-        // waiting for this Flush() to complete.
-        constexpr size_t kMaxEntrySize = sizeof(*entry) + LOGGER_ENTRY_MAX_PAYLOAD + 1;
-        unsigned char entry_copy[kMaxEntrySize] __attribute__((uninitialized));
-        CHECK_LT(entry->msg_len(), LOGGER_ENTRY_MAX_PAYLOAD + 1);
-        memcpy(entry_copy, entry, sizeof(*entry) + entry->msg_len());
-        logd_lock.unlock();
-
-        if (!reinterpret_cast<SerializedLogEntry*>(entry_copy)->Flush(writer, log_id)) {
+        if (!entry->Flush(writer, log_id)) {
             logd_lock.lock();
             return false;
         }
-
-        logd_lock.lock();
     }
 
-    state.set_start(state.start() + 1);
     return true;
 }
 
 bool SerializedLogBuffer::Clear(log_id_t id, uid_t uid) {
     auto lock = std::lock_guard{logd_lock};
+    auto log_lock = std::lock_guard{log_locks_[id]};
     if (uid == 0) {
         Prune(id, ULONG_MAX);
     } else {
@@ -319,7 +549,7 @@ size_t SerializedLogBuffer::GetSizeUsed(log_id_t id) {
 }
 
 size_t SerializedLogBuffer::GetSize(log_id_t id) {
-    auto lock = std::lock_guard{logd_lock};
+    auto lock = std::lock_guard{log_locks_[id]};
     return max_size_[id];
 }
 
@@ -333,9 +563,60 @@ bool SerializedLogBuffer::SetSize(log_id_t id, size_t size) {
     }
 
     auto lock = std::lock_guard{logd_lock};
+    auto log_lock = std::lock_guard{log_locks_[id]};
     max_size_[id] = size;
 
     MaybePrune(id);
+    UpdatePersistentRing(id);
 
     return true;
 }
+
+std::string SerializedLogBuffer::PersistentRingPath(log_id_t log_id) const {
+    return persistent_dir_ + "/" + android_log_id_to_name(log_id) + ".ring";
+}
+
+// Chunks in the old ring keep their slots until they're pruned, but they're no longer persisted
+// since the new ring replaces the old one's file.
+void SerializedLogBuffer::UpdatePersistentRing(log_id_t log_id) {
+    if (persistent_dir_.empty()) {
+        return;
+    }
+    size_t slot_size = max_size_[log_id] / kChunkSizeDivisor;
+    auto& ring = persistent_rings_[log_id];
+    if (ring != nullptr && ring->slot_size() == slot_size) {
+        return;
+    }
+    ring = PersistentLogRing::Create(PersistentRingPath(log_id), log_id, slot_size,
+                                     kPersistentSlots);
+}
+
+void SerializedLogBuffer::EnablePersistence(const std::string& dir) {
+    auto lock = std::lock_guard{logd_lock};
+    persistent_dir_ = dir;
+    uint64_t highest_sequence = 0;
+    log_id_for_each(i) {
+        auto log_lock = std::lock_guard{log_locks_[i]};
+        CHECK(logs_[i].empty());
+
+        size_t slot_size = max_size_[i] / kChunkSizeDivisor;
+        persistent_rings_[i] = PersistentLogRing::Reattach(PersistentRingPath(i), i, slot_size,
+                                                           kPersistentSlots, &logs_[i]);
+        if (persistent_rings_[i] == nullptr) {
+            UpdatePersistentRing(i);
+            continue;
+        }
+        for (auto& chunk : logs_[i]) {
+            chunk.IncReaderRefCount();
+            for (const auto& entry : chunk) {
+                stats_->Add(entry.ToLogStatisticsElement(i));
+            }
+            chunk.DecReaderRefCount();
+            highest_sequence = std::max(highest_sequence, chunk.highest_sequence_number());
+        }
+        MaybePrune(i);
+    }
+    if (highest_sequence >= sequence_.load(std::memory_order_relaxed)) {
+        sequence_.store(highest_sequence + 1, std::memory_order_relaxed);
+    }
+}
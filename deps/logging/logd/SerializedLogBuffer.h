@@ -18,9 +18,13 @@
 
 #include <atomic>
 #include <bitset>
+#include <condition_variable>
+#include <deque>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <queue>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -31,19 +35,29 @@
 #include "LogStatistics.h"
 #include "LogTags.h"
 #include "LogdLock.h"
+#include "PersistentLogRing.h"
 #include "SerializedLogChunk.h"
 #include "SerializedLogEntry.h"
 
+// Writers only take the lock of the log they append to, so writers to different logs never contend.
+// logd_lock is still held to touch the reader list or reader state: to wake readers, and when
+// pruning, which must move readers off the pruned chunks.  Code needing both takes logd_lock first,
+// and code needing several log locks takes them in ascending log_id order (see ScopedLogLocks).
 class SerializedLogBuffer final : public LogBuffer {
   public:
     // Create SerializedLogChunk's with size = max_size_[log_id] / kChunkSizeDivisor.
     static constexpr size_t kChunkSizeDivisor = 4;
+    // Persistent rings have room for the chunks of a full log, plus one being written and one
+    // more that a uid clear may need while it copies the logs to keep out of a chunk.
+    static constexpr size_t kPersistentSlots = kChunkSizeDivisor + 2;
 
     SerializedLogBuffer(LogReaderList* reader_list, LogTags* tags, LogStatistics* stats);
+    ~SerializedLogBuffer() override;
     void Init() override;
 
     int Log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid, pid_t tid, const char* msg,
             uint16_t len) override;
+    size_t LogBatch(std::span<const LogBatchEntry> entries) override;
     std::unique_ptr<FlushToState> CreateFlushToState(uint64_t start, LogMask log_mask)
             REQUIRES(logd_lock) override;
     bool FlushTo(LogWriter* writer, FlushToState& state,
@@ -57,24 +71,57 @@ class SerializedLogBuffer final : public LogBuffer {
 
     uint64_t sequence() const override { return sequence_.load(std::memory_order_relaxed); }
 
+    // Keeps each log's chunks in a PersistentLogRing in dir, first restoring the logs left in them
+    // by a previous logd.  Must be called before anything is logged.  Logs whose ring can't be
+    // created keep their chunks on the heap.
+    void EnablePersistence(const std::string& dir);
+
   private:
     bool ShouldLog(log_id_t log_id, const char* msg, uint16_t len);
+    // Appends a log with log_locks_[log_id] held, returning true if the log is now over its size
+    // limit and must be pruned.
+    bool LogLocked(log_id_t log_id, uint64_t sequence, log_time realtime, uid_t uid, pid_t pid,
+                   pid_t tid, const char* msg, uint16_t len);
+    // The functions below that prune or clear log_id also require log_locks_[log_id].
     void MaybePrune(log_id_t log_id) REQUIRES(logd_lock);
     void Prune(log_id_t log_id, size_t bytes_to_free) REQUIRES(logd_lock);
     void UidClear(log_id_t log_id, uid_t uid) REQUIRES(logd_lock);
     void RemoveChunkFromStats(log_id_t log_id, SerializedLogChunk& chunk);
-    size_t GetSizeUsed(log_id_t id) REQUIRES(logd_lock);
+    size_t GetSizeUsed(log_id_t id);
+    // Creates a new ring for log_id if its chunk size no longer matches its ring's slot size.
+    void UpdatePersistentRing(log_id_t log_id);
+    std::string PersistentRingPath(log_id_t log_id) const;
+
+    // Chunks are compressed by compression_thread_ once they're full, so that the message that
+    // fills one doesn't wait for it.  Until then they're accounted for by their uncompressed size.
+    void QueueCompression(log_id_t log_id, SerializedLogChunk* chunk);
+    void CompressionThread();
 
     LogReaderList* reader_list_;
     LogTags* tags_;
     LogStatistics* stats_;
 
-    size_t max_size_[LOG_ID_MAX] GUARDED_BY(logd_lock) = {};
-    std::list<SerializedLogChunk> logs_[LOG_ID_MAX] GUARDED_BY(logd_lock);
+    // log_locks_[i] guards max_size_[i], logs_[i] and the position of every reader within logs_[i].
+    std::mutex log_locks_[LOG_ID_MAX];
+    size_t max_size_[LOG_ID_MAX] = {};
+    std::list<SerializedLogChunk> logs_[LOG_ID_MAX];
+    // Empty unless EnablePersistence() was called, and persistent_rings_[i] is guarded by
+    // log_locks_[i].
+    std::string persistent_dir_;
+    std::shared_ptr<PersistentLogRing> persistent_rings_[LOG_ID_MAX];
 
     std::atomic<uint64_t> sequence_ = 1;
+
+    // Taken after log_locks_, if both are needed.  Queued chunks may be pruned before they're
+    // compressed, so they're only dereferenced once found in logs_ again.
+    std::mutex compression_lock_;
+    std::condition_variable compression_condition_;
+    std::deque<std::pair<log_id_t, SerializedLogChunk*>> compression_queue_
+            GUARDED_BY(compression_lock_);
+    bool compression_stop_ GUARDED_BY(compression_lock_) = false;
+    std::thread compression_thread_ GUARDED_BY(compression_lock_);
 };
 
 // Exposed for testing.
 void ClearLogsByUid(std::list<SerializedLogChunk>& log_buffer, uid_t uid, size_t max_size,
-                    log_id_t log_id, LogStatistics* stats);
\ No newline at end of file
+                    log_id_t log_id, LogStatistics* stats, PersistentLogRing* ring = nullptr);
\ No newline at end of file
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <log/log.h>
+
+#include "LogReaderList.h"
+#include "LogReaderThread.h"
+#include "LogSize.h"
+#include "LogStatistics.h"
+#include "LogTags.h"
+#include "LogWriter.h"
+#include "SerializedLogBuffer.h"
+
+char* android::uidToName(uid_t) {
+    return nullptr;
+}
+
+namespace {
+
+class NullWriter : public LogWriter {
+  public:
+    NullWriter() : LogWriter(0, true) {}
+
+    bool Write(const logger_entry&, const char*) override { return true; }
+    std::string name() const override { return "benchmark_reader"; }
+};
+
+// Each writer thread logs to its own log, as different processes logging to main, system, radio
+// and crash would.
+constexpr log_id_t kWriterLogIds[] = {LOG_ID_MAIN, LOG_ID_SYSTEM, LOG_ID_RADIO, LOG_ID_CRASH};
+constexpr size_t kMessagesPerWriter = 20000;
+
+void ReleaseAndJoinReaders(LogReaderList& reader_list) {
+    {
+        auto lock = std::lock_guard{logd_lock};
+        for (auto& reader : reader_list.running_reader_threads()) {
+            reader->Release();
+        }
+    }
+    while (true) {
+        {
+            auto lock = std::lock_guard{logd_lock};
+            if (reader_list.running_reader_threads().empty()) {
+                return;
+            }
+        }
+        usleep(1000);
+    }
+}
+
+}  // namespace
+
+// Measures SerializedLogBuffer::Log() throughput with range(0) writer threads logging concurrently,
+// and with range(1) blocking readers that follow every log.  The buffers are kept at their minimum
+// size so that pruning, and the reader notifications that it causes, are part of what's measured.
+static void BM_serialized_log_contended(benchmark::State& state) {
+    const size_t writers = state.range(0);
+    const size_t readers = state.range(1);
+    // Readers falling behind the writers is expected here, so don't log each time it happens.
+    android::base::SetLogger([](android::base::LogId, android::base::LogSeverity, const char*,
+                                const char*, unsigned int, const char*) {});
+
+    LogReaderList reader_list;
+    LogTags tags;
+    LogStatistics stats(false, true);
+    SerializedLogBuffer log_buffer(&reader_list, &tags, &stats);
+    log_id_for_each(i) { log_buffer.SetSize(i, kLogBufferMinSize); }
+
+    for (size_t i = 0; i < readers; ++i) {
+        auto lock = std::lock_guard{logd_lock};
+        reader_list.AddAndRunThread(std::make_unique<LogReaderThread>(
+                &log_buffer, &reader_list, std::make_unique<NullWriter>(), false, 0, kLogMaskAll, 0,
+                log_time{}, 1, std::chrono::steady_clock::time_point{}));
+    }
+
+    // A text log is a priority byte, a NUL terminated tag and a NUL terminated message.
+    std::string msg = "\x04tag";
+    msg += '\0';
+    msg += "contended benchmark message of a fairly typical length";
+    msg += '\0';
+
+    for (auto _ : state) {
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < writers; ++t) {
+            threads.emplace_back([&, t] {
+                log_id_t log_id = kWriterLogIds[t % std::size(kWriterLogIds)];
+                for (size_t i = 0; i < kMessagesPerWriter; ++i) {
+                    log_buffer.Log(log_id, log_time(0, i), 1000, 1, t + 1, msg.data(), msg.size());
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * writers * kMessagesPerWriter);
+
+    ReleaseAndJoinReaders(reader_list);
+}
+BENCHMARK(BM_serialized_log_contended)
+        ->ArgNames({"writers", "readers"})
+        ->ArgsProduct({{1, 2, 4}, {0, 1}})
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+
+// Measures SerializedLogBuffer::Log() throughput from a single writer, with range(0) selecting
+// whether the detailed pid, tid and tag statistics are enabled.  Messages come in bursts of 8 from
+// one of 4 threads of one of 16 processes, each burst with one of 32 tags, so the statistics
+// tables see a realistic mix.
+static void BM_serialized_log_statistics(benchmark::State& state) {
+    constexpr size_t kTags = 32;
+    const bool enable_statistics = state.range(0);
+    android::base::SetLogger([](android::base::LogId, android::base::LogSeverity, const char*,
+                                const char*, unsigned int, const char*) {});
+
+    LogReaderList reader_list;
+    LogTags tags;
+    LogStatistics stats(enable_statistics, true);
+    SerializedLogBuffer log_buffer(&reader_list, &tags, &stats);
+    log_buffer.SetSize(LOG_ID_MAIN, kLogBufferMinSize);
+
+    std::vector<std::string> msgs;
+    for (size_t i = 0; i < kTags; ++i) {
+        std::string msg = "\x04";
+        msg += "BenchmarkTag" + std::to_string(i);
+        msg += '\0';
+        msg += "statistics benchmark message of a fairly typical length";
+        msg += '\0';
+        msgs.emplace_back(std::move(msg));
+    }
+
+    size_t i = 0;
+    for (auto _ : state) {
+        size_t burst = i / 8;
+        pid_t pid = 1000 + burst % 16;
+        pid_t tid = pid + (burst / 16) % 4;
+        const std::string& msg = msgs[(burst * 7) % kTags];
+        log_buffer.Log(LOG_ID_MAIN, log_time(0, i), 10000 + pid % 4, pid, tid, msg.data(),
+                       msg.size());
+        ++i;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_serialized_log_statistics)->ArgName("statistics")->Arg(0)->Arg(1);
+
+// Measures reading a full main log, as `logcat -d --pid` does, where each of 16 processes logs in
+// bursts of a few thousand messages.  range(0) is the pid to read, or 0 to read every log.
+static void BM_serialized_flush_pid(benchmark::State& state) {
+    constexpr pid_t kPids = 16;
+    constexpr size_t kBurst = 2000;
+    const pid_t pid = state.range(0);
+    android::base::SetLogger([](android::base::LogId, android::base::LogSeverity, const char*,
+                                const char*, unsigned int, const char*) {});
+
+    LogReaderList reader_list;
+    LogTags tags;
+    LogStatistics stats(false, true);
+    SerializedLogBuffer log_buffer(&reader_list, &tags, &stats);
+    log_buffer.SetSize(LOG_ID_MAIN, 1024 * 1024);
+
+    std::string msg = "\x04tag";
+    msg += '\0';
+    msg += "flush benchmark message of a fairly typical length";
+    msg += '\0';
+    for (size_t i = 0; i < 100000; ++i) {
+        pid_t log_pid = 1 + (i / kBurst) % kPids;
+        log_buffer.Log(LOG_ID_MAIN, log_time(0, i), 1000, log_pid, log_pid, msg.data(), msg.size());
+    }
+
+    NullWriter writer;
+    for (auto _ : state) {
+        auto lock = std::lock_guard{logd_lock};
+        auto flush_to_state = log_buffer.CreateFlushToState(1, 1 << LOG_ID_MAIN);
+        flush_to_state->set_pid(pid);
+        log_buffer.FlushTo(&writer, *flush_to_state,
+                           [pid](log_id_t, pid_t log_pid, uint64_t, log_time) {
+                               return pid == 0 || log_pid == pid ? FilterResult::kWrite
+                                                                 : FilterResult::kSkip;
+                           });
+    }
+}
+BENCHMARK(BM_serialized_flush_pid)->ArgName("pid")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
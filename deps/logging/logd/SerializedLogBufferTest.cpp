@@ -16,6 +16,12 @@
 
 #include "SerializedLogBuffer.h"
 
+#include <chrono>
+#include <functional>
+#include <future>
+#include <thread>
+
+#include <android-base/file.h>
 #include <gtest/gtest.h>
 #include <log/log.h>
 
@@ -396,3 +402,170 @@ TEST(SerializedLogBuffer, uid_prune_coalesce) {
     ClearLogsByUid(chunks, kClearUid, kMaxSize, LOG_ID_MAIN, nullptr);
     VerifyChunks(expected_chunks, chunks);
 }
+
+class StringWriter : public LogWriter {
+  public:
+    StringWriter(std::vector<std::string>* msgs) : LogWriter(0, true), msgs_(msgs) {}
+
+    bool Write(const logger_entry& entry, const char* msg) override {
+        msgs_->emplace_back(msg, entry.len);
+        return true;
+    }
+    std::string name() const override { return "string_writer"; }
+
+  private:
+    std::vector<std::string>* msgs_;
+};
+
+// Returns every log in log_buffer, and sets *next_sequence to the sequence number after the last.
+static std::vector<std::string> ReadAllLogs(SerializedLogBuffer& log_buffer,
+                                            uint64_t* next_sequence = nullptr) {
+    std::vector<std::string> msgs;
+    StringWriter writer(&msgs);
+    auto lock = std::lock_guard{logd_lock};
+    auto flush_to_state = log_buffer.CreateFlushToState(1, kLogMaskAll);
+    EXPECT_TRUE(log_buffer.FlushTo(&writer, *flush_to_state, nullptr));
+    if (next_sequence != nullptr) {
+        *next_sequence = flush_to_state->start();
+    }
+    return msgs;
+}
+
+// Logs enough to fill and prune several chunks, then checks that a new buffer on the same
+// directory restores the logs that were left, and numbers new logs after them.
+TEST(SerializedLogBuffer, persistent_logs_survive_restart) {
+    TemporaryDir dir;
+    std::vector<std::string> expected;
+    uint64_t next_sequence;
+    {
+        LogReaderList reader_list;
+        LogTags tags;
+        LogStatistics stats(false, true);
+        SerializedLogBuffer log_buffer(&reader_list, &tags, &stats);
+        log_buffer.SetSize(LOG_ID_MAIN, kLogBufferMinSize);
+        log_buffer.EnablePersistence(dir.path);
+
+        for (size_t i = 0; i < 4 * kLogBufferMinSize / 100; ++i) {
+            std::string msg = "message " + std::to_string(i) + std::string(80, 'x');
+            ASSERT_GT(log_buffer.Log(LOG_ID_MAIN, log_time(1, i), 1000, 1, 1, msg.data(),
+                                     msg.size()),
+                      0);
+        }
+        expected = ReadAllLogs(log_buffer, &next_sequence);
+        ASSERT_FALSE(expected.empty());
+        // Some logs must have been pruned for this to test that pruned logs stay pruned.
+        ASSERT_NE(expected.front().substr(0, 10), "message 0x");
+    }
+
+    LogReaderList reader_list;
+    LogTags tags;
+    LogStatistics stats(false, true);
+    SerializedLogBuffer log_buffer(&reader_list, &tags, &stats);
+    log_buffer.SetSize(LOG_ID_MAIN, kLogBufferMinSize);
+    log_buffer.EnablePersistence(dir.path);
+
+    uint64_t restored_next_sequence;
+    EXPECT_EQ(expected, ReadAllLogs(log_buffer, &restored_next_sequence));
+    EXPECT_EQ(next_sequence, restored_next_sequence);
+    // The restored logs are accounted for in the statistics like any others.
+    EXPECT_GT(stats.Sizes(LOG_ID_MAIN), 0U);
+
+    std::string msg = "after restart";
+    ASSERT_GT(log_buffer.Log(LOG_ID_MAIN, log_time(2, 0), 1000, 1, 1, msg.data(), msg.size()), 0);
+    expected.emplace_back(msg);
+    EXPECT_EQ(expected, ReadAllLogs(log_buffer));
+    EXPECT_EQ(restored_next_sequence + 1, log_buffer.sequence());
+}
+
+// Logs that were cleared, and logs of a log whose size changed, are not restored.
+TEST(SerializedLogBuffer, persistent_logs_cleared_or_resized) {
+    TemporaryDir dir;
+    {
+        LogReaderList reader_list;
+        LogTags tags;
+        LogStatistics stats(false, true);
+        SerializedLogBuffer log_buffer(&reader_list, &tags, &stats);
+        log_buffer.SetSize(LOG_ID_MAIN, kLogBufferMinSize);
+        log_buffer.SetSize(LOG_ID_SYSTEM, kLogBufferMinSize);
+        log_buffer.EnablePersistence(dir.path);
+
+        std::string msg = "persistent message";
+        for (log_id_t log_id : {LOG_ID_MAIN, LOG_ID_SYSTEM}) {
+            ASSERT_GT(log_buffer.Log(log_id, log_time(1, 0), 1000, 1, 1, msg.data(), msg.size()),
+                      0);
+        }
+        log_buffer.Clear(LOG_ID_MAIN, 0);
+    }
+
+    LogReaderList reader_list;
+    LogTags tags;
+    LogStatistics stats(false, true);
+    SerializedLogBuffer log_buffer(&reader_list, &tags, &stats);
+    log_buffer.SetSize(LOG_ID_MAIN, kLogBufferMinSize);
+    log_buffer.SetSize(LOG_ID_SYSTEM, 2 * kLogBufferMinSize);
+    log_buffer.EnablePersistence(dir.path);
+
+    EXPECT_EQ(std::vector<std::string>{}, ReadAllLogs(log_buffer));
+}
+
+// A StringWriter that calls on_write before writing each log.
+class HookedStringWriter : public StringWriter {
+  public:
+    HookedStringWriter(std::vector<std::string>* msgs, std::function<void()> on_write)
+        : StringWriter(msgs), on_write_(std::move(on_write)) {}
+
+    bool Write(const logger_entry& entry, const char* msg) override {
+        on_write_();
+        return StringWriter::Write(entry, msg);
+    }
+
+  private:
+    std::function<void()> on_write_;
+};
+
+// FlushTo() walks the logs without logd_lock, so a log added after it finds no more, but before
+// it takes logd_lock again to return, must still be flushed: its writer notified the readers under
+// logd_lock before this reader could wait for that notification.
+TEST(SerializedLogBuffer, flush_to_sees_logs_added_before_it_returns) {
+    LogReaderList reader_list;
+    LogTags tags;
+    LogStatistics stats(false, true);
+    SerializedLogBuffer log_buffer(&reader_list, &tags, &stats);
+
+    std::string msg1 = "message 1";
+    std::string msg2 = "message 2";
+    ASSERT_GT(log_buffer.Log(LOG_ID_MAIN, log_time(1, 0), 1000, 1, 1, msg1.data(), msg1.size()),
+              0);
+
+    // The reader is held in its first write until logd_lock is taken here, so once it has written
+    // message 1 and found no more logs, it waits for logd_lock while message 2 is added.
+    std::promise<void> writing;
+    std::promise<void> locked;
+    std::vector<std::string> msgs;
+    HookedStringWriter writer(&msgs, [&, first = true]() mutable {
+        if (first) {
+            first = false;
+            writing.set_value();
+            locked.get_future().wait();
+        }
+    });
+    std::thread reader([&]() {
+        auto lock = std::lock_guard{logd_lock};
+        auto flush_to_state = log_buffer.CreateFlushToState(1, kLogMaskAll);
+        EXPECT_TRUE(log_buffer.FlushTo(&writer, *flush_to_state, nullptr));
+    });
+
+    writing.get_future().wait();
+    {
+        auto lock = std::lock_guard{logd_lock};
+        locked.set_value();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        // Without any running readers to notify, Log() doesn't need logd_lock.
+        ASSERT_GT(log_buffer.Log(LOG_ID_MAIN, log_time(1, 1), 1000, 1, 1, msg2.data(),
+                                 msg2.size()),
+                  0);
+    }
+    reader.join();
+
+    EXPECT_EQ((std::vector<std::string>{msg1, msg2}), msgs);
+}
@@ -16,6 +16,8 @@
 
 #include "SerializedLogChunk.h"
 
+#include <algorithm>
+
 #include <android-base/logging.h>
 
 #include "CompressionEngine.h"
@@ -25,10 +27,27 @@ SerializedLogChunk::~SerializedLogChunk() {
     CHECK_EQ(reader_ref_count_, 0U);
 }
 
-void SerializedLogChunk::FinishWriting() {
+void SerializedLogChunk::FinishWriting(bool compress) {
     writer_active_ = false;
     CHECK_EQ(compressed_log_.size(), 0U);
-    CompressionEngine::GetInstance().Compress(contents_, write_offset_, compressed_log_);
+    // Persistent chunks keep their contents in their slot, where they're already accounted for by
+    // the page cache rather than logd's heap.
+    if (persistent()) {
+        return;
+    }
+    compression_pending_ = true;
+    if (!compress) {
+        return;
+    }
+    SerializedData compressed_log;
+    CompressionEngine::GetInstance().Compress(contents_, write_offset_, compressed_log);
+    SetCompressedLog(std::move(compressed_log));
+}
+
+void SerializedLogChunk::SetCompressedLog(SerializedData&& compressed_log) {
+    CHECK(compression_pending_);
+    compression_pending_ = false;
+    compressed_log_ = std::move(compressed_log);
     LOG(VERBOSE) << "Compressed Log, buffer max size: " << contents_.size()
                  << " size used: " << write_offset_
                  << " compressed size: " << compressed_log_.size();
@@ -40,7 +59,7 @@ void SerializedLogChunk::FinishWriting() {
 // TODO: Develop a better reference counting strategy to guard against the case where the writer is
 // much faster than the reader, and we needlessly compess / decompress the logs.
 void SerializedLogChunk::IncReaderRefCount() {
-    if (++reader_ref_count_ != 1 || writer_active_) {
+    if (++reader_ref_count_ != 1 || writer_active_ || compression_pending_ || persistent()) {
         return;
     }
     contents_.Resize(write_offset_);
@@ -52,7 +71,7 @@ void SerializedLogChunk::DecReaderRefCount() {
     if (--reader_ref_count_ != 0) {
         return;
     }
-    if (!writer_active_) {
+    if (!writer_active_ && !compression_pending_ && !persistent()) {
         contents_.Resize(0);
     }
 }
@@ -88,5 +107,61 @@ SerializedLogEntry* SerializedLogChunk::Log(uint64_t sequence, log_time realtime
     memcpy(entry->msg(), msg, len);
     write_offset_ += entry->total_len();
     highest_sequence_number_ = sequence;
+    if (committed_offset_ != nullptr) {
+        __atomic_store_n(committed_offset_, write_offset_, __ATOMIC_RELEASE);
+    }
+    AddToSummary(uid, pid, realtime);
     return entry;
 }
+
+void SerializedLogChunk::RestoreLogs(int write_offset) {
+    CHECK(persistent());
+    CHECK(writer_active_);
+    CHECK_LE(static_cast<size_t>(write_offset), contents_.size());
+    while (write_offset_ < write_offset) {
+        auto* entry = log_entry(write_offset_);
+        write_offset_ += entry->total_len();
+        highest_sequence_number_ = entry->sequence();
+        AddToSummary(entry->uid(), entry->pid(), entry->realtime());
+    }
+    CHECK_EQ(write_offset_, write_offset);
+}
+
+void SerializedLogChunk::AddToSummary(uid_t uid, pid_t pid, log_time realtime) {
+    max_realtime_ = std::max(max_realtime_, realtime);
+    pid_bloom_.set(PidBloomBit(pid, 0));
+    pid_bloom_.set(PidBloomBit(pid, 1));
+    if (!too_many_uids_) {
+        auto uids_end = uids_.begin() + uid_count_;
+        if (std::find(uids_.begin(), uids_end, uid) == uids_end) {
+            if (uid_count_ == kMaxSummaryUids) {
+                too_many_uids_ = true;
+            } else {
+                uids_[uid_count_++] = uid;
+            }
+        }
+    }
+}
+
+// Each pid sets two bits, picked by the top bits of two multiplicative hashes of it.
+size_t SerializedLogChunk::PidBloomBit(pid_t pid, int hash) {
+    static constexpr uint32_t kMultipliers[] = {0x9e3779b1, 0x85ebca6b};
+    static_assert(kPidBloomBits == 1 << 8);
+    return (static_cast<uint32_t>(pid) * kMultipliers[hash]) >> 24;
+}
+
+bool SerializedLogChunk::MayContainLogsFor(pid_t pid, std::optional<uid_t> uid,
+                                           log_time min_realtime) const {
+    if (write_offset_ == 0 || max_realtime_ < min_realtime) {
+        return false;
+    }
+    if (pid != 0 &&
+        (!pid_bloom_.test(PidBloomBit(pid, 0)) || !pid_bloom_.test(PidBloomBit(pid, 1)))) {
+        return false;
+    }
+    if (uid && !too_many_uids_) {
+        auto uids_end = uids_.begin() + uid_count_;
+        return std::find(uids_.begin(), uids_end, *uid) != uids_end;
+    }
+    return true;
+}
@@ -18,7 +18,10 @@
 
 #include <sys/types.h>
 
+#include <array>
+#include <bitset>
 #include <list>
+#include <optional>
 #include <vector>
 
 #include <android-base/logging.h>
@@ -56,10 +59,23 @@ class SerializedLogChunk {
     };
 
     explicit SerializedLogChunk(size_t size) : contents_(size) {}
+    // Creates a chunk in a slot of a PersistentLogRing.  Such chunks are never compressed, and
+    // Log() publishes their write offset to committed_offset, in the slot's header.
+    SerializedLogChunk(SerializedData&& contents, uint32_t* committed_offset)
+        : contents_(std::move(contents)), committed_offset_(committed_offset) {}
     SerializedLogChunk(SerializedLogChunk&& other) noexcept = default;
     ~SerializedLogChunk();
 
-    void FinishWriting();
+    // Closes this chunk for writing and, unless compress is false, compresses it.  Otherwise it keeps
+    // its uncompressed contents, and is accounted for by them, until SetCompressedLog() is called.
+    void FinishWriting(bool compress = true);
+    // Installs the compressed contents of a chunk that was finished without being compressed.
+    void SetCompressedLog(SerializedData&& compressed_log);
+    bool compression_pending() const { return compression_pending_; }
+    // The uncompressed contents of a chunk pending compression, which may be read without holding
+    // the log's lock since they are not written or freed until SetCompressedLog() is called.
+    SerializedData ShareContents() const { return contents_.Share(); }
+
     void IncReaderRefCount();
     void DecReaderRefCount();
     void AttachReader(SerializedFlushToState* reader);
@@ -70,6 +86,15 @@ class SerializedLogChunk {
     bool CanLog(size_t len);
     SerializedLogEntry* Log(uint64_t sequence, log_time realtime, uid_t uid, pid_t pid, pid_t tid,
                             const char* msg, uint16_t len);
+    // Takes in the logs already in the contents of a persistent chunk up to write_offset, as left
+    // there by a previous logd, as if they had been logged to it.
+    void RestoreLogs(int write_offset);
+    bool persistent() const { return committed_offset_ != nullptr; }
+
+    // Whether this chunk may hold logs from pid, unless it is 0, from uid, if set, and with a
+    // realtime of at least min_realtime.  This answers from a summary of the logs, without reading
+    // them, so it may return true for a chunk with no such logs but never false for one with some.
+    bool MayContainLogsFor(pid_t pid, std::optional<uid_t> uid, log_time min_realtime) const;
 
     // If this buffer has been compressed, we only consider its compressed size when accounting for
     // memory consumption for pruning.  This is since the uncompressed log is only by used by
@@ -100,7 +125,23 @@ class SerializedLogChunk {
     int write_offset_ = 0;
     uint32_t reader_ref_count_ = 0;
     bool writer_active_ = true;
+    bool compression_pending_ = false;
     uint64_t highest_sequence_number_ = 1;
     SerializedData compressed_log_;
     std::vector<SerializedFlushToState*> readers_;
+    uint32_t* committed_offset_ = nullptr;
+
+    // The summary used by MayContainLogsFor(), kept up to date by Log().  Pids are recorded in a
+    // small bloom filter and uids in a short list, which gives up once a chunk has logs from more
+    // than kMaxSummaryUids of them.
+    static constexpr size_t kPidBloomBits = 256;
+    static constexpr size_t kMaxSummaryUids = 8;
+    log_time max_realtime_;
+    std::bitset<kPidBloomBits> pid_bloom_;
+    std::array<uid_t, kMaxSummaryUids> uids_;
+    uint8_t uid_count_ = 0;
+    bool too_many_uids_ = false;
+
+    void AddToSummary(uid_t uid, pid_t pid, log_time realtime);
+    static size_t PidBloomBit(pid_t pid, int hash);
 };
@@ -18,11 +18,14 @@
 
 #include <limits>
 
+#include <android-base/file.h>
 #include <android-base/silent_death_test.h>
 #include <android-base/stringprintf.h>
 #include <android/log.h>
 #include <gtest/gtest.h>
 
+#include "CompressionEngine.h"
+
 using SerializedLogChunk_DeathTest = SilentDeathTest;
 
 using android::base::StringPrintf;
@@ -108,6 +111,42 @@ TEST(SerializedLogChunk, three_logs) {
     }
 }
 
+// A chunk finished without compression keeps its contents readable and is accounted for by its
+// uncompressed size until the compressed contents are installed, as SerializedLogBuffer does from
+// its compression thread.
+TEST(SerializedLogChunk, deferred_compression) {
+    size_t chunk_size = 10 * 4096;
+    auto chunk = SerializedLogChunk{chunk_size};
+    static const char log_message[] = "deferred compression message";
+    chunk.Log(1, log_time(), 1000, 1, 1, log_message, sizeof(log_message));
+
+    chunk.FinishWriting(false);
+    EXPECT_TRUE(chunk.compression_pending());
+    EXPECT_EQ(chunk_size + sizeof(SerializedLogChunk), chunk.PruneSize());
+
+    // Readers coming and going must neither free nor overwrite the uncompressed contents.
+    chunk.IncReaderRefCount();
+    EXPECT_STREQ(log_message, chunk.log_entry(0)->msg());
+    chunk.DecReaderRefCount();
+
+    SerializedData contents = chunk.ShareContents();
+    SerializedData compressed_log;
+    CompressionEngine::GetInstance().Compress(contents, chunk.write_offset(), compressed_log);
+    size_t compressed_size = compressed_log.size();
+
+    chunk.IncReaderRefCount();
+    chunk.SetCompressedLog(std::move(compressed_log));
+    EXPECT_FALSE(chunk.compression_pending());
+    EXPECT_EQ(compressed_size + sizeof(SerializedLogChunk), chunk.PruneSize());
+    // A reader that was attached when compression landed keeps the uncompressed contents.
+    EXPECT_STREQ(log_message, chunk.log_entry(0)->msg());
+    chunk.DecReaderRefCount();
+
+    chunk.IncReaderRefCount();
+    EXPECT_STREQ(log_message, chunk.log_entry(0)->msg());
+    chunk.DecReaderRefCount();
+}
+
 // Check that the CHECK() in DecReaderRefCount() if the ref count goes bad is caught.
 TEST_F(SerializedLogChunk_DeathTest, catch_DecCompressedRef_CHECK) {
     size_t chunk_size = 10 * 4096;
@@ -115,3 +154,37 @@ TEST_F(SerializedLogChunk_DeathTest, catch_DecCompressedRef_CHECK) {
     EXPECT_DEATH({ chunk.DecReaderRefCount(); }, "");
 }
 
+TEST(SerializedLogChunk, zstd_dictionary) {
+    static const char log_message[] = "ActivityManager: Start proc for service com.example.app";
+    std::string dictionary;
+    for (int i = 0; i < 64; ++i) {
+        dictionary += log_message;
+    }
+    TemporaryFile dictionary_file;
+    ASSERT_TRUE(android::base::WriteStringToFile(dictionary, dictionary_file.path));
+
+    ZstdCompressionEngine engine;
+    ASSERT_TRUE(engine.LoadDictionary(dictionary_file.path));
+    EXPECT_FALSE(engine.LoadDictionary(dictionary_file.path));
+
+    SerializedData contents(sizeof(log_message));
+    memcpy(contents.data(), log_message, sizeof(log_message));
+    SerializedData compressed;
+    ASSERT_TRUE(engine.Compress(contents, contents.size(), compressed));
+    // The whole message is in the dictionary, so it compresses to little more than a reference.
+    EXPECT_LT(compressed.size(), sizeof(log_message) / 2);
+
+    SerializedData decompressed(sizeof(log_message));
+    ASSERT_TRUE(engine.Decompress(compressed, decompressed));
+    EXPECT_EQ(0, memcmp(log_message, decompressed.data(), sizeof(log_message)));
+
+    CompressionStats stats = engine.stats();
+    EXPECT_EQ(sizeof(log_message), stats.uncompressed_bytes);
+    EXPECT_EQ(compressed.size(), stats.compressed_bytes);
+    EXPECT_EQ(sizeof(log_message), stats.decompressed_bytes);
+
+    // A dictionary can't be swapped in once chunks have been compressed without it.
+    ZstdCompressionEngine used_engine;
+    ASSERT_TRUE(used_engine.Compress(contents, contents.size(), compressed));
+    EXPECT_FALSE(used_engine.LoadDictionary(dictionary_file.path));
+}
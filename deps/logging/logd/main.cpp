@@ -49,6 +49,7 @@
 #include <utils/threads.h>
 
 #include "CommandListener.h"
+#include "CompressionEngine.h"
 #include "LogAudit.h"
 #include "LogBuffer.h"
 #include "LogKlog.h"
@@ -245,7 +246,18 @@ int main(int argc, char* argv[]) {
     // LogBuffer is the object which is responsible for holding all log entries.
     LogBuffer* log_buffer = nullptr;
     if (buffer_type == "serialized") {
-        log_buffer = new SerializedLogBuffer(&reader_list, &log_tags, &log_statistics);
+        // A dictionary must be loaded before anything is compressed with it, so before any logs
+        // can arrive.  Without one, chunks are compressed on their own as before.
+        std::string dictionary = GetProperty("ro.logd.compression.dictionary", "");
+        if (!dictionary.empty() && !CompressionEngine::GetInstance().LoadDictionary(dictionary)) {
+            LOG(ERROR) << "Could not load compression dictionary '" << dictionary << "'";
+        }
+        auto* serialized_log_buffer =
+                new SerializedLogBuffer(&reader_list, &log_tags, &log_statistics);
+        if (GetBoolProperty("ro.logd.buffer.persistent", false)) {
+            serialized_log_buffer->EnablePersistence("/data/misc/logd");
+        }
+        log_buffer = serialized_log_buffer;
     } else if (buffer_type == "simple") {
         log_buffer = new SimpleLogBuffer(&reader_list, &log_tags, &log_statistics);
     } else {